@@ -0,0 +1,155 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <time.h>
+
+/**
+ * @brief 基准测试状态
+ *
+ * 每个基准函数接收一个bench_state，在内部循环iterations次；
+ * 需要排除在计时之外的准备工作可以用pause()/resume()包起来
+ */
+class bench_state {
+public:
+    bench_state(long long iters, long long a) : iterations(iters), arg(a), items(0), bytes(0),
+    m_elapsed_ns(0), m_cpu_ns(0), m_running(false), m_skipped(false) {}
+
+    /**
+     * @brief 暂停计时
+     */
+    void pause();
+
+    /**
+     * @brief 恢复计时
+     */
+    void resume();
+
+    /**
+     * @brief 标记本次基准被跳过（例如缺少数据库）
+     * @param reason 跳过原因
+     */
+    void skip(const char *reason) { m_skipped = true; m_skip_reason = reason; }
+
+    /**
+     * @brief 附加一个自定义计数器，随JSON一起输出
+     * @param name 计数器名
+     * @param value 计数器值
+     */
+    void counter(const char *name, double value) { m_counters.push_back(std::make_pair(std::string(name), value)); }
+
+    long long iterations;   // 需要执行的迭代次数
+    long long arg;          // 基准参数（规模、线程数等）
+    long long items;        // 已处理的条目数，用于计算items_per_second
+    long long bytes;        // 已处理的字节数，用于计算bytes_per_second
+
+private:
+    friend class bench_runner;
+
+    long long m_elapsed_ns;  // 累计的墙钟时间
+    long long m_cpu_ns;      // 累计的进程CPU时间
+    struct timespec m_wall_start;
+    struct timespec m_cpu_start;
+    bool m_running;
+    bool m_skipped;
+    std::string m_skip_reason;
+    std::vector<std::pair<std::string, double> > m_counters;
+};
+
+typedef void (*bench_func)(bench_state &);
+
+/**
+ * @brief 基准测试执行器
+ *
+ * 负责注册、过滤、自动标定迭代次数，并以Google Benchmark兼容的JSON格式输出结果，
+ * 方便用compare.py之类的工具跨版本对比
+ */
+class bench_runner {
+public:
+    /**
+     * @brief 获取执行器单例
+     * @return 执行器指针
+     */
+    static bench_runner *get_instance() {
+        static bench_runner instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 注册一个基准
+     * @param name 基准名称
+     * @param func 基准函数
+     * @param args 参数列表，每个参数生成一个"name/arg"基准；为空时不带参数
+     * @param fixed_iters 固定迭代次数，0表示自动标定
+     */
+    void add(const char *name, bench_func func, const std::vector<long long> &args, long long fixed_iters = 0);
+
+    /**
+     * @brief 执行所有匹配过滤器的基准
+     * @param filter 名称子串过滤器，为空时执行全部
+     * @param out JSON输出文件
+     * @param min_time_ms 自动标定时每个基准的最短运行时间
+     * @return 执行的基准数量
+     */
+    int run(const char *filter, FILE *out, int min_time_ms);
+
+private:
+    struct entry {
+        std::string name;
+        bench_func func;
+        long long arg;
+        bool has_arg;
+        long long fixed_iters;
+    };
+    std::vector<entry> m_entries;
+};
+
+/**
+ * @brief 静态注册辅助类，配合BENCHMARK宏在main之前完成注册
+ */
+struct bench_registrar {
+    bench_registrar(const char *name, bench_func func, const std::vector<long long> &args, long long fixed_iters = 0) {
+        bench_runner::get_instance()->add(name, func, args, fixed_iters);
+    }
+};
+
+#define BENCH_CONCAT2(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT2(a, b)
+
+// 注册基准：BENCHMARK(函数, {参数...})，参数列表为空时不带参数
+#define BENCHMARK(func, ...) \
+    static bench_registrar BENCH_CONCAT(bench_reg_, __LINE__)(#func, func, std::vector<long long> __VA_ARGS__)
+
+// 注册固定迭代次数的基准，适用于规模本身就是参数的场景
+#define BENCHMARK_ITERS(func, iters, ...) \
+    static bench_registrar BENCH_CONCAT(bench_reg_, __LINE__)(#func, func, std::vector<long long> __VA_ARGS__, iters)
+
+/**
+ * @brief 阻止编译器把基准结果优化掉
+ */
+template <typename T>
+inline void do_not_optimize(T const &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/**
+ * @brief 进程启动以来调用malloc的次数
+ *
+ * bench_main中替换了malloc，统计所有来源（包括operator new）的分配
+ */
+long long bench_malloc_count();
+
+/**
+ * @brief 进程启动以来调用epoll_ctl/epoll_wait的次数，同样由bench_main替换后计数
+ */
+long long bench_epoll_ctl_count();
+long long bench_epoll_wait_count();
+
+// 基准程序的全局选项，由bench_main解析
+extern const char *g_bench_root;     // 网站根目录
+extern const char *g_bench_tmpdir;   // 临时文件目录（日志等）
+extern const char *g_bench_db;       // 数据库连接串 user:passwd:dbname[@host[:port]]
+
+#endif
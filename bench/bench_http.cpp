@@ -0,0 +1,408 @@
+#include "bench.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <ctype.h>
+#include <string>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "../http/http_conn.h"
+#include "../http/http_scan.h"
+#include "../http/http_router.h"
+
+// 典型浏览器请求会携带的请求头，按出现频率排序，基准按参数取前N个
+static const char *bench_headers[] = {
+    "Host: localhost:9006",
+    "Connection: keep-alive",
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36",
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8",
+    "Accept-Encoding: gzip, deflate, br, zstd",
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8",
+    "Cache-Control: max-age=0",
+    "Upgrade-Insecure-Requests: 1",
+    "Sec-Fetch-Site: same-origin",
+    "Sec-Fetch-Mode: navigate",
+    "Sec-Fetch-User: ?1",
+    "Sec-Fetch-Dest: document",
+    "Sec-Ch-Ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"",
+    "Sec-Ch-Ua-Mobile: ?0",
+    "Sec-Ch-Ua-Platform: \"Linux\"",
+    "Referer: http://localhost:9006/judge.html",
+    "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; lang=zh-CN",
+    "If-None-Match: \"2a0b3-5f2-64a1c2d3\"",
+    "If-Modified-Since: Wed, 08 May 2025 10:00:00 GMT",
+    "DNT: 1",
+    "Pragma: no-cache",
+    "Priority: u=0, i",
+    "Origin: http://localhost:9006",
+    "X-Requested-With: XMLHttpRequest",
+};
+static const int bench_header_total = sizeof(bench_headers) / sizeof(bench_headers[0]);
+
+/**
+ * @brief 构造带N个请求头的GET请求
+ * @param nheaders 请求头数量
+ * @return 完整的请求报文
+ */
+static std::string build_request(int nheaders) {
+    std::string req = "GET /judge.html HTTP/1.1\r\n";
+    for (int i = 0; i < nheaders && i < bench_header_total; ++i) {
+        req += bench_headers[i];
+        req += "\r\n";
+    }
+    req += "\r\n";
+    return req;
+}
+
+/**
+ * @brief 访问http_conn私有解析接口的基准辅助类
+ */
+class http_conn_bench {
+public:
+    static void setup(http_conn &conn) {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        http_router::get_instance()->init(root());
+        conn.init(-1, addr, (char *)root(), 0, 1, "root", "", "");
+    }
+
+    // 只重置行解析所需的下标，不走init()，用于单独测量行切分
+    static void load_raw(http_conn &conn, const std::string &req) {
+        memcpy(conn.m_read_buf, req.data(), req.size());
+        conn.m_read_idx = req.size();
+        conn.m_checked_idx = 0;
+        conn.m_start_line = 0;
+    }
+
+    // 按真实请求的生命周期走一遍：请求间复位 + 数据到达
+    static void load_request(http_conn &conn, const std::string &req) {
+        conn.init();
+        memcpy(conn.m_read_buf, req.data(), req.size());
+        conn.m_read_idx = req.size();
+    }
+
+    // 模拟长连接上一个请求刚处理完：读缓冲区中已消费used字节
+    static void finish_request(http_conn &conn, int used) {
+        conn.m_read_idx = used;
+        conn.m_checked_idx = used;
+        conn.m_request_end = used;
+    }
+
+    static void reset_request(http_conn &conn) {
+        conn.reset_request();
+    }
+
+    static int split_lines(http_conn &conn) {
+        int n = 0;
+        while (conn.parse_line() == http_conn::LINE_OK) {
+            conn.m_start_line = conn.m_checked_idx;
+            ++n;
+        }
+        return n;
+    }
+
+    // 请求行之后逐个解析请求头，直到空行
+    static int parse_headers(http_conn &conn) {
+        conn.m_header_count = 0;
+        memset(conn.m_header_index, -1, sizeof(conn.m_header_index));
+        int n = 0;
+        while (conn.parse_line() == http_conn::LINE_OK) {
+            char *text = conn.get_line();
+            conn.m_start_line = conn.m_checked_idx;
+            if (n++ == 0)
+                continue;
+            if (conn.parse_headers(text) != http_conn::NO_REQUEST)
+                break;
+        }
+        return conn.m_header_count;
+    }
+
+    // 一个请求的完整处理：解析、定位资源、生成响应头
+    static int serve(http_conn &conn) {
+        http_conn::HTTP_CODE ret = conn.process_read();
+        conn.process_write(ret);
+        conn.unmap();
+        return ret;
+    }
+
+    static long long response_bytes(http_conn &conn) {
+        return conn.bytes_to_send;
+    }
+
+    static int process_read(http_conn &conn) {
+        int ret = conn.process_read();
+        conn.unmap();
+        return ret;
+    }
+
+    static const char *root() {
+        static char path[PATH_MAX];
+        if (!path[0] && !realpath(g_bench_root, path))
+            strncpy(path, g_bench_root, sizeof(path) - 1);
+        return path;
+    }
+};
+
+// 请求行+请求头的逐行切分（parse_line）
+static void http_parse_line(bench_state &st) {
+    static http_conn conn;
+    http_conn_bench::setup(conn);
+    std::string req = build_request(st.arg);
+    for (long long i = 0; i < st.iterations; ++i) {
+        http_conn_bench::load_raw(conn, req);
+        int n = http_conn_bench::split_lines(conn);
+        do_not_optimize(n);
+    }
+    st.items = st.iterations;
+    st.bytes = st.iterations * (long long)req.size();
+}
+BENCHMARK(http_parse_line, {3, 12, 24});
+
+// 逐行切分并建立请求头表（名称哈希查找 + 值区间记录）
+static void http_parse_headers(bench_state &st) {
+    static http_conn conn;
+    http_conn_bench::setup(conn);
+    std::string req = build_request(st.arg);
+    for (long long i = 0; i < st.iterations; ++i) {
+        http_conn_bench::load_raw(conn, req);
+        int n = http_conn_bench::parse_headers(conn);
+        do_not_optimize(n);
+    }
+    st.items = st.iterations * st.arg;
+    st.bytes = st.iterations * (long long)req.size();
+}
+BENCHMARK(http_parse_headers, {3, 12, 24});
+
+// 完整的process_read：请求间复位、主从状态机解析、do_request定位并映射文件
+static void http_process_read(bench_state &st) {
+    static http_conn conn;
+    http_conn_bench::setup(conn);
+    std::string req = build_request(st.arg);
+    for (long long i = 0; i < st.iterations; ++i) {
+        http_conn_bench::load_request(conn, req);
+        int ret = http_conn_bench::process_read(conn);
+        if (ret != http_conn::FILE_REQUEST) {
+            st.skip("process_read did not resolve judge.html, check --root");
+            return;
+        }
+    }
+    st.items = st.iterations;
+    st.bytes = st.iterations * (long long)req.size();
+}
+BENCHMARK(http_process_read, {3, 12, 24});
+
+// 三种分隔符扫描实现的横向对比：在24个请求头的报文中逐个定位行尾，参数为HTTP_SCAN_IMPL
+static void http_scan(bench_state &st) {
+    http_scan_func scan = http_scan_get((HTTP_SCAN_IMPL)st.arg);
+    if (!scan) {
+        st.skip("scan implementation not supported by this CPU");
+        return;
+    }
+    std::string req = build_request(24);
+    const char *buf = req.data();
+    size_t len = req.size();
+    for (long long i = 0; i < st.iterations; ++i) {
+        size_t pos = 0;
+        int lines = 0;
+        while (pos < len) {
+            pos += scan(buf + pos, len - pos);
+            pos += 2;
+            ++lines;
+        }
+        do_not_optimize(lines);
+    }
+    st.bytes = st.iterations * (long long)len;
+}
+BENCHMARK(http_scan, {HTTP_SCAN_SCALAR, HTTP_SCAN_SSE42, HTTP_SCAN_AVX2});
+
+// 路由表查找：别名页面、表单、静态文件与兜底路由混合
+static void http_route_match(bench_state &st) {
+    http_router::get_instance()->init(http_conn_bench::root());
+    static const char *urls[] = {"/", "/0", "/2CGISQL.cgi", "/5", "/judge.html", "/metrics", "/frame.jpg", "/7"};
+    const int nurls = sizeof(urls) / sizeof(urls[0]);
+    int lens[nurls];
+    for (int i = 0; i < nurls; ++i)
+        lens[i] = strlen(urls[i]);
+    for (long long i = 0; i < st.iterations; ++i) {
+        int k = i % nurls;
+        const route *r = http_router::get_instance()->match(urls[k], lens[k], ROUTE_METHOD_POST);
+        do_not_optimize(r);
+    }
+    st.items = st.iterations;
+}
+BENCHMARK(http_route_match, {});
+
+// 稳定状态下每个请求的malloc次数，arg为0时是GET静态页面，为1时是POST登录表单
+static void http_request_mallocs(bench_state &st) {
+    static http_conn conn;
+    http_conn_bench::setup(conn);
+    std::string req;
+    if (st.arg == 0) {
+        req = build_request(12);
+    } else {
+        const char *body = "user=admin&password=123456";
+        char head[256];
+        snprintf(head, sizeof(head), "POST /2CGISQL.cgi HTTP/1.1\r\nHost: localhost:9006\r\n"
+                 "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: %zu\r\n\r\n", strlen(body));
+        req = std::string(head) + body;
+    }
+    // 预热一次，让一次性的初始化分配不计入
+    http_conn_bench::load_request(conn, req);
+    http_conn_bench::serve(conn);
+
+    long long before = bench_malloc_count();
+    for (long long i = 0; i < st.iterations; ++i) {
+        http_conn_bench::load_request(conn, req);
+        int ret = http_conn_bench::serve(conn);
+        do_not_optimize(ret);
+    }
+    st.items = st.iterations;
+    st.counter("mallocs_per_request", (double)(bench_malloc_count() - before) / st.iterations);
+}
+BENCHMARK(http_request_mallocs, {0, 1});
+
+// 长连接上请求之间的复位开销，arg为上一个请求占用的读缓冲区字节数，耗时应与之无关
+static void http_reset(bench_state &st) {
+    static http_conn conn;
+    http_conn_bench::setup(conn);
+    for (long long i = 0; i < st.iterations; ++i) {
+        http_conn_bench::finish_request(conn, st.arg);
+        http_conn_bench::reset_request(conn);
+        do_not_optimize(conn);
+    }
+    st.items = st.iterations;
+}
+BENCHMARK(http_reset, {64, 512, 2047});
+
+// 长连接上每个请求的epoll系统调用次数，经由socketpair和真实的epoll走完读取、处理、发送；
+// arg为0时是EPOLLONESHOT逐步重新注册（proactor的流程），为1时是单线程模式的持久边沿触发注册
+static void http_epoll_syscalls(bench_state &st) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        st.skip("socketpair failed");
+        return;
+    }
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    int epfd = epoll_create1(0);
+    http_conn::m_epollfd = epfd;
+    http_conn::m_persist = (1 == st.arg);
+
+    static http_conn conn;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    http_router::get_instance()->init(http_conn_bench::root());
+    conn.init(sv[0], addr, (char *)http_conn_bench::root(), 1, 1, "root", "", "");
+
+    std::string req = build_request(3);
+    char resp[65536];
+    epoll_event ev;
+    long long ctl_before = bench_epoll_ctl_count();
+    long long wait_before = bench_epoll_wait_count();
+    for (long long i = 0; i < st.iterations; ++i) {
+        send(sv[1], req.data(), req.size(), 0);
+        if (!http_conn::m_persist) {
+            // 可读时读取并交给process()，它注册EPOLLOUT；可写时发送，write()重新注册EPOLLIN
+            epoll_wait(epfd, &ev, 1, -1);
+            conn.fired();
+            conn.read_once();
+            conn.process();
+            epoll_wait(epfd, &ev, 1, -1);
+            conn.fired();
+            conn.write();
+        } else {
+            // 对端读走响应时的EPOLLOUT边沿也会唤醒，直到等到请求
+            do {
+                epoll_wait(epfd, &ev, 1, -1);
+            } while (!(ev.events & EPOLLIN));
+            conn.read_once();
+            conn.process();
+            if (EPOLLOUT == conn.take_interest())
+                conn.write();
+        }
+        while (recv(sv[1], resp, sizeof(resp), MSG_DONTWAIT) > 0)
+            ;
+    }
+    st.items = st.iterations;
+    st.counter("epoll_ctl_per_request", (double)(bench_epoll_ctl_count() - ctl_before) / st.iterations);
+    st.counter("epoll_wait_per_request", (double)(bench_epoll_wait_count() - wait_before) / st.iterations);
+
+    conn.close_conn();
+    close(sv[1]);
+    close(epfd);
+    http_conn::m_persist = false;
+}
+BENCHMARK(http_epoll_syscalls, {0, 1});
+
+// 静态文件的完整响应与条件请求命中304的对比，arg为0时是普通GET，为1时带匹配的If-None-Match
+static void http_conditional_get(bench_state &st) {
+    static http_conn conn;
+    http_conn_bench::setup(conn);
+    std::string path = std::string(http_conn_bench::root()) + "/frame.jpg";
+    file_info info;
+    if (!file_cache::get_instance()->lookup(path.c_str(), &info)) {
+        st.skip("frame.jpg not found");
+        return;
+    }
+    std::string req = "GET /frame.jpg HTTP/1.1\r\nHost: localhost:9006\r\nConnection: keep-alive\r\n";
+    if (st.arg == 1)
+        req += std::string("If-None-Match: ") + info.etag + "\r\n";
+    req += "\r\n";
+
+    long long sent = 0;
+    for (long long i = 0; i < st.iterations; ++i) {
+        http_conn_bench::load_request(conn, req);
+        int ret = http_conn_bench::serve(conn);
+        sent += http_conn_bench::response_bytes(conn);
+        do_not_optimize(ret);
+    }
+    st.items = st.iterations;
+    st.counter("response_bytes", (double)sent / st.iterations);
+}
+BENCHMARK(http_conditional_get, {0, 1});
+
+static bool bench_hpack_field(void *arg, const char *, size_t name_len, const char *, size_t value_len) {
+    *(size_t *)arg += name_len + value_len;
+    return true;
+}
+
+// HPACK解码一个典型的浏览器请求头部块；arg为0时全部是不加入索引的字面量（连接上的第一个请求），
+// 为1时全部引用动态表（同一连接上重复的请求头）
+static void http2_hpack_decode(bench_state &st) {
+    std::string literal, indexed, warmup;
+    int n = 0;
+    for (int i = 0; i < bench_header_total; ++i) {
+        const char *line = bench_headers[i];
+        const char *colon = strchr(line, ':');
+        std::string name(line, colon - line), value(colon + 2);
+        for (size_t j = 0; j < name.size(); ++j)
+            name[j] = tolower(name[j]);
+        if (name == "connection" || name == "keep-alive" || name.size() > 126 || value.size() > 126)
+            continue;
+        literal += (char)0x00;
+        literal += (char)name.size() + name;
+        literal += (char)value.size() + value;
+        warmup += (char)0x40;
+        warmup += (char)name.size() + name;
+        warmup += (char)value.size() + value;
+        ++n;
+    }
+    // 动态表中新加入的表项在前，第i个字段的下标为62+(n-1-i)
+    for (int i = 0; i < n; ++i)
+        hpack_encode_int(indexed, HPACK_STATIC_COUNT + n - i, 7, 0x80);
+
+    hpack_decoder decoder;
+    size_t total = 0;
+    decoder.decode((const uint8_t *)warmup.data(), warmup.size(), bench_hpack_field, &total);
+    const std::string &block = st.arg == 0 ? literal : indexed;
+    for (long long i = 0; i < st.iterations; ++i) {
+        bool ok = decoder.decode((const uint8_t *)block.data(), block.size(), bench_hpack_field, &total);
+        do_not_optimize(ok);
+    }
+    do_not_optimize(total);
+    st.items = st.iterations;
+    st.bytes = st.iterations * block.size();
+    st.counter("fields", n);
+}
+BENCHMARK(http2_hpack_decode, {0, 1});
@@ -0,0 +1,50 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string>
+#include "../log/log.h"
+
+// Log是单例，异步模式一旦开启就无法切回同步，所以同步基准必须先跑
+static int g_log_mode = -1;
+
+/**
+ * @brief 以指定模式初始化日志单例
+ * @param async 是否异步
+ * @return 当前模式是否满足要求
+ */
+static bool log_setup(bool async) {
+    if (g_log_mode == (async ? 1 : 0))
+        return true;
+    if (g_log_mode == 1 && !async)
+        return false;
+    std::string path = std::string(g_bench_tmpdir) + (async ? "/bench_async_log" : "/bench_sync_log");
+    if (!Log::get_instance()->init(path.c_str(), 0, 2000, 800000, async ? 800 : 0))
+        return false;
+    g_log_mode = async ? 1 : 0;
+    return true;
+}
+
+// 与服务器中LOG_INFO宏相同的调用方式：写一行后立即flush
+static void log_write(bench_state &st, bool async) {
+    if (!log_setup(async)) {
+        st.skip("log mode unavailable (async already initialised or tmpdir not writable)");
+        return;
+    }
+    long long before = bench_malloc_count();
+    for (long long i = 0; i < st.iterations; ++i) {
+        Log::get_instance()->write_log(1, "deal with the client(%s)", "127.0.0.1");
+        Log::get_instance()->flush();
+    }
+    st.items = st.iterations;
+    st.counter("mallocs_per_line", (double)(bench_malloc_count() - before) / st.iterations);
+}
+
+static void log_write_sync(bench_state &st) {
+    log_write(st, false);
+}
+BENCHMARK(log_write_sync, {});
+
+static void log_write_async(bench_state &st) {
+    log_write(st, true);
+}
+BENCHMARK(log_write_async, {});
@@ -0,0 +1,219 @@
+#include "bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+extern "C" void *__libc_malloc(size_t size);
+
+static long long g_malloc_count = 0;
+
+// 覆盖glibc的malloc，只计数不改变行为
+extern "C" void *malloc(size_t size) {
+    __atomic_fetch_add(&g_malloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+long long bench_malloc_count() {
+    return __atomic_load_n(&g_malloc_count, __ATOMIC_RELAXED);
+}
+
+static long long g_epoll_ctl_count = 0;
+static long long g_epoll_wait_count = 0;
+
+// 同样覆盖epoll_ctl和epoll_wait，只计数后转发
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+    __atomic_fetch_add(&g_epoll_ctl_count, 1, __ATOMIC_RELAXED);
+    return (int)syscall(SYS_epoll_ctl, epfd, op, fd, event);
+}
+
+extern "C" int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+    __atomic_fetch_add(&g_epoll_wait_count, 1, __ATOMIC_RELAXED);
+    return epoll_pwait(epfd, events, maxevents, timeout, NULL);
+}
+
+long long bench_epoll_ctl_count() {
+    return __atomic_load_n(&g_epoll_ctl_count, __ATOMIC_RELAXED);
+}
+
+long long bench_epoll_wait_count() {
+    return __atomic_load_n(&g_epoll_wait_count, __ATOMIC_RELAXED);
+}
+
+const char *g_bench_root = "../root";
+const char *g_bench_tmpdir = "/tmp";
+const char *g_bench_db = NULL;
+
+static long long diff_ns(const struct timespec &a, const struct timespec &b) {
+    return (b.tv_sec - a.tv_sec) * 1000000000LL + (b.tv_nsec - a.tv_nsec);
+}
+
+void bench_state::pause() {
+    if (!m_running) return;
+    struct timespec wall, cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+    m_elapsed_ns += diff_ns(m_wall_start, wall);
+    m_cpu_ns += diff_ns(m_cpu_start, cpu);
+    m_running = false;
+}
+
+void bench_state::resume() {
+    if (m_running) return;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &m_cpu_start);
+    clock_gettime(CLOCK_MONOTONIC, &m_wall_start);
+    m_running = true;
+}
+
+void bench_runner::add(const char *name, bench_func func, const std::vector<long long> &args, long long fixed_iters) {
+    entry e;
+    e.name = name;
+    e.func = func;
+    e.fixed_iters = fixed_iters;
+    if (args.empty()) {
+        e.arg = 0;
+        e.has_arg = false;
+        m_entries.push_back(e);
+        return;
+    }
+    for (size_t i = 0; i < args.size(); ++i) {
+        e.arg = args[i];
+        e.has_arg = true;
+        m_entries.push_back(e);
+    }
+}
+
+int bench_runner::run(const char *filter, FILE *out, int min_time_ms) {
+    char host[HOST_NAME_MAX + 1] = {0};
+    gethostname(host, sizeof(host) - 1);
+    time_t now = time(NULL);
+    char date[64];
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+    fprintf(out, "{\n  \"context\": {\n");
+    fprintf(out, "    \"date\": \"%s\",\n", date);
+    fprintf(out, "    \"host_name\": \"%s\",\n", host);
+    fprintf(out, "    \"executable\": \"tinywebserver-bench\",\n");
+    fprintf(out, "    \"num_cpus\": %ld,\n", sysconf(_SC_NPROCESSORS_ONLN));
+#ifdef NDEBUG
+    fprintf(out, "    \"library_build_type\": \"release\"\n");
+#else
+    fprintf(out, "    \"library_build_type\": \"debug\"\n");
+#endif
+    fprintf(out, "  },\n  \"benchmarks\": [");
+
+    fprintf(stderr, "%-48s %14s %14s %12s\n", "Benchmark", "Time(ns)", "CPU(ns)", "Iterations");
+    int count = 0;
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        entry &e = m_entries[i];
+        char name[256];
+        if (e.has_arg)
+            snprintf(name, sizeof(name), "%s/%lld", e.name.c_str(), e.arg);
+        else
+            snprintf(name, sizeof(name), "%s", e.name.c_str());
+        if (filter && !strstr(name, filter))
+            continue;
+
+        // 自动标定：从1次开始每次放大，直到单轮运行时间超过min_time_ms
+        long long iters = e.fixed_iters > 0 ? e.fixed_iters : 1;
+        bench_state *st = NULL;
+        while (true) {
+            delete st;
+            st = new bench_state(iters, e.arg);
+            st->resume();
+            e.func(*st);
+            st->pause();
+            if (st->m_skipped || e.fixed_iters > 0)
+                break;
+            if (st->m_elapsed_ns >= min_time_ms * 1000000LL || iters >= 1000000000LL)
+                break;
+            long long grow = st->m_elapsed_ns > 0 ? (min_time_ms * 1400000LL / st->m_elapsed_ns) : 100;
+            if (grow < 2) grow = 2;
+            if (grow > 100) grow = 100;
+            iters *= grow;
+        }
+
+        fprintf(out, "%s\n    {\n", count ? "," : "");
+        fprintf(out, "      \"name\": \"%s\",\n", name);
+        fprintf(out, "      \"run_name\": \"%s\",\n", name);
+        fprintf(out, "      \"run_type\": \"iteration\",\n");
+        if (st->m_skipped) {
+            fprintf(out, "      \"error_occurred\": true,\n");
+            fprintf(out, "      \"error_message\": \"%s\"\n    }", st->m_skip_reason.c_str());
+            fprintf(stderr, "%-48s SKIPPED: %s\n", name, st->m_skip_reason.c_str());
+            delete st;
+            ++count;
+            continue;
+        }
+
+        double real_per = (double)st->m_elapsed_ns / st->iterations;
+        double cpu_per = (double)st->m_cpu_ns / st->iterations;
+        double secs = st->m_elapsed_ns / 1e9;
+        fprintf(out, "      \"iterations\": %lld,\n", st->iterations);
+        fprintf(out, "      \"real_time\": %.3f,\n", real_per);
+        fprintf(out, "      \"cpu_time\": %.3f,\n", cpu_per);
+        fprintf(out, "      \"time_unit\": \"ns\"");
+        if (st->items > 0 && secs > 0)
+            fprintf(out, ",\n      \"items_per_second\": %.3f", st->items / secs);
+        if (st->bytes > 0 && secs > 0)
+            fprintf(out, ",\n      \"bytes_per_second\": %.3f", st->bytes / secs);
+        for (size_t c = 0; c < st->m_counters.size(); ++c)
+            fprintf(out, ",\n      \"%s\": %.3f", st->m_counters[c].first.c_str(), st->m_counters[c].second);
+        fprintf(out, "\n    }");
+
+        fprintf(stderr, "%-48s %14.1f %14.1f %12lld\n", name, real_per, cpu_per, st->iterations);
+        delete st;
+        ++count;
+    }
+    fprintf(out, "\n  ]\n}\n");
+    fflush(out);
+    return count;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--filter=substr] [--out=file.json] [--min_time_ms=N]\n"
+                    "          [--root=dir] [--tmpdir=dir] [--db=user:passwd:dbname[@host[:port]]]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *filter = NULL;
+    const char *out_path = NULL;
+    int min_time_ms = 200;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--filter=", 9) == 0)
+            filter = argv[i] + 9;
+        else if (strncmp(argv[i], "--out=", 6) == 0)
+            out_path = argv[i] + 6;
+        else if (strncmp(argv[i], "--min_time_ms=", 14) == 0)
+            min_time_ms = atoi(argv[i] + 14);
+        else if (strncmp(argv[i], "--root=", 7) == 0)
+            g_bench_root = argv[i] + 7;
+        else if (strncmp(argv[i], "--tmpdir=", 9) == 0)
+            g_bench_tmpdir = argv[i] + 9;
+        else if (strncmp(argv[i], "--db=", 5) == 0)
+            g_bench_db = argv[i] + 5;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    FILE *out = stdout;
+    if (out_path) {
+        out = fopen(out_path, "w");
+        if (!out) {
+            perror(out_path);
+            return 1;
+        }
+    }
+    int n = bench_runner::get_instance()->run(filter, out, min_time_ms > 0 ? min_time_ms : 1);
+    if (out != stdout)
+        fclose(out);
+    fflush(NULL);
+    // 线程池和异步日志的线程是分离的、不会退出，跳过静态对象析构，避免析构时与它们竞争
+    _exit(n > 0 ? 0 : 1);
+}
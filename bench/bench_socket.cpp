@@ -0,0 +1,494 @@
+#include "bench.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>   // tcp_info::tcpi_segs_out，glibc的netinet/tcp.h没有
+#include <arpa/inet.h>
+#include <vector>
+#include "../net/socket_opts.h"
+#include "../net/ip_limiter.h"
+
+// socket_opts各个参数的效果，全部走回环地址；用例按参数对比开启前后
+
+/**
+ * @brief 按调优参数创建回环地址上的监听socket，端口由内核分配
+ * @param opts 调优参数
+ * @param addr 输出监听地址
+ * @return 监听socket，失败返回-1
+ */
+static int bench_listen(const socket_opts &opts, sockaddr_in *addr) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    std::string failed;
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(*addr);
+    if (!opts.apply_listen(fd, &failed) || bind(fd, (sockaddr *)addr, len) != 0 ||
+        getsockname(fd, (sockaddr *)addr, &len) != 0 || listen(fd, opts.backlog) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int bench_connect(const sockaddr_in &addr, bool nonblock) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | (nonblock ? SOCK_NONBLOCK : 0), 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (const sockaddr *)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool recv_all(int fd, char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = recv(fd, buf, len, 0);
+        if (n <= 0)
+            return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static long long segs_out(int fd) {
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    memset(&info, 0, sizeof(info));
+    getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len);
+    return info.tcpi_segs_out;
+}
+
+// 突发连接：arg为backlog，一次发起256个连接而暂不accept，统计进入全连接队列的数量；
+// 超出的SYN被丢弃，客户端要等1秒后重传，backlog为5时这就是突发流量下的连接延迟
+static void socket_backlog(bench_state &st) {
+    const int CLIENTS = 256;
+    socket_opts opts;
+    opts.backlog = st.arg;
+    sockaddr_in addr;
+    int lfd = bench_listen(opts, &addr);
+    if (lfd < 0) {
+        st.skip("listen failed");
+        return;
+    }
+    fcntl(lfd, F_SETFL, O_NONBLOCK);
+    long long accepted = 0;
+    for (long long i = 0; i < st.iterations; ++i) {
+        std::vector<int> clients;
+        for (int c = 0; c < CLIENTS; ++c) {
+            int fd = bench_connect(addr, true);
+            if (fd >= 0)
+                clients.push_back(fd);
+        }
+        usleep(20000);
+        int fd;
+        while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+            ++accepted;
+            close(fd);
+        }
+        for (size_t c = 0; c < clients.size(); ++c)
+            close(clients[c]);
+        // 等被丢弃的SYN重传进队列后清掉，不影响下一轮
+        st.pause();
+        usleep(1100000);
+        while ((fd = accept(lfd, NULL, NULL)) >= 0)
+            close(fd);
+        st.resume();
+    }
+    close(lfd);
+    st.items = st.iterations * CLIENTS;
+    st.counter("queued_of_256", (double)accepted / st.iterations);
+}
+BENCHMARK_ITERS(socket_backlog, 1, {5, 1024});
+
+// 写-写-读：响应头和响应体分两次send，arg为TCP_NODELAY；
+// 关闭时第二次send的小报文段要等第一段的ACK，而对端在延迟ACK，每个请求多出几十毫秒
+static void socket_nodelay(bench_state &st) {
+    socket_opts opts;
+    opts.nodelay = st.arg != 0;
+    sockaddr_in addr;
+    int lfd = bench_listen(opts, &addr);
+    int cfd = lfd < 0 ? -1 : bench_connect(addr, false);
+    int sfd = cfd < 0 ? -1 : accept(lfd, NULL, NULL);
+    if (sfd < 0) {
+        st.skip("loopback connection failed");
+        return;
+    }
+    const char head[] = "HTTP/1.1 200 OK\r\nContent-Length:5\r\n\r\n";
+    char buf[256];
+    for (long long i = 0; i < st.iterations; ++i) {
+        send(cfd, "GET", 3, 0);
+        recv_all(sfd, buf, 3);
+        send(sfd, head, sizeof(head) - 1, 0);
+        send(sfd, "hello", 5, 0);
+        recv_all(cfd, buf, sizeof(head) - 1 + 5);
+    }
+    close(sfd);
+    close(cfd);
+    close(lfd);
+    st.items = st.iterations;
+}
+BENCHMARK_ITERS(socket_nodelay, 50, {0, 1});
+
+// 流式响应：开启TCP_NODELAY后，响应头和16个小块分别写出，arg为是否用TCP_CORK包住整个响应；
+// 统计每个响应发出的报文段数
+static void socket_cork(bench_state &st) {
+    socket_opts opts;
+    sockaddr_in addr;
+    int lfd = bench_listen(opts, &addr);
+    int cfd = lfd < 0 ? -1 : bench_connect(addr, false);
+    int sfd = cfd < 0 ? -1 : accept(lfd, NULL, NULL);
+    if (sfd < 0) {
+        st.skip("loopback connection failed");
+        return;
+    }
+    const char head[] = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n";
+    char chunk[512];
+    memset(chunk, 'x', sizeof(chunk));
+    const int CHUNKS = 16;
+    size_t total = sizeof(head) - 1 + CHUNKS * sizeof(chunk);
+    std::vector<char> buf(total);
+    long long segs_before = segs_out(sfd);
+    for (long long i = 0; i < st.iterations; ++i) {
+        if (st.arg)
+            socket_opts::set_cork(sfd, true);
+        send(sfd, head, sizeof(head) - 1, 0);
+        for (int c = 0; c < CHUNKS; ++c)
+            send(sfd, chunk, sizeof(chunk), 0);
+        if (st.arg)
+            socket_opts::set_cork(sfd, false);
+        recv_all(cfd, &buf[0], total);
+    }
+    st.items = st.iterations;
+    st.bytes = st.iterations * total;
+    st.counter("segments_per_response", (double)(segs_out(sfd) - segs_before) / st.iterations);
+    close(sfd);
+    close(cfd);
+    close(lfd);
+}
+BENCHMARK(socket_cork, {0, 1});
+
+struct bulk_arg {
+    int fd;
+    long long total;
+};
+
+static void *bulk_reader(void *p) {
+    bulk_arg *arg = (bulk_arg *)p;
+    std::vector<char> buf(256 * 1024);
+    long long got = 0;
+    while (got < arg->total) {
+        ssize_t n = recv(arg->fd, &buf[0], buf.size(), 0);
+        if (n <= 0)
+            break;
+        got += n;
+    }
+    return NULL;
+}
+
+// 大文件发送吞吐，arg为两端的SO_SNDBUF/SO_RCVBUF，0表示内核自动调节；
+// 设置的值会被内核翻倍，上限为net.core.wmem_max/rmem_max
+static void socket_buffers(bench_state &st) {
+    const long long TOTAL = 32LL << 20;
+    socket_opts opts;
+    opts.sndbuf = opts.rcvbuf = st.arg;
+    sockaddr_in addr;
+    int lfd = bench_listen(opts, &addr);
+    int cfd = lfd < 0 ? -1 : socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (cfd >= 0 && st.arg > 0) {
+        setsockopt(cfd, SOL_SOCKET, SO_SNDBUF, &opts.sndbuf, sizeof(int));
+        setsockopt(cfd, SOL_SOCKET, SO_RCVBUF, &opts.rcvbuf, sizeof(int));
+    }
+    int sfd = -1;
+    if (cfd >= 0 && connect(cfd, (sockaddr *)&addr, sizeof(addr)) == 0)
+        sfd = accept(lfd, NULL, NULL);
+    if (sfd < 0) {
+        st.skip("loopback connection failed");
+        return;
+    }
+    std::vector<char> data(256 * 1024, 'x');
+    for (long long i = 0; i < st.iterations; ++i) {
+        bulk_arg arg = {cfd, TOTAL};
+        pthread_t tid;
+        pthread_create(&tid, NULL, bulk_reader, &arg);
+        long long left = TOTAL;
+        while (left > 0) {
+            ssize_t n = send(sfd, &data[0], left < (long long)data.size() ? left : data.size(), 0);
+            if (n <= 0)
+                break;
+            left -= n;
+        }
+        pthread_join(tid, NULL);
+    }
+    int effective = 0;
+    socklen_t len = sizeof(effective);
+    getsockopt(sfd, SOL_SOCKET, SO_SNDBUF, &effective, &len);
+    st.counter("effective_sndbuf", effective);
+    st.bytes = st.iterations * TOTAL;
+    close(sfd);
+    close(cfd);
+    close(lfd);
+}
+BENCHMARK(socket_buffers, {0, 16384, 1048576});
+
+// 空闲连接：64个客户端只建连不发数据，arg为TCP_DEFER_ACCEPT秒数；
+// 统计发数据之前监听socket上的可读通知和accept数，开启后服务器不会为它们醒来
+static void socket_defer_accept(bench_state &st) {
+    const int CLIENTS = 64;
+    socket_opts opts;
+    opts.defer_accept = st.arg;
+    sockaddr_in addr;
+    int lfd = bench_listen(opts, &addr);
+    if (lfd < 0) {
+        st.skip("listen failed");
+        return;
+    }
+    fcntl(lfd, F_SETFL, O_NONBLOCK);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = lfd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+
+    long long idle_accepted = 0, accepted = 0;
+    for (long long i = 0; i < st.iterations; ++i) {
+        std::vector<int> clients;
+        for (int c = 0; c < CLIENTS; ++c) {
+            int fd = bench_connect(addr, false);
+            if (fd >= 0)
+                clients.push_back(fd);
+        }
+        int fd;
+        if (epoll_wait(epfd, &ev, 1, 50) > 0) {
+            while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+                ++idle_accepted;
+                close(fd);
+            }
+        }
+        for (size_t c = 0; c < clients.size(); ++c)
+            send(clients[c], "GET", 3, 0);
+        usleep(20000);
+        while ((fd = accept(lfd, NULL, NULL)) >= 0) {
+            ++accepted;
+            close(fd);
+        }
+        for (size_t c = 0; c < clients.size(); ++c)
+            close(clients[c]);
+    }
+    close(epfd);
+    close(lfd);
+    st.items = st.iterations * CLIENTS;
+    st.counter("accepted_while_idle", (double)idle_accepted / st.iterations);
+    st.counter("accepted_after_data", (double)accepted / st.iterations);
+}
+BENCHMARK_ITERS(socket_defer_accept, 5, {0, 1});
+
+// 短连接：建连、发请求、收响应、关闭，arg为TCP_FASTOPEN；
+// 开启后请求随SYN发出，省掉一个往返，需要net.ipv4.tcp_fastopen同时包含1（客户端）和2（服务端）
+static void socket_fastopen(bench_state &st) {
+    FILE *f = fopen("/proc/sys/net/ipv4/tcp_fastopen", "r");
+    int sysctl = 0;
+    if (f) {
+        if (fscanf(f, "%d", &sysctl) != 1)
+            sysctl = 0;
+        fclose(f);
+    }
+    if (st.arg && (sysctl & 3) != 3) {
+        st.skip("net.ipv4.tcp_fastopen must be 3");
+        return;
+    }
+    socket_opts opts;
+    opts.fastopen = st.arg ? 256 : 0;
+    sockaddr_in addr;
+    int lfd = bench_listen(opts, &addr);
+    if (lfd < 0) {
+        st.skip("listen failed");
+        return;
+    }
+    const char resp[] = "HTTP/1.1 200 OK\r\nContent-Length:0\r\n\r\n";
+    char buf[256];
+    long long syn_data = 0;
+    for (long long i = 0; i < st.iterations; ++i) {
+        int cfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (st.arg) {
+            // 第一次连接取得cookie，之后的连接在SYN中携带请求
+            sendto(cfd, "GET", 3, MSG_FASTOPEN, (sockaddr *)&addr, sizeof(addr));
+        } else {
+            connect(cfd, (sockaddr *)&addr, sizeof(addr));
+            send(cfd, "GET", 3, 0);
+        }
+        int sfd = accept(lfd, NULL, NULL);
+        struct tcp_info info;
+        socklen_t len = sizeof(info);
+        if (getsockopt(sfd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0 && (info.tcpi_options & TCPI_OPT_SYN_DATA))
+            ++syn_data;
+        recv_all(sfd, buf, 3);
+        send(sfd, resp, sizeof(resp) - 1, 0);
+        recv_all(cfd, buf, sizeof(resp) - 1);
+        close(sfd);
+        close(cfd);
+    }
+    close(lfd);
+    st.items = st.iterations;
+    st.counter("syn_data_ratio", (double)syn_data / st.iterations);
+}
+BENCHMARK_ITERS(socket_fastopen, 2000, {0, 1});
+
+struct echo_arg {
+    int fd;
+    long long rounds;
+};
+
+static void *echo_server(void *p) {
+    echo_arg *arg = (echo_arg *)p;
+    char c;
+    for (long long i = 0; i < arg->rounds; ++i) {
+        if (recv(arg->fd, &c, 1, 0) != 1)
+            break;
+        send(arg->fd, &c, 1, 0);
+    }
+    return NULL;
+}
+
+// 1字节往返延迟，arg为SO_BUSY_POLL微秒数；阻塞读时在网卡队列上忙等，省掉中断和唤醒。
+// 只对支持NAPI的网卡生效，回环设备上两者应当相同，且调大需要CAP_NET_ADMIN
+static void socket_busy_poll(bench_state &st) {
+    socket_opts opts;
+    opts.busy_poll = st.arg;
+    sockaddr_in addr;
+    int lfd = bench_listen(opts, &addr);
+    if (lfd < 0) {
+        st.skip("SO_BUSY_POLL not permitted");
+        return;
+    }
+    int cfd = bench_connect(addr, false);
+    int sfd = cfd < 0 ? -1 : accept(lfd, NULL, NULL);
+    if (sfd < 0) {
+        st.skip("loopback connection failed");
+        return;
+    }
+    if (st.arg)
+        setsockopt(cfd, SOL_SOCKET, SO_BUSY_POLL, &opts.busy_poll, sizeof(int));
+    echo_arg arg = {sfd, st.iterations};
+    pthread_t tid;
+    pthread_create(&tid, NULL, echo_server, &arg);
+    char c = 'x';
+    for (long long i = 0; i < st.iterations; ++i) {
+        send(cfd, &c, 1, 0);
+        recv(cfd, &c, 1, 0);
+    }
+    pthread_join(tid, NULL);
+    close(sfd);
+    close(cfd);
+    close(lfd);
+    st.items = st.iterations;
+}
+BENCHMARK(socket_busy_poll, {0, 50});
+
+// 多进程模式：arg个监听socket以SO_REUSEPORT绑定同一端口，内核按四元组散列分配新连接；
+// 发起1024个连接后从各个socket收取，imbalance是最多的一个与平均值之比（1.0为完全均匀）
+static void socket_reuseport(bench_state &st) {
+    const int CLIENTS = 1024;
+    int n = (int)st.arg;
+    std::vector<int> lfds;
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < n; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        int flag = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+        socklen_t len = sizeof(addr);
+        if (bind(fd, (sockaddr *)&addr, len) != 0 || getsockname(fd, (sockaddr *)&addr, &len) != 0 ||
+            listen(fd, CLIENTS) != 0) {
+            close(fd);
+            for (size_t j = 0; j < lfds.size(); ++j)
+                close(lfds[j]);
+            st.skip("SO_REUSEPORT not supported");
+            return;
+        }
+        lfds.push_back(fd);
+    }
+
+    std::vector<long long> accepted(n, 0);
+    long long total = 0;
+    for (long long it = 0; it < st.iterations; ++it) {
+        std::vector<int> clients;
+        for (int i = 0; i < CLIENTS; ++i) {
+            int fd = bench_connect(addr, false);
+            if (fd >= 0)
+                clients.push_back(fd);
+        }
+        for (int i = 0; i < n; ++i) {
+            int fd;
+            while ((fd = accept(lfds[i], NULL, NULL)) >= 0) {
+                close(fd);
+                ++accepted[i];
+                ++total;
+            }
+        }
+        for (size_t i = 0; i < clients.size(); ++i)
+            close(clients[i]);
+    }
+    for (int i = 0; i < n; ++i)
+        close(lfds[i]);
+
+    long long most = 0;
+    for (int i = 0; i < n; ++i)
+        if (accepted[i] > most)
+            most = accepted[i];
+    st.items = total;
+    st.counter("imbalance", total ? (double)most * n / total : 0);
+}
+BENCHMARK_ITERS(socket_reuseport, 1, {1, 4, 8});
+
+// 按IP限流的接入检查：admit和release一对的开销，arg为轮换的客户端地址个数（表项数）
+static ip_limiter *bench_limiter() {
+    static bool ready = false;
+    if (!ready) {
+        ip_limit limit;
+        limit.conns = 1000;
+        limit.rate = 1000000;
+        limit.burst = 1000000;
+        ip_limiter::get_instance()->init(limit, 1024);
+        ready = true;
+    }
+    return ip_limiter::get_instance();
+}
+
+static void ip_limiter_admit(bench_state &st) {
+    ip_limiter *limiter = bench_limiter();
+    uint32_t base = htonl(0x0a000001);
+    long long rejected = 0;
+    for (long long it = 0; it < st.iterations; ++it) {
+        int fd = (int)(it & 1023);
+        uint32_t ip = base + htonl((uint32_t)(it % st.arg));
+        if (limiter->admit(fd, ip) != ip_limiter::IP_ADMIT)
+            ++rejected;
+        limiter->release(fd);
+    }
+    st.items = st.iterations;
+    st.counter("rejected", (double)rejected);
+}
+BENCHMARK(ip_limiter_admit, {1, 1024, 65536});
+
+// 定时器每次tick时整表清理一遍的耗时
+static void ip_limiter_sweep(bench_state &st) {
+    ip_limiter *limiter = bench_limiter();
+    for (long long it = 0; it < st.iterations; ++it)
+        limiter->sweep();
+    st.items = st.iterations;
+}
+BENCHMARK(ip_limiter_sweep, {});
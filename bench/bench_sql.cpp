@@ -0,0 +1,85 @@
+#include "bench.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include "../CGImysql/sql_connection_pool.h"
+
+static const int BENCH_SQL_CONN = 8;
+
+/**
+ * @brief 按--db参数初始化连接池，只初始化一次
+ * @return 连接池是否可用
+ */
+static bool sql_setup() {
+    static int state = -1;
+    if (state >= 0)
+        return state == 1;
+    state = 0;
+    if (!g_bench_db)
+        return false;
+
+    // user:passwd:dbname[@host[:port]]
+    std::string spec = g_bench_db;
+    std::string host = "localhost";
+    int port = 3306;
+    size_t at = spec.find('@');
+    if (at != std::string::npos) {
+        host = spec.substr(at + 1);
+        spec = spec.substr(0, at);
+        size_t colon = host.find(':');
+        if (colon != std::string::npos) {
+            port = atoi(host.c_str() + colon + 1);
+            host = host.substr(0, colon);
+        }
+    }
+    size_t c1 = spec.find(':');
+    size_t c2 = c1 == std::string::npos ? c1 : spec.find(':', c1 + 1);
+    if (c2 == std::string::npos)
+        return false;
+
+    // 连接失败时init会直接exit，这里只能信任调用者给出的连接串
+    connection_pool::GetInstance()->init(host, spec.substr(0, c1), spec.substr(c1 + 1, c2 - c1 - 1),
+                                         spec.substr(c2 + 1), port, BENCH_SQL_CONN, 1);
+    state = 1;
+    return true;
+}
+
+struct sql_worker_arg {
+    long long count;
+};
+
+static void *sql_worker(void *arg) {
+    sql_worker_arg *a = (sql_worker_arg *)arg;
+    connection_pool *pool = connection_pool::GetInstance();
+    for (long long i = 0; i < a->count; ++i) {
+        MYSQL *con = NULL;
+        connectionRAII guard(&con, pool);
+        do_not_optimize(con);
+    }
+    return NULL;
+}
+
+// arg个线程争抢BENCH_SQL_CONN个连接，每次取出后立即归还
+static void sql_acquire_release(bench_state &st) {
+    if (!sql_setup()) {
+        st.skip("no database, pass --db=user:passwd:dbname[@host[:port]]");
+        return;
+    }
+    int nthreads = st.arg;
+    long long per = st.iterations / nthreads;
+    if (per == 0) per = 1;
+    std::vector<pthread_t> tids(nthreads);
+    std::vector<sql_worker_arg> args(nthreads);
+    for (int i = 0; i < nthreads; ++i) {
+        args[i].count = per;
+        pthread_create(&tids[i], NULL, sql_worker, &args[i]);
+    }
+    for (int i = 0; i < nthreads; ++i)
+        pthread_join(tids[i], NULL);
+    st.iterations = per * nthreads;
+    st.items = st.iterations;
+}
+BENCHMARK(sql_acquire_release, {1, 4, 16, 64});
@@ -0,0 +1,331 @@
+#include "bench.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "../threadpool/threadpool.h"
+#include "../http/http_conn.h"
+
+/**
+ * @brief 空任务，满足threadpool对任务类型的接口要求
+ */
+class bench_task {
+public:
+    bench_task() : mysql(NULL), m_state(0), m_cpu(-1), improv(0), timer_flag(0) {}
+    void process() { s_done.fetch_add(1, std::memory_order_relaxed); }
+    bool read_once() { return true; }
+    bool write() { return true; }
+    int classify() { return TASK_FAST; }
+
+    MYSQL *mysql;
+    int m_state;
+    int m_cpu;
+    int improv;
+    int timer_flag;
+    static std::atomic<long long> s_done;
+};
+std::atomic<long long> bench_task::s_done(0);
+
+struct producer_arg {
+    threadpool<bench_task> *pool;
+    bench_task *task;
+    long long count;
+    long long rejected;
+};
+
+static void *producer(void *arg) {
+    producer_arg *p = (producer_arg *)arg;
+    for (long long i = 0; i < p->count; ++i) {
+        // 队列满时append失败，让出CPU后重试，统计被拒绝的次数
+        while (!p->pool->append_p(p->task)) {
+            ++p->rejected;
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// arg个生产者并发投递，测量从投递到全部被工作线程取走处理的吞吐
+static void threadpool_throughput(bench_state &st) {
+    // 整个进程只创建一个池，所有规模共用，创建线程的开销不计入结果
+    static threadpool<bench_task> *pool =
+        new threadpool<bench_task>(0, connection_pool::GetInstance(), 8, 10000);
+
+    int nproducers = st.arg;
+    long long per = st.iterations / nproducers;
+    if (per == 0) per = 1;
+    long long total = per * nproducers;
+    std::vector<bench_task> tasks(nproducers);
+    std::vector<producer_arg> args(nproducers);
+    std::vector<pthread_t> tids(nproducers);
+
+    long long start = bench_task::s_done.load();
+    for (int i = 0; i < nproducers; ++i) {
+        args[i].pool = pool;
+        args[i].task = &tasks[i];
+        args[i].count = per;
+        args[i].rejected = 0;
+        pthread_create(&tids[i], NULL, producer, &args[i]);
+    }
+    long long rejected = 0;
+    for (int i = 0; i < nproducers; ++i) {
+        pthread_join(tids[i], NULL);
+        rejected += args[i].rejected;
+    }
+    while (bench_task::s_done.load() - start < total)
+        sched_yield();
+
+    st.iterations = total;
+    st.items = total;
+    st.counter("queue_full_retries", rejected);
+}
+BENCHMARK(threadpool_throughput, {1, 2, 4, 8, 16, 32, 64});
+
+/**
+ * @brief 记录执行时所在CPU的任务，m_cpu模拟连接收包所在的核
+ */
+class rss_task {
+public:
+    rss_task() : mysql(NULL), m_state(0), m_cpu(-1), improv(0), timer_flag(0) {}
+    void process() {
+        if (sched_getcpu() == m_cpu)
+            s_same.fetch_add(1, std::memory_order_relaxed);
+        s_done.fetch_add(1, std::memory_order_relaxed);
+    }
+    bool read_once() { return true; }
+    bool write() { return true; }
+    int classify() { return TASK_FAST; }
+
+    MYSQL *mysql;
+    int m_state;
+    int m_cpu;
+    int improv;
+    int timer_flag;
+    static std::atomic<long long> s_done;
+    static std::atomic<long long> s_same;
+};
+std::atomic<long long> rss_task::s_done(0);
+std::atomic<long long> rss_task::s_same(0);
+
+struct rss_producer_arg {
+    threadpool<rss_task> *pool;
+    rss_task *task;
+    long long count;
+};
+
+static void *rss_producer(void *arg) {
+    rss_producer_arg *p = (rss_producer_arg *)arg;
+    for (long long i = 0; i < p->count; ++i)
+        while (!p->pool->append_p(p->task))
+            sched_yield();
+    return NULL;
+}
+
+// 每个CPU上一个绑核的生产者，投递标记为本核的任务；arg为1时按CPU分流，
+// same_cpu_ratio是任务在标记的核上执行的比例，共用队列时约为1/CPU数
+static void threadpool_rss(bench_state &st) {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    sched_getaffinity(0, sizeof(set), &set);
+    for (int c = 0; c < CPU_SETSIZE; ++c)
+        if (CPU_ISSET(c, &set))
+            cpus.push_back(c);
+    if (cpus.size() < 2) {
+        st.skip("needs at least 2 CPUs");
+        return;
+    }
+    // 同threadpool_throughput，每种配置只创建一个池
+    static threadpool<rss_task> *pools[2] = {NULL, NULL};
+    if (!pools[st.arg]) {
+        cpu_affinity affinity;
+        affinity.rss = st.arg == 1;
+        pools[st.arg] = new threadpool<rss_task>(0, connection_pool::GetInstance(), (int)cpus.size(),
+                                                 10000, &affinity);
+    }
+    threadpool<rss_task> *pool = pools[st.arg];
+
+    int n = (int)cpus.size();
+    long long per = st.iterations / n;
+    if (per == 0) per = 1;
+    long long total = per * n;
+    std::vector<rss_task> tasks(n);
+    std::vector<rss_producer_arg> args(n);
+    std::vector<pthread_t> tids(n);
+
+    long long start = rss_task::s_done.load();
+    long long same = rss_task::s_same.load();
+    for (int i = 0; i < n; ++i) {
+        tasks[i].m_cpu = cpus[i];
+        args[i].pool = pool;
+        args[i].task = &tasks[i];
+        args[i].count = per;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        cpu_affinity::pin_attr(&attr, std::vector<int>(1, cpus[i]));
+        pthread_create(&tids[i], &attr, rss_producer, &args[i]);
+        pthread_attr_destroy(&attr);
+    }
+    for (int i = 0; i < n; ++i)
+        pthread_join(tids[i], NULL);
+    while (rss_task::s_done.load() - start < total)
+        sched_yield();
+
+    st.iterations = total;
+    st.items = total;
+    st.counter("same_cpu_ratio", (double)(rss_task::s_same.load() - same) / total);
+}
+BENCHMARK(threadpool_rss, {0, 1});
+
+/**
+ * @brief 阻塞1毫秒的任务，模拟一次MySQL往返
+ */
+class blocking_task {
+public:
+    blocking_task() : mysql(NULL), m_state(0), m_cpu(-1), improv(0), timer_flag(0) {}
+    void process() {
+        usleep(1000);
+        s_done.fetch_add(1, std::memory_order_relaxed);
+    }
+    bool read_once() { return true; }
+    bool write() { return true; }
+    int classify() { return TASK_FAST; }
+
+    MYSQL *mysql;
+    int m_state;
+    int m_cpu;
+    int improv;
+    int timer_flag;
+    static std::atomic<long long> s_done;
+};
+std::atomic<long long> blocking_task::s_done(0);
+
+// 任务阻塞在I/O上时固定4个线程（arg=0）和在4到64之间伸缩（arg=1）的吞吐，
+// threads为结束时的线程数，avg_wait_us为平均排队时间
+static void threadpool_elastic(bench_state &st) {
+    static threadpool<blocking_task> *pools[2] = {NULL, NULL};
+    if (!pools[st.arg]) {
+        pool_sizing sizing;
+        sizing.min_threads = 4;
+        sizing.max_threads = st.arg == 1 ? 64 : 4;
+        sizing.wait_ms = 2;
+        pools[st.arg] = new threadpool<blocking_task>(0, connection_pool::GetInstance(), 4, 10000,
+                                                      NULL, &sizing);
+    }
+    threadpool<blocking_task> *pool = pools[st.arg];
+    std::vector<blocking_task> tasks(64);
+
+    long long start = blocking_task::s_done.load();
+    unsigned long long tasks_before = pool->stats().tasks[TASK_FAST];
+    unsigned long long wait_before = pool->stats().wait_us[TASK_FAST];
+    for (long long i = 0; i < st.iterations; ++i)
+        while (!pool->append_p(&tasks[i % tasks.size()]))
+            sched_yield();
+    while (blocking_task::s_done.load() - start < st.iterations)
+        usleep(100);
+
+    st.items = st.iterations;
+    st.counter("threads", pool->threads());
+    unsigned long long n = pool->stats().tasks[TASK_FAST] - tasks_before;
+    st.counter("avg_wait_us", n ? (double)(pool->stats().wait_us[TASK_FAST] - wait_before) / n : 0);
+}
+BENCHMARK(threadpool_elastic, {0, 1});
+
+static long long mono_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief 阻塞1毫秒的慢任务（模拟注册时的MySQL往返）或记录排队时间的快任务（模拟静态页面）
+ */
+class mixed_task {
+public:
+    mixed_task() : mysql(NULL), m_state(0), m_cpu(-1), improv(0), timer_flag(0), slow(false),
+                   queued_at(0), latency(0) {}
+    void process() {
+        if (slow)
+            usleep(1000);
+        else
+            latency = mono_ns() - queued_at;
+        s_done.fetch_add(1, std::memory_order_relaxed);
+    }
+    bool read_once() { return true; }
+    bool write() { return true; }
+    int classify() { return slow ? TASK_DB : TASK_FAST; }
+
+    MYSQL *mysql;
+    int m_state;
+    int m_cpu;
+    int improv;
+    int timer_flag;
+    bool slow;
+    long long queued_at;
+    long long latency;
+    static std::atomic<long long> s_done;
+};
+std::atomic<long long> mixed_task::s_done(0);
+
+// 4个线程，每投递一个快任务前先投递8个慢任务；arg=0时慢任务也按快任务排队（等同于单个FIFO），
+// arg=1时按数据库任务排队。fast_p50_us、fast_p99_us为快任务从入队到开始执行的时间
+static void threadpool_priority(bench_state &st) {
+    static threadpool<mixed_task> *pools[2] = {NULL, NULL};
+    if (!pools[st.arg])
+        pools[st.arg] = new threadpool<mixed_task>(0, connection_pool::GetInstance(), 4, 100000);
+    threadpool<mixed_task> *pool = pools[st.arg];
+    const int SLOW_PER_FAST = 8;
+    std::vector<mixed_task> slow(SLOW_PER_FAST * 4);
+    for (size_t i = 0; i < slow.size(); ++i)
+        slow[i].slow = true;
+    std::vector<mixed_task> fast(st.iterations);
+
+    long long start = mixed_task::s_done.load();
+    for (long long i = 0; i < st.iterations; ++i) {
+        for (int j = 0; j < SLOW_PER_FAST; ++j)
+            while (!pool->append_p(&slow[j % slow.size()], st.arg == 1 ? TASK_DB : TASK_FAST))
+                sched_yield();
+        fast[i].queued_at = mono_ns();
+        while (!pool->append_p(&fast[i], TASK_FAST))
+            sched_yield();
+    }
+    while (mixed_task::s_done.load() - start < st.iterations * (SLOW_PER_FAST + 1))
+        usleep(100);
+
+    std::vector<long long> lat(st.iterations);
+    for (long long i = 0; i < st.iterations; ++i)
+        lat[i] = fast[i].latency;
+    std::sort(lat.begin(), lat.end());
+    st.items = st.iterations;
+    st.counter("fast_p50_us", lat[lat.size() / 2] / 1000.0);
+    st.counter("fast_p99_us", lat[lat.size() * 99 / 100] / 1000.0);
+}
+BENCHMARK(threadpool_priority, {0, 1});
+
+// 连接对象的页已在目标节点时mbind的开销，用来说明按fd缓存节点的必要；arg为放置的字节数
+static void numa_place(bench_state &st) {
+    static char *buf = NULL;
+    static size_t cap = 0;
+    size_t len = (size_t)st.arg;
+    if (cap < len) {
+        free(buf);
+        buf = (char *)aligned_alloc(4096, len);
+        memset(buf, 0, len);
+        cap = len;
+    }
+    int node = cpu_affinity::node_of_cpu(sched_getcpu());
+    if (node < 0 || !cpu_affinity::place(buf, len, node)) {
+        st.skip("mbind not supported");
+        return;
+    }
+    for (long long i = 0; i < st.iterations; ++i)
+        cpu_affinity::place(buf, len, node);
+    st.items = st.iterations;
+    st.counter("nodes", cpu_affinity::node_count());
+}
+BENCHMARK(numa_place, {sizeof(http_conn), 1 << 20});
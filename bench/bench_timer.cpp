@@ -0,0 +1,89 @@
+#include "bench.h"
+
+#include <stdlib.h>
+#include <vector>
+#include "../timer/lst_timer.h"
+
+static void bench_cb(client_data *) {}
+
+/**
+ * @brief 生成n个到期时间随机分布的定时器
+ * @param timers 输出的定时器数组
+ * @param users 定时器对应的客户端数据
+ * @param base 基准到期时刻（毫秒）
+ */
+static void make_timers(std::vector<util_timer *> &timers, std::vector<client_data> &users, long long base) {
+    for (size_t i = 0; i < timers.size(); ++i) {
+        users[i].sockfd = i;
+        util_timer *t = new util_timer;
+        t->expire = base + rand() % 3600000;
+        t->cb_func = bench_cb;
+        t->user_data = &users[i];
+        users[i].timer = t;
+        timers[i] = t;
+    }
+}
+
+// 向规模为arg的链表依次插入全部定时器，每次迭代插入arg个
+static void timer_add(bench_state &st) {
+    srand(1);
+    for (long long it = 0; it < st.iterations; ++it) {
+        st.pause();
+        sort_timer_lst *lst = new sort_timer_lst;
+        std::vector<util_timer *> timers(st.arg);
+        std::vector<client_data> users(st.arg);
+        make_timers(timers, users, timer_now_ms() + 100000);
+        st.resume();
+        for (long long i = 0; i < st.arg; ++i)
+            lst->add_timer(timers[i]);
+        st.pause();
+        delete lst;
+        st.resume();
+    }
+    st.items = st.iterations * st.arg;
+}
+BENCHMARK_ITERS(timer_add, 3, {1000, 10000});
+
+// 链表中已有arg个定时器，模拟活跃连接不断延长超时时间（adjust_timer）
+static void timer_adjust(bench_state &st) {
+    st.pause();
+    srand(2);
+    sort_timer_lst lst;
+    std::vector<util_timer *> timers(st.arg);
+    std::vector<client_data> users(st.arg);
+    long long base = timer_now_ms() + 100000;
+    make_timers(timers, users, base);
+    for (long long i = 0; i < st.arg; ++i)
+        lst.add_timer(timers[i]);
+
+    long long bump = 3600000;
+    st.resume();
+    for (long long it = 0; it < st.iterations; ++it) {
+        util_timer *t = timers[rand() % st.arg];
+        t->expire = base + (bump++);
+        lst.adjust_timer(t);
+    }
+    st.items = st.iterations;
+}
+BENCHMARK(timer_adjust, {1000, 10000});
+
+// 链表中arg个定时器全部到期，一次tick全部处理掉
+static void timer_tick(bench_state &st) {
+    srand(3);
+    for (long long it = 0; it < st.iterations; ++it) {
+        st.pause();
+        sort_timer_lst *lst = new sort_timer_lst;
+        std::vector<util_timer *> timers(st.arg);
+        std::vector<client_data> users(st.arg);
+        make_timers(timers, users, timer_now_ms() - 7200000);
+        for (long long i = 0; i < st.arg; ++i)
+            lst->add_timer(timers[i]);
+        st.resume();
+        lst->tick();
+        st.pause();
+        delete lst;
+        st.resume();
+    }
+    st.items = st.iterations * st.arg;
+}
+BENCHMARK_ITERS(timer_tick, 3, {1000, 10000});
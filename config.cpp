@@ -16,6 +16,13 @@ Config::Config() {
     thread_num = 8;        // 默认线程池线程数量为8
     close_log = 0;         // 默认不关闭日志
     actor_model = 0;       // 默认使用Proactor模型
+    max_body = 16 << 20;   // 默认请求体上限16MB
+    tls_port = 0;          // 默认不开启HTTPS
+    tls_cert = "./server.crt";
+    tls_key = "./server.key";
+    io_engine = 0;         // 默认使用epoll
+    workers = 0;           // 默认单进程
+    drain_timeout = 10;    // 默认优雅退出最多等待10秒
 }
 
 /**
@@ -29,7 +36,7 @@ Config::Config() {
 void Config::parse_arg(int argc, char* argv[]) {
     int opt;
     // 定义命令行选项字符串，冒号表示该选项后跟参数
-    const char *str = "p:l:m:o:s:t:c:a:";
+    const char *str = "p:l:m:o:s:t:c:a:b:P:C:K:T:e:O:A:E:w:g:L:D:";
     
     // 使用getopt解析命令行参数
     while ((opt = getopt(argc, argv, str)) != -1) {
@@ -74,6 +81,91 @@ void Config::parse_arg(int argc, char* argv[]) {
             actor_model = atoi(optarg);
             break;
         }
+        case 'b': // 请求体大小上限
+        {
+            max_body = atoll(optarg);
+            break;
+        }
+        case 'P': // HTTPS端口
+        {
+            tls_port = atoi(optarg);
+            break;
+        }
+        case 'C': // 证书链文件
+        {
+            tls_cert = optarg;
+            break;
+        }
+        case 'K': // 私钥文件
+        {
+            tls_key = optarg;
+            break;
+        }
+        case 'T': // 会话票据密钥文件
+        {
+            tls_ticket_key = optarg;
+            break;
+        }
+        case 'e': // I/O引擎
+        {
+            io_engine = atoi(optarg);
+            break;
+        }
+        case 'O': // socket调优参数
+        {
+            string err;
+            if (!sock_opts.parse(optarg, &err)) {
+                fprintf(stderr, "invalid socket option: %s\n", err.c_str());
+                exit(1);
+            }
+            break;
+        }
+        case 'w': // 工作进程数量
+        {
+            workers = atoi(optarg);
+            break;
+        }
+        case 'g': // 优雅退出的最长等待时间
+        {
+            drain_timeout = atoi(optarg);
+            break;
+        }
+        case 'L': // 按客户端IP的接入限制
+        {
+            string err;
+            if (!limits.parse(optarg, &err)) {
+                fprintf(stderr, "invalid limit option: %s\n", err.c_str());
+                exit(1);
+            }
+            break;
+        }
+        case 'D': // 连接各阶段的时限
+        {
+            string err;
+            if (!timeouts.parse(optarg, &err)) {
+                fprintf(stderr, "invalid timeout option: %s\n", err.c_str());
+                exit(1);
+            }
+            break;
+        }
+        case 'A': // 线程绑核
+        {
+            string err;
+            if (!affinity.parse(optarg, &err)) {
+                fprintf(stderr, "invalid affinity option: %s\n", err.c_str());
+                exit(1);
+            }
+            break;
+        }
+        case 'E': // 线程池的伸缩和调度参数
+        {
+            string err;
+            if (!sizing.parse(optarg, &err)) {
+                fprintf(stderr, "invalid pool option: %s\n", err.c_str());
+                exit(1);
+            }
+            break;
+        }
         default:
             break;
         }
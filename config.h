@@ -35,5 +35,18 @@ public:
     int sql_num;           // 数据库连接池数量，默认8
     int thread_num;        // 线程池内线程数量，默认8
     int close_log;         // 是否关闭日志，0:不关闭，1:关闭
-    int actor_model;       // 并发模型选择，0:Proactor，1:Reactor
+    int actor_model;       // 并发模型选择，0:Proactor，1:Reactor，2:单线程（主线程完成全部读写和处理），3:协程
+    long long max_body;    // 请求体大小上限（字节），超过时直接返回413，默认16MB
+    int tls_port;          // HTTPS端口，0表示不开启（默认）
+    string tls_cert;       // 证书链文件，默认./server.crt
+    string tls_key;        // 私钥文件，默认./server.key
+    string tls_ticket_key; // 会话票据密钥文件（80字节），默认为空，即每个进程随机生成
+    int io_engine;         // I/O引擎，0:epoll（默认），1:io_uring（需要用make URING=1编译）
+    socket_opts sock_opts; // socket调优参数，-O key=value[,key=value...]
+    cpu_affinity affinity; // 线程绑核方式，-A loop=N,workers=CPU列表,rss=0|1
+    pool_sizing sizing;    // 线程池的伸缩和调度参数，-E min=N,max=N,wait_ms=N,idle_ms=N,<类别>_weight=N,<类别>_reserve=N
+    int workers;           // 工作进程数量，0表示单进程（默认）
+    int drain_timeout;     // 收到SIGTERM后等待进行中请求完成的最长秒数，默认10
+    ip_limit limits;       // 按客户端IP的接入限制，-L conns=N,rate=N,burst=N,rst=0|1
+    conn_timeouts timeouts; // 连接各阶段的时限，-D header_ms=N,body_ms=N,min_rate=N,write_ms=N,keepalive_ms=N
 };
\ No newline at end of file
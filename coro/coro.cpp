@@ -0,0 +1,148 @@
+#include "coro.h"
+
+#ifdef USE_COROUTINE
+
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <new>
+
+frame_pool::frame_pool() {
+    for (int i = 0; i < CLASSES; ++i)
+        m_free[i] = NULL;
+}
+
+frame_pool::~frame_pool() {
+    for (int i = 0; i < CLASSES; ++i) {
+        while (m_free[i]) {
+            void *next = *(void **)m_free[i];
+            ::operator delete(m_free[i]);
+            m_free[i] = next;
+        }
+    }
+}
+
+void *frame_pool::alloc(size_t size) {
+    size_t c = (size + BLOCK - 1) / BLOCK - 1;
+    if (c >= (size_t)CLASSES)
+        return ::operator new(size);
+    void *p = m_free[c];
+    if (p) {
+        m_free[c] = *(void **)p;
+        return p;
+    }
+    // 按档的上限分配，同一档内不同大小的帧可以互相复用
+    return ::operator new((c + 1) * BLOCK);
+}
+
+void frame_pool::free(void *p, size_t size) {
+    size_t c = (size + BLOCK - 1) / BLOCK - 1;
+    if (c >= (size_t)CLASSES) {
+        ::operator delete(p);
+        return;
+    }
+    *(void **)p = m_free[c];
+    m_free[c] = p;
+}
+
+coro_loop::coro_loop() : m_conns(NULL), m_max_fd(0), m_eventfd(-1) {}
+
+coro_loop::~coro_loop() {
+    delete[] m_conns;
+    if (m_eventfd >= 0)
+        close(m_eventfd);
+}
+
+bool coro_loop::init(int max_fd) {
+    m_eventfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_eventfd < 0)
+        return false;
+    m_max_fd = max_fd;
+    m_conns = new coro_conn[max_fd];
+    return true;
+}
+
+void coro_loop::complete(int fd, unsigned gen, std::coroutine_handle<> handle) {
+    done d = {fd, gen, handle};
+    m_lock.lock();
+    bool first = m_done.empty();
+    m_done.push_back(d);
+    m_lock.unlock();
+    // 事件循环还没取走上一批时已经通知过，不必再写
+    if (first) {
+        uint64_t one = 1;
+        while (::write(m_eventfd, &one, sizeof(one)) < 0 && errno == EINTR) {}
+    }
+}
+
+void coro_loop::take(std::vector<done> *out) {
+    // 先清零计数再取队列：之后交回的协程一定会再次唤醒事件循环
+    uint64_t count;
+    while (::read(m_eventfd, &count, sizeof(count)) < 0 && errno == EINTR) {}
+    m_lock.lock();
+    out->swap(m_done);
+    m_lock.unlock();
+}
+
+bool coro_loop::release(int fd) {
+    if (fd < 0 || fd >= m_max_fd)
+        return true;
+    coro_conn &c = m_conns[fd];
+    if (c.offloaded) {
+        c.closing = true;
+        return false;
+    }
+    if (c.handle)
+        c.handle.destroy();
+    c.handle = nullptr;
+    c.waiting = 0;
+    c.closing = false;
+    ++c.gen;
+    return true;
+}
+
+void coro_loop::destroy_all() {
+    // 线程池已经退出，不会再有协程交回；同一个协程可能既在队列里又挂在连接上，只销毁一次
+    std::vector<done> list;
+    take(&list);
+    for (size_t i = 0; i < list.size(); ++i) {
+        coro_conn &c = m_conns[list[i].fd];
+        if (c.handle != list[i].handle || c.gen != list[i].gen)
+            list[i].handle.destroy();
+    }
+    for (int fd = 0; fd < m_max_fd; ++fd) {
+        if (m_conns[fd].handle)
+            m_conns[fd].handle.destroy();
+        m_conns[fd].handle = nullptr;
+    }
+}
+
+void coro_offload::process() {
+    m_conn->mysql = mysql;
+    m_conn->process();
+    // 交回之后事件循环可能立即恢复或销毁协程帧，本对象随之失效；
+    // 线程池在这之后只释放connectionRAII持有的数据库连接，不再访问任务
+    m_loop->complete(m_fd, m_gen, m_handle);
+}
+
+bool coro_offload::await_suspend(std::coroutine_handle<> h) {
+    coro_conn &c = m_loop->conn(m_fd);
+    m_gen = c.gen;
+    m_handle = h;
+    c.handle = h;
+    c.offloaded = true;
+    m_queued = m_pool->append_p(this, m_cls);
+    if (!m_queued)
+        c.offloaded = false;
+    return m_queued;
+}
+
+void coro_offload::await_resume() {
+    if (m_queued)
+        return;
+    connectionRAII mysqlcon(&m_conn->mysql, m_db);
+    m_conn->process();
+}
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef CORO_H
+#define CORO_H
+
+#ifdef USE_COROUTINE
+
+#include <stddef.h>
+#include <coroutine>
+#include <exception>
+#include <vector>
+#include "../lock/locker.h"
+#include "../http/http_conn.h"
+#include "../threadpool/threadpool.h"
+
+/**
+ * @brief 协程帧的内存池
+ *
+ * 帧的大小由编译器决定，同一个协程函数的帧大小固定；按64字节分档，每档一个空闲链表，
+ * 连接关闭时帧回到链表，下一个连接直接复用。超过最大档的帧直接用operator new。
+ * 帧只在事件循环线程中创建和销毁，不加锁
+ */
+class frame_pool {
+public:
+    /**
+     * @brief 获取单例
+     */
+    static frame_pool *get_instance() {
+        static frame_pool instance;
+        return &instance;
+    }
+
+    void *alloc(size_t size);
+    void free(void *p, size_t size);
+
+private:
+    frame_pool();
+    ~frame_pool();
+
+    static const size_t BLOCK = 64;     // 分档的粒度
+    static const int CLASSES = 64;      // 档数，最大4KB
+
+private:
+    void *m_free[CLASSES];              // 每档的空闲链表，链表指针存在空闲块的开头
+};
+
+/**
+ * @brief 连接处理协程的返回类型
+ *
+ * 协程创建后立即运行到第一个挂起点；结束时不挂起，帧直接释放。
+ * 挂起中的句柄由awaitable记在连接的coro_conn中，返回值本身不持有句柄
+ */
+struct conn_task {
+    struct promise_type {
+        conn_task get_return_object() { return conn_task(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        static void *operator new(size_t size) { return frame_pool::get_instance()->alloc(size); }
+        static void operator delete(void *p, size_t size) { frame_pool::get_instance()->free(p, size); }
+    };
+};
+
+/**
+ * @brief 协程模式下一个连接的调度状态，按fd索引
+ */
+struct coro_conn {
+    std::coroutine_handle<> handle;     // 挂起中的协程，为空表示没有
+    unsigned gen;                       // 连接代数，fd复用后线程池交回的旧协程据此销毁
+    int waiting;                        // 等待的socket事件（EPOLLIN/EPOLLOUT），0表示没有在等socket
+    bool offloaded;                     // 协程交给了线程池，由工作线程处理请求
+    bool closing;                       // 在线程池中处理期间定时器到期，协程交回后关闭连接
+
+    coro_conn() : gen(0), waiting(0), offloaded(false), closing(false) {}
+};
+
+/**
+ * @brief 协程模式的调度器：每个连接挂起中的协程，以及线程池处理完交回的协程
+ *
+ * 工作线程把处理完的任务放进队列并写eventfd，事件循环在epoll中收到eventfd可读后取出并恢复
+ */
+class coro_loop {
+public:
+    /**
+     * @brief 线程池交回的协程
+     */
+    struct done {
+        int fd;
+        unsigned gen;
+        std::coroutine_handle<> handle;
+    };
+
+    coro_loop();
+    ~coro_loop();
+
+    /**
+     * @brief 分配连接状态并创建eventfd
+     * @param max_fd 连接fd的上限
+     * @return 失败时返回false
+     */
+    bool init(int max_fd);
+
+    int eventfd() const { return m_eventfd; }
+    coro_conn &conn(int fd) { return m_conns[fd]; }
+
+    /**
+     * @brief 工作线程处理完请求后调用，之后不能再访问协程帧
+     */
+    void complete(int fd, unsigned gen, std::coroutine_handle<> handle);
+
+    /**
+     * @brief 事件循环取出全部交回的协程
+     */
+    void take(std::vector<done> *out);
+
+    /**
+     * @brief 连接关闭：销毁挂起在socket上的协程，由定时器回调在关闭socket之前调用
+     * @return 可以立即关闭时返回true；协程还在线程池中时只标记closing并返回false，
+     *         工作线程仍在访问连接，socket要等协程交回后再关闭
+     */
+    bool release(int fd);
+
+    /**
+     * @brief 退出时销毁剩余的协程，须在线程池析构之后、释放连接数组之前调用
+     */
+    void destroy_all();
+
+private:
+    coro_conn *m_conns;
+    int m_max_fd;
+    int m_eventfd;
+    locker m_lock;                      // 保护m_done
+    std::vector<done> m_done;           // 已交回、尚未恢复的协程
+};
+
+/**
+ * @brief 等待socket事件的awaitable
+ *
+ * 连接上已经记下该边沿时不挂起；否则挂起，事件循环收到事件后恢复
+ */
+struct io_wait {
+    coro_conn *state;
+    int *ready;                         // 连接记下的边沿事件（http_conn::ready）
+    int events;
+
+    bool await_ready() const { return (*ready & events) != 0; }
+    void await_suspend(std::coroutine_handle<> h) {
+        state->handle = h;
+        state->waiting = events;
+    }
+    void await_resume() { state->waiting = 0; }
+};
+
+/**
+ * @brief 把请求交给线程池处理的awaitable，同时也是线程池的任务
+ *
+ * 位于挂起的协程帧中，不另外分配；工作线程执行process()后把协程交回事件循环，由事件循环恢复。
+ * 队列满时不挂起，直接在事件循环中处理
+ */
+struct coro_offload {
+    // 线程池（proactor方式）要求的成员
+    MYSQL *mysql;
+    int m_state;
+    int m_cpu;
+    int improv;
+    int timer_flag;
+    bool read_once() { return false; }
+    bool write() { return false; }
+    int classify() { return m_cls; }
+
+    coro_offload(coro_loop *loop, threadpool<coro_offload> *pool, connection_pool *db, http_conn *conn,
+                 int fd, int cls)
+        : mysql(NULL), m_state(0), m_cpu(conn->m_cpu), improv(0), timer_flag(0), m_loop(loop), m_pool(pool),
+          m_db(db), m_conn(conn), m_fd(fd), m_cls(cls), m_gen(0), m_queued(false) {}
+
+    /**
+     * @brief 在工作线程中处理请求，mysql由线程池的connectionRAII取得
+     */
+    void process();
+
+    bool await_ready() const { return false; }
+    bool await_suspend(std::coroutine_handle<> h);
+    void await_resume();
+
+private:
+    coro_loop *m_loop;
+    threadpool<coro_offload> *m_pool;
+    connection_pool *m_db;
+    http_conn *m_conn;
+    int m_fd;
+    int m_cls;
+    unsigned m_gen;
+    std::coroutine_handle<> m_handle;
+    bool m_queued;                      // 是否已交给线程池
+};
+
+#endif
+
+#endif
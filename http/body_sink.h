@@ -0,0 +1,30 @@
+#ifndef BODY_SINK_H
+#define BODY_SINK_H
+
+/**
+ * @brief 流式请求体的接收方
+ *
+ * 与body_source对应，用于放不进读缓冲区的请求体：http_conn每读入一段就交给consume()，
+ * 交出后读缓冲区的这段空间立即用来接收后面的数据，因此无论请求体多大，每个连接占用的内存都是固定的。
+ * 接收方由请求路由到的处理函数决定，通常分配在请求内存池中，请求结束或连接关闭时由http_conn调用析构函数
+ */
+class body_sink {
+public:
+    virtual ~body_sink() {}
+
+    /**
+     * @brief 接收下一段请求体，各段按到达顺序交出，总长度等于Content-Length
+     * @param data 数据
+     * @param len 长度
+     * @return 是否成功，失败时回复500
+     */
+    virtual bool consume(const char *data, long len) = 0;
+
+    /**
+     * @brief 请求体已全部交出，随后开始处理请求
+     * @return 是否成功，失败时回复500
+     */
+    virtual bool finish() { return true; }
+};
+
+#endif
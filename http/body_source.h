@@ -0,0 +1,26 @@
+#ifndef BODY_SOURCE_H
+#define BODY_SOURCE_H
+
+/**
+ * @brief 流式响应体的数据源
+ *
+ * 用于事先不知道总长度、需要边生成边发送的响应（动态页面、数据库结果集等）。
+ * http_conn以Transfer-Encoding: chunked发送，每次只缓存一个块：
+ * 上一块完全写入socket后才会再次调用produce()，socket写满时等待EPOLLOUT，
+ * 因此无论响应体多大，每个连接占用的内存都是固定的。
+ * 数据源对象通常分配在请求内存池中，响应结束或连接关闭时由http_conn调用析构函数
+ */
+class body_source {
+public:
+    virtual ~body_source() {}
+
+    /**
+     * @brief 生成下一段响应体
+     * @param buf 输出缓冲区
+     * @param size 缓冲区大小
+     * @return 写入的字节数，0表示响应体结束，-1表示出错（连接将被关闭）
+     */
+    virtual int produce(char *buf, int size) = 0;
+};
+
+#endif
@@ -0,0 +1,202 @@
+#include "file_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+
+static const char *const WEEKDAYS[7] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *const MONTHS[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                       "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+int http_format_date(time_t t, char *buf) {
+    // 不用strftime，避免受locale影响
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return snprintf(buf, file_info::DATE_LEN, "%s, %02d %s %04d %02d:%02d:%02d GMT",
+                    WEEKDAYS[tm.tm_wday], tm.tm_mday, MONTHS[tm.tm_mon], tm.tm_year + 1900,
+                    tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+static int parse_2digits(const char *s) {
+    if (s[0] < '0' || s[0] > '9' || s[1] < '0' || s[1] > '9')
+        return -1;
+    return (s[0] - '0') * 10 + (s[1] - '0');
+}
+
+bool http_parse_date(const char *s, time_t *t) {
+    // 格式：Sun, 06 Nov 1994 08:49:37 GMT
+    if (!s || strlen(s) != 29 || s[3] != ',' || s[4] != ' ' || s[7] != ' ' || s[11] != ' ' ||
+        s[16] != ' ' || s[19] != ':' || s[22] != ':' || s[25] != ' ' || strcmp(s + 26, "GMT") != 0)
+        return false;
+    int mon = -1;
+    for (int i = 0; i < 12; ++i) {
+        if (strncmp(s + 8, MONTHS[i], 3) == 0) {
+            mon = i;
+            break;
+        }
+    }
+    int day = parse_2digits(s + 5);
+    int y1 = parse_2digits(s + 12);
+    int y2 = parse_2digits(s + 14);
+    int hour = parse_2digits(s + 17);
+    int min = parse_2digits(s + 20);
+    int sec = parse_2digits(s + 23);
+    if (mon < 0 || day < 1 || y1 < 0 || y2 < 0 || hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 60)
+        return false;
+
+    // 公历日期转天数（Howard Hinnant的days_from_civil）
+    long y = y1 * 100 + y2;
+    int m = mon + 1;
+    y -= m <= 2;
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    long days = era * 146097 + doe - 719468;
+    *t = (time_t)days * 86400 + hour * 3600 + min * 60 + sec;
+    return true;
+}
+
+bool http_etag_match(const char *value, const char *etag) {
+    if (!value)
+        return false;
+    // 比较时忽略W/前缀
+    if (strncmp(etag, "W/", 2) == 0)
+        etag += 2;
+    size_t etag_len = strlen(etag);
+    const char *p = value;
+    while (*p) {
+        p += strspn(p, " \t,");
+        if (*p == '*')
+            return true;
+        if (strncmp(p, "W/", 2) == 0)
+            p += 2;
+        size_t n = strcspn(p, ",");
+        size_t len = n;
+        while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t'))
+            --len;
+        if (len == etag_len && memcmp(p, etag, len) == 0)
+            return true;
+        p += n;
+    }
+    return false;
+}
+
+// 解析非负十进制数，返回解析结束的位置，没有数字或溢出时返回NULL
+static const char *parse_offset(const char *p, long long *v) {
+    if (*p < '0' || *p > '9')
+        return NULL;
+    long long n = 0;
+    while (*p >= '0' && *p <= '9') {
+        if (n > (LLONG_MAX - 9) / 10)
+            return NULL;
+        n = n * 10 + (*p++ - '0');
+    }
+    *v = n;
+    return p;
+}
+
+RANGE_RESULT http_parse_range(const char *value, long long size, long long *start, long long *end) {
+    if (!value || strncasecmp(value, "bytes=", 6) != 0)
+        return RANGE_NONE;
+    const char *p = value + 6;
+    p += strspn(p, " \t");
+    // 多段范围需要multipart/byteranges，暂不支持，按完整响应处理
+    if (strchr(p, ','))
+        return RANGE_NONE;
+
+    long long first, last;
+    if (*p == '-') {
+        // 后缀范围：最后N个字节
+        p = parse_offset(p + 1, &last);
+        if (!p || p[strspn(p, " \t")] != '\0')
+            return RANGE_NONE;
+        if (last == 0 || size == 0)
+            return RANGE_UNSATISFIABLE;
+        *start = last >= size ? 0 : size - last;
+        *end = size - 1;
+        return RANGE_OK;
+    }
+
+    p = parse_offset(p, &first);
+    if (!p || *p != '-')
+        return RANGE_NONE;
+    ++p;
+    if (*p >= '0' && *p <= '9') {
+        p = parse_offset(p, &last);
+        if (!p || last < first)
+            return RANGE_NONE;
+    } else {
+        last = size - 1;
+    }
+    if (p[strspn(p, " \t")] != '\0')
+        return RANGE_NONE;
+    if (first >= size)
+        return RANGE_UNSATISFIABLE;
+    *start = first;
+    *end = last >= size ? size - 1 : last;
+    return RANGE_OK;
+}
+
+void file_cache::fill(file_info *info, const struct stat &st, time_t now) {
+    info->st = st;
+    info->exists = true;
+    info->checked = now;
+    unsigned long long mtime = (unsigned long long)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+    snprintf(info->etag, file_info::ETAG_LEN, "\"%lx-%llx-%llx\"",
+             (unsigned long)st.st_ino, mtime, (unsigned long long)st.st_size);
+    http_format_date(st.st_mtime, info->last_modified);
+}
+
+bool file_cache::lookup(const char *path, file_info *info, bool cache_missing) {
+    time_t now = time(NULL);
+    m_lock.lock();
+    std::map<std::string, entry, std::less<> >::iterator it = m_entries.find(path);
+    if (it != m_entries.end() && now - it->second.info.checked < VALID_SECONDS) {
+        *info = it->second.info;
+        m_order.splice(m_order.begin(), m_order, it->second.pos);
+        m_lock.unlock();
+        return info->exists;
+    }
+    m_lock.unlock();
+
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        // 预压缩文件缺失时缓存这个结果，不必每次都stat
+        file_info missing;
+        memset(&missing, 0, sizeof(missing));
+        missing.exists = false;
+        missing.checked = now;
+        if (cache_missing)
+            store(path, missing);
+        *info = missing;
+        return false;
+    }
+    update(path, st, info);
+    return true;
+}
+
+void file_cache::update(const char *path, const struct stat &st, file_info *info) {
+    fill(info, st, time(NULL));
+    store(path, *info);
+}
+
+void file_cache::store(const char *path, const file_info &info) {
+    m_lock.lock();
+    std::map<std::string, entry, std::less<> >::iterator it = m_entries.find(path);
+    if (it != m_entries.end()) {
+        it->second.info = info;
+        m_order.splice(m_order.begin(), m_order, it->second.pos);
+    } else {
+        if (m_entries.size() >= MAX_ENTRIES) {
+            m_entries.erase(m_entries.find(*m_order.back()));
+            m_order.pop_back();
+        }
+        it = m_entries.insert(std::make_pair(std::string(path), entry())).first;
+        it->second.info = info;
+        m_order.push_front(&it->first);
+        it->second.pos = m_order.begin();
+    }
+    m_lock.unlock();
+}
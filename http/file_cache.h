@@ -0,0 +1,141 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <sys/stat.h>
+#include <time.h>
+#include <list>
+#include <map>
+#include <string>
+
+#include "../lock/locker.h"
+
+/**
+ * @brief 静态文件的元数据：stat结果以及由它生成的缓存校验头
+ */
+struct file_info {
+    static const int ETAG_LEN = 64;
+    static const int DATE_LEN = 32;
+    struct stat st;                   // stat结果
+    char etag[ETAG_LEN];              // 强ETag，含双引号："inode-mtime-size"
+    char last_modified[DATE_LEN];     // Last-Modified，IMF-fixdate格式
+    time_t checked;                   // 上次stat的时间
+    bool exists;                      // 文件是否存在，只有预压缩文件不存在的结果会被缓存
+};
+
+/**
+ * @brief 文件元数据缓存
+ *
+ * 按完整路径缓存stat结果和格式化好的ETag/Last-Modified，
+ * VALID_SECONDS内不重复stat，304判断可以完全不碰文件系统；
+ * 真正发送文件时由调用方用fstat确认，发现变化后通过update()刷新
+ */
+class file_cache {
+public:
+    // 缓存项有效期（秒），与nginx的open_file_cache_valid含义相同
+    static const int VALID_SECONDS = 1;
+    // 缓存项上限，超过后淘汰最久未使用的项
+    static const size_t MAX_ENTRIES = 1024;
+
+    /**
+     * @brief 获取缓存单例
+     * @return 缓存指针
+     */
+    static file_cache *get_instance() {
+        static file_cache instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 查询文件元数据，过期或未命中时重新stat
+     * @param path 文件完整路径
+     * @param info 输出的元数据
+     * @param cache_missing stat失败时是否也缓存结果。只用于由已存在的文件派生出的预压缩文件路径：
+     *        这类路径的数量受文件数限制；客户端任意构造的URL不缓存，否则大量404会挤掉有用的项
+     * @return 成功返回true，文件不存在等stat失败时返回false
+     */
+    bool lookup(const char *path, file_info *info, bool cache_missing = false);
+
+    /**
+     * @brief 用新的stat结果刷新缓存项
+     * @param path 文件完整路径
+     * @param st 新的stat结果
+     * @param info 输出的元数据
+     */
+    void update(const char *path, const struct stat &st, file_info *info);
+
+    /**
+     * @brief 两个stat结果是否对应同一版本的文件
+     */
+    static bool same_version(const struct stat &a, const struct stat &b) {
+        return a.st_ino == b.st_ino && a.st_size == b.st_size &&
+               a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+    }
+
+private:
+    file_cache() {}
+
+    /**
+     * @brief 由stat结果生成ETag和Last-Modified
+     */
+    static void fill(file_info *info, const struct stat &st, time_t now);
+
+    /**
+     * @brief 写入或覆盖缓存项，项数达到上限时先淘汰最久未使用的一项
+     */
+    void store(const char *path, const file_info &info);
+
+    /**
+     * @brief 缓存项：元数据及其在使用顺序链表中的位置
+     */
+    struct entry {
+        file_info info;
+        std::list<const std::string *>::iterator pos;
+    };
+
+    std::map<std::string, entry, std::less<> > m_entries;  // 路径到缓存项
+    std::list<const std::string *> m_order;                 // 最近使用的在前，元素指向m_entries的键
+    locker m_lock;                                          // 保护m_entries和m_order
+};
+
+/**
+ * @brief 格式化HTTP日期（IMF-fixdate）
+ * @param t 时间
+ * @param buf 输出缓冲区，至少file_info::DATE_LEN字节
+ * @return 写入的长度
+ */
+int http_format_date(time_t t, char *buf);
+
+/**
+ * @brief 解析HTTP日期，只支持IMF-fixdate
+ * @param s 日期字符串
+ * @param t 输出的时间
+ * @return 是否解析成功
+ */
+bool http_parse_date(const char *s, time_t *t);
+
+/**
+ * @brief 判断If-None-Match的值是否命中ETag（弱比较）
+ * @param value If-None-Match请求头的值
+ * @param etag 当前的ETag，含双引号
+ * @return 是否命中
+ */
+bool http_etag_match(const char *value, const char *etag);
+
+// http_parse_range的返回值
+enum RANGE_RESULT {
+    RANGE_NONE = 0,        // 没有可用的范围（语法错误或多段范围），按完整响应处理
+    RANGE_OK,              // 单段范围，可以返回206
+    RANGE_UNSATISFIABLE    // 范围落在文件之外，返回416
+};
+
+/**
+ * @brief 解析Range请求头，只支持单段的bytes范围（含"-N"形式的后缀范围）
+ * @param value Range请求头的值
+ * @param size 文件大小
+ * @param start 输出的起始偏移
+ * @param end 输出的结束偏移（含）
+ * @return 解析结果
+ */
+RANGE_RESULT http_parse_range(const char *value, long long size, long long *start, long long *end);
+
+#endif
@@ -0,0 +1,368 @@
+#include "hpack.h"
+
+#include <string.h>
+
+// RFC 7541 附录B的Huffman编码表，下标为符号（256为EOS）
+static const uint32_t HUFFMAN_CODES[257] = {
+    0x00001ff8, 0x007fffd8, 0x0fffffe2, 0x0fffffe3, 0x0fffffe4, 0x0fffffe5,
+    0x0fffffe6, 0x0fffffe7, 0x0fffffe8, 0x00ffffea, 0x3ffffffc, 0x0fffffe9,
+    0x0fffffea, 0x3ffffffd, 0x0fffffeb, 0x0fffffec, 0x0fffffed, 0x0fffffee,
+    0x0fffffef, 0x0ffffff0, 0x0ffffff1, 0x0ffffff2, 0x3ffffffe, 0x0ffffff3,
+    0x0ffffff4, 0x0ffffff5, 0x0ffffff6, 0x0ffffff7, 0x0ffffff8, 0x0ffffff9,
+    0x0ffffffa, 0x0ffffffb, 0x00000014, 0x000003f8, 0x000003f9, 0x00000ffa,
+    0x00001ff9, 0x00000015, 0x000000f8, 0x000007fa, 0x000003fa, 0x000003fb,
+    0x000000f9, 0x000007fb, 0x000000fa, 0x00000016, 0x00000017, 0x00000018,
+    0x00000000, 0x00000001, 0x00000002, 0x00000019, 0x0000001a, 0x0000001b,
+    0x0000001c, 0x0000001d, 0x0000001e, 0x0000001f, 0x0000005c, 0x000000fb,
+    0x00007ffc, 0x00000020, 0x00000ffb, 0x000003fc, 0x00001ffa, 0x00000021,
+    0x0000005d, 0x0000005e, 0x0000005f, 0x00000060, 0x00000061, 0x00000062,
+    0x00000063, 0x00000064, 0x00000065, 0x00000066, 0x00000067, 0x00000068,
+    0x00000069, 0x0000006a, 0x0000006b, 0x0000006c, 0x0000006d, 0x0000006e,
+    0x0000006f, 0x00000070, 0x00000071, 0x00000072, 0x000000fc, 0x00000073,
+    0x000000fd, 0x00001ffb, 0x0007fff0, 0x00001ffc, 0x00003ffc, 0x00000022,
+    0x00007ffd, 0x00000003, 0x00000023, 0x00000004, 0x00000024, 0x00000005,
+    0x00000025, 0x00000026, 0x00000027, 0x00000006, 0x00000074, 0x00000075,
+    0x00000028, 0x00000029, 0x0000002a, 0x00000007, 0x0000002b, 0x00000076,
+    0x0000002c, 0x00000008, 0x00000009, 0x0000002d, 0x00000077, 0x00000078,
+    0x00000079, 0x0000007a, 0x0000007b, 0x00007ffe, 0x000007fc, 0x00003ffd,
+    0x00001ffd, 0x0ffffffc, 0x000fffe6, 0x003fffd2, 0x000fffe7, 0x000fffe8,
+    0x003fffd3, 0x003fffd4, 0x003fffd5, 0x007fffd9, 0x003fffd6, 0x007fffda,
+    0x007fffdb, 0x007fffdc, 0x007fffdd, 0x007fffde, 0x00ffffeb, 0x007fffdf,
+    0x00ffffec, 0x00ffffed, 0x003fffd7, 0x007fffe0, 0x00ffffee, 0x007fffe1,
+    0x007fffe2, 0x007fffe3, 0x007fffe4, 0x001fffdc, 0x003fffd8, 0x007fffe5,
+    0x003fffd9, 0x007fffe6, 0x007fffe7, 0x00ffffef, 0x003fffda, 0x001fffdd,
+    0x000fffe9, 0x003fffdb, 0x003fffdc, 0x007fffe8, 0x007fffe9, 0x001fffde,
+    0x007fffea, 0x003fffdd, 0x003fffde, 0x00fffff0, 0x001fffdf, 0x003fffdf,
+    0x007fffeb, 0x007fffec, 0x001fffe0, 0x001fffe1, 0x003fffe0, 0x001fffe2,
+    0x007fffed, 0x003fffe1, 0x007fffee, 0x007fffef, 0x000fffea, 0x003fffe2,
+    0x003fffe3, 0x003fffe4, 0x007ffff0, 0x003fffe5, 0x003fffe6, 0x007ffff1,
+    0x03ffffe0, 0x03ffffe1, 0x000fffeb, 0x0007fff1, 0x003fffe7, 0x007ffff2,
+    0x003fffe8, 0x01ffffec, 0x03ffffe2, 0x03ffffe3, 0x03ffffe4, 0x07ffffde,
+    0x07ffffdf, 0x03ffffe5, 0x00fffff1, 0x01ffffed, 0x0007fff2, 0x001fffe3,
+    0x03ffffe6, 0x07ffffe0, 0x07ffffe1, 0x03ffffe7, 0x07ffffe2, 0x00fffff2,
+    0x001fffe4, 0x001fffe5, 0x03ffffe8, 0x03ffffe9, 0x0ffffffd, 0x07ffffe3,
+    0x07ffffe4, 0x07ffffe5, 0x000fffec, 0x00fffff3, 0x000fffed, 0x001fffe6,
+    0x003fffe9, 0x001fffe7, 0x001fffe8, 0x007ffff3, 0x003fffea, 0x003fffeb,
+    0x01ffffee, 0x01ffffef, 0x00fffff4, 0x00fffff5, 0x03ffffea, 0x007ffff4,
+    0x03ffffeb, 0x07ffffe6, 0x03ffffec, 0x03ffffed, 0x07ffffe7, 0x07ffffe8,
+    0x07ffffe9, 0x07ffffea, 0x07ffffeb, 0x0ffffffe, 0x07ffffec, 0x07ffffed,
+    0x07ffffee, 0x07ffffef, 0x07fffff0, 0x03ffffee, 0x3fffffff,
+};
+static const uint8_t HUFFMAN_BITS[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+struct hpack_static_entry {
+    const char *name;
+    const char *value;
+};
+
+// RFC 7541 附录A的静态表，下标从1开始
+static const hpack_static_entry HPACK_STATIC_TABLE[HPACK_STATIC_COUNT] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+
+/**
+ * @brief 由编码表构建的Huffman解码树
+ *
+ * next[node][bit]为子节点：0表示不存在，负数-(sym+1)表示到达符号sym
+ */
+struct huffman_tree {
+    short next[256][2];
+
+    huffman_tree() {
+        memset(next, 0, sizeof(next));
+        int count = 1;
+        for (int sym = 0; sym < 257; ++sym) {
+            uint32_t code = HUFFMAN_CODES[sym];
+            int node = 0;
+            for (int i = HUFFMAN_BITS[sym] - 1; i >= 0; --i) {
+                int bit = (code >> i) & 1;
+                if (i == 0) {
+                    next[node][bit] = -(sym + 1);
+                } else {
+                    if (next[node][bit] == 0)
+                        next[node][bit] = count++;
+                    node = next[node][bit];
+                }
+            }
+        }
+    }
+};
+
+static const huffman_tree &get_huffman_tree() {
+    static const huffman_tree tree;
+    return tree;
+}
+
+bool hpack_huffman_decode(const uint8_t *p, size_t len, std::string &out) {
+    const huffman_tree &tree = get_huffman_tree();
+    int node = 0;
+    int depth = 0;        // 当前未完成符号已消耗的位数
+    bool all_ones = true; // 这些位是否全为1（只有这样才是合法的填充）
+    for (size_t i = 0; i < len; ++i) {
+        uint8_t byte = p[i];
+        for (int b = 7; b >= 0; --b) {
+            int bit = (byte >> b) & 1;
+            int next = tree.next[node][bit];
+            ++depth;
+            all_ones = all_ones && bit;
+            if (next < 0) {
+                int sym = -next - 1;
+                if (sym == 256)
+                    return false;
+                out.push_back((char)sym);
+                node = 0;
+                depth = 0;
+                all_ones = true;
+            } else if (next == 0) {
+                return false;
+            } else {
+                node = next;
+            }
+        }
+    }
+    // 结尾的填充必须是不超过7位的EOS前缀
+    return depth <= 7 && all_ones;
+}
+
+bool hpack_decode_int(const uint8_t *&p, const uint8_t *end, int prefix, uint32_t *out) {
+    if (p >= end)
+        return false;
+    uint32_t max = (1u << prefix) - 1;
+    uint32_t value = *p++ & max;
+    if (value < max) {
+        *out = value;
+        return true;
+    }
+    int shift = 0;
+    while (p < end) {
+        uint8_t b = *p++;
+        // 超过28位的整数在HTTP/2中没有意义，按格式错误处理
+        if (shift > 21)
+            return false;
+        value += (uint32_t)(b & 0x7f) << shift;
+        shift += 7;
+        if (!(b & 0x80)) {
+            *out = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+void hpack_encode_int(std::string &out, uint32_t value, int prefix, uint8_t first) {
+    uint32_t max = (1u << prefix) - 1;
+    if (value < max) {
+        out.push_back((char)(first | value));
+        return;
+    }
+    out.push_back((char)(first | max));
+    value -= max;
+    while (value >= 128) {
+        out.push_back((char)(0x80 | (value & 0x7f)));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+void hpack_encode_indexed(std::string &out, uint32_t index) {
+    hpack_encode_int(out, index, 7, 0x80);
+}
+
+void hpack_encode_literal(std::string &out, uint32_t name_index, const char *value, size_t value_len) {
+    hpack_encode_int(out, name_index, 4, 0x00);
+    hpack_encode_int(out, value_len, 7, 0x00);
+    out.append(value, value_len);
+}
+
+bool hpack_decoder::read_string(const uint8_t *&p, const uint8_t *end, std::string &out) {
+    out.clear();
+    if (p >= end)
+        return false;
+    bool huffman = *p & 0x80;
+    uint32_t len;
+    if (!hpack_decode_int(p, end, 7, &len) || len > (size_t)(end - p))
+        return false;
+    if (huffman) {
+        if (!hpack_huffman_decode(p, len, out))
+            return false;
+    } else {
+        out.assign((const char *)p, len);
+    }
+    p += len;
+    return true;
+}
+
+bool hpack_decoder::lookup(uint32_t index, const char **name, size_t *name_len,
+                           const char **value, size_t *value_len) const {
+    if (index == 0)
+        return false;
+    if (index <= (uint32_t)HPACK_STATIC_COUNT) {
+        const hpack_static_entry &e = HPACK_STATIC_TABLE[index - 1];
+        *name = e.name;
+        *name_len = strlen(e.name);
+        *value = e.value;
+        *value_len = strlen(e.value);
+        return true;
+    }
+    index -= HPACK_STATIC_COUNT + 1;
+    if (index >= m_dynamic.size())
+        return false;
+    const entry &e = m_dynamic[index];
+    *name = e.name.c_str();
+    *name_len = e.name.size();
+    *value = e.value.c_str();
+    *value_len = e.value.size();
+    return true;
+}
+
+void hpack_decoder::evict(size_t limit) {
+    while (m_size > limit && !m_dynamic.empty()) {
+        const entry &e = m_dynamic.back();
+        m_size -= e.name.size() + e.value.size() + 32;
+        m_dynamic.pop_back();
+    }
+}
+
+void hpack_decoder::add(const std::string &name, const std::string &value) {
+    size_t size = name.size() + value.size() + 32;
+    // 比整个表还大的表项会清空动态表，本身也不加入
+    if (size > m_max_size) {
+        evict(0);
+        return;
+    }
+    evict(m_max_size - size);
+    entry e;
+    e.name = name;
+    e.value = value;
+    m_dynamic.push_front(e);
+    m_size += size;
+}
+
+bool hpack_decoder::decode(const uint8_t *p, size_t len, field_cb cb, void *arg) {
+    const uint8_t *end = p + len;
+    bool first = true;
+    while (p < end) {
+        uint8_t b = *p;
+        if (b & 0x80) {
+            // 完整的索引字段
+            uint32_t index;
+            const char *name, *value;
+            size_t name_len, value_len;
+            if (!hpack_decode_int(p, end, 7, &index) || !lookup(index, &name, &name_len, &value, &value_len))
+                return false;
+            // 动态表中的字符串在回调中可能因插入而失效，这里的回调不会修改表，直接传出
+            if (!cb(arg, name, name_len, value, value_len))
+                return false;
+        } else if ((b & 0xe0) == 0x20) {
+            // 动态表大小更新，只能出现在头部块开头
+            uint32_t size;
+            if (!first || !hpack_decode_int(p, end, 5, &size) || size > TABLE_LIMIT)
+                return false;
+            m_max_size = size;
+            evict(m_max_size);
+            continue;
+        } else {
+            // 字面量：01为加入索引，0000为不加入索引，0001为永不索引
+            bool indexing = (b & 0xc0) == 0x40;
+            int prefix = indexing ? 6 : 4;
+            uint32_t index;
+            if (!hpack_decode_int(p, end, prefix, &index))
+                return false;
+            if (index) {
+                const char *name, *value;
+                size_t name_len, value_len;
+                if (!lookup(index, &name, &name_len, &value, &value_len))
+                    return false;
+                m_name.assign(name, name_len);
+            } else if (!read_string(p, end, m_name)) {
+                return false;
+            }
+            if (!read_string(p, end, m_value))
+                return false;
+            if (indexing)
+                add(m_name, m_value);
+            if (!cb(arg, m_name.c_str(), m_name.size(), m_value.c_str(), m_value.size()))
+                return false;
+        }
+        first = false;
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <deque>
+
+/**
+ * @brief HPACK（RFC 7541）头部压缩
+ *
+ * 解码器完整支持静态表、动态表和Huffman编码；
+ * 编码器只用于服务器响应，只使用静态表索引和不加入索引的字面量，不维护动态表
+ */
+
+// 静态表项数
+const int HPACK_STATIC_COUNT = 61;
+
+// 响应中用到的静态表下标（RFC 7541 附录A）
+enum HPACK_STATIC_INDEX {
+    HPACK_STATUS_200 = 8,
+    HPACK_STATUS_204 = 9,
+    HPACK_STATUS_206 = 10,
+    HPACK_STATUS_304 = 11,
+    HPACK_STATUS_400 = 12,
+    HPACK_STATUS_404 = 13,
+    HPACK_STATUS_500 = 14,
+    HPACK_ACCEPT_RANGES = 18,
+    HPACK_CACHE_CONTROL = 24,
+    HPACK_CONTENT_ENCODING = 26,
+    HPACK_CONTENT_LENGTH = 28,
+    HPACK_CONTENT_RANGE = 30,
+    HPACK_CONTENT_TYPE = 31,
+    HPACK_ETAG = 34,
+    HPACK_LAST_MODIFIED = 44,
+    HPACK_VARY = 59
+};
+
+/**
+ * @brief 头部块解码器，每个HTTP/2连接一个，动态表在整个连接内有效
+ */
+class hpack_decoder {
+public:
+    // 我们在SETTINGS中通告的动态表上限（即协议默认值）
+    static const size_t TABLE_LIMIT = 4096;
+
+    /**
+     * @brief 解码出一个字段时的回调
+     * @return 返回false时中止解码
+     */
+    typedef bool (*field_cb)(void *arg, const char *name, size_t name_len, const char *value, size_t value_len);
+
+    hpack_decoder() : m_size(0), m_max_size(TABLE_LIMIT) {}
+
+    /**
+     * @brief 解码一个完整的头部块
+     * @param p 头部块
+     * @param len 长度
+     * @param cb 每个字段调用一次，name和value以'\0'结尾，只在回调期间有效
+     * @param arg 传给回调的参数
+     * @return 格式错误（COMPRESSION_ERROR）或回调中止时返回false
+     */
+    bool decode(const uint8_t *p, size_t len, field_cb cb, void *arg);
+
+private:
+    struct entry {
+        std::string name;
+        std::string value;
+    };
+
+    /**
+     * @brief 按下标取表项，1~61为静态表，之后为动态表（新加入的在前）
+     */
+    bool lookup(uint32_t index, const char **name, size_t *name_len, const char **value, size_t *value_len) const;
+
+    /**
+     * @brief 读取一个字符串字面量（可能是Huffman编码）
+     */
+    static bool read_string(const uint8_t *&p, const uint8_t *end, std::string &out);
+
+    void add(const std::string &name, const std::string &value);
+    void evict(size_t limit);
+
+    std::deque<entry> m_dynamic;  // 动态表，front为最新的表项
+    size_t m_size;                // 动态表当前大小（按RFC计算，每项额外32字节）
+    size_t m_max_size;            // 动态表当前上限，由对端的表大小更新指令设置
+    std::string m_name;           // 解码用的临时缓冲，复用容量
+    std::string m_value;
+};
+
+/**
+ * @brief 解码HPACK整数
+ * @param p 当前位置，成功后前移
+ * @param end 数据结尾
+ * @param prefix 前缀位数（1~8）
+ * @param out 输出
+ * @return 数据不完整或溢出时返回false
+ */
+bool hpack_decode_int(const uint8_t *&p, const uint8_t *end, int prefix, uint32_t *out);
+
+/**
+ * @brief Huffman解码，结果追加到out
+ * @return 编码非法（含EOS或填充不正确）时返回false
+ */
+bool hpack_huffman_decode(const uint8_t *p, size_t len, std::string &out);
+
+/**
+ * @brief 编码HPACK整数
+ * @param out 输出
+ * @param value 整数值
+ * @param prefix 前缀位数
+ * @param first 首字节中前缀以外的高位标志
+ */
+void hpack_encode_int(std::string &out, uint32_t value, int prefix, uint8_t first);
+
+/**
+ * @brief 编码静态表中的完整字段（如:status 200）
+ */
+void hpack_encode_indexed(std::string &out, uint32_t index);
+
+/**
+ * @brief 编码“名称取自静态表、不加入索引”的字面量字段，值不做Huffman编码
+ */
+void hpack_encode_literal(std::string &out, uint32_t name_index, const char *value, size_t value_len);
+
+#endif
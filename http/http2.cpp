@@ -0,0 +1,829 @@
+#include "http2.h"
+#include "http_conn.h"
+
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+// 帧类型（RFC 7540 第6节）
+enum H2_FRAME_TYPE {
+    H2_DATA = 0,
+    H2_HEADERS,
+    H2_PRIORITY,
+    H2_RST_STREAM,
+    H2_SETTINGS,
+    H2_PUSH_PROMISE,
+    H2_PING,
+    H2_GOAWAY,
+    H2_WINDOW_UPDATE,
+    H2_CONTINUATION
+};
+
+// 帧标志
+const uint8_t H2_FLAG_END_STREAM = 0x1;
+const uint8_t H2_FLAG_ACK = 0x1;
+const uint8_t H2_FLAG_END_HEADERS = 0x4;
+const uint8_t H2_FLAG_PADDED = 0x8;
+const uint8_t H2_FLAG_PRIORITY = 0x20;
+
+// 错误码（RFC 7540 第7节）
+enum H2_ERROR {
+    H2_NO_ERROR = 0,
+    H2_PROTOCOL_ERROR,
+    H2_INTERNAL_ERROR,
+    H2_FLOW_CONTROL_ERROR,
+    H2_SETTINGS_TIMEOUT,
+    H2_STREAM_CLOSED,
+    H2_FRAME_SIZE_ERROR,
+    H2_REFUSED_STREAM,
+    H2_CANCEL,
+    H2_COMPRESSION_ERROR,
+    H2_CONNECT_ERROR,
+    H2_ENHANCE_YOUR_CALM
+};
+
+// SETTINGS参数
+enum H2_SETTING {
+    H2_SETTINGS_HEADER_TABLE_SIZE = 1,
+    H2_SETTINGS_ENABLE_PUSH,
+    H2_SETTINGS_MAX_CONCURRENT_STREAMS,
+    H2_SETTINGS_INITIAL_WINDOW_SIZE,
+    H2_SETTINGS_MAX_FRAME_SIZE,
+    H2_SETTINGS_MAX_HEADER_LIST_SIZE
+};
+
+// 协议默认的流量控制窗口
+const int64_t H2_DEFAULT_WINDOW = 65535;
+const int64_t H2_MAX_WINDOW = 0x7fffffff;
+
+// 客户端连接前言
+static const char H2_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const size_t H2_PREFACE_LEN = sizeof(H2_PREFACE) - 1;
+// HTTP/1解析器已经读走的前言部分："PRI * HTTP/2.0\r\n"
+static const size_t H2_PREFACE_LINE_LEN = 16;
+
+static const char H2_SWITCHING_PROTOCOLS[] =
+    "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+
+static inline uint32_t get_u32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static inline void put_frame_header(uint8_t *p, uint32_t len, uint8_t type, uint8_t flags, uint32_t sid) {
+    p[0] = len >> 16;
+    p[1] = len >> 8;
+    p[2] = len;
+    p[3] = type;
+    p[4] = flags;
+    put_u32(p + 5, sid & 0x7fffffff);
+}
+
+/**
+ * @brief base64url解码（HTTP2-Settings请求头，不带填充）
+ * @return 输入非法时返回false
+ */
+static bool base64url_decode(const char *s, std::string &out) {
+    uint32_t acc = 0;
+    int bits = 0;
+    for (; *s && *s != '='; ++s) {
+        int v;
+        char c = *s;
+        if (c >= 'A' && c <= 'Z')
+            v = c - 'A';
+        else if (c >= 'a' && c <= 'z')
+            v = c - 'a' + 26;
+        else if (c >= '0' && c <= '9')
+            v = c - '0' + 52;
+        else if (c == '-' || c == '+')
+            v = 62;
+        else if (c == '_' || c == '/')
+            v = 63;
+        else
+            return false;
+        acc = (acc << 6) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back((char)(acc >> bits));
+        }
+    }
+    return true;
+}
+
+http2_session::http2_session(http_conn *conn)
+    : m_conn(conn), m_in_len(0), m_preface(NULL), m_preface_left(0), m_last_sid(0), m_next_sid(0),
+      m_hblock_sid(0), m_hblock_end_stream(false), m_decoding(NULL), m_decode_ok(true),
+      m_send_window(H2_DEFAULT_WINDOW), m_initial_window(H2_DEFAULT_WINDOW), m_recv_credit(0),
+      m_iov_count(0), m_iov_pos(0), m_closing(false)
+{
+}
+
+http2_session::~http2_session() {
+    for (std::map<uint32_t, stream>::iterator it = m_streams.begin(); it != m_streams.end(); ++it)
+        release(it->second);
+}
+
+void http2_session::start_prior_knowledge(const char *data, long len) {
+    m_preface = H2_PREFACE + H2_PREFACE_LINE_LEN;
+    m_preface_left = H2_PREFACE_LEN - H2_PREFACE_LINE_LEN;
+    memcpy(m_in, data, len);
+    m_in_len = len;
+    send_settings();
+}
+
+bool http2_session::start_upgrade(const char *settings, const char *data, long len) {
+    std::string payload;
+    if (!base64url_decode(settings, payload) || apply_settings((const uint8_t *)payload.data(), payload.size()) != H2_NO_ERROR)
+        return false;
+    // 101之后服务器先发送SETTINGS，客户端再发送完整的连接前言
+    m_ctrl.append(H2_SWITCHING_PROTOCOLS, sizeof(H2_SWITCHING_PROTOCOLS) - 1);
+    send_settings();
+    m_preface = H2_PREFACE;
+    m_preface_left = H2_PREFACE_LEN;
+    memcpy(m_in, data, len);
+    m_in_len = len;
+
+    // 升级请求本身成为半关闭的流1
+    m_last_sid = 1;
+    stream &s = open_stream(1);
+    s.got_headers = true;
+    s.end_stream = true;
+    http2_response resp;
+    m_conn->serve_h2(NULL, &resp);
+    encode_response(s, resp);
+    return true;
+}
+
+http2_session::stream &http2_session::open_stream(uint32_t sid) {
+    stream &s = m_streams[sid];
+    s.id = sid;
+    s.state = STREAM_OPEN;
+    s.window = m_initial_window;
+    s.field_count = 0;
+    s.body_too_large = false;
+    s.got_headers = false;
+    s.end_stream = false;
+    s.head_queued = false;
+    s.data = NULL;
+    s.remaining = 0;
+    s.map_addr = NULL;
+    s.map_len = 0;
+    return s;
+}
+
+void http2_session::process() {
+    const uint8_t *p = (const uint8_t *)m_in;
+    long left = m_in_len;
+
+    if (m_preface_left > 0 && !m_closing) {
+        size_t n = (size_t)left < m_preface_left ? left : m_preface_left;
+        if (memcmp(p, m_preface, n) != 0) {
+            connection_error(H2_PROTOCOL_ERROR);
+        } else {
+            m_preface += n;
+            m_preface_left -= n;
+            p += n;
+            left -= n;
+        }
+    }
+
+    while (!m_closing && m_preface_left == 0 && left >= 9) {
+        uint32_t len = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+        if (len > MAX_FRAME_SIZE) {
+            connection_error(H2_FRAME_SIZE_ERROR);
+            break;
+        }
+        if (left < (long)(9 + len))
+            break;
+        if (!on_frame(p[3], p[4], get_u32(p + 5) & 0x7fffffff, p + 9, len))
+            break;
+        p += 9 + len;
+        left -= 9 + len;
+    }
+
+    if (m_closing) {
+        m_in_len = 0;
+    } else {
+        // 不完整的帧移到缓冲区开头，等待后续数据
+        memmove(m_in, p, left);
+        m_in_len = left;
+    }
+
+    // 请求体已被消费，一次性归还本轮的连接级接收窗口
+    if (m_recv_credit > 0 && !m_closing) {
+        send_window_update(0, m_recv_credit);
+        m_recv_credit = 0;
+    }
+}
+
+bool http2_session::on_frame(uint8_t type, uint8_t flags, uint32_t sid, const uint8_t *payload, uint32_t len) {
+    // 头部块必须由连续的CONTINUATION帧完成，中间不能夹杂其他帧
+    if (m_hblock_sid != 0 && (type != H2_CONTINUATION || sid != m_hblock_sid))
+        return connection_error(H2_PROTOCOL_ERROR);
+
+    switch (type) {
+    case H2_DATA:
+        return on_data(flags, sid, payload, len);
+    case H2_HEADERS:
+        return on_headers(flags, sid, payload, len);
+    case H2_PRIORITY:
+        // 不做优先级调度，所有流轮转发送
+        if (sid == 0)
+            return connection_error(H2_PROTOCOL_ERROR);
+        if (len != 5)
+            return connection_error(H2_FRAME_SIZE_ERROR);
+        return true;
+    case H2_RST_STREAM:
+        return on_rst_stream(sid, payload, len);
+    case H2_SETTINGS:
+        return on_settings(flags, sid, payload, len);
+    case H2_PUSH_PROMISE:
+        // 客户端不能推送
+        return connection_error(H2_PROTOCOL_ERROR);
+    case H2_PING:
+        if (sid != 0)
+            return connection_error(H2_PROTOCOL_ERROR);
+        if (len != 8)
+            return connection_error(H2_FRAME_SIZE_ERROR);
+        if (!(flags & H2_FLAG_ACK))
+            send_frame(H2_PING, H2_FLAG_ACK, 0, payload, 8);
+        return true;
+    case H2_GOAWAY:
+        if (sid != 0)
+            return connection_error(H2_PROTOCOL_ERROR);
+        // 对端不再发起新的流，已经在发送的响应发完后关闭连接
+        m_closing = true;
+        return false;
+    case H2_WINDOW_UPDATE:
+        return on_window_update(sid, payload, len);
+    case H2_CONTINUATION:
+        if (m_hblock_sid == 0)
+            return connection_error(H2_PROTOCOL_ERROR);
+        if (m_hblock.size() + len > MAX_HEADER_BLOCK)
+            return connection_error(H2_ENHANCE_YOUR_CALM);
+        m_hblock.append((const char *)payload, len);
+        if (flags & H2_FLAG_END_HEADERS)
+            return finish_headers();
+        return true;
+    default:
+        // 未知类型的帧必须忽略
+        return true;
+    }
+}
+
+bool http2_session::on_headers(uint8_t flags, uint32_t sid, const uint8_t *payload, uint32_t len) {
+    if (sid == 0 || !(sid & 1))
+        return connection_error(H2_PROTOCOL_ERROR);
+    const uint8_t *p = payload;
+    uint32_t n = len;
+    if (flags & H2_FLAG_PADDED) {
+        if (n < 1 || p[0] >= n)
+            return connection_error(H2_PROTOCOL_ERROR);
+        n -= 1 + p[0];
+        ++p;
+    }
+    if (flags & H2_FLAG_PRIORITY) {
+        if (n < 5)
+            return connection_error(H2_FRAME_SIZE_ERROR);
+        p += 5;
+        n -= 5;
+    }
+
+    if (sid > m_last_sid) {
+        m_last_sid = sid;
+        // 超过并发上限的流照常解码（保持HPACK动态表同步），随后拒绝
+        if (m_streams.size() < (size_t)MAX_STREAMS)
+            open_stream(sid);
+    } else {
+        // 已存在的流上只能是trailer，且必须结束该流
+        std::map<uint32_t, stream>::iterator it = m_streams.find(sid);
+        if (it == m_streams.end() || it->second.end_stream || !(flags & H2_FLAG_END_STREAM))
+            return connection_error(H2_STREAM_CLOSED);
+    }
+
+    m_hblock_sid = sid;
+    m_hblock_end_stream = flags & H2_FLAG_END_STREAM;
+    m_hblock.assign((const char *)p, n);
+    if (flags & H2_FLAG_END_HEADERS)
+        return finish_headers();
+    return true;
+}
+
+bool http2_session::finish_headers() {
+    uint32_t sid = m_hblock_sid;
+    m_hblock_sid = 0;
+    std::map<uint32_t, stream>::iterator it = m_streams.find(sid);
+    bool trailers = it != m_streams.end() && it->second.got_headers;
+
+    m_decoding = (it == m_streams.end() || trailers) ? NULL : &it->second;
+    m_decode_ok = true;
+    bool ok = m_decoder.decode((const uint8_t *)m_hblock.data(), m_hblock.size(), on_field, this);
+    m_decoding = NULL;
+    m_hblock.clear();
+    if (!ok)
+        return connection_error(H2_COMPRESSION_ERROR);
+
+    if (it == m_streams.end()) {
+        send_rst(sid, H2_REFUSED_STREAM);
+        return true;
+    }
+    stream &s = it->second;
+    if (trailers) {
+        // trailer中的字段不影响响应，直接丢弃
+        s.end_stream = true;
+        if (s.state == STREAM_OPEN)
+            dispatch(s);
+        return true;
+    }
+
+    s.got_headers = true;
+    if (!m_decode_ok || s.method.empty() || s.path.empty()) {
+        send_rst(sid, H2_PROTOCOL_ERROR);
+        m_streams.erase(it);
+        return true;
+    }
+    if (m_hblock_end_stream) {
+        s.end_stream = true;
+        dispatch(s);
+    }
+    return true;
+}
+
+bool http2_session::on_field(void *arg, const char *name, size_t name_len, const char *value, size_t value_len) {
+    http2_session *self = (http2_session *)arg;
+    stream *s = self->m_decoding;
+    if (!s)
+        return true;
+    if (name_len > 0 && name[0] == ':') {
+        // 伪头部必须出现在普通请求头之前，且只接受请求用的几种
+        if (s->field_count > 0) {
+            self->m_decode_ok = false;
+        } else if (strcmp(name, ":method") == 0) {
+            s->method.assign(value, value_len);
+        } else if (strcmp(name, ":path") == 0) {
+            s->path.assign(value, value_len);
+        } else if (strcmp(name, ":authority") == 0) {
+            s->authority.assign(value, value_len);
+        } else if (strcmp(name, ":scheme") != 0) {
+            self->m_decode_ok = false;
+        }
+        return true;
+    }
+    // HTTP/2禁止逐跳请求头，请求头名称必须是小写
+    for (size_t i = 0; i < name_len; ++i) {
+        if (name[i] >= 'A' && name[i] <= 'Z')
+            self->m_decode_ok = false;
+    }
+    if (strcmp(name, "connection") == 0 || strcmp(name, "keep-alive") == 0 ||
+        strcmp(name, "transfer-encoding") == 0 || strcmp(name, "upgrade") == 0)
+        self->m_decode_ok = false;
+    s->fields.append(name, name_len + 1);
+    s->fields.append(value, value_len + 1);
+    ++s->field_count;
+    return true;
+}
+
+bool http2_session::on_data(uint8_t flags, uint32_t sid, const uint8_t *payload, uint32_t len) {
+    if (sid == 0)
+        return connection_error(H2_PROTOCOL_ERROR);
+    // 整个帧（含填充）都计入流量控制
+    m_recv_credit += len;
+    const uint8_t *p = payload;
+    uint32_t n = len;
+    if (flags & H2_FLAG_PADDED) {
+        if (n < 1 || p[0] >= n)
+            return connection_error(H2_PROTOCOL_ERROR);
+        n -= 1 + p[0];
+        ++p;
+    }
+
+    std::map<uint32_t, stream>::iterator it = m_streams.find(sid);
+    if (it == m_streams.end()) {
+        if (sid > m_last_sid)
+            return connection_error(H2_PROTOCOL_ERROR);
+        // 已经结束或被拒绝的流，丢弃
+        return true;
+    }
+    stream &s = it->second;
+    if (!s.got_headers || s.end_stream) {
+        send_rst(sid, H2_STREAM_CLOSED);
+        cancel(it);
+        return true;
+    }
+    if (s.state == STREAM_OPEN) {
+        if (s.body.size() + n > (size_t)MAX_BODY) {
+            // 不再缓存，直接回复413；对端可能还在发送，响应结束后用RST_STREAM(NO_ERROR)终止
+            s.body_too_large = true;
+            std::string().swap(s.body);
+            dispatch(s);
+        } else {
+            s.body.append((const char *)p, n);
+        }
+    }
+    if (flags & H2_FLAG_END_STREAM) {
+        s.end_stream = true;
+        if (s.state == STREAM_OPEN)
+            dispatch(s);
+    }
+    return true;
+}
+
+// 负载中的错误码只说明对端终止流的原因，不论取值都按取消处理，因此不读取
+bool http2_session::on_rst_stream(uint32_t sid, const uint8_t *, uint32_t len) {
+    if (sid == 0)
+        return connection_error(H2_PROTOCOL_ERROR);
+    if (len != 4)
+        return connection_error(H2_FRAME_SIZE_ERROR);
+    if (sid > m_last_sid)
+        return connection_error(H2_PROTOCOL_ERROR);
+    std::map<uint32_t, stream>::iterator it = m_streams.find(sid);
+    if (it != m_streams.end()) {
+        // 对端已经终止该流，不需要再回RST_STREAM
+        it->second.end_stream = true;
+        cancel(it);
+    }
+    return true;
+}
+
+bool http2_session::on_settings(uint8_t flags, uint32_t sid, const uint8_t *payload, uint32_t len) {
+    if (sid != 0)
+        return connection_error(H2_PROTOCOL_ERROR);
+    if (flags & H2_FLAG_ACK) {
+        if (len != 0)
+            return connection_error(H2_FRAME_SIZE_ERROR);
+        return true;
+    }
+    uint32_t err = apply_settings(payload, len);
+    if (err != H2_NO_ERROR)
+        return connection_error(err);
+    send_frame(H2_SETTINGS, H2_FLAG_ACK, 0, NULL, 0);
+    return true;
+}
+
+uint32_t http2_session::apply_settings(const uint8_t *payload, uint32_t len) {
+    if (len % 6 != 0)
+        return H2_FRAME_SIZE_ERROR;
+    for (uint32_t i = 0; i < len; i += 6) {
+        uint16_t id = (payload[i] << 8) | payload[i + 1];
+        uint32_t value = get_u32(payload + i + 2);
+        switch (id) {
+        case H2_SETTINGS_ENABLE_PUSH:
+            if (value > 1)
+                return H2_PROTOCOL_ERROR;
+            break;
+        case H2_SETTINGS_INITIAL_WINDOW_SIZE:
+        {
+            if (value > H2_MAX_WINDOW)
+                return H2_FLOW_CONTROL_ERROR;
+            // 新的初始窗口按差值作用于所有已打开的流
+            int64_t delta = (int64_t)value - m_initial_window;
+            for (std::map<uint32_t, stream>::iterator it = m_streams.begin(); it != m_streams.end(); ++it) {
+                it->second.window += delta;
+                if (it->second.window > H2_MAX_WINDOW)
+                    return H2_FLOW_CONTROL_ERROR;
+            }
+            m_initial_window = value;
+            break;
+        }
+        case H2_SETTINGS_MAX_FRAME_SIZE:
+            // 对端允许更大的帧也只发送默认大小的帧
+            if (value < MAX_FRAME_SIZE || value > 0xffffff)
+                return H2_PROTOCOL_ERROR;
+            break;
+        default:
+            // 响应头不使用动态表，HEADER_TABLE_SIZE等参数与发送无关
+            break;
+        }
+    }
+    return H2_NO_ERROR;
+}
+
+bool http2_session::on_window_update(uint32_t sid, const uint8_t *payload, uint32_t len) {
+    if (len != 4)
+        return connection_error(H2_FRAME_SIZE_ERROR);
+    uint32_t increment = get_u32(payload) & 0x7fffffff;
+    if (sid == 0) {
+        if (increment == 0)
+            return connection_error(H2_PROTOCOL_ERROR);
+        m_send_window += increment;
+        if (m_send_window > H2_MAX_WINDOW)
+            return connection_error(H2_FLOW_CONTROL_ERROR);
+        return true;
+    }
+    std::map<uint32_t, stream>::iterator it = m_streams.find(sid);
+    if (it == m_streams.end()) {
+        if (sid > m_last_sid)
+            return connection_error(H2_PROTOCOL_ERROR);
+        return true;
+    }
+    stream &s = it->second;
+    s.window += increment;
+    if (increment == 0 || s.window > H2_MAX_WINDOW) {
+        send_rst(sid, increment == 0 ? H2_PROTOCOL_ERROR : H2_FLOW_CONTROL_ERROR);
+        cancel(it);
+    }
+    return true;
+}
+
+bool http2_session::drain() {
+    if (m_closing)
+        return true;
+    if (!m_streams.empty() || m_hblock_sid != 0)
+        return false;
+    send_goaway(H2_NO_ERROR);
+    m_closing = true;
+    return true;
+}
+
+bool http2_session::connection_error(uint32_t code) {
+    if (!m_closing)
+        send_goaway(code);
+    m_closing = true;
+    return false;
+}
+
+void http2_session::dispatch(stream &s) {
+    http2_request req;
+    req.method = s.method.c_str();
+    req.path = &s.path[0];
+    req.authority = s.authority.empty() ? NULL : &s.authority[0];
+    req.fields = s.fields.data();
+    req.field_count = s.field_count;
+    req.body = s.body.data();
+    req.body_len = s.body.size();
+    req.body_too_large = s.body_too_large;
+
+    http2_response resp;
+    m_conn->serve_h2(&req, &resp);
+    encode_response(s, resp);
+
+    // 请求已处理完，释放请求数据
+    std::string().swap(s.fields);
+    std::string().swap(s.body);
+}
+
+void http2_session::encode_response(stream &s, http2_response &resp) {
+    std::string block;
+    switch (resp.status) {
+    case 200: hpack_encode_indexed(block, HPACK_STATUS_200); break;
+    case 204: hpack_encode_indexed(block, HPACK_STATUS_204); break;
+    case 206: hpack_encode_indexed(block, HPACK_STATUS_206); break;
+    case 304: hpack_encode_indexed(block, HPACK_STATUS_304); break;
+    case 400: hpack_encode_indexed(block, HPACK_STATUS_400); break;
+    case 404: hpack_encode_indexed(block, HPACK_STATUS_404); break;
+    case 500: hpack_encode_indexed(block, HPACK_STATUS_500); break;
+    default:
+    {
+        char status[4];
+        snprintf(status, sizeof(status), "%03d", resp.status);
+        hpack_encode_literal(block, HPACK_STATUS_200, status, 3);
+        break;
+    }
+    }
+
+    char buf[96];
+    int n;
+    if (resp.content_type)
+        hpack_encode_literal(block, HPACK_CONTENT_TYPE, resp.content_type, strlen(resp.content_type));
+    if (resp.content_encoding)
+        hpack_encode_literal(block, HPACK_CONTENT_ENCODING, resp.content_encoding, strlen(resp.content_encoding));
+    if (resp.validators) {
+        hpack_encode_literal(block, HPACK_ETAG, resp.etag, strlen(resp.etag));
+        hpack_encode_literal(block, HPACK_LAST_MODIFIED, resp.last_modified, strlen(resp.last_modified));
+        n = snprintf(buf, sizeof(buf), "max-age=%d", http_conn::CACHE_MAX_AGE);
+        hpack_encode_literal(block, HPACK_CACHE_CONTROL, buf, n);
+    }
+    if (resp.vary)
+        hpack_encode_literal(block, HPACK_VARY, "accept-encoding", 15);
+    if (resp.accept_ranges)
+        hpack_encode_literal(block, HPACK_ACCEPT_RANGES, "bytes", 5);
+    if (resp.range_total >= 0) {
+        if (resp.range_start < 0)
+            n = snprintf(buf, sizeof(buf), "bytes */%lld", resp.range_total);
+        else
+            n = snprintf(buf, sizeof(buf), "bytes %lld-%lld/%lld", resp.range_start, resp.range_end, resp.range_total);
+        hpack_encode_literal(block, HPACK_CONTENT_RANGE, buf, n);
+    }
+    if (resp.has_body) {
+        n = snprintf(buf, sizeof(buf), "%lld", resp.data_len);
+        hpack_encode_literal(block, HPACK_CONTENT_LENGTH, buf, n);
+    }
+
+    // 响应头只有固定的几项，不会超过一帧
+    long long body = resp.has_body ? resp.data_len : 0;
+    uint8_t flags = H2_FLAG_END_HEADERS | (body == 0 ? H2_FLAG_END_STREAM : 0);
+    s.head.resize(9);
+    put_frame_header((uint8_t *)&s.head[0], block.size(), H2_HEADERS, flags, s.id);
+    s.head.append(block);
+
+    // 动态生成的响应体随string一起转移，短字符串的数据地址会变，需要重新取
+    bool in_mem = !resp.mem.empty() && resp.data == resp.mem.data();
+    s.mem.swap(resp.mem);
+    s.data = in_mem ? s.mem.data() : resp.data;
+    s.remaining = body;
+    s.map_addr = resp.map_addr;
+    s.map_len = resp.map_len;
+    s.state = STREAM_RESPONDING;
+}
+
+void http2_session::send_settings() {
+    uint8_t payload[12];
+    payload[0] = 0;
+    payload[1] = H2_SETTINGS_MAX_CONCURRENT_STREAMS;
+    put_u32(payload + 2, MAX_STREAMS);
+    payload[6] = 0;
+    payload[7] = H2_SETTINGS_ENABLE_PUSH;
+    put_u32(payload + 8, 0);
+    send_frame(H2_SETTINGS, 0, 0, payload, sizeof(payload));
+}
+
+void http2_session::send_frame(uint8_t type, uint8_t flags, uint32_t sid, const void *payload, uint32_t len) {
+    // 积压超过上限时不再应答，改发GOAWAY(ENHANCE_YOUR_CALM)；m_closing使process()停止处理后续的帧
+    if (!m_closing && m_ctrl.size() + 9 + len > MAX_CTRL) {
+        m_closing = true;
+        send_goaway(H2_ENHANCE_YOUR_CALM);
+        return;
+    }
+    uint8_t head[9];
+    put_frame_header(head, len, type, flags, sid);
+    m_ctrl.append((const char *)head, 9);
+    if (len > 0)
+        m_ctrl.append((const char *)payload, len);
+}
+
+void http2_session::send_rst(uint32_t sid, uint32_t code) {
+    uint8_t payload[4];
+    put_u32(payload, code);
+    send_frame(H2_RST_STREAM, 0, sid, payload, 4);
+}
+
+void http2_session::send_goaway(uint32_t code) {
+    uint8_t payload[8];
+    put_u32(payload, m_last_sid);
+    put_u32(payload + 4, code);
+    send_frame(H2_GOAWAY, 0, 0, payload, 8);
+}
+
+void http2_session::send_window_update(uint32_t sid, uint32_t increment) {
+    uint8_t payload[4];
+    put_u32(payload, increment);
+    send_frame(H2_WINDOW_UPDATE, 0, sid, payload, 4);
+}
+
+void http2_session::cancel(std::map<uint32_t, stream>::iterator it) {
+    stream &s = it->second;
+    if (!s.head_queued) {
+        release(s);
+        m_streams.erase(it);
+        return;
+    }
+    // 当前发送批次可能还引用着响应体，等release_done()再释放
+    s.remaining = 0;
+    s.state = STREAM_DONE;
+}
+
+bool http2_session::want_write() {
+    if (m_iov_pos < m_iov_count || !m_ctrl.empty() || m_closing)
+        return true;
+    if (m_preface_left > 0)
+        return false;
+    for (std::map<uint32_t, stream>::iterator it = m_streams.begin(); it != m_streams.end(); ++it) {
+        const stream &s = it->second;
+        if (s.state == STREAM_DONE)
+            return true;
+        if (s.state == STREAM_RESPONDING &&
+            (!s.head_queued || (s.remaining > 0 && s.window > 0 && m_send_window > 0)))
+            return true;
+    }
+    return false;
+}
+
+bool http2_session::fill_batch() {
+    m_iov_count = 0;
+    m_iov_pos = 0;
+    if (!m_ctrl.empty()) {
+        m_ctrl_sending.swap(m_ctrl);
+        m_ctrl.clear();
+        m_iov[m_iov_count].iov_base = &m_ctrl_sending[0];
+        m_iov[m_iov_count].iov_len = m_ctrl_sending.size();
+        ++m_iov_count;
+    }
+
+    // 收到客户端的连接前言之前只发送控制帧：Upgrade方式下流1的响应已经就绪，
+    // 但客户端可能只准备了有限的缓冲区来接收紧跟在101之后的数据
+    if (m_preface_left > 0)
+        return m_iov_count > 0;
+
+    // 每轮每个流最多发送一帧，从上一批停下的流开始轮转，大文件不会饿死其他流
+    int out_used = 0;
+    bool progress = true;
+    while (progress && !m_streams.empty()) {
+        progress = false;
+        std::map<uint32_t, stream>::iterator it = m_streams.lower_bound(m_next_sid);
+        for (size_t visited = 0; visited < m_streams.size(); ++visited, ++it) {
+            if (it == m_streams.end())
+                it = m_streams.begin();
+            if (m_iov_count + 2 > MAX_IOV || out_used + 9 > OUTPUT_SIZE)
+                return m_iov_count > 0;
+            stream &s = it->second;
+            if (s.state != STREAM_RESPONDING)
+                continue;
+            if (!s.head_queued) {
+                m_iov[m_iov_count].iov_base = &s.head[0];
+                m_iov[m_iov_count].iov_len = s.head.size();
+                ++m_iov_count;
+                s.head_queued = true;
+                progress = true;
+                if (s.remaining == 0) {
+                    s.state = STREAM_DONE;
+                    continue;
+                }
+            }
+            int64_t n = s.remaining;
+            if (n > MAX_FRAME_SIZE)
+                n = MAX_FRAME_SIZE;
+            if (n > m_send_window)
+                n = m_send_window;
+            if (n > s.window)
+                n = s.window;
+            if (n <= 0 || m_iov_count + 2 > MAX_IOV)
+                continue;
+            bool last = n == s.remaining;
+            uint8_t *head = (uint8_t *)m_out + out_used;
+            put_frame_header(head, n, H2_DATA, last ? H2_FLAG_END_STREAM : 0, s.id);
+            out_used += 9;
+            m_iov[m_iov_count].iov_base = head;
+            m_iov[m_iov_count].iov_len = 9;
+            m_iov[m_iov_count + 1].iov_base = (void *)s.data;
+            m_iov[m_iov_count + 1].iov_len = n;
+            m_iov_count += 2;
+            s.data += n;
+            s.remaining -= n;
+            s.window -= n;
+            m_send_window -= n;
+            if (last)
+                s.state = STREAM_DONE;
+            m_next_sid = s.id + 1;
+            progress = true;
+        }
+    }
+    return m_iov_count > 0;
+}
+
+void http2_session::release_done() {
+    std::map<uint32_t, stream>::iterator it = m_streams.begin();
+    while (it != m_streams.end()) {
+        stream &s = it->second;
+        if (s.state != STREAM_DONE) {
+            ++it;
+            continue;
+        }
+        // 提前回复（如413）时对端可能还没发完请求体，通知它停止发送
+        if (!s.end_stream)
+            send_rst(s.id, H2_NO_ERROR);
+        release(s);
+        m_streams.erase(it++);
+    }
+}
+
+void http2_session::release(stream &s) {
+    if (s.map_addr) {
+        munmap(s.map_addr, s.map_len);
+        s.map_addr = NULL;
+    }
+}
+
+http2_session::WRITE_RESULT http2_session::write() {
+    while (true) {
+        if (m_iov_pos >= m_iov_count) {
+            release_done();
+            if (!fill_batch())
+                return m_closing ? WRITE_CLOSE : WRITE_IDLE;
+        }
+        ssize_t n = m_conn->send_iov(m_iov + m_iov_pos, m_iov_count - m_iov_pos);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return WRITE_AGAIN;
+            return WRITE_CLOSE;
+        }
+        // 按已写出的字节数推进iovec
+        size_t left = n;
+        while (m_iov_pos < m_iov_count && left >= m_iov[m_iov_pos].iov_len) {
+            left -= m_iov[m_iov_pos].iov_len;
+            ++m_iov_pos;
+        }
+        if (left > 0) {
+            m_iov[m_iov_pos].iov_base = (char *)m_iov[m_iov_pos].iov_base + left;
+            m_iov[m_iov_pos].iov_len -= left;
+        }
+    }
+}
@@ -0,0 +1,267 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <map>
+#include <string>
+
+#include "hpack.h"
+#include "file_cache.h"
+
+class http_conn;
+
+/**
+ * @brief 交给http_conn处理的一个HTTP/2请求
+ */
+struct http2_request {
+    const char *method;     // :method
+    char *path;             // :path
+    char *authority;        // :authority，可为NULL
+    const char *fields;     // 普通请求头，依次为name\0value\0
+    int field_count;        // 普通请求头数量
+    const char *body;       // 请求体
+    long long body_len;     // 请求体长度
+    bool body_too_large;    // 请求体超过上限，直接返回413
+};
+
+/**
+ * @brief http_conn生成的HTTP/2响应，由会话编码成HEADERS和DATA帧
+ */
+struct http2_response {
+    int status;                              // 状态码
+    const char *content_type;                // Content-Type，NULL表示不发送
+    const char *content_encoding;            // Content-Encoding，NULL表示不发送
+    bool validators;                         // 是否发送ETag/Last-Modified/Cache-Control
+    char etag[file_info::ETAG_LEN];
+    char last_modified[file_info::DATE_LEN];
+    bool vary;                               // 是否发送Vary: Accept-Encoding
+    bool accept_ranges;                      // 是否发送Accept-Ranges: bytes
+    long long range_start;                   // Content-Range，range_total<0时不发送；
+    long long range_end;                     // range_start<0时为416的"bytes */total"
+    long long range_total;
+    const char *data;                        // 响应体
+    long long data_len;                      // 响应体长度，同时作为Content-Length
+    bool has_body;                           // 304等没有响应体的状态为false
+    char *map_addr;                          // 响应体所在的映射区，响应发完后munmap
+    long long map_len;
+    std::string mem;                         // 动态生成的响应体，data指向这里
+
+    http2_response()
+        : status(500), content_type(NULL), content_encoding(NULL), validators(false), vary(false),
+          accept_ranges(false), range_start(0), range_end(0), range_total(-1), data(NULL), data_len(0),
+          has_body(true), map_addr(NULL), map_len(0) {}
+};
+
+/**
+ * @brief HTTP/2（h2c）连接会话
+ *
+ * 支持prior knowledge和HTTP/1.1 Upgrade两种方式建立。
+ * 收到完整的请求后同步交给http_conn::serve_h2()，复用do_request的路由和文件映射逻辑；
+ * 响应体直接引用映射区，与HEADERS/控制帧一起用writev发送。
+ * 多个流按轮转方式每次发送一帧，受连接级和流级发送窗口控制，窗口用完时等待WINDOW_UPDATE
+ */
+class http2_session {
+public:
+    // 帧负载上限，即协议默认的SETTINGS_MAX_FRAME_SIZE，我们不通告更大的值
+    static const uint32_t MAX_FRAME_SIZE = 16384;
+    // 输入缓冲区大小，至少能放下一个完整的帧
+    static const int INPUT_SIZE = MAX_FRAME_SIZE + 9;
+    // 帧头缓冲区大小，每批DATA帧的9字节帧头写在这里
+    static const int OUTPUT_SIZE = 4096;
+    // 每批writev的iovec上限
+    static const int MAX_IOV = 64;
+    // 允许的最大并发流数，在SETTINGS中通告
+    static const int MAX_STREAMS = 32;
+    // 单个请求头部块和请求体的上限
+    static const size_t MAX_HEADER_BLOCK = 16384;
+    static const long long MAX_BODY = 16384;
+    // 待发送控制帧的上限：对端不停发送PING、SETTINGS却不读取应答时按连接错误处理
+    static const size_t MAX_CTRL = 65536;
+
+    // write()的结果
+    enum WRITE_RESULT {
+        WRITE_AGAIN = 0,    // socket写满，等待EPOLLOUT
+        WRITE_IDLE,         // 没有可发送的数据，等待对端的请求或WINDOW_UPDATE
+        WRITE_CLOSE         // 连接应当关闭
+    };
+
+    explicit http2_session(http_conn *conn);
+    ~http2_session();
+
+    /**
+     * @brief 以prior knowledge方式开始，连接前言的"PRI * HTTP/2.0\r\n"已由HTTP/1解析器读走
+     * @param data 前言之后已读入的数据
+     * @param len 长度
+     */
+    void start_prior_knowledge(const char *data, long len);
+
+    /**
+     * @brief 以HTTP/1.1 Upgrade方式开始，当前的HTTP/1请求成为流1
+     * @param settings HTTP2-Settings请求头的值（base64url编码的SETTINGS负载）
+     * @param data 升级请求之后已读入的数据
+     * @param len 长度
+     * @return HTTP2-Settings非法时返回false
+     */
+    bool start_upgrade(const char *settings, const char *data, long len);
+
+    /**
+     * @brief 取输入缓冲区，供read_once直接读入
+     */
+    void input(char **buf, long **idx, long *size) {
+        *buf = m_in;
+        *idx = &m_in_len;
+        *size = INPUT_SIZE;
+    }
+
+    /**
+     * @brief 处理输入缓冲区中所有完整的帧
+     */
+    void process();
+
+    /**
+     * @brief 是否有待发送的数据
+     */
+    bool want_write();
+
+    /**
+     * @brief 优雅关闭：没有活动的流时发送GOAWAY(NO_ERROR)，发完后关闭连接
+     * @return 是否已经进入关闭流程；还有流在处理时返回false，等它们结束后再调用
+     */
+    bool drain();
+
+    /**
+     * @brief 没有活动的流、未处理的输入和待发送的数据
+     */
+    bool idle() const { return m_streams.empty() && m_in_len == 0 && m_ctrl.empty() && m_iov_pos >= m_iov_count; }
+
+    /**
+     * @brief 经由所属连接发送尽可能多的数据
+     * @return 发送结果
+     */
+    WRITE_RESULT write();
+
+private:
+    // 流的状态
+    enum STREAM_STATE {
+        STREAM_OPEN = 0,    // 正在接收请求
+        STREAM_RESPONDING,  // 请求已收完，正在发送响应
+        STREAM_DONE         // 响应已全部排入发送批次，本批发完后释放
+    };
+
+    struct stream {
+        uint32_t id;
+        STREAM_STATE state;
+        int64_t window;         // 流级发送窗口，对端调整初始窗口后可能为负
+        std::string method;     // 请求的伪头部
+        std::string path;
+        std::string authority;
+        std::string fields;     // 普通请求头，name\0value\0
+        int field_count;
+        std::string body;       // 请求体
+        bool body_too_large;
+        bool got_headers;       // 已收到请求头，之后的HEADERS只能是trailer
+        bool end_stream;        // 对端已发送END_STREAM
+        std::string head;       // 编码好的HEADERS帧
+        bool head_queued;
+        const char *data;       // 待发送的响应体
+        long long remaining;
+        char *map_addr;         // 需要munmap的映射区
+        long long map_len;
+        std::string mem;        // 动态生成的响应体
+    };
+
+    bool on_frame(uint8_t type, uint8_t flags, uint32_t sid, const uint8_t *payload, uint32_t len);
+    bool on_headers(uint8_t flags, uint32_t sid, const uint8_t *payload, uint32_t len);
+    bool on_data(uint8_t flags, uint32_t sid, const uint8_t *payload, uint32_t len);
+    bool on_settings(uint8_t flags, uint32_t sid, const uint8_t *payload, uint32_t len);
+    bool on_window_update(uint32_t sid, const uint8_t *payload, uint32_t len);
+    bool on_rst_stream(uint32_t sid, const uint8_t *payload, uint32_t len);
+
+    /**
+     * @brief 应用对端的SETTINGS参数
+     * @return 0表示成功，否则为HTTP/2错误码
+     */
+    uint32_t apply_settings(const uint8_t *payload, uint32_t len);
+
+    /**
+     * @brief 连接错误：发送GOAWAY，发完后关闭连接
+     * @return 总是返回false，便于直接return
+     */
+    bool connection_error(uint32_t code);
+
+    /**
+     * @brief 新建一个流
+     */
+    stream &open_stream(uint32_t sid);
+
+    /**
+     * @brief 头部块收齐后解码，得到流的请求头
+     */
+    bool finish_headers();
+    static bool on_field(void *arg, const char *name, size_t name_len, const char *value, size_t value_len);
+
+    /**
+     * @brief 请求收完后交给http_conn处理并准备响应
+     */
+    void dispatch(stream &s);
+
+    /**
+     * @brief 把http2_response编码成HEADERS帧，响应体交给流发送
+     */
+    void encode_response(stream &s, http2_response &resp);
+
+    void send_settings();
+    void send_frame(uint8_t type, uint8_t flags, uint32_t sid, const void *payload, uint32_t len);
+    void send_rst(uint32_t sid, uint32_t code);
+    void send_goaway(uint32_t code);
+    void send_window_update(uint32_t sid, uint32_t increment);
+
+    /**
+     * @brief 组装下一批待发送的iovec
+     * @return 没有可发送的数据时返回false
+     */
+    bool fill_batch();
+
+    /**
+     * @brief 取消一个流，响应头已排入发送批次的流要等本批发完再释放
+     */
+    void cancel(std::map<uint32_t, stream>::iterator it);
+
+    /**
+     * @brief 一批数据发送完后释放已结束的流
+     */
+    void release_done();
+    static void release(stream &s);
+
+    http_conn *m_conn;              // 所属的连接
+    hpack_decoder m_decoder;        // 请求头解码器
+
+    char m_in[INPUT_SIZE];          // 输入缓冲区
+    long m_in_len;                  // 输入缓冲区中的字节数
+    const char *m_preface;          // 尚未收到的连接前言部分，NULL表示已收完
+    size_t m_preface_left;
+
+    std::map<uint32_t, stream> m_streams;  // 活动的流
+    uint32_t m_last_sid;            // 已接受的最大流ID
+    uint32_t m_next_sid;            // 轮转发送时下一个优先的流ID
+    uint32_t m_hblock_sid;          // 正在接收头部块（等待CONTINUATION）的流，0表示没有
+    bool m_hblock_end_stream;       // 该头部块的HEADERS帧是否带END_STREAM
+    std::string m_hblock;           // 头部块缓冲
+    stream *m_decoding;             // 正在解码的流，NULL表示解码后丢弃（被拒绝的流或trailer）
+    bool m_decode_ok;               // 解码出的请求头是否合法
+
+    int64_t m_send_window;          // 连接级发送窗口
+    int64_t m_initial_window;       // 对端的SETTINGS_INITIAL_WINDOW_SIZE
+    uint32_t m_recv_credit;         // 已消费、尚未通过WINDOW_UPDATE归还的接收窗口
+
+    std::string m_ctrl;             // 待发送的控制帧（SETTINGS、PING、WINDOW_UPDATE等）
+    std::string m_ctrl_sending;     // 本批正在发送的控制帧
+    char m_out[OUTPUT_SIZE];        // 本批DATA帧的帧头
+    struct iovec m_iov[MAX_IOV];    // 本批待发送的数据
+    int m_iov_count;
+    int m_iov_pos;                  // 第一个未发完的iovec
+    bool m_closing;                 // 已发送GOAWAY或对端已发送GOAWAY，发完后关闭
+};
+
+#endif
@@ -1,9 +1,21 @@
 #include "http_conn.h"
+#include "http_scan.h"
+#include "http_router.h"
+#include "../net/socket_opts.h"
+#include "../net/ip_limiter.h"
+#include "../prefork/prefork.h"
+#include "../threadpool/pool_sizing.h"
 
 #include <mysql/mysql.h>
 #include <fstream>
+#include <new>
 
 const char *ok_200_title = "OK";
+const char *partial_206_title = "Partial Content";
+const char *not_modified_304_title = "Not Modified";
+const char *error_413_title = "Payload Too Large";
+const char *error_413_form = "The request body exceeds the configured limit.\n";
+const char *error_416_title = "Range Not Satisfiable";
 const char *error_400_title = "BAD Request";
 const char *error_400_form = "Your request has bad syntax or is inherently impossible to staisfy";
 const char *error_403_title = "Forbidden";
@@ -14,9 +26,12 @@ const char *error_500_title = "Internal Error";
 const char *error_500_form = "There was an unusual problem serving the request file.\n";
 
 locker m_lock;
-map<string, string> users;
+// 透明比较器允许直接用char*查找，避免每次构造临时string
+map<string, string, less<> > users;
 
 void http_conn::initmysql_result(connection_pool *connPool) {
+    // 在任何连接init()之前调用，日志开关还没有设置，取连接池的
+    m_close_log = connPool->m_close_log;
     MYSQL *mysql = NULL;
     connectionRAII mysqlcon(&mysql, connPool);
 
@@ -33,13 +48,7 @@ void http_conn::initmysql_result(connection_pool *connPool) {
     }
 }
 
-int setnonblocking(int fd) {
-    int old_option = fcntl(fd, F_GETFL);
-    int new_option = old_option | O_NONBLOCK;
-    fcntl(fd, F_SETFL, new_option);
-    return old_option;
-}
-
+// 连接socket由accept4创建时已是非阻塞的，这里只注册事件
 void addfd(int epollfd, int fd, bool one_shot, int TRIGMode) {
     epoll_event event;
     event.data.fd = fd;
@@ -53,7 +62,6 @@ void addfd(int epollfd, int fd, bool one_shot, int TRIGMode) {
     if (one_shot)
         event.events |= EPOLLONESHOT;
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-    setnonblocking(fd);
 }
 
 void removefd(int epollfd, int fd) {
@@ -75,27 +83,80 @@ void modfd(int epollfd, int fd, int ev, int TRIGMode) {
 
 int http_conn::m_user_count = 0;
 int http_conn::m_epollfd = -1;
+bool http_conn::m_uring = false;
+bool http_conn::m_persist = false;
+bool http_conn::m_cork = true;
+volatile bool http_conn::m_draining = false;
+long long http_conn::m_max_body = 16 << 20;
+conn_timeouts http_conn::m_timeouts;
 
 void http_conn::close_conn(bool real_close) {
+    // 单线程/协程模式下连接归事件循环所有：协程把数据库请求交给线程池时这里运行在工作线程中，
+    // 立即关闭的话fd会在工作线程返回之前被新连接复用。只做标记，协程交回后由inline_close()关闭
+    if (real_close && m_persist && m_sockfd != -1) {
+        m_close_pending = true;
+        return;
+    }
     if (real_close && (m_sockfd != -1)) {
         printf("close %d\n", m_sockfd);
-        removefd(m_epollfd, m_sockfd);
+        // 先归还配额再关闭：fd一旦关闭就可能被新连接复用
+        ip_limiter::get_instance()->release(m_sockfd);
+        if (m_uring)
+            close(m_sockfd);
+        else
+            removefd(m_epollfd, m_sockfd);
         m_sockfd = -1;
         m_user_count--;
+        __atomic_sub_fetch(&prefork::get_instance()->stats()->connections, 1, __ATOMIC_RELAXED);
+    }
+    if (real_close) {
+        delete m_h2;
+        m_h2 = NULL;
+        tls_free(m_tls);
+        m_tls = NULL;
     }
 }
 
 void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMode,
-                     int close_log, string user, string passwd, string sqlname)
+                     int close_log, const string &user, const string &passwd, const string &sqlname)
 {
+    // 上一个使用者可能在流式响应中途被定时器关闭
+    finish_stream();
+    finish_sink();
+    m_arena.init();
+    delete m_h2;
+    m_h2 = NULL;
+    tls_free(m_tls);
+    m_tls = NULL;
     m_sockfd = sockfd;
     m_address = addr;
 
-    addfd(m_epollfd, sockfd, true, m_TRIGMode);
+    m_TRIGMode = TRIGMode;
+    if (m_persist) {
+        // 只有一个线程处理连接，不需要EPOLLONESHOT防止并发；读写两个方向一次注册，之后不再epoll_ctl
+        epoll_event event;
+        event.data.fd = sockfd;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+        epoll_ctl(m_epollfd, EPOLL_CTL_ADD, sockfd, &event);
+    } else if (!m_uring) {
+        addfd(m_epollfd, sockfd, true, m_TRIGMode);
+    }
+    m_events = EPOLLIN;
+    m_want = 0;
+    m_drained = false;
+    m_corked = false;
+    m_served = false;
+    m_close_pending = false;
+    // 从接入起（含TLS握手）必须在时限内收完第一个请求的请求头
+    set_deadline(timer_now_ms() + m_timeouts.header_ms);
+    ready = 0;
+    blocked = false;
     m_user_count++;
+    worker_stats *stats = prefork::get_instance()->stats();
+    __atomic_add_fetch(&stats->connections, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&stats->accepted, 1, __ATOMIC_RELAXED);
 
     doc_root = root;
-    m_TRIGMode = TRIGMode;
     m_close_log = close_log;
 
     strcpy(sql_user, user.c_str());
@@ -105,10 +166,29 @@ void http_conn::init(int sockfd, const sockaddr_in &addr, char *root, int TRIGMo
     init();
 }
 
+bool http_conn::start_tls() {
+    m_tls = tls_context::get_instance()->accept(m_sockfd);
+    return m_tls != NULL;
+}
+
 void http_conn::init() {
     mysql = NULL;
     bytes_to_send = 0;
     bytes_have_send = 0;
+    m_start_line = 0;
+    m_checked_idx = 0;
+    m_read_idx = 0;
+    m_write_idx = 0;
+    m_pending = false;
+    m_state = 0;
+    timer_flag = 0;
+    improv = 0;
+    // 缓冲区不清零：解析只依赖下标，写入的字符串都自带结尾的'\0'
+    m_write_buf[0] = '\0';
+    clear_request();
+}
+
+void http_conn::clear_request() {
     m_check_state = CHECK_STATE_REQUESTLINE;
     m_linger = false;
     m_method = GET;
@@ -116,22 +196,70 @@ void http_conn::init() {
     m_version = 0;
     m_content_length = 0;
     m_host = 0;
-    m_start_line = 0;
-    m_checked_idx = 0;
-    m_read_idx = 0;
-    m_write_idx = 0;
+    m_header_count = 0;
+    memset(m_header_index, -1, sizeof(m_header_index));
     cgi = 0;
-    m_state = 0;
-    timer_flag = 0;
-    improv = 0;
-    memset(m_read_buf, '\0', READ_BUFFER_SIZE);
-    memset(m_write_buf, '\0', WRITE_BUFFER_SIZE);
-    memset(m_real_file, '\0', FILENAME_LEN);
+    m_request_end = -1;
+    finish_sink();
+    m_body_start = 0;
+    m_body_received = 0;
+    m_expect_continue = false;
+    m_interim = false;
+    m_route = NULL;
+    m_range_start = 0;
+    m_range_end = -1;
+    m_mime = NULL;
+    m_encoding = NULL;
+    m_string = 0;
+    m_arena.reset();
+    m_real_file[0] = '\0';
+}
+
+void http_conn::reset_request() {
+    // 只保留当前请求之后已经读入的数据（流水线请求），未完整解析的请求则整体丢弃
+    long leftover = 0;
+    if (m_request_end >= 0 && m_request_end < m_read_idx) {
+        leftover = m_read_idx - m_request_end;
+        memmove(m_read_buf, m_read_buf + m_request_end, leftover);
+    }
+    init();
+    m_read_idx = leftover;
+    m_pending = leftover > 0;
+    m_served = true;
+    // 流水线中的下一个请求已经开始到达，否则进入长连接的空闲期
+    set_deadline(timer_now_ms() + (m_pending ? m_timeouts.header_ms : m_timeouts.keepalive_ms));
+}
+
+void http_conn::note_read(long n) {
+    if (n <= 0)
+        return;
+    long long now = timer_now_ms();
+    if (m_h2) {
+        // HTTP/2连接上各个流交错进行，不区分阶段，有数据到达就按空闲时限延长
+        set_deadline(now + m_timeouts.keepalive_ms);
+    } else if (m_check_state == CHECK_STATE_CONTENT) {
+        m_body_bytes += n;
+        body_deadline(now);
+    } else if (m_read_idx == n && m_check_state == CHECK_STATE_REQUESTLINE) {
+        // 新请求的第一个字节：请求头的时限从这里开始，之后陆续到达的数据不再延长
+        set_deadline(now + m_timeouts.header_ms);
+    }
+}
+
+void http_conn::body_deadline(long long now) {
+    if (m_timeouts.min_rate > 0)
+        set_deadline(m_body_since + m_timeouts.body_ms + m_body_bytes * 1000 / m_timeouts.min_rate);
+    else
+        set_deadline(now + m_timeouts.body_ms);
 }
 
 http_conn::LINE_STATUS http_conn::parse_line() {
     char temp;
     for (; m_checked_idx < m_read_idx; ++m_checked_idx) {
+        // 向量化跳过普通字符，直接落到下一个控制字符上
+        m_checked_idx += http_find_ctl(m_read_buf + m_checked_idx, m_read_idx - m_checked_idx);
+        if (m_checked_idx >= m_read_idx)
+            break;
         temp = m_read_buf[m_checked_idx];
         if (temp == '\r') {
             if ((m_checked_idx + 1) == m_read_idx)
@@ -149,39 +277,175 @@ http_conn::LINE_STATUS http_conn::parse_line() {
                 return LINE_OK;
             }
             return LINE_BAD;
+        } else {
+            // 请求行和请求头中不允许出现CRLF之外的控制字符
+            return LINE_BAD;
         }
     }
     return LINE_OPEN;
 }
 
 bool http_conn::read_once() {
-    if (m_read_idx >= READ_BUFFER_SIZE) {
+    // HTTP/2连接直接读入会话的帧缓冲区
+    char *buf = m_read_buf;
+    long *idx = &m_read_idx;
+    long size = READ_BUFFER_SIZE;
+    if (m_h2)
+        m_h2->input(&buf, &idx, &size);
+    m_drained = false;
+    if (*idx >= size) {
         return false;
     }
+    if (m_tls)
+        return read_tls(buf, idx, size);
     int bytes_read = 0;
     if (0 == m_TRIGMode) {
-        bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE-m_read_idx, 0);
-        m_read_idx += bytes_read;
+        bytes_read = recv(m_sockfd, buf + *idx, size - *idx, 0);
+        if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && *idx > 0) {
+            // 缓冲区里还有上一轮留下的流水线请求，没有新数据也可以继续处理
+            return true;
+        }
         if (bytes_read <= 0) {
             return false;
         }
+        *idx += bytes_read;
+        note_read(bytes_read);
         return true;
     } else {
-        while (true) {
-            bytes_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+        long start = *idx;
+        while (*idx < size) {
+            // 缓冲区读满时先交给process()消费（大请求体会交给接收方腾出空间），
+            // 剩下的数据在重新注册EPOLLIN时会再次触发
+            bytes_read = recv(m_sockfd, buf + *idx, size - *idx, 0);
             if (bytes_read == -1) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    m_drained = true;
                     break;
+                }
                 return false;
             } else if (bytes_read == 0) {
                 return false;
             }
-            m_read_idx += bytes_read;
+            *idx += bytes_read;
         }
+        note_read(*idx - start);
         return true;
     }
 }
 
+bool http_conn::read_tls(char *buf, long *idx, long size) {
+    if (!tls_established(m_tls)) {
+        TLS_RESULT r = tls_handshake(m_tls);
+        if (r == TLS_ERROR)
+            return false;
+        if (r != TLS_OK) {
+            m_drained = true;   // 握手在等待socket，对端的下一段数据会带来新的事件
+            return true;
+        }
+        LOG_INFO("tls handshake done, fd %d, ktls send: %d", m_sockfd, tls_ktls_send(m_tls));
+    }
+    // 不论触发模式都要读到EAGAIN：已解密的数据留在OpenSSL中时不会再有可读事件
+    long start = *idx;
+    while (*idx < size) {
+        ssize_t n = tls_recv(m_tls, buf + *idx, size - *idx);
+        if (n > 0) {
+            *idx += n;
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            m_drained = true;
+            break;
+        }
+        return false;
+    }
+    note_read(*idx - start);
+    return true;
+}
+
+void http_conn::rearm(int ev) {
+    if (m_uring || m_persist) {
+        m_want = ev;
+        return;
+    }
+    if (ev == m_events)
+        return;
+    // 先记录再注册：事件可能在epoll_ctl返回前就在主线程触发，fired()必须晚于这里的赋值
+    m_events = ev;
+    modfd(m_epollfd, m_sockfd, ev, m_TRIGMode);
+}
+
+bool http_conn::idle() const {
+    // io_uring和单线程模式只有事件循环一个线程；线程池模式下其他注册状态说明连接正在处理或发送
+    if (!m_uring && !m_persist && m_events != EPOLLIN)
+        return false;
+    if (m_pending || (m_tls && tls_pending(m_tls)))
+        return false;
+    if (m_h2)
+        return m_h2->idle();
+    // 刚接入的连接可能正在发来第一个请求，关闭会让客户端收到空响应
+    return m_served && m_check_state == CHECK_STATE_REQUESTLINE && m_read_idx == 0 && bytes_to_send == 0 &&
+           !m_body && !m_sink;
+}
+
+long http_conn::feed(const char *data, long len) {
+    char *buf = m_read_buf;
+    long *idx = &m_read_idx;
+    long size = READ_BUFFER_SIZE;
+    if (m_h2)
+        m_h2->input(&buf, &idx, &size);
+    if (*idx >= size)
+        return -1;
+    long n = size - *idx < len ? size - *idx : len;
+    memcpy(buf + *idx, data, n);
+    *idx += n;
+    note_read(n);
+    return n;
+}
+
+ssize_t http_conn::send_iov(const struct iovec *iov, int count) {
+    if (m_tls)
+        return tls_writev(m_tls, iov, count);
+    return writev(m_sockfd, iov, count);
+}
+
+/**
+ * @brief 路由对应的任务类别：登录、注册要查询或写入数据库，/metrics可以延后，其余都是快速请求
+ */
+static int task_class_of(const route *r) {
+    if (!r)
+        return TASK_FAST;
+    switch (r->handler) {
+    case ROUTE_LOGIN:
+    case ROUTE_REGISTER:
+        return TASK_DB;
+    case ROUTE_METRICS:
+        return TASK_BACKGROUND;
+    default:
+        return TASK_FAST;
+    }
+}
+
+int http_conn::classify() {
+    if (m_h2)
+        return TASK_FAST;
+    if (m_check_state != CHECK_STATE_REQUESTLINE)
+        return m_task_class;
+    // 请求行形如"POST /3?x HTTP/1.1"，路径到空格或'?'为止；还没收全时先按快速请求排队
+    const char *p = m_read_buf + m_start_line;
+    const char *end = m_read_buf + m_read_idx;
+    const char *sp = (const char *)memchr(p, ' ', end - p);
+    if (!sp)
+        return m_task_class = TASK_FAST;
+    int mask = (sp - p == 4 && strncasecmp(p, "POST", 4) == 0) ? 1 << POST : 1 << GET;
+    const char *url = sp + 1;
+    const char *url_end = url;
+    while (url_end < end && *url_end != ' ' && *url_end != '?' && *url_end != '\r')
+        ++url_end;
+    if (url_end == end)
+        return m_task_class = TASK_FAST;
+    return m_task_class = task_class_of(http_router::get_instance()->match(url, url_end - url, mask));
+}
+
 http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
     m_url = strpbrk(text, " \t");
     if (!m_url) {
@@ -189,6 +453,11 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
     }
     *m_url++ = '\0';
     char *method = text;
+    // HTTP/2连接前言的第一行："PRI * HTTP/2.0"
+    if (strcmp(method, "PRI") == 0 && strcmp(m_url, "* HTTP/2.0") == 0) {
+        m_task_class = TASK_FAST;
+        return HTTP2_PREFACE;
+    }
     if (strcasecmp(method, "GET") == 0)
         m_method = GET;
     else if (strcasecmp(method, "POST") == 0) {
@@ -218,9 +487,10 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
 
     if (!m_url || m_url[0] != '/')
         return BAD_REQUEST;
-    if (strlen(m_url) == 1) {
-        strcat(m_url, "judge.html");
-    }
+    // 请求体还没到齐时，之后的读事件按这个类别排队
+    const route *r = http_router::get_instance()->match(m_url, strcspn(m_url, "?"), 1 << m_method);
+    m_route = r;
+    m_task_class = task_class_of(r);
     m_check_state = CHECK_STATE_HEADER;
     return NO_REQUEST;
 }
@@ -228,48 +498,181 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
 http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
     if (text[0] == '\0') {
         if (m_content_length != 0) {
+            // 请求体还没开始读就按Content-Length拒绝，不必等上传完
+            if (m_content_length > m_max_body) {
+                m_linger = false;
+                return PAYLOAD_TOO_LARGE;
+            }
+            m_body_start = m_checked_idx;
+            if (m_checked_idx + m_content_length > READ_BUFFER_SIZE) {
+                if (m_checked_idx >= READ_BUFFER_SIZE)
+                    return BAD_REQUEST;
+                HTTP_CODE ret = start_sink();
+                if (ret != NO_REQUEST)
+                    return ret;
+            }
+            // 客户端在等待100 Continue时才发送请求体，由process()按普通响应发出
+            m_expect_continue = m_read_idx == m_checked_idx &&
+                                http_header_has_token(get_header(HDR_EXPECT), "100-continue");
             m_check_state  =CHECK_STATE_CONTENT;
+            // 请求体阶段：和请求头一起到达的部分也计入
+            m_body_since = timer_now_ms();
+            m_body_bytes = m_read_idx - m_checked_idx;
+            body_deadline(m_body_since);
             return NO_REQUEST;
         }
+        m_request_end = m_checked_idx;
+        // 只升级没有请求体的请求，带请求体的按HTTP/1.1处理
+        if (http_header_has_token(get_header(HDR_UPGRADE), "h2c") &&
+            http_header_has_token(get_header(HDR_CONNECTION), "upgrade") && get_header(HDR_HTTP2_SETTINGS))
+            return HTTP2_UPGRADE;
         return GET_REQUEST;
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0)
-    {
-        text += 11;
-        text += strspn(text, " \t");
-        if (strcasecmp(text, "keep-alive") == 0)
-        {
-            m_linger = true;
-        }
-    }
-    else if (strncasecmp(text, "Content-length:", 15) == 0)
-    {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);
-    }
-    else if (strncasecmp(text, "Host:", 5) == 0)
+
+    // 名称与冒号之间不允许有空白，也不支持已废弃的折行写法
+    char *colon = strchr(text, ':');
+    if (!colon || colon == text || colon[-1] == ' ' || colon[-1] == '\t')
+        return BAD_REQUEST;
+    if (m_header_count >= MAX_HEADERS)
+        return BAD_REQUEST;
+
+    *colon = '\0';
+    char *value = colon + 1;
+    value += strspn(value, " \t");
+    int value_len = strlen(value);
+    while (value_len > 0 && (value[value_len - 1] == ' ' || value[value_len - 1] == '\t'))
+        --value_len;
+    value[value_len] = '\0';
+
+    http_header &h = m_headers[m_header_count];
+    h.name = text;
+    h.name_len = colon - text;
+    h.value = value;
+    h.value_len = value_len;
+    h.id = http_header_lookup(text, h.name_len);
+    if (h.id != HDR_UNKNOWN && m_header_index[h.id] < 0)
+        m_header_index[h.id] = m_header_count;
+    ++m_header_count;
+
+    switch (h.id) {
+    case HDR_CONNECTION:
+        m_linger = http_header_has_token(value, "keep-alive");
+        break;
+    case HDR_CONTENT_LENGTH:
     {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;
+        char *end;
+        errno = 0;
+        m_content_length = strtoll(value, &end, 10);
+        if (end == value || *end != '\0' || m_content_length < 0 || errno == ERANGE)
+            return BAD_REQUEST;
+        break;
     }
-    else
-    {
-        LOG_INFO("oop!unknow header: %s", text);
+    case HDR_HOST:
+        m_host = value;
+        break;
+    default:
+        break;
     }
     return NO_REQUEST;
 }
 
 http_conn::HTTP_CODE http_conn::parse_content(char *text) {
+    if (m_sink)
+        return sink_content();
     if (m_read_idx >= (m_content_length + m_checked_idx)) {
-        text[m_content_length] = '\0';
+        // 请求体之后可能紧跟着下一个流水线请求，不能再写'\0'截断，按m_content_length取用
+        m_request_end = m_checked_idx + m_content_length;
         m_string = text;
         return GET_REQUEST;
     }
     return NO_REQUEST;
 }
 
+/**
+ * @brief 登录、注册表单的接收方：拼接到请求内存池中，收完后作为m_string交给表单解析
+ */
+class form_sink : public body_sink {
+public:
+    form_sink(char *buf, char **out) : m_buf(buf), m_len(0), m_out(out) {}
+
+    bool consume(const char *data, long len) {
+        // 缓冲区按Content-Length分配，http_conn交出的总长度不会超过它
+        memcpy(m_buf + m_len, data, len);
+        m_len += len;
+        return true;
+    }
+
+    bool finish() {
+        *m_out = m_buf;
+        return true;
+    }
+
+private:
+    char *m_buf;    // 请求内存池中的缓冲区
+    long m_len;     // 已收到的字节数
+    char **m_out;   // 收完后写入的请求体指针
+};
+
+/**
+ * @brief 不使用请求体的路由（静态文件、固定页面）的接收方：读出后直接丢弃，
+ *        连接上的下一个请求照常解析
+ */
+class discard_sink : public body_sink {
+public:
+    bool consume(const char *, long) { return true; }
+};
+
+http_conn::HTTP_CODE http_conn::start_sink() {
+    void *mem;
+    int handler = m_route ? m_route->handler : ROUTE_STATIC;
+    if (handler == ROUTE_LOGIN || handler == ROUTE_REGISTER) {
+        // 表单字段还要复制一份并拼进SQL语句，都在同一个内存池里，只接受较短的表单
+        if (m_content_length > FORM_MAX_BODY) {
+            m_linger = false;
+            return PAYLOAD_TOO_LARGE;
+        }
+        char *buf = (char *)m_arena.alloc(m_content_length, 1);
+        mem = m_arena.alloc(sizeof(form_sink), alignof(form_sink));
+        if (!buf || !mem)
+            return INTERNAL_ERROR;
+        m_sink = new (mem) form_sink(buf, &m_string);
+    } else {
+        mem = m_arena.alloc(sizeof(discard_sink), alignof(discard_sink));
+        if (!mem)
+            return INTERNAL_ERROR;
+        m_sink = new (mem) discard_sink();
+    }
+    return NO_REQUEST;
+}
+
+void http_conn::finish_sink() {
+    if (m_sink) {
+        m_sink->~body_sink();
+        m_sink = NULL;
+    }
+}
+
+http_conn::HTTP_CODE http_conn::sink_content() {
+    // 把请求头之后已读入的数据交给接收方，再把这段空间让给后续的数据；
+    // 请求头仍留在缓冲区开头，m_url等指针保持有效
+    long long need = m_content_length - m_body_received;
+    long long n = m_read_idx - m_checked_idx;
+    if (n > need)
+        n = need;
+    if (n > 0 && !m_sink->consume(m_read_buf + m_checked_idx, n))
+        return INTERNAL_ERROR;
+    m_body_received += n;
+    m_checked_idx += n;
+    if (m_body_received < m_content_length) {
+        m_read_idx = m_checked_idx = m_start_line = m_body_start;
+        return NO_REQUEST;
+    }
+    m_request_end = m_checked_idx;
+    if (!m_sink->finish())
+        return INTERNAL_ERROR;
+    return GET_REQUEST;
+}
+
 http_conn::HTTP_CODE http_conn::process_read() {
     LINE_STATUS line_status = LINE_OK;
     HTTP_CODE ret = NO_REQUEST;
@@ -278,22 +681,22 @@ http_conn::HTTP_CODE http_conn::process_read() {
     while ((m_check_state == CHECK_STATE_CONTENT && line_status == LINE_OK) || ((line_status = parse_line()) == LINE_OK)) {
         text = get_line();
         m_start_line = m_checked_idx;
-        LOG_INFO("%s", text);
         switch (m_check_state) {
         case CHECK_STATE_REQUESTLINE:
         {
+            LOG_INFO("%s", text);
             ret = parse_request_line(text);
-            if (ret == BAD_REQUEST)
-                return BAD_REQUEST;
+            if (ret != NO_REQUEST)
+                return ret;
             break;
         }
         case CHECK_STATE_HEADER:
         {
             ret = parse_headers(text);
-            if (ret == BAD_REQUEST)
-                return BAD_REQUEST;
-            else if (ret == GET_REQUEST)
+            if (ret == GET_REQUEST)
                 return do_request();
+            else if (ret != NO_REQUEST)
+                return ret;
             break;
         }
         case CHECK_STATE_CONTENT:
@@ -301,6 +704,8 @@ http_conn::HTTP_CODE http_conn::process_read() {
             ret = parse_content(text);
             if (ret == GET_REQUEST)
                 return do_request();
+            if (ret != NO_REQUEST)
+                return ret;
             line_status = LINE_OPEN;
             break;
         }
@@ -311,152 +716,490 @@ http_conn::HTTP_CODE http_conn::process_read() {
     return NO_REQUEST;
 }
 
-http_conn::HTTP_CODE http_conn::do_request() {
-    strcpy(m_real_file, doc_root);
-    int len = strlen(doc_root);
-    const char *p = strrchr(m_url, '/');
-
-    if (cgi == 1 && (*(p+1) == '2' || *(p+1) == '3')) {
-        char flag = m_url[1];
-        char *m_url_real = (char *)malloc(sizeof(char) * 200);
-        strcpy(m_url_real, "/");
-        strcpy(m_url_real, m_url + 2);
-        strncpy(m_real_file + len, m_url_real, FILENAME_LEN - len - 1);
-        free(m_url_real);
-
-        char name[100], password[100];
-        int i;
-        for (i = 5; m_string[i] != '&'; ++i)
-            name[i-5] = m_string[i];
-        name[i-5] = '\0';
-
-        int j = 0;
-        for (i=i+10; m_string[i] != '\0'; ++i, ++j) {
-            password[j] = m_string[i];
-        }
-        password[j] = '\0';
-
-        if (*(p+1) == '3') {
-            char *sql_insert = (char *)malloc(sizeof(char) * 200);
-            strcpy(sql_insert, "INSERT INTO user(username, passwd) VALUES(");
-            strcat(sql_insert, "'");
-            strcat(sql_insert, name);
-            strcat(sql_insert, "', '");
-            strcat(sql_insert, password);
-            strcat(sql_insert, "')");
-
-            if (users.find(name) == users.end()) {
-                m_lock.lock();
-                int res = mysql_query(mysql, sql_insert);
-                users.insert(pair<string, string>(name, password));
-                m_lock.unlock();
-
-                if (!res)
-                    strcpy(m_url, "/log.html");
-                else 
-                    strcpy(m_url, "/registerError.html");
-            } else {
-                strcpy(m_url, "/registerError.html");
+bool http_conn::parse_form(const char **name, const char **password) {
+    // 表单格式：user=xxx&password=yyy，字段拷贝到内存池中
+    // 请求体不以'\0'结尾，所有比较都限定在m_content_length之内
+    if (!m_string || m_content_length < 5 || strncmp(m_string, "user=", 5) != 0)
+        return false;
+    const char *p = m_string + 5;
+    const char *end = m_string + m_content_length;
+    const char *amp = (const char *)memchr(p, '&', end - p);
+    if (!amp || end - amp < 10 || strncmp(amp, "&password=", 10) != 0)
+        return false;
+    *name = m_arena.strndup(p, amp - p);
+
+    p = amp + 10;
+    *password = m_arena.strndup(p, end - p);
+    return *name && *password;
+}
+
+bool http_conn::do_login() {
+    const char *name, *password;
+    if (!parse_form(&name, &password))
+        return false;
+    map<string, string, less<> >::iterator it = users.find(name);
+    return it != users.end() && it->second == password;
+}
+
+bool http_conn::do_register() {
+    const char *name, *password;
+    if (!parse_form(&name, &password))
+        return false;
+    if (users.find(name) != users.end())
+        return false;
+
+    static const char *fmt = "INSERT INTO user(username, passwd) VALUES('%s', '%s')";
+    int size = strlen(fmt) + strlen(name) + strlen(password);
+    char *sql_insert = (char *)m_arena.alloc(size, 1);
+    if (!sql_insert)
+        return false;
+    snprintf(sql_insert, size, fmt, name, password);
+    m_lock.lock();
+    int res = mysql_query(mysql, sql_insert);
+    users.insert(pair<string, string>(name, password));
+    m_lock.unlock();
+    return !res;
+}
+
+/**
+ * @brief /metrics的数据源，按Prometheus文本格式逐项输出
+ */
+class metrics_source : public body_source {
+public:
+    metrics_source() : m_step(0) {
+        // 先汇总全部工作进程的计数器，多进程模式下从任一进程都能看到整体
+        memset(&m_total, 0, sizeof(m_total));
+        m_slots = prefork::get_instance()->slots(&m_count);
+        for (int i = 0; i < m_count; ++i) {
+            m_total.connections += __atomic_load_n(&m_slots[i].connections, __ATOMIC_RELAXED);
+            m_total.accepted += __atomic_load_n(&m_slots[i].accepted, __ATOMIC_RELAXED);
+            m_total.requests += __atomic_load_n(&m_slots[i].requests, __ATOMIC_RELAXED);
+            m_total.restarts += __atomic_load_n(&m_slots[i].restarts, __ATOMIC_RELAXED);
+            m_total.limited_rate += __atomic_load_n(&m_slots[i].limited_rate, __ATOMIC_RELAXED);
+            m_total.limited_conns += __atomic_load_n(&m_slots[i].limited_conns, __ATOMIC_RELAXED);
+            const pool_stats &p = m_slots[i].pool;
+            m_total.pool.threads += __atomic_load_n(&p.threads, __ATOMIC_RELAXED);
+            m_total.pool.active += __atomic_load_n(&p.active, __ATOMIC_RELAXED);
+            for (int c = 0; c < TASK_CLASSES; ++c) {
+                m_total.pool.queued[c] += __atomic_load_n(&p.queued[c], __ATOMIC_RELAXED);
+                m_total.pool.tasks[c] += __atomic_load_n(&p.tasks[c], __ATOMIC_RELAXED);
+                m_total.pool.wait_us[c] += __atomic_load_n(&p.wait_us[c], __ATOMIC_RELAXED);
             }
+            m_total.pool.grown += __atomic_load_n(&p.grown, __ATOMIC_RELAXED);
+            m_total.pool.shrunk += __atomic_load_n(&p.shrunk, __ATOMIC_RELAXED);
         }
-        else if (*(p+1) == '2') {
-            if (users.find(name) != users.end() && users[name] == password)
-                strcpy(m_url, "/welcome.html");
-            else 
-                strcpy(m_url, "/logError.html");
-        }
-    }
-
-    if (*(p+1) == '0') {
-        char *m_url_real = (char*) malloc(sizeof(char)*200);
-        strcpy(m_url_real, "/register.html");
-        strncpy(m_real_file+len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
-    } else if (*(p+1) == '1') {
-        char *m_url_real = (char*) malloc(sizeof(char)*200);
-        strcpy(m_url_real, "/log.html");
-        strncpy(m_real_file+len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
-    } else if (*(p+1) == '5') {
-        char *m_url_real = (char*) malloc(sizeof(char)*200);
-        strcpy(m_url_real, "/picture.html");
-        strncpy(m_real_file+len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
-    } else if (*(p+1) == '6') {
-        char *m_url_real = (char*) malloc(sizeof(char)*200);
-        strcpy(m_url_real, "/video.html");
-        strncpy(m_real_file+len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
-    } else if (*(p+1) == '7') {
-        char *m_url_real = (char*) malloc(sizeof(char)*200);
-        strcpy(m_url_real, "/fans.html");
-        strncpy(m_real_file+len, m_url_real, strlen(m_url_real));
-        free(m_url_real);
-    } else 
-        strncpy(m_real_file+len, m_url, FILENAME_LEN-len-1);
-    
-    if (stat(m_real_file, &m_file_stat) < 0) 
+    }
+
+    int produce(char *buf, int size) {
+        int n = 0;
+        int step = m_step++;
+        if (step == 0) {
+            n = snprintf(buf, size,
+                         "# TYPE tinywebserver_connections gauge\n"
+                         "tinywebserver_connections %d\n"
+                         "# TYPE tinywebserver_accepted_total counter\n"
+                         "tinywebserver_accepted_total %llu\n"
+                         "# TYPE tinywebserver_requests_total counter\n"
+                         "tinywebserver_requests_total %llu\n"
+                         "# TYPE tinywebserver_limited_total counter\n"
+                         "tinywebserver_limited_total{reason=\"rate\"} %llu\n"
+                         "tinywebserver_limited_total{reason=\"conns\"} %llu\n",
+                         m_total.connections, m_total.accepted, m_total.requests,
+                         m_total.limited_rate, m_total.limited_conns);
+        } else if (step == 1) {
+            // 排队时间的累计值除以任务数即平均排队时间，按任务类别分开；单线程模式没有线程池，全部为0
+            const pool_stats &p = m_total.pool;
+            n = snprintf(buf, size,
+                         "# TYPE tinywebserver_pool_threads gauge\n"
+                         "tinywebserver_pool_threads %d\n"
+                         "# TYPE tinywebserver_pool_active_threads gauge\n"
+                         "tinywebserver_pool_active_threads %d\n"
+                         "# TYPE tinywebserver_pool_resizes_total counter\n"
+                         "tinywebserver_pool_resizes_total{direction=\"grow\"} %llu\n"
+                         "tinywebserver_pool_resizes_total{direction=\"shrink\"} %llu\n"
+                         "# TYPE tinywebserver_pool_queue_depth gauge\n"
+                         "tinywebserver_pool_queue_depth{class=\"fast\"} %d\n"
+                         "tinywebserver_pool_queue_depth{class=\"db\"} %d\n"
+                         "tinywebserver_pool_queue_depth{class=\"background\"} %d\n"
+                         "# TYPE tinywebserver_pool_tasks_total counter\n"
+                         "tinywebserver_pool_tasks_total{class=\"fast\"} %llu\n"
+                         "tinywebserver_pool_tasks_total{class=\"db\"} %llu\n"
+                         "tinywebserver_pool_tasks_total{class=\"background\"} %llu\n"
+                         "# TYPE tinywebserver_pool_queue_wait_seconds_total counter\n"
+                         "tinywebserver_pool_queue_wait_seconds_total{class=\"fast\"} %.6f\n"
+                         "tinywebserver_pool_queue_wait_seconds_total{class=\"db\"} %.6f\n"
+                         "tinywebserver_pool_queue_wait_seconds_total{class=\"background\"} %.6f\n",
+                         p.threads, p.active, p.grown, p.shrunk,
+                         p.queued[TASK_FAST], p.queued[TASK_DB], p.queued[TASK_BACKGROUND],
+                         p.tasks[TASK_FAST], p.tasks[TASK_DB], p.tasks[TASK_BACKGROUND],
+                         p.wait_us[TASK_FAST] / 1e6, p.wait_us[TASK_DB] / 1e6,
+                         p.wait_us[TASK_BACKGROUND] / 1e6);
+        } else if (!prefork::get_instance()->active()) {
+            return 0;
+        } else if (step == 2) {
+            n = snprintf(buf, size,
+                         "# TYPE tinywebserver_worker_restarts_total counter\n"
+                         "tinywebserver_worker_restarts_total %llu\n"
+                         "# TYPE tinywebserver_worker_connections gauge\n"
+                         "# TYPE tinywebserver_worker_requests_total counter\n",
+                         m_total.restarts);
+        } else if (step - 3 < m_count) {
+            // 每个工作进程一组，带worker和pid标签
+            const worker_stats &w = m_slots[step - 3];
+            int pid = __atomic_load_n(&w.pid, __ATOMIC_RELAXED);
+            n = snprintf(buf, size,
+                         "tinywebserver_worker_connections{worker=\"%d\",pid=\"%d\"} %d\n"
+                         "tinywebserver_worker_requests_total{worker=\"%d\",pid=\"%d\"} %llu\n",
+                         step - 3, pid, __atomic_load_n(&w.connections, __ATOMIC_RELAXED),
+                         step - 3, pid, __atomic_load_n(&w.requests, __ATOMIC_RELAXED));
+        } else {
+            return 0;
+        }
+        return (n < 0 || n >= size) ? -1 : n;
+    }
+
+private:
+    int m_step;                  // 已经输出的指标项数
+    worker_stats m_total;        // 开始响应时全部进程的合计
+    const worker_stats *m_slots; // 各工作进程的计数器
+    int m_count;                 // 工作进程数量
+};
+
+http_conn::HTTP_CODE http_conn::do_request() {
+    __atomic_add_fetch(&prefork::get_instance()->stats()->requests, 1, __ATOMIC_RELAXED);
+    // 查询串不参与路由和文件映射
+    int path_len = strcspn(m_url, "?");
+    const route *r = http_router::get_instance()->match(m_url, path_len, 1 << m_method);
+    if (!r)
+        return BAD_REQUEST;
+
+    const route_file *target = NULL;
+    switch (r->handler) {
+    case ROUTE_PAGE:
+        target = &r->file;
+        break;
+    case ROUTE_LOGIN:
+        target = do_login() ? &r->file : &r->fail;
+        break;
+    case ROUTE_REGISTER:
+        target = do_register() ? &r->file : &r->fail;
+        break;
+    case ROUTE_METRICS:
+        return DYNAMIC_REQUEST;
+    case ROUTE_STATIC:
+    default:
+    {
+        int len = strlen(doc_root);
+        if (len + path_len >= FILENAME_LEN)
+            return BAD_REQUEST;
+        memcpy(m_real_file, doc_root, len);
+        memcpy(m_real_file + len, m_url, path_len);
+        m_real_file[len + path_len] = '\0';
+        break;
+    }
+    }
+    if (target) {
+        if (target->len == 0)
+            return NO_RESOURCE;
+        memcpy(m_real_file, target->path, target->len + 1);
+    }
+
+    file_cache *cache = file_cache::get_instance();
+    if (!cache->lookup(m_real_file, &m_file))
         return NO_RESOURCE;
 
-    if (!(m_file_stat.st_mode & S_IROTH)) 
+    if (!(m_file.st.st_mode & S_IROTH)) 
         return FORBIDDEN_REQUEST;
     
-    if (S_ISDIR(m_file_stat.st_mode))
+    if (S_ISDIR(m_file.st.st_mode))
         return BAD_REQUEST;
-    
+
+    m_mime = http_mime_lookup(m_real_file);
+    if (m_mime->compressible)
+        select_encoding();
+
+    // 缓存的元数据足以判断304，无需打开文件
+    if (not_modified())
+        return NOT_MODIFIED;
+
     int fd = open(m_real_file, O_RDONLY);
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (fd < 0)
+        return NO_RESOURCE;
+    // 缓存可能落后于文件的实际状态，以打开的文件为准，避免按旧的大小映射
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NO_RESOURCE;
+    }
+    if (!file_cache::same_version(st, m_file.st)) {
+        cache->update(m_real_file, st, &m_file);
+        if (not_modified()) {
+            close(fd);
+            return NOT_MODIFIED;
+        }
+    }
+    RANGE_RESULT range = range_request();
+    if (range == RANGE_UNSATISFIABLE) {
+        close(fd);
+        return RANGE_NOT_SATISFIABLE;
+    }
+    if (m_file.st.st_size > 0) {
+        m_file_address = (char *)mmap(0, m_file.st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m_file_address == MAP_FAILED) {
+            m_file_address = 0;
+            close(fd);
+            return INTERNAL_ERROR;
+        }
+    }
     close(fd);
-    return FILE_REQUEST;
+    return range == RANGE_OK ? PARTIAL_CONTENT : FILE_REQUEST;
+}
+
+void http_conn::select_encoding() {
+    // 只发送离线生成好的.br/.gz，请求线程上从不做压缩
+    static const struct {
+        const char *name;
+        const char *suffix;
+    } encodings[] = { { "br", ".br" }, { "gzip", ".gz" } };
+
+    const char *accept = get_header(HDR_ACCEPT_ENCODING);
+    if (!accept)
+        return;
+    int any = http_header_token_q(accept, "*");
+    size_t len = strlen(m_real_file);
+    if (len + 4 > FILENAME_LEN)
+        return;
+    for (size_t i = 0; i < sizeof(encodings) / sizeof(encodings[0]); ++i) {
+        int q = http_header_token_q(accept, encodings[i].name);
+        if (q < 0)
+            q = any;
+        if (q <= 0)
+            continue;
+        memcpy(m_real_file + len, encodings[i].suffix, 4);
+        file_info variant;
+        // 比原文件旧的压缩文件说明没有重新生成，不能使用；压缩文件缺失的结果也缓存
+        if (file_cache::get_instance()->lookup(m_real_file, &variant, true) && S_ISREG(variant.st.st_mode) &&
+            (variant.st.st_mode & S_IROTH) && variant.st.st_mtime >= m_file.st.st_mtime) {
+            m_file = variant;
+            m_encoding = encodings[i].name;
+            return;
+        }
+        m_real_file[len] = '\0';
+    }
+}
+
+RANGE_RESULT http_conn::range_request() {
+    if (m_method != GET)
+        return RANGE_NONE;
+    const char *range = get_header(HDR_RANGE);
+    if (!range)
+        return RANGE_NONE;
+    // If-Range与当前版本不符时忽略Range，直接返回完整的新版本；
+    // ETag按强比较，弱ETag和无法解析的日期都视为不符
+    const char *if_range = get_header(HDR_IF_RANGE);
+    if (if_range) {
+        if (if_range[0] == '"') {
+            if (strcmp(if_range, m_file.etag) != 0)
+                return RANGE_NONE;
+        } else {
+            time_t t;
+            if (!http_parse_date(if_range, &t) || t != m_file.st.st_mtime)
+                return RANGE_NONE;
+        }
+    }
+    return http_parse_range(range, m_file.st.st_size, &m_range_start, &m_range_end);
+}
+
+bool http_conn::not_modified() {
+    // 条件请求只对GET生效；If-None-Match优先于If-Modified-Since
+    if (m_method != GET)
+        return false;
+    const char *inm = get_header(HDR_IF_NONE_MATCH);
+    if (inm)
+        return http_etag_match(inm, m_file.etag);
+    const char *ims = get_header(HDR_IF_MODIFIED_SINCE);
+    time_t since;
+    if (ims && http_parse_date(ims, &since))
+        return m_file.st.st_mtime <= since;
+    return false;
 }
 
 void http_conn::unmap() {
+    finish_stream();
+    finish_sink();
     if (m_file_address) {
-        munmap(m_file_address, m_file_stat.st_size);
+        munmap(m_file_address, m_file.st.st_size);
         m_file_address = 0;
     }
 }
 
 bool http_conn::write() {
-    int temp = 0;
-    if (bytes_to_send == 0) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-        init();
+    if (m_tls && !tls_established(m_tls)) {
+        // 握手过程中socket写满，继续握手
+        TLS_RESULT r = tls_handshake(m_tls);
+        if (r == TLS_ERROR)
+            return false;
+        if (r == TLS_WANT_WRITE)
+            rearm(EPOLLOUT);
+        else if (!pending_request())
+            rearm(EPOLLIN);
+        return true;
+    }
+    if (m_h2) {
+        switch (m_h2->write()) {
+        case http2_session::WRITE_AGAIN:
+            set_deadline(timer_now_ms() + m_timeouts.write_ms);
+            rearm(EPOLLOUT);
+            return true;
+        case http2_session::WRITE_IDLE:
+            // 优雅退出期间，最后一个流发完后发送GOAWAY
+            if (m_draining && m_h2->drain()) {
+                rearm(EPOLLOUT);
+                return true;
+            }
+            if (!pending_request())
+                rearm(EPOLLIN);
+            return true;
+        default:
+            return false;
+        }
+    }
+    if (bytes_to_send == 0 && !m_body) {
+        reset_request();
+        if (!pending_request())
+            rearm(EPOLLIN);
         return true;
     }
 
     while (1) {
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        struct iovec *iov;
+        int count;
+        SEND_RESULT r = next_send(&iov, &count);
+        if (r == SEND_DONE) {
+            // 缓冲区中还有流水线请求时保持未注册状态，由调用方直接派发处理，
+            // 避免同时被EPOLLIN再次触发
+            if (!pending_request())
+                rearm(EPOLLIN);
+            return true;
+        }
+        if (r == SEND_CLOSE)
+            return false;
+
+        ssize_t temp = send_iov(iov, count);
         if (temp < 0) {
             if (errno == EAGAIN) {
-                modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+                rearm(EPOLLOUT);
                 return true;
             }
             unmap();
             return false;
         }
+        sent(temp);
+    }
+}
 
-        bytes_have_send += temp;
-        bytes_to_send -= temp;
-        if (bytes_have_send >= m_iv[0].iov_len) {
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
-        } else {
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
+http_conn::SEND_RESULT http_conn::next_send(struct iovec **iov, int *count) {
+    if (m_body && m_cork && !m_corked) {
+        // 流式响应分多次写出，每块末尾的小报文段在TCP_NODELAY下会立即发出，期间先攒满报文段
+        m_corked = socket_opts::set_cork(m_sockfd, true);
+    }
+    while (bytes_to_send <= 0) {
+        if (m_interim) {
+            // 100 Continue已发出：请求还没处理完，不复位也不关闭，请求体的时限从现在开始
+            m_interim = false;
+            m_body_since = timer_now_ms();
+            body_deadline(m_body_since);
+            return SEND_DONE;
         }
-
-        if (bytes_to_send <= 0) {
-            unmap();
-            modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
-            if (m_linger) {
-                init();
-                return true;
-            } else {
-                return false;
+        if (m_body) {
+            // 上一块已经全部写出，再向数据源要下一块
+            int len = next_chunk(&m_iv[0]);
+            if (len < 0) {
+                unmap();
+                return SEND_CLOSE;
             }
+            m_iv_count = 1;
+            bytes_to_send = len;
+            continue;
         }
+        if (m_corked) {
+            socket_opts::set_cork(m_sockfd, false);
+            m_corked = false;
+        }
+        unmap();
+        if (!m_linger)
+            return SEND_CLOSE;
+        reset_request();
+        return SEND_DONE;
+    }
+    *iov = m_iv;
+    *count = m_iv_count;
+    return SEND_MORE;
+}
+
+void http_conn::queue_continue() {
+    static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    m_expect_continue = false;
+    // 只占用写缓冲区，不改动m_write_idx，最终响应从头写入
+    memcpy(m_write_buf, CONTINUE, sizeof(CONTINUE) - 1);
+    m_iv[0].iov_base = m_write_buf;
+    m_iv[0].iov_len = sizeof(CONTINUE) - 1;
+    m_iv_count = 1;
+    bytes_to_send = sizeof(CONTINUE) - 1;
+    bytes_have_send = 0;
+    m_interim = true;
+}
+
+void http_conn::sent(size_t n) {
+    if (n > 0)
+        set_deadline(timer_now_ms() + m_timeouts.write_ms);
+    bytes_have_send += n;
+    bytes_to_send -= n;
+    // 按已写出的字节数推进各个iovec
+    for (int i = 0; i < m_iv_count && n > 0; ++i) {
+        if (n >= m_iv[i].iov_len) {
+            n -= m_iv[i].iov_len;
+            m_iv[i].iov_len = 0;
+        } else {
+            m_iv[i].iov_base = (char *)m_iv[i].iov_base + n;
+            m_iv[i].iov_len -= n;
+            n = 0;
+        }
+    }
+}
+
+int http_conn::next_chunk(struct iovec *iv) {
+    // 块头（十六进制长度+CRLF）最多10字节，数据直接生成在它后面，尾部留出CRLF和结束块的位置
+    const int head = 10;
+    const int tail = 7;
+    int n = m_body->produce(m_stream_buf + head, STREAM_BUFFER_SIZE - head - tail);
+    if (n < 0 || n > STREAM_BUFFER_SIZE - head - tail)
+        return -1;
+
+    char *start = m_stream_buf + head;
+    int len = 0;
+    if (n > 0) {
+        char size_line[head + 1];
+        int h = snprintf(size_line, sizeof(size_line), "%x\r\n", n);
+        start -= h;
+        memcpy(start, size_line, h);
+        memcpy(m_stream_buf + head + n, "\r\n", 2);
+        len = h + n + 2;
+    } else {
+        // 数据源结束：发送长度为0的结束块，之后按普通响应的结束流程处理
+        memcpy(start, "0\r\n\r\n", 5);
+        len = 5;
+        finish_stream();
+    }
+    iv->iov_base = start;
+    iv->iov_len = len;
+    return len;
+}
+
+void http_conn::finish_stream() {
+    if (m_body) {
+        m_body->~body_source();
+        m_body = NULL;
     }
 }
 
@@ -481,19 +1224,36 @@ bool http_conn::add_status_line(int status, const char *title) {
     return add_response("%s %d %s\r\n", "HTTP/1.1", status, title);
 }
 
-bool http_conn::add_headers(int content_len) {
+bool http_conn::add_headers(long long content_len) {
     return add_content_length(content_len) && add_linger() && add_blank_line();
 }
 
-bool http_conn::add_content_length(int content_len) {
-    return add_response("Content-Length:%d\r\n", content_len);
+bool http_conn::add_content_length(long long content_len) {
+    return add_response("Content-Length:%lld\r\n", content_len);
+}
+
+bool http_conn::add_validators() {
+    if (!add_response("ETag:%s\r\nLast-Modified:%s\r\nCache-Control:max-age=%d\r\n",
+                      m_file.etag, m_file.last_modified, CACHE_MAX_AGE))
+        return false;
+    // 可压缩类型的响应内容随Accept-Encoding变化，304也要带上
+    if (m_mime && m_mime->compressible && !add_response("Vary:Accept-Encoding\r\n"))
+        return false;
+    return true;
 }
 
 bool http_conn::add_content_type() {
-    return add_response("Content-Type:%s\r\n", "text/html");
+    if (!add_response("Content-Type:%s\r\n", m_mime ? m_mime->type : "text/html"))
+        return false;
+    if (m_encoding && !add_response("Content-Encoding:%s\r\n", m_encoding))
+        return false;
+    return true;
 }
 
 bool http_conn::add_linger() {
+    // 优雅退出期间每个响应都是连接上的最后一个
+    if (m_draining)
+        m_linger = false;
     return add_response("Connection:%s\r\n", (m_linger == true) ? "keep-alive" : "close");
 }
 
@@ -523,6 +1283,14 @@ bool http_conn::process_write(HTTP_CODE ret) {
             return false;
         break;
     }
+    case PAYLOAD_TOO_LARGE:
+    {
+        add_status_line(413, error_413_title);
+        add_headers(strlen(error_413_form));
+        if (!add_content(error_413_form))
+            return false;
+        break;
+    }
     case FORBIDDEN_REQUEST:
     {
         add_status_line(403, error_403_title);
@@ -531,17 +1299,61 @@ bool http_conn::process_write(HTTP_CODE ret) {
             return false;
         break;
     }
+    case DYNAMIC_REQUEST:
+    {
+        void *mem = m_arena.alloc(sizeof(metrics_source), alignof(metrics_source));
+        if (!mem)
+            return false;
+        return start_stream(new (mem) metrics_source(), "text/plain; version=0.0.4");
+    }
+    case NOT_MODIFIED:
+    {
+        // 304不带响应体
+        add_status_line(304, not_modified_304_title);
+        if (!(add_validators() && add_linger() && add_blank_line()))
+            return false;
+        break;
+    }
+    case PARTIAL_CONTENT:
+    {
+        long long len = m_range_end - m_range_start + 1;
+        add_status_line(206, partial_206_title);
+        add_validators();
+        add_content_type();
+        add_response("Content-Range:bytes %lld-%lld/%lld\r\n", m_range_start, m_range_end, (long long)m_file.st.st_size);
+        if (!add_headers(len))
+            return false;
+        // 直接从映射区的偏移处发送，不做拷贝
+        m_iv[0].iov_base = m_write_buf;
+        m_iv[0].iov_len = m_write_idx;
+        m_iv[1].iov_base = m_file_address + m_range_start;
+        m_iv[1].iov_len = len;
+        m_iv_count = 2;
+        bytes_to_send = m_write_idx + len;
+        return true;
+    }
+    case RANGE_NOT_SATISFIABLE:
+    {
+        add_status_line(416, error_416_title);
+        add_response("Content-Range:bytes */%lld\r\n", (long long)m_file.st.st_size);
+        if (!add_headers(0))
+            return false;
+        break;
+    }
     case FILE_REQUEST:
     {
         add_status_line(200, ok_200_title);
-        if (m_file_stat.st_size != 0) {
-            add_headers(m_file_stat.st_size);
+        add_validators();
+        add_content_type();
+        add_response("Accept-Ranges:bytes\r\n");
+        if (m_file.st.st_size != 0) {
+            add_headers(m_file.st.st_size);
             m_iv[0].iov_base = m_write_buf;
             m_iv[0].iov_len = m_write_idx;
             m_iv[1].iov_base = m_file_address;
-            m_iv[1].iov_len = m_file_stat.st_size;
+            m_iv[1].iov_len = m_file.st.st_size;
             m_iv_count = 2;
-            bytes_to_send = m_write_idx + m_file_stat.st_size;
+            bytes_to_send = m_write_idx + m_file.st.st_size;
             return true;
         }
         else {
@@ -550,6 +1362,7 @@ bool http_conn::process_write(HTTP_CODE ret) {
             if (!add_content(ok_string))
                 return false;
         }
+        break;
     }
     default:
         return false;
@@ -561,15 +1374,221 @@ bool http_conn::process_write(HTTP_CODE ret) {
     return true;
 }
 
+bool http_conn::start_stream(body_source *body, const char *content_type) {
+    m_body = body;
+    add_status_line(200, ok_200_title);
+    if (!(add_response("Content-Type:%s\r\nTransfer-Encoding:chunked\r\n", content_type) &&
+          add_linger() && add_blank_line())) {
+        finish_stream();
+        return false;
+    }
+    // 响应头和第一块合并到一次writev中
+    m_iv[0].iov_base = m_write_buf;
+    m_iv[0].iov_len = m_write_idx;
+    int len = next_chunk(&m_iv[1]);
+    if (len < 0) {
+        finish_stream();
+        return false;
+    }
+    m_iv_count = 2;
+    bytes_to_send = m_write_idx + len;
+    return true;
+}
+
+bool http_conn::start_h2(bool upgrade) {
+    m_h2 = new http2_session(this);
+    if (!upgrade) {
+        m_h2->start_prior_knowledge(m_read_buf + m_checked_idx, m_read_idx - m_checked_idx);
+    } else if (!m_h2->start_upgrade(get_header(HDR_HTTP2_SETTINGS), m_read_buf + m_request_end,
+                                    m_read_idx - m_request_end)) {
+        return false;
+    }
+    m_read_idx = m_checked_idx = m_start_line = 0;
+    return true;
+}
+
+void http_conn::process_h2() {
+    m_h2->process();
+    while (m_tls && tls_pending(m_tls) && read_once())
+        m_h2->process();
+    if (m_draining)
+        m_h2->drain();
+    rearm(m_h2->want_write() ? EPOLLOUT : EPOLLIN);
+}
+
+void http_conn::serve_h2(const http2_request *req, http2_response *resp) {
+    HTTP_CODE ret;
+    if (!req) {
+        ret = do_request();
+    } else {
+        clear_request();
+        // 请求头直接引用会话中保存的字段，流处理期间有效
+        const char *p = req->fields;
+        for (int i = 0; i < req->field_count; ++i) {
+            const char *name = p;
+            int name_len = strlen(name);
+            const char *value = name + name_len + 1;
+            int value_len = strlen(value);
+            p = value + value_len + 1;
+            if (m_header_count >= MAX_HEADERS)
+                continue;
+            http_header &h = m_headers[m_header_count];
+            h.name = name;
+            h.name_len = name_len;
+            h.value = value;
+            h.value_len = value_len;
+            h.id = http_header_lookup(name, name_len);
+            if (h.id != HDR_UNKNOWN && m_header_index[h.id] < 0)
+                m_header_index[h.id] = m_header_count;
+            ++m_header_count;
+        }
+        m_url = req->path;
+        m_host = req->authority;
+        m_string = (char *)req->body;
+        m_content_length = req->body_len;
+        bool method_ok = true;
+        if (strcmp(req->method, "GET") == 0) {
+            m_method = GET;
+        } else if (strcmp(req->method, "POST") == 0) {
+            m_method = POST;
+            cgi = 1;
+        } else {
+            method_ok = false;
+        }
+        if (req->body_too_large)
+            ret = PAYLOAD_TOO_LARGE;
+        else if (!method_ok || m_url[0] != '/')
+            ret = BAD_REQUEST;
+        else
+            ret = do_request();
+    }
+
+    const char *form = NULL;
+    switch (ret) {
+    case FILE_REQUEST:
+    case PARTIAL_CONTENT:
+        resp->status = ret == FILE_REQUEST ? 200 : 206;
+        resp->content_type = m_mime->type;
+        resp->content_encoding = m_encoding;
+        resp->validators = true;
+        memcpy(resp->etag, m_file.etag, sizeof(resp->etag));
+        memcpy(resp->last_modified, m_file.last_modified, sizeof(resp->last_modified));
+        resp->vary = m_mime->compressible;
+        if (ret == PARTIAL_CONTENT) {
+            resp->range_start = m_range_start;
+            resp->range_end = m_range_end;
+            resp->range_total = m_file.st.st_size;
+            resp->data = m_file_address + m_range_start;
+            resp->data_len = m_range_end - m_range_start + 1;
+        } else if (m_file.st.st_size == 0) {
+            resp->accept_ranges = true;
+            resp->data = "<html><body></body></html>";
+            resp->data_len = strlen(resp->data);
+        } else {
+            resp->accept_ranges = true;
+            resp->data = m_file_address;
+            resp->data_len = m_file.st.st_size;
+        }
+        // 映射区随响应转交给会话
+        resp->map_addr = m_file_address;
+        resp->map_len = m_file.st.st_size;
+        m_file_address = 0;
+        return;
+    case NOT_MODIFIED:
+        resp->status = 304;
+        resp->validators = true;
+        memcpy(resp->etag, m_file.etag, sizeof(resp->etag));
+        memcpy(resp->last_modified, m_file.last_modified, sizeof(resp->last_modified));
+        resp->vary = m_mime && m_mime->compressible;
+        resp->has_body = false;
+        return;
+    case RANGE_NOT_SATISFIABLE:
+        resp->status = 416;
+        resp->range_start = -1;
+        resp->range_total = m_file.st.st_size;
+        return;
+    case DYNAMIC_REQUEST:
+    {
+        // HTTP/2的DATA帧自带分帧，动态内容一次生成完，按普通响应发送
+        metrics_source source;
+        int n;
+        while ((n = source.produce(m_stream_buf, STREAM_BUFFER_SIZE)) > 0)
+            resp->mem.append(m_stream_buf, n);
+        if (n < 0) {
+            resp->mem.clear();
+            form = error_500_form;
+            resp->status = 500;
+            break;
+        }
+        resp->status = 200;
+        resp->content_type = "text/plain; version=0.0.4";
+        resp->data = resp->mem.data();
+        resp->data_len = resp->mem.size();
+        return;
+    }
+    case PAYLOAD_TOO_LARGE:
+        resp->status = 413;
+        form = error_413_form;
+        break;
+    case FORBIDDEN_REQUEST:
+        resp->status = 403;
+        form = error_403_form;
+        break;
+    case INTERNAL_ERROR:
+        resp->status = 500;
+        form = error_500_form;
+        break;
+    default:
+        resp->status = 404;
+        form = error_404_form;
+        break;
+    }
+    resp->data = form;
+    resp->data_len = strlen(form);
+}
+
 void http_conn::process() {
+    if (m_h2) {
+        process_h2();
+        return;
+    }
+    if (m_tls && !tls_established(m_tls)) {
+        // 握手尚未完成，read_once()已经推进过一步
+        rearm(tls_handshake(m_tls) == TLS_WANT_WRITE ? EPOLLOUT : EPOLLIN);
+        return;
+    }
+    m_pending = false;
     HTTP_CODE read_ret = process_read();
+    // 读缓冲区满时OpenSSL里可能还留有已解密的数据，epoll不会再通知，处理完腾出空间后直接读取
+    while (read_ret == NO_REQUEST && m_tls && tls_pending(m_tls) && read_once())
+        read_ret = process_read();
     if (read_ret == NO_REQUEST) {
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_TRIGMode);
+        if (m_expect_continue) {
+            queue_continue();
+            rearm(EPOLLOUT);
+            return;
+        }
+        rearm(EPOLLIN);
         return ;
     }
+    // 请求已经完整，处理和发送响应期间按写出的进展计时
+    set_deadline(timer_now_ms() + m_timeouts.write_ms);
+    if (read_ret == HTTP2_PREFACE || read_ret == HTTP2_UPGRADE) {
+        if (!start_h2(read_ret == HTTP2_UPGRADE)) {
+            // HTTP2-Settings非法，按普通的错误请求处理
+            delete m_h2;
+            m_h2 = NULL;
+            read_ret = BAD_REQUEST;
+        } else {
+            process_h2();
+            return;
+        }
+    }
     bool write_ret = process_write(read_ret);
     if (!write_ret) {
+        // 连接已经关闭（或交给事件循环关闭），不能再登记事件
         close_conn();
+        return;
     }
-    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_TRIGMode);
+    rearm(EPOLLOUT);
 }
\ No newline at end of file
@@ -26,6 +26,16 @@
 #include "../CGImysql/sql_connection_pool.h"
 #include "../timer/lst_timer.h"
 #include "../log/log.h"
+#include "http_header.h"
+#include "request_arena.h"
+#include "file_cache.h"
+#include "http_mime.h"
+#include "body_source.h"
+#include "body_sink.h"
+#include "http2.h"
+#include "tls.h"
+
+struct route;
 
 /**
  * @brief HTTP连接处理类
@@ -34,6 +44,10 @@
  * 支持GET和POST请求，实现了HTTP协议的主要功能
  */
 class http_conn {
+    // 基准测试需要直接驱动私有的解析接口
+    friend class http_conn_bench;
+    // HTTP/2会话把每个流的请求交回本连接处理
+    friend class http2_session;
 public:
     // 文件名最大长度
     static const int FILENAME_LEN = 200;
@@ -41,6 +55,14 @@ public:
     static const int READ_BUFFER_SIZE = 2048;
     // 写缓冲区大小
     static const int WRITE_BUFFER_SIZE = 1024;
+    // 流式响应每块的缓冲区大小，也是每个连接为流式响应缓存的上限
+    static const int STREAM_BUFFER_SIZE = 4096;
+    // 登录、注册表单放不进读缓冲区时允许的最大长度，表单在请求内存池中拼接
+    static const int FORM_MAX_BODY = 512;
+    // 单个请求允许的最大请求头数量
+    static const int MAX_HEADERS = 64;
+    // 静态文件响应的Cache-Control: max-age（秒），0表示每次都向服务器验证
+    static const int CACHE_MAX_AGE = 0;
     
     // HTTP请求方法枚举
     enum METHOD {
@@ -70,9 +92,23 @@ public:
         FORBIDDEN_REQUEST,  // 客户对资源没有足够的访问权限
         FILE_REQUEST,       // 文件请求
         INTERNAL_ERROR,     // 服务器内部错误
-        CLOSED_CONNECTION   // 客户端已关闭连接
+        CLOSED_CONNECTION,  // 客户端已关闭连接
+        DYNAMIC_REQUEST,    // 动态生成的响应（运行状态统计）
+        NOT_MODIFIED,       // 条件请求命中，返回304
+        PARTIAL_CONTENT,    // Range请求，返回206
+        RANGE_NOT_SATISFIABLE, // Range超出文件范围，返回416
+        PAYLOAD_TOO_LARGE,  // 请求体超过上限，返回413
+        HTTP2_PREFACE,      // 收到HTTP/2连接前言（prior knowledge），切换到HTTP/2
+        HTTP2_UPGRADE       // 收到Upgrade: h2c请求，回复101后切换到HTTP/2
     };
     
+    // next_send()的结果
+    enum SEND_RESULT {
+        SEND_MORE = 0,  // 还有数据待发送
+        SEND_DONE,      // 响应已发完，长连接已复位
+        SEND_CLOSE      // 响应已发完（或出错），连接应当关闭
+    };
+
     // 行的读取状态
     enum LINE_STATUS {
         LINE_OK = 0,  // 读取到完整行
@@ -94,7 +130,13 @@ public:
      * @param passwd 数据库密码
      * @param sqlname 数据库名
      */
-    void init(int sockfd, const sockaddr_in &addr, char *, int, int, string user, string passwd, string sqlname);
+    void init(int sockfd, const sockaddr_in &addr, char *, int, int, const string &user, const string &passwd, const string &sqlname);
+
+    /**
+     * @brief 把刚初始化的连接切换为HTTPS，握手在之后的读写事件中完成
+     * @return 是否成功
+     */
+    bool start_tls();
     
     /**
      * @brief 关闭连接
@@ -133,16 +175,149 @@ public:
      * @param connPool 连接池指针
      */
     void initmysql_result(connection_pool *connPool);
+
+    /**
+     * @brief O(1)获取已知请求头的值
+     * @param id 请求头编号
+     * @param len 输出值长度，可为NULL
+     * @return 请求头值（指向读缓冲区，本次请求内有效），不存在时返回NULL
+     */
+    const char *get_header(HEADER_ID id, int *len = NULL) const {
+        int idx = m_header_index[id];
+        if (idx < 0)
+            return NULL;
+        if (len)
+            *len = m_headers[idx].value_len;
+        return m_headers[idx].value;
+    }
+
+    /**
+     * @brief 获取按出现顺序排列的全部请求头（含未知请求头）
+     * @param count 输出请求头数量
+     * @return 请求头数组
+     */
+    const http_header *get_headers(int *count) const {
+        *count = m_header_count;
+        return m_headers;
+    }
     
+    /**
+     * @brief 读缓冲区中是否还有未处理的流水线请求
+     *
+     * write()完成一个长连接响应后，若返回true则连接保持未注册epoll的状态，
+     * 调用方需要直接把它再交给process()处理。HTTPS连接在OpenSSL中还有已解密的数据时同样返回true
+     * @return 是否有待处理的数据
+     */
+    bool pending_request() const { return m_pending || (m_tls && tls_pending(m_tls)); }
+
+    /**
+     * @brief 线程池按什么类别（task_class）排队：读缓冲区开头是新请求时只看请求行的方法和路径查路由，
+     *        不解析请求头；请求行已经解析过（请求体还在陆续到达）时沿用parse_request_line记下的类别。
+     *        在事件循环中、交给线程池之前调用
+     */
+    int classify();
+
+    /**
+     * @brief 由io_uring引擎或单线程模式驱动时，取出process()/write()登记的事件兴趣并清空
+     * @return EPOLLIN或EPOLLOUT；0表示没有登记（有待处理的流水线请求）
+     */
+    int take_interest() {
+        int ev = m_want;
+        m_want = 0;
+        return ev;
+    }
+
+    /**
+     * @brief 事件循环收到该连接的事件时调用：EPOLLONESHOT注册随之失效，之后的rearm()必须重新注册
+     */
+    void fired() { m_events = 0; }
+
+    /**
+     * @brief 是否为空闲的长连接：在等待下一个请求，没有读入任何数据，也没有待发送的响应
+     *
+     * 线程池模式下只有已注册读事件、没有线程在处理的连接才可能返回true；由事件循环线程调用
+     */
+    bool idle() const;
+
+    /**
+     * @brief 连接当前阶段的截止时刻（毫秒，timer_now_ms()），由处理连接的线程在阶段变化和取得进展时更新
+     *
+     * 事件循环据此调整定时器；定时器到期时截止时刻已经推后的连接不会被关闭
+     */
+    long long deadline() const { return __atomic_load_n(&m_deadline, __ATOMIC_RELAXED); }
+
+    /**
+     * @brief 上一次read_once()是否读到了EAGAIN
+     *
+     * 边沿触发下为false时socket里可能还有数据（读缓冲区先满了），不会再有新的可读事件
+     */
+    bool drained() const { return m_drained; }
+
+    /**
+     * @brief 把引擎收到的数据追加到输入缓冲区（HTTP/2连接为会话的帧缓冲区），代替read_once()
+     * @return 追加的字节数，缓冲区已满时返回-1
+     */
+    long feed(const char *data, long len);
+
+    /**
+     * @brief 取下一批待发送的数据，流式响应在上一块发完后生成下一块
+     *
+     * 响应发完时按长连接复位或要求关闭，write()和io_uring引擎共用
+     * @param iov 输出iovec数组，SEND_MORE时有效，直到下一次sent()
+     * @param count 输出iovec个数
+     * @return 发送状态
+     */
+    SEND_RESULT next_send(struct iovec **iov, int *count);
+
+    /**
+     * @brief 已写出n字节，推进iovec
+     */
+    void sent(size_t n);
+
+    /**
+     * @brief 连接是否已被close_conn()关闭；单线程/协程模式下可能只做了标记，socket留给事件循环关闭
+     */
+    bool closed() const { return m_sockfd == -1 || m_close_pending; }
+
+    /**
+     * @brief close_conn()是否已经关闭了socket并减少了连接计数
+     */
+    bool released() const { return m_sockfd == -1; }
+
+    /**
+     * @brief 是否为HTTPS连接，其读写必须经过OpenSSL
+     */
+    bool is_tls() const { return m_tls != NULL; }
+
+    /**
+     * @brief 是否已切换到HTTP/2，其发送由会话组帧
+     */
+    bool is_h2() const { return m_h2 != NULL; }
+
     // 定时器相关标志
     int timer_flag;
     int improv;
+    // 单线程模式下由事件循环维护
+    int ready;                 // 已触发、尚未处理的边沿事件（EPOLLIN/EPOLLOUT）
+    bool blocked;              // 响应因socket写满而暂停，等待EPOLLOUT
 
 private:
     /**
-     * @brief 初始化连接
+     * @brief 复位请求状态
+     *
+     * 只重置下标和解析状态，不清空缓冲区，代价与缓冲区大小无关
      */
     void init();
+
+    /**
+     * @brief 复位与单个请求有关的解析状态，HTTP/2的每个流处理前也会调用
+     */
+    void clear_request();
+
+    /**
+     * @brief 长连接上一个请求完成后复位，保留已读入的下一个请求
+     */
+    void reset_request();
     
     /**
      * @brief 解析HTTP请求
@@ -177,13 +352,143 @@ private:
      * @return 解析结果
      */
     HTTP_CODE parse_content(char *text);
+
+    /**
+     * @brief 为放不进读缓冲区的请求体按路由选择接收方
+     * @return NO_REQUEST表示成功，否则为要回复的错误
+     */
+    HTTP_CODE start_sink();
+
+    /**
+     * @brief 把已读入的请求体交给接收方，腾出读缓冲区
+     * @return 请求体读完时为GET_REQUEST，否则为NO_REQUEST，接收方出错为INTERNAL_ERROR
+     */
+    HTTP_CODE sink_content();
+
+    /**
+     * @brief 析构请求体的接收方
+     */
+    void finish_sink();
+
+    /**
+     * @brief 把100 Continue放进写缓冲区，按普通响应的流程发出，发完后继续读取请求体
+     */
+    void queue_continue();
     
     /**
      * @brief 处理HTTP请求
      * @return 处理结果
      */
     HTTP_CODE do_request();
+
+    /**
+     * @brief 根据If-None-Match/If-Modified-Since判断目标文件是否未修改
+     * @return 可以返回304时为true
+     */
+    bool not_modified();
+
+    /**
+     * @brief 解析Range/If-Range，结果存入m_range_start和m_range_end
+     * @return 解析结果
+     */
+    RANGE_RESULT range_request();
+
+    /**
+     * @brief 按Accept-Encoding选择预压缩文件，命中时改写m_real_file和m_file
+     */
+    void select_encoding();
+
+    /**
+     * @brief 从请求体中解析登录/注册表单
+     * @param name 输出用户名，分配在请求内存池中
+     * @param password 输出密码，分配在请求内存池中
+     * @return 表单格式是否正确
+     */
+    bool parse_form(const char **name, const char **password);
+
+    /**
+     * @brief 处理登录表单
+     * @return 用户名和密码是否匹配
+     */
+    bool do_login();
+
+    /**
+     * @brief 处理注册表单
+     * @return 是否注册成功
+     */
+    bool do_register();
+
+    /**
+     * @brief 以chunked编码开始发送流式响应
+     * @param body 数据源，之后由本连接负责析构
+     * @param content_type 响应的Content-Type
+     * @return 是否成功
+     */
+    bool start_stream(body_source *body, const char *content_type);
+
+    /**
+     * @brief 从数据源生成下一块并按chunked格式封装到m_stream_buf
+     * @param iv 输出的iovec
+     * @return 块的总字节数，出错返回-1
+     */
+    int next_chunk(struct iovec *iv);
+
+    /**
+     * @brief 析构并释放数据源
+     */
+    void finish_stream();
     
+    /**
+     * @brief HTTPS连接的读操作：先推进握手，再读出所有已解密的数据
+     */
+    bool read_tls(char *buf, long *idx, long size);
+
+    /**
+     * @brief 发送数据，HTTPS连接经由TLS会话，语义与writev相同
+     */
+    ssize_t send_iov(const struct iovec *iov, int count);
+
+    /**
+     * @brief 登记下一步等待的事件
+     *
+     * EPOLLONESHOT注册仍然有效且事件相同时不重复调用epoll_ctl；
+     * io_uring和单线程模式下只登记，由引擎取走
+     */
+    void rearm(int ev);
+
+    void set_deadline(long long at) { __atomic_store_n(&m_deadline, at, __ATOMIC_RELAXED); }
+
+    /**
+     * @brief 读入n字节后更新截止时刻：新请求的第一个字节开始计算请求头时限，请求体按最低速度延长
+     */
+    void note_read(long n);
+
+    /**
+     * @brief 按请求体已收到的字节数计算截止时刻
+     */
+    void body_deadline(long long now);
+
+    /**
+     * @brief 切换到HTTP/2，读缓冲区中尚未解析的数据转交给会话
+     * @param upgrade 是否为Upgrade: h2c方式，否则为prior knowledge
+     * @return 是否成功
+     */
+    bool start_h2(bool upgrade);
+
+    /**
+     * @brief 处理HTTP/2会话中已收到的帧，并按是否有待发送的数据注册事件
+     */
+    void process_h2();
+
+    /**
+     * @brief 处理HTTP/2的一个流，复用do_request()的路由和文件映射
+     *
+     * 映射区的所有权转交给响应，由会话在响应发完后释放
+     * @param req 流的请求，NULL表示处理已解析好的HTTP/1.1升级请求
+     * @param resp 输出的响应
+     */
+    void serve_h2(const http2_request *req, http2_response *resp);
+
     /**
      * @brief 获取一行数据
      * @return 行数据的起始位置
@@ -210,26 +515,36 @@ private:
     bool add_response(const char *format, ...);
     bool add_content(const char *content);
     bool add_status_line(int status, const char *title);
-    bool add_headers(int m_content_length);
+    bool add_headers(long long m_content_length);
     bool add_content_type();
-    bool add_content_length(int m_content_length);
+    bool add_validators();
+    bool add_content_length(long long m_content_length);
     bool add_linger();
     bool add_blank_line();
 
 public:
     static int m_epollfd;      // 所有socket上的事件都被注册到同一个epoll内核事件中
+    static bool m_uring;       // 由io_uring引擎驱动：不注册epoll，事件兴趣记在m_want中
+    static bool m_cork;        // 流式响应期间开启TCP_CORK
+    static bool m_persist;     // 单线程模式：连接只注册一次EPOLLIN|EPOLLOUT|EPOLLET，事件兴趣记在m_want中
+    static volatile bool m_draining;  // 优雅退出中：响应一律带Connection: close，HTTP/2连接发送GOAWAY
     static int m_user_count;   // 统计用户数量
+    static long long m_max_body;  // 请求体大小上限
+    static conn_timeouts m_timeouts;  // 各阶段的时限
     MYSQL *mysql;              // 数据库连接
     int m_state;               // 读为0，写为1
+    int m_cpu;                 // 连接收包所在的CPU（SO_INCOMING_CPU），线程池按它选择队列，-1表示不区分
+    int m_task_class;          // 当前请求的类别（task_class），解析完请求行后设置
 
 private:
-    int m_sockfd;              // 该HTTP连接的socket
     sockaddr_in m_address;     // 通信的socket地址
     
     char m_read_buf[READ_BUFFER_SIZE];  // 读缓冲区
     long m_read_idx;           // 标识读缓冲区中已经读入的客户端数据的最后一个字节的下一个位置
     long m_checked_idx;        // 当前正在分析的字符在读缓冲区中的位置
     int m_start_line;          // 当前正在解析的行的起始位置
+    bool m_pending;            // reset_request()后读缓冲区中留有下一个请求，尚未派发
+    long m_request_end;        // 当前请求（含请求体）在读缓冲区中的结束位置，-1表示尚未解析完整
     
     char m_write_buf[WRITE_BUFFER_SIZE];  // 写缓冲区
     int m_write_idx;           // 写缓冲区中待发送的字节数
@@ -243,19 +558,50 @@ private:
     char *m_host;              // 主机名
     long m_content_length;     // HTTP请求的消息总长度
     bool m_linger;             // 是否保持连接
+
+    http_header m_headers[MAX_HEADERS];     // 按出现顺序保存的请求头
+    int m_header_count;                     // 请求头数量
+    signed char m_header_index[HDR_COUNT];  // 已知请求头在m_headers中的下标，-1表示不存在
     
-    char *m_file_address;      // 客户请求的目标文件被mmap到内存中的起始位置
-    struct stat m_file_stat;   // 目标文件的状态
+    file_info m_file;          // 目标文件的状态及ETag/Last-Modified
+    long long m_range_start;   // 206响应的起始偏移，完整响应时为0
+    long long m_range_end;     // 206响应的结束偏移（含）
+    const http_mime *m_mime;   // 目标文件的MIME类型
+    const char *m_encoding;    // 选中的Content-Encoding，NULL表示不压缩
     struct iovec m_iv[2];      // 采用writev来执行写操作
     int m_iv_count;            // 被写内存块的数量
     
     int cgi;                   // 是否启用POST
-    char *m_string;            // 存储请求体数据
+    char *m_string;            // 存储请求体数据，不是表单的大请求体为NULL
+    long m_body_start;         // 请求体在读缓冲区中的起始位置（紧跟请求头）
+    long long m_body_received; // 已交给接收方的请求体字节数
+    bool m_expect_continue;    // 请求头带Expect: 100-continue且请求体还没开始发送，需要先回复100
+    bool m_interim;            // 写缓冲区中是100 Continue，发完后继续读取请求体而不是结束请求
+    const route *m_route;      // 请求行匹配到的路由，NULL表示没有
+    request_arena m_arena;     // 请求级内存池，每个请求开始时复位
     
-    int bytes_to_send;         // 剩余发送字节数
-    int bytes_have_send;       // 已发送字节数
+    long long bytes_to_send;   // 剩余发送字节数
+    long long bytes_have_send; // 已发送字节数
+    char m_stream_buf[STREAM_BUFFER_SIZE];  // 流式响应当前块的缓冲区
     char *doc_root;            // 网站根目录
+    int m_want;                // io_uring和单线程模式下登记的事件兴趣
+    int m_events;              // 当前有效的EPOLLONESHOT注册，触发后为0
+    bool m_drained;            // 上一次读取是否读到了EAGAIN
+    bool m_served;             // 连接上已经完成过请求，此后的空闲期才可以安全关闭
+    bool m_close_pending;      // 单线程/协程模式下close_conn()只做标记，由事件循环关闭socket
+    long long m_deadline;      // 当前阶段的截止时刻（毫秒）
+    long long m_body_since;    // 开始接收请求体的时刻（毫秒）
+    long long m_body_bytes;    // 已收到的请求体字节数，按它计算最低速度
 
+    // init()、close_conn()在连接建立之前就会读取的资源句柄，给出初值而不依赖分配到的内存恰好为0；
+    // 连接数组按MAX_FD整块分配，这些成员集中放在m_users旁边，构造时只触碰每个对象的同一个页面
+    int m_sockfd = -1;         // 该HTTP连接的socket，-1表示已关闭
+    char *m_file_address = NULL;  // 客户请求的目标文件被mmap到内存中的起始位置
+    body_sink *m_sink = NULL;  // 放不进读缓冲区的请求体的接收方，NULL表示请求体在读缓冲区中
+    body_source *m_body = NULL;  // 流式响应的数据源，NULL表示普通响应
+    bool m_corked = false;     // 当前响应是否开启了TCP_CORK
+    http2_session *m_h2 = NULL;  // HTTP/2会话，NULL表示HTTP/1.1连接
+    tls_session *m_tls = NULL;   // TLS会话，NULL表示明文连接
     map<string, string> m_users;  // 用户名和密码的映射表
     int m_TRIGMode;            // 触发模式
     int m_close_log;           // 是否关闭日志
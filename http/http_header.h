@@ -0,0 +1,220 @@
+#ifndef HTTP_HEADER_H
+#define HTTP_HEADER_H
+
+#include <string.h>
+#include <strings.h>
+
+/**
+ * @brief 已知请求头的编号
+ *
+ * 顺序必须与HEADER_NAMES一致；新增请求头后若static_assert报冲突，调整header_hash中的系数即可
+ */
+enum HEADER_ID {
+    HDR_UNKNOWN = -1,
+    HDR_HOST = 0,
+    HDR_CONNECTION,
+    HDR_KEEP_ALIVE,
+    HDR_CONTENT_LENGTH,
+    HDR_CONTENT_TYPE,
+    HDR_TRANSFER_ENCODING,
+    HDR_TE,
+    HDR_EXPECT,
+    HDR_USER_AGENT,
+    HDR_ACCEPT,
+    HDR_ACCEPT_ENCODING,
+    HDR_ACCEPT_LANGUAGE,
+    HDR_COOKIE,
+    HDR_REFERER,
+    HDR_ORIGIN,
+    HDR_AUTHORIZATION,
+    HDR_CACHE_CONTROL,
+    HDR_PRAGMA,
+    HDR_IF_NONE_MATCH,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_IF_RANGE,
+    HDR_RANGE,
+    HDR_UPGRADE,
+    HDR_HTTP2_SETTINGS,
+    HDR_X_FORWARDED_FOR,
+    HDR_COUNT
+};
+
+struct http_header_name {
+    const char *name;
+    int len;
+};
+
+#define HTTP_HEADER_NAME(s) { s, sizeof(s) - 1 }
+
+// 已知请求头的规范名称，下标即HEADER_ID
+constexpr http_header_name HEADER_NAMES[HDR_COUNT] = {
+    HTTP_HEADER_NAME("Host"),
+    HTTP_HEADER_NAME("Connection"),
+    HTTP_HEADER_NAME("Keep-Alive"),
+    HTTP_HEADER_NAME("Content-Length"),
+    HTTP_HEADER_NAME("Content-Type"),
+    HTTP_HEADER_NAME("Transfer-Encoding"),
+    HTTP_HEADER_NAME("TE"),
+    HTTP_HEADER_NAME("Expect"),
+    HTTP_HEADER_NAME("User-Agent"),
+    HTTP_HEADER_NAME("Accept"),
+    HTTP_HEADER_NAME("Accept-Encoding"),
+    HTTP_HEADER_NAME("Accept-Language"),
+    HTTP_HEADER_NAME("Cookie"),
+    HTTP_HEADER_NAME("Referer"),
+    HTTP_HEADER_NAME("Origin"),
+    HTTP_HEADER_NAME("Authorization"),
+    HTTP_HEADER_NAME("Cache-Control"),
+    HTTP_HEADER_NAME("Pragma"),
+    HTTP_HEADER_NAME("If-None-Match"),
+    HTTP_HEADER_NAME("If-Modified-Since"),
+    HTTP_HEADER_NAME("If-Range"),
+    HTTP_HEADER_NAME("Range"),
+    HTTP_HEADER_NAME("Upgrade"),
+    HTTP_HEADER_NAME("HTTP2-Settings"),
+    HTTP_HEADER_NAME("X-Forwarded-For"),
+};
+
+#undef HTTP_HEADER_NAME
+
+// 哈希表槽位数，必须是2的幂
+const int HEADER_HASH_SIZE = 64;
+
+constexpr unsigned header_lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c + 32) : (unsigned char)c;
+}
+
+/**
+ * @brief 请求头名称哈希：只看长度、首字符和尾字符，系数离线搜索得到
+ * @param name 请求头名称（不要求以'\0'结尾）
+ * @param len 名称长度，必须大于0
+ * @return 槽位下标
+ */
+constexpr unsigned header_hash(const char *name, int len) {
+    return (len + header_lower(name[0]) * 12u + header_lower(name[len - 1]) * 29u) & (HEADER_HASH_SIZE - 1);
+}
+
+struct http_header_slots {
+    signed char slot[HEADER_HASH_SIZE];
+    bool perfect;
+};
+
+/**
+ * @brief 编译期生成槽位表，同时检查已知名称之间没有冲突
+ */
+constexpr http_header_slots build_header_slots() {
+    http_header_slots t = {};
+    for (int i = 0; i < HEADER_HASH_SIZE; ++i)
+        t.slot[i] = -1;
+    t.perfect = true;
+    for (int id = 0; id < HDR_COUNT; ++id) {
+        unsigned h = header_hash(HEADER_NAMES[id].name, HEADER_NAMES[id].len);
+        if (t.slot[h] != -1)
+            t.perfect = false;
+        t.slot[h] = id;
+    }
+    return t;
+}
+
+constexpr http_header_slots HEADER_SLOTS = build_header_slots();
+static_assert(HEADER_SLOTS.perfect, "header_hash is no longer perfect for HEADER_NAMES, retune its coefficients");
+
+/**
+ * @brief 把请求头名称解析为HEADER_ID
+ * @param name 请求头名称
+ * @param len 名称长度
+ * @return 已知请求头返回其编号，否则返回HDR_UNKNOWN
+ */
+inline HEADER_ID http_header_lookup(const char *name, int len) {
+    if (len <= 0)
+        return HDR_UNKNOWN;
+    int id = HEADER_SLOTS.slot[header_hash(name, len)];
+    if (id < 0 || HEADER_NAMES[id].len != len || strncasecmp(HEADER_NAMES[id].name, name, len) != 0)
+        return HDR_UNKNOWN;
+    return (HEADER_ID)id;
+}
+
+/**
+ * @brief 一个已解析的请求头，名称和值都直接指向读缓冲区，不做拷贝
+ */
+struct http_header {
+    const char *name;  // 请求头名称，以'\0'结尾
+    int name_len;      // 名称长度
+    const char *value; // 去掉首尾空白后的值，以'\0'结尾
+    int value_len;     // 值长度
+    HEADER_ID id;      // 已知请求头编号，未知为HDR_UNKNOWN
+};
+
+/**
+ * @brief 判断逗号分隔的请求头值中是否包含某个token（大小写不敏感）
+ *
+ * 用于Connection: keep-alive, Upgrade之类的多值请求头
+ * @param value 请求头值
+ * @param token 要查找的token
+ * @return 是否包含
+ */
+inline bool http_header_has_token(const char *value, const char *token) {
+    if (!value)
+        return false;
+    size_t tlen = strlen(token);
+    const char *p = value;
+    while (*p) {
+        p += strspn(p, " \t,");
+        size_t n = strcspn(p, ",;");
+        size_t len = n;
+        while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t'))
+            --len;
+        if (len == tlen && strncasecmp(p, token, tlen) == 0)
+            return true;
+        p += n;
+        if (*p == ';')
+            p += strcspn(p, ",");
+    }
+    return false;
+}
+
+/**
+ * @brief 取逗号分隔的请求头值中某个token的q值（大小写不敏感）
+ *
+ * 用于Accept-Encoding之类带权重的请求头，例如"gzip;q=0.8, br"
+ * @param value 请求头值
+ * @param token 要查找的token
+ * @return q值的千分数（0~1000），未列出时返回-1
+ */
+inline int http_header_token_q(const char *value, const char *token) {
+    if (!value)
+        return -1;
+    size_t tlen = strlen(token);
+    const char *p = value;
+    while (*p) {
+        p += strspn(p, " \t,");
+        size_t n = strcspn(p, ",;");
+        size_t len = n;
+        while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t'))
+            --len;
+        bool hit = len == tlen && strncasecmp(p, token, tlen) == 0;
+        p += n;
+        int q = 1000;
+        // 参数部分只关心q=，格式为0、1或带最多三位小数
+        while (*p == ';') {
+            ++p;
+            p += strspn(p, " \t");
+            size_t plen = strcspn(p, ",;");
+            if (plen >= 2 && (p[0] == 'q' || p[0] == 'Q') && p[1] == '=') {
+                const char *v = p + 2;
+                q = (*v == '1') ? 1000 : 0;
+                if (v[0] == '0' && v[1] == '.') {
+                    int scale = 100;
+                    for (const char *d = v + 2; *d >= '0' && *d <= '9' && scale > 0; ++d, scale /= 10)
+                        q += (*d - '0') * scale;
+                }
+            }
+            p += plen;
+        }
+        if (hit)
+            return q;
+    }
+    return -1;
+}
+
+#endif
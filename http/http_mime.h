@@ -0,0 +1,68 @@
+#ifndef HTTP_MIME_H
+#define HTTP_MIME_H
+
+#include <string.h>
+#include <strings.h>
+
+/**
+ * @brief 扩展名到MIME类型的映射
+ */
+struct http_mime {
+    const char *ext;        // 扩展名，不含'.'
+    const char *type;       // Content-Type
+    bool compressible;      // 是否值得压缩，决定是否查找.gz/.br预压缩文件
+};
+
+// 按扩展名查找的MIME表，新增类型直接追加
+const http_mime MIME_TYPES[] = {
+    { "html",  "text/html; charset=utf-8",              true  },
+    { "htm",   "text/html; charset=utf-8",              true  },
+    { "css",   "text/css; charset=utf-8",               true  },
+    { "js",    "text/javascript; charset=utf-8",        true  },
+    { "mjs",   "text/javascript; charset=utf-8",        true  },
+    { "json",  "application/json",                      true  },
+    { "xml",   "application/xml",                       true  },
+    { "txt",   "text/plain; charset=utf-8",             true  },
+    { "md",    "text/markdown; charset=utf-8",          true  },
+    { "svg",   "image/svg+xml",                         true  },
+    { "ico",   "image/x-icon",                          true  },
+    { "wasm",  "application/wasm",                      true  },
+    { "gif",   "image/gif",                             false },
+    { "jpg",   "image/jpeg",                            false },
+    { "jpeg",  "image/jpeg",                            false },
+    { "png",   "image/png",                             false },
+    { "webp",  "image/webp",                            false },
+    { "avif",  "image/avif",                            false },
+    { "mp4",   "video/mp4",                             false },
+    { "webm",  "video/webm",                            false },
+    { "mp3",   "audio/mpeg",                            false },
+    { "ogg",   "audio/ogg",                             false },
+    { "woff",  "font/woff",                             false },
+    { "woff2", "font/woff2",                            false },
+    { "pdf",   "application/pdf",                       false },
+    { "zip",   "application/zip",                       false },
+    { "gz",    "application/gzip",                      false },
+};
+
+// 未知扩展名按二进制流处理
+const http_mime MIME_DEFAULT = { "", "application/octet-stream", false };
+
+/**
+ * @brief 按文件路径的扩展名查找MIME类型（大小写不敏感）
+ * @param path 文件路径
+ * @return MIME表项，未知扩展名返回MIME_DEFAULT
+ */
+inline const http_mime *http_mime_lookup(const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *dot = strrchr(path, '.');
+    if (!dot || (slash && dot < slash))
+        return &MIME_DEFAULT;
+    ++dot;
+    for (size_t i = 0; i < sizeof(MIME_TYPES) / sizeof(MIME_TYPES[0]); ++i) {
+        if (strcasecmp(MIME_TYPES[i].ext, dot) == 0)
+            return &MIME_TYPES[i];
+    }
+    return &MIME_DEFAULT;
+}
+
+#endif
@@ -0,0 +1,143 @@
+#include "http_router.h"
+
+#include <string.h>
+#include <stdio.h>
+
+http_router::http_router() {
+    m_nodes.push_back(node());
+}
+
+void http_router::init(const char *doc_root) {
+    m_doc_root = doc_root;
+    m_nodes.clear();
+    m_nodes.push_back(node());
+    m_routes.clear();
+
+    // 兜底：其余URL都按静态文件处理
+    add_route("/", ROUTE_STATIC, ROUTE_METHOD_ANY, false);
+    add_route("/", ROUTE_PAGE, ROUTE_METHOD_ANY, true, "/judge.html");
+    add_route("/0", ROUTE_PAGE, ROUTE_METHOD_ANY, false, "/register.html");
+    add_route("/1", ROUTE_PAGE, ROUTE_METHOD_ANY, false, "/log.html");
+    add_route("/2", ROUTE_LOGIN, ROUTE_METHOD_POST, false, "/welcome.html", "/logError.html");
+    add_route("/3", ROUTE_REGISTER, ROUTE_METHOD_POST, false, "/log.html", "/registerError.html");
+    add_route("/5", ROUTE_PAGE, ROUTE_METHOD_ANY, false, "/picture.html");
+    add_route("/6", ROUTE_PAGE, ROUTE_METHOD_ANY, false, "/video.html");
+    add_route("/7", ROUTE_PAGE, ROUTE_METHOD_ANY, false, "/fans.html");
+    add_route("/metrics", ROUTE_METRICS, ROUTE_METHOD_GET, true);
+}
+
+void http_router::resolve(route_file &f, const char *page) {
+    f.path[0] = '\0';
+    f.len = 0;
+    if (!page)
+        return;
+    int n = snprintf(f.path, route_file::PATH_LEN, "%s%s", m_doc_root.c_str(), page);
+    if (n < 0 || n >= route_file::PATH_LEN) {
+        f.path[0] = '\0';
+        return;
+    }
+    f.len = n;
+}
+
+void http_router::add_route(const char *prefix, ROUTE_HANDLER handler, int methods, bool exact,
+                            const char *page, const char *fail_page) {
+    route r;
+    r.handler = handler;
+    r.methods = methods;
+    r.exact = exact;
+    resolve(r.file, page);
+    resolve(r.fail, fail_page);
+
+    int n = insert(prefix);
+    m_routes.push_back(r);
+    // 同一节点上完全匹配的路由排在前缀路由之前，查找时优先命中
+    std::vector<int> &rs = m_nodes[n].routes;
+    if (exact)
+        rs.insert(rs.begin(), m_routes.size() - 1);
+    else
+        rs.push_back(m_routes.size() - 1);
+}
+
+int http_router::insert(const char *prefix) {
+    int cur = 0;
+    const char *p = prefix;
+    while (*p) {
+        int next = -1;
+        for (size_t i = 0; i < m_nodes[cur].children.size(); ++i) {
+            int c = m_nodes[cur].children[i];
+            if (m_nodes[c].label[0] == *p) {
+                next = c;
+                break;
+            }
+        }
+        if (next < 0) {
+            node leaf;
+            leaf.label = p;
+            m_nodes.push_back(leaf);
+            m_nodes[cur].children.push_back(m_nodes.size() - 1);
+            return m_nodes.size() - 1;
+        }
+
+        // 计算与已有边的公共前缀长度
+        const std::string &label = m_nodes[next].label;
+        size_t common = 0;
+        while (common < label.size() && p[common] && label[common] == p[common])
+            ++common;
+
+        if (common < label.size()) {
+            // 拆分边：next -> mid(公共部分) -> next(剩余部分)
+            node mid;
+            mid.label = label.substr(0, common);
+            m_nodes[next].label = label.substr(common);
+            mid.children.push_back(next);
+            m_nodes.push_back(mid);
+            int mid_idx = m_nodes.size() - 1;
+            std::vector<int> &siblings = m_nodes[cur].children;
+            for (size_t i = 0; i < siblings.size(); ++i) {
+                if (siblings[i] == next)
+                    siblings[i] = mid_idx;
+            }
+            next = mid_idx;
+        }
+        cur = next;
+        p += common;
+    }
+    return cur;
+}
+
+const route *http_router::match(const char *url, int len, int method_mask) const {
+    const route *best = NULL;
+    int cur = 0;
+    int pos = 0;
+    while (true) {
+        const node &n = m_nodes[cur];
+        for (size_t i = 0; i < n.routes.size(); ++i) {
+            const route &r = m_routes[n.routes[i]];
+            if (!(r.methods & method_mask))
+                continue;
+            if (r.exact && pos != len)
+                continue;
+            best = &r;
+            break;
+        }
+        if (pos >= len)
+            break;
+
+        int next = -1;
+        for (size_t i = 0; i < n.children.size(); ++i) {
+            const node &c = m_nodes[n.children[i]];
+            if (c.label[0] == url[pos]) {
+                next = n.children[i];
+                break;
+            }
+        }
+        if (next < 0)
+            break;
+        const std::string &label = m_nodes[next].label;
+        if ((int)label.size() > len - pos || memcmp(label.data(), url + pos, label.size()) != 0)
+            break;
+        pos += label.size();
+        cur = next;
+    }
+    return best;
+}
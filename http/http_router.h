@@ -0,0 +1,114 @@
+#ifndef HTTP_ROUTER_H
+#define HTTP_ROUTER_H
+
+#include <string>
+#include <vector>
+
+// 路由允许的请求方法，位序与http_conn::METHOD一致
+const int ROUTE_METHOD_GET = 1 << 0;
+const int ROUTE_METHOD_POST = 1 << 1;
+const int ROUTE_METHOD_ANY = ~0;
+
+// 路由处理方式
+enum ROUTE_HANDLER {
+    ROUTE_STATIC = 0,   // 按URL映射到网站根目录下的文件
+    ROUTE_PAGE,         // 固定页面（别名），直接使用预解析好的文件
+    ROUTE_LOGIN,        // 登录表单
+    ROUTE_REGISTER,     // 注册表单
+    ROUTE_METRICS       // 运行状态统计
+};
+
+/**
+ * @brief 启动时预解析好的文件路径
+ */
+struct route_file {
+    static const int PATH_LEN = 200;  // 与http_conn::FILENAME_LEN一致
+    char path[PATH_LEN];              // 完整路径，以'\0'结尾
+    int len;                          // 路径长度，0表示未设置
+};
+
+/**
+ * @brief 一条路由
+ */
+struct route {
+    ROUTE_HANDLER handler;  // 处理方式
+    int methods;            // 允许的请求方法掩码
+    bool exact;             // true时URL必须与前缀完全相同
+    route_file file;        // ROUTE_PAGE的目标页面；表单处理成功后的页面
+    route_file fail;        // 表单处理失败后的页面
+};
+
+/**
+ * @brief URL路由表
+ *
+ * 启动时构建的基数树，按URL前缀把请求映射到处理方式，匹配最长前缀；
+ * 查找过程只读、不分配内存，可以被所有工作线程并发使用
+ */
+class http_router {
+public:
+    /**
+     * @brief 获取路由表单例
+     * @return 路由表指针
+     */
+    static http_router *get_instance() {
+        static http_router instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 以网站根目录构建默认路由
+     * @param doc_root 网站根目录
+     */
+    void init(const char *doc_root);
+
+    /**
+     * @brief 添加一条路由，只能在启动阶段调用
+     * @param prefix URL前缀
+     * @param handler 处理方式
+     * @param methods 允许的请求方法掩码
+     * @param exact 是否要求完全匹配
+     * @param page 目标页面（相对网站根目录），可为NULL
+     * @param fail_page 失败页面（相对网站根目录），可为NULL
+     */
+    void add_route(const char *prefix, ROUTE_HANDLER handler, int methods, bool exact,
+                   const char *page = NULL, const char *fail_page = NULL);
+
+    /**
+     * @brief 查找URL对应的路由
+     * @param url URL路径
+     * @param len 路径长度（不含查询串）
+     * @param method_mask 请求方法对应的掩码位
+     * @return 最长匹配的路由，没有匹配时返回NULL
+     */
+    const route *match(const char *url, int len, int method_mask) const;
+
+private:
+    http_router();
+
+    /**
+     * @brief 基数树节点，children中各边的首字符互不相同
+     */
+    struct node {
+        std::string label;          // 从父节点到本节点的边上的字符串
+        std::vector<int> children;  // 子节点下标
+        std::vector<int> routes;    // 挂在本节点上的路由下标
+    };
+
+    /**
+     * @brief 把前缀插入基数树，必要时拆分已有的边
+     * @param prefix URL前缀
+     * @return 前缀对应的节点下标
+     */
+    int insert(const char *prefix);
+
+    /**
+     * @brief 用网站根目录和相对路径填充route_file
+     */
+    void resolve(route_file &f, const char *page);
+
+    std::vector<node> m_nodes;    // 节点池，下标0为根节点
+    std::vector<route> m_routes;  // 路由池
+    std::string m_doc_root;       // 网站根目录
+};
+
+#endif
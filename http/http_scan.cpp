@@ -0,0 +1,123 @@
+#include "http_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_SCAN_X86 1
+#endif
+
+// 控制字符表：0x00-0x1f（HTAB除外）和0x7f。常量初始化，其他编译单元的静态初始化中也可以使用
+static const bool is_ctl_table[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1, 1, 1, 1, 1, 1,     // 0x00-0x0f
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,     // 0x10-0x1f
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x20-0x2f
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x30-0x3f
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x40-0x4f
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x50-0x5f
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     // 0x60-0x6f
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1      // 0x70-0x7f，0x80之后都为0
+};
+
+static size_t scan_scalar(const char *buf, size_t len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    size_t i = 0;
+    for (; i < len; ++i) {
+        if (is_ctl_table[p[i]])
+            break;
+    }
+    return i;
+}
+
+#ifdef HTTP_SCAN_X86
+__attribute__((target("sse4.2")))
+static size_t scan_sse42(const char *buf, size_t len) {
+    // 三个区间：[0x00,0x08] [0x0a,0x1f] [0x7f,0x7f]
+    static const char ranges[16] = "\x00\x08" "\x0a\x1f" "\x7f\x7f";
+    const __m128i r = _mm_loadu_si128((const __m128i *)ranges);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(buf + i));
+        int idx = _mm_cmpestri(r, 6, b, 16, _SIDD_LEAST_SIGNIFICANT | _SIDD_CMP_RANGES | _SIDD_UBYTE_OPS);
+        if (idx != 16)
+            return i + idx;
+    }
+    return i + scan_scalar(buf + i, len - i);
+}
+
+__attribute__((target("avx2,bmi")))
+static size_t scan_avx2(const char *buf, size_t len) {
+    const __m256i limit = _mm256_set1_epi8(0x1f);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i *)(buf + i));
+        // 无符号 b <= 0x1f 等价于 min(b, 0x1f) == b
+        __m256i low = _mm256_cmpeq_epi8(_mm256_min_epu8(b, limit), b);
+        low = _mm256_andnot_si256(_mm256_cmpeq_epi8(b, tab), low);
+        __m256i hit = _mm256_or_si256(low, _mm256_cmpeq_epi8(b, del));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(hit);
+        if (mask)
+            return i + _tzcnt_u32(mask);
+    }
+    // 尾部不足32字节时用同样逻辑的128位VEX指令处理，避免调用非VEX编码的SSE版本带来状态切换开销
+    if (i + 16 <= len) {
+        __m128i b = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i low = _mm_cmpeq_epi8(_mm_min_epu8(b, _mm256_castsi256_si128(limit)), b);
+        low = _mm_andnot_si128(_mm_cmpeq_epi8(b, _mm256_castsi256_si128(tab)), low);
+        __m128i hit = _mm_or_si128(low, _mm_cmpeq_epi8(b, _mm256_castsi256_si128(del)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(hit);
+        if (mask)
+            return i + _tzcnt_u32(mask);
+        i += 16;
+    }
+    return i + scan_scalar(buf + i, len - i);
+}
+#endif
+
+static http_scan_func pick_scan(const char **name) {
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return scan_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        *name = "sse4.2";
+        return scan_sse42;
+    }
+#endif
+    *name = "scalar";
+    return scan_scalar;
+}
+
+static const char *scan_name = "scalar";
+
+// 第一次调用时选择实现，不依赖各编译单元动态初始化的先后；局部静态变量的初始化是线程安全的
+static http_scan_func scan_impl() {
+    static const http_scan_func impl = pick_scan(&scan_name);
+    return impl;
+}
+
+size_t http_find_ctl(const char *buf, size_t len) {
+    return scan_impl()(buf, len);
+}
+
+http_scan_func http_scan_get(HTTP_SCAN_IMPL impl) {
+    switch (impl) {
+#ifdef HTTP_SCAN_X86
+    case HTTP_SCAN_AVX2:
+        return __builtin_cpu_supports("avx2") ? scan_avx2 : NULL;
+    case HTTP_SCAN_SSE42:
+        return __builtin_cpu_supports("sse4.2") ? scan_sse42 : NULL;
+#endif
+    case HTTP_SCAN_SCALAR:
+        return scan_scalar;
+    default:
+        return NULL;
+    }
+}
+
+const char *http_scan_name() {
+    scan_impl();
+    return scan_name;
+}
@@ -0,0 +1,46 @@
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+
+/**
+ * @brief HTTP报文分隔符扫描
+ *
+ * 参考picohttpparser的做法，一次比较16/32个字节，
+ * 在请求行和请求头中定位第一个控制字符（CR、LF以及其他非法控制字符，HTAB除外）。
+ * 第一次使用时通过CPUID选择AVX2、SSE4.2或标量实现
+ */
+
+// 扫描实现的种类
+enum HTTP_SCAN_IMPL {
+    HTTP_SCAN_SCALAR = 0,
+    HTTP_SCAN_SSE42,
+    HTTP_SCAN_AVX2
+};
+
+typedef size_t (*http_scan_func)(const char *buf, size_t len);
+
+/**
+ * @brief 查找第一个控制字符
+ *
+ * 控制字符指0x00-0x1f（HTAB除外）和0x7f，请求行和请求头中合法的控制字符只有行尾的CRLF
+ * @param buf 待扫描的数据
+ * @param len 数据长度
+ * @return 第一个控制字符的偏移，不存在时返回len
+ */
+size_t http_find_ctl(const char *buf, size_t len);
+
+/**
+ * @brief 获取指定实现的扫描函数，基准测试用于横向对比
+ * @param impl 实现种类
+ * @return 扫描函数，CPU不支持时返回NULL
+ */
+http_scan_func http_scan_get(HTTP_SCAN_IMPL impl);
+
+/**
+ * @brief 当前选中的实现名称
+ * @return "avx2"、"sse4.2"或"scalar"
+ */
+const char *http_scan_name();
+
+#endif
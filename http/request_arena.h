@@ -0,0 +1,82 @@
+#ifndef REQUEST_ARENA_H
+#define REQUEST_ARENA_H
+
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * @brief 请求级内存池
+ *
+ * 每个连接持有一个，内存直接内嵌在对象里，按指针递增分配，每个请求开始时整体复位；
+ * 用来存放请求处理过程中的临时数据（表单字段、SQL语句、动态页面等），
+ * 稳定运行后请求处理不再调用全局malloc。空间用尽时返回NULL，由调用方按失败处理
+ */
+class request_arena {
+public:
+    // 内存池容量
+    static const size_t ARENA_SIZE = 2048;
+
+    // 不写构造函数：http_conn按MAX_FD整块预分配，构造时逐个写入会让全部页面常驻内存，
+    // 使用前由reset()复位即可
+
+    /**
+     * @brief 分配一块内存
+     * @param size 字节数
+     * @param align 对齐要求，必须是2的幂
+     * @return 内存地址，空间不足时返回NULL
+     */
+    void *alloc(size_t size, size_t align = alignof(max_align_t)) {
+        size_t start = (m_used + align - 1) & ~(align - 1);
+        if (start > ARENA_SIZE || size > ARENA_SIZE - start)
+            return NULL;
+        m_used = start + size;
+        if (m_used > m_high_water)
+            m_high_water = m_used;
+        return m_buf + start;
+    }
+
+    /**
+     * @brief 复制一段字符串到内存池，结果以'\0'结尾
+     * @param s 源字符串
+     * @param len 长度
+     * @return 副本地址，空间不足时返回NULL
+     */
+    char *strndup(const char *s, size_t len) {
+        char *p = (char *)alloc(len + 1, 1);
+        if (!p)
+            return NULL;
+        memcpy(p, s, len);
+        p[len] = '\0';
+        return p;
+    }
+
+    /**
+     * @brief 复位，之前分配的内存全部作废
+     */
+    void reset() { m_used = 0; }
+
+    /**
+     * @brief 复位并清空统计，连接建立时调用
+     */
+    void init() {
+        m_used = 0;
+        m_high_water = 0;
+    }
+
+    /**
+     * @brief 当前请求已使用的字节数
+     */
+    size_t used() const { return m_used; }
+
+    /**
+     * @brief 历史最高使用量，用于评估ARENA_SIZE是否合适
+     */
+    size_t high_water() const { return m_high_water; }
+
+private:
+    alignas(max_align_t) char m_buf[ARENA_SIZE];  // 内嵌存储
+    size_t m_used;                                // 已使用的字节数
+    size_t m_high_water;                          // 最高使用量
+};
+
+#endif
@@ -1,11 +1,18 @@
 #include <iostream>
 #include <string>
+#include <vector>
+#include <utility>
+#include <cassert>
 #include <cstring>
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include "http_conn.h"
+#include "hpack.h"
+#include "file_cache.h"
+#include "../net/ip_limiter.h"
+#include "../timer/lst_timer.h"
 
 // 测试 HTTP 请求解析
 void test_http_parsing() {
@@ -54,11 +61,159 @@ void test_http_parsing() {
     conn.close_conn();
 }
 
+typedef std::vector<std::pair<std::string, std::string> > field_list;
+
+static bool collect_field(void *arg, const char *name, size_t name_len, const char *value, size_t value_len) {
+    ((field_list *)arg)->push_back(std::make_pair(std::string(name, name_len), std::string(value, value_len)));
+    return true;
+}
+
+// 解码一个头部块，成功时返回true，字段依次放入fields
+static bool decode_block(hpack_decoder &decoder, const std::vector<uint8_t> &block, field_list &fields) {
+    fields.clear();
+    return decoder.decode(block.data(), block.size(), collect_field, &fields);
+}
+
+// 测试 HPACK 头部解码（用例取自 RFC 7541 附录C）
+void test_hpack_decoding() {
+    std::cout << "\nTesting HPACK integers..." << std::endl;
+    uint32_t value;
+    // C.1.2: 1337，5位前缀
+    const uint8_t int_1337[] = {0x1f, 0x9a, 0x0a};
+    const uint8_t *p = int_1337;
+    assert(hpack_decode_int(p, int_1337 + sizeof(int_1337), 5, &value) && value == 1337);
+    assert(p == int_1337 + sizeof(int_1337));
+    // 续位标志置位但数据已经结束
+    const uint8_t int_truncated[] = {0x1f, 0x9a};
+    p = int_truncated;
+    assert(!hpack_decode_int(p, int_truncated + sizeof(int_truncated), 5, &value));
+    // 超过28位的整数
+    const uint8_t int_overflow[] = {0x1f, 0xff, 0xff, 0xff, 0xff, 0x0f};
+    p = int_overflow;
+    assert(!hpack_decode_int(p, int_overflow + sizeof(int_overflow), 5, &value));
+
+    std::cout << "\nTesting HPACK Huffman strings..." << std::endl;
+    hpack_decoder decoder;
+    field_list fields;
+    // C.4.1: 请求头，字符串使用Huffman编码并加入动态表
+    std::vector<uint8_t> req1 = {0x82, 0x86, 0x84, 0x41, 0x8c, 0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a,
+                                 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff};
+    assert(decode_block(decoder, req1, fields) && fields.size() == 4);
+    assert(fields[0].first == ":method" && fields[0].second == "GET");
+    assert(fields[1].first == ":scheme" && fields[1].second == "http");
+    assert(fields[2].first == ":path" && fields[2].second == "/");
+    assert(fields[3].first == ":authority" && fields[3].second == "www.example.com");
+    // C.4.2: :authority取自上一个块加入的动态表项
+    std::vector<uint8_t> req2 = {0x82, 0x86, 0x84, 0xbe, 0x58, 0x86, 0xa8, 0xeb, 0x10, 0x64, 0x9c, 0xbf};
+    assert(decode_block(decoder, req2, fields) && fields.size() == 5);
+    assert(fields[3].first == ":authority" && fields[3].second == "www.example.com");
+    assert(fields[4].first == "cache-control" && fields[4].second == "no-cache");
+    // 含EOS的编码、超过7位的填充都是非法的
+    std::string out;
+    const uint8_t huff_eos[] = {0xff, 0xff, 0xff, 0xff};
+    assert(!hpack_huffman_decode(huff_eos, sizeof(huff_eos), out));
+    out.clear();
+    const uint8_t huff_padding[] = {0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff, 0xff};
+    assert(!hpack_huffman_decode(huff_padding, sizeof(huff_padding), out));
+
+    std::cout << "\nTesting HPACK dynamic table eviction..." << std::endl;
+    hpack_decoder small;
+    // 表大小更新为256，随后是C.5.1的响应头，加入4项共222字节
+    std::vector<uint8_t> resp1 = {0x3f, 0xe1, 0x01};
+    const char *c51 = "\x48\x03" "302" "\x58\x07" "private" "\x61\x1d" "Mon, 21 Oct 2013 20:13:21 GMT"
+                      "\x6e\x17" "https://www.example.com";
+    resp1.insert(resp1.end(), c51, c51 + strlen(c51));
+    assert(decode_block(small, resp1, fields) && fields.size() == 4);
+    assert(fields[0].first == ":status" && fields[0].second == "302");
+    assert(fields[3].first == "location" && fields[3].second == "https://www.example.com");
+    // C.5.2: 加入:status 307后超过256字节，最早的:status 302被淘汰
+    std::vector<uint8_t> resp2 = {0x48, 0x03, '3', '0', '7', 0xc1, 0xc0, 0xbf};
+    assert(decode_block(small, resp2, fields) && fields.size() == 4);
+    assert(fields[0].second == "307");
+    assert(fields[1].first == "cache-control" && fields[1].second == "private");
+    assert(fields[2].first == "date" && fields[2].second == "Mon, 21 Oct 2013 20:13:21 GMT");
+    assert(fields[3].first == "location");
+    // 动态表只剩4项，下标66已经不存在
+    std::vector<uint8_t> evicted = {0xc2};
+    assert(!decode_block(small, evicted, fields));
+
+    std::cout << "\nTesting malformed HPACK blocks..." << std::endl;
+    hpack_decoder bad;
+    // 下标0不合法
+    std::vector<uint8_t> zero_index = {0x80};
+    assert(!decode_block(bad, zero_index, fields));
+    // 字面量的名称下标整数被截断
+    std::vector<uint8_t> truncated = {0x7f};
+    assert(!decode_block(bad, truncated, fields));
+    // 表大小更新超过通告的上限
+    std::vector<uint8_t> too_large = {0x3f, 0xe2, 0x1f};
+    assert(!decode_block(bad, too_large, fields));
+}
+
+// 测试 Range 请求头解析
+void test_range_parsing() {
+    std::cout << "\nTesting Range parsing..." << std::endl;
+    long long start = -1, end = -1;
+    assert(http_parse_range("bytes=0-499", 1000, &start, &end) == RANGE_OK && start == 0 && end == 499);
+    assert(http_parse_range("BYTES=0-0", 1000, &start, &end) == RANGE_OK && start == 0 && end == 0);
+    // 开放结尾以及超出文件的结尾都截到最后一个字节
+    assert(http_parse_range("bytes=500-", 1000, &start, &end) == RANGE_OK && start == 500 && end == 999);
+    assert(http_parse_range("bytes=900-5000", 1000, &start, &end) == RANGE_OK && start == 900 && end == 999);
+    // 后缀范围：最后N个字节，N超过文件大小时为整个文件
+    assert(http_parse_range("bytes=-200", 1000, &start, &end) == RANGE_OK && start == 800 && end == 999);
+    assert(http_parse_range("bytes=-2000", 1000, &start, &end) == RANGE_OK && start == 0 && end == 999);
+    assert(http_parse_range("bytes=-0", 1000, &start, &end) == RANGE_UNSATISFIABLE);
+    // 等号之后和结尾的空白
+    assert(http_parse_range("bytes= 10-19 \t", 1000, &start, &end) == RANGE_OK && start == 10 && end == 19);
+    // 起点落在文件之外、空文件
+    assert(http_parse_range("bytes=1000-", 1000, &start, &end) == RANGE_UNSATISFIABLE);
+    assert(http_parse_range("bytes=0-", 0, &start, &end) == RANGE_UNSATISFIABLE);
+    assert(http_parse_range("bytes=-5", 0, &start, &end) == RANGE_UNSATISFIABLE);
+    // 语法错误和多段范围按完整响应处理
+    assert(http_parse_range("bytes=500-100", 1000, &start, &end) == RANGE_NONE);
+    assert(http_parse_range("bytes=0-1,5-6", 1000, &start, &end) == RANGE_NONE);
+    assert(http_parse_range("bytes=0-9x", 1000, &start, &end) == RANGE_NONE);
+    assert(http_parse_range("bytes=abc", 1000, &start, &end) == RANGE_NONE);
+    assert(http_parse_range("items=0-9", 1000, &start, &end) == RANGE_NONE);
+    assert(http_parse_range(NULL, 1000, &start, &end) == RANGE_NONE);
+}
+
+// 测试 -L 和 -D 参数解析
+void test_option_parsing() {
+    std::cout << "\nTesting option parsing..." << std::endl;
+    std::string err;
+    ip_limit limit;
+    assert(limit.parse("conns=10,rate=5,,burst=20,rst=1", &err));
+    assert(limit.conns == 10 && limit.rate == 5 && limit.burst == 20 && limit.rst && limit.enabled());
+    // 未出现的参数保持原值
+    assert(limit.parse("rate=0", &err) && limit.conns == 10 && limit.rate == 0);
+    const char *bad_limits[] = {"conns=-1", "rate=abc", "burst=5x", "conns", "rate=", "rate=1000001", "foo=1"};
+    for (size_t i = 0; i < sizeof(bad_limits) / sizeof(bad_limits[0]); ++i) {
+        ip_limit l;
+        err.clear();
+        assert(!l.parse(bad_limits[i], &err) && err == bad_limits[i]);
+    }
+
+    conn_timeouts timeouts;
+    assert(timeouts.parse("header_ms=1000,min_rate=0", &err));
+    assert(timeouts.header_ms == 1000 && timeouts.min_rate == 0 && timeouts.body_ms == 20000);
+    const char *bad_timeouts[] = {"body_ms=0", "write_ms=-5", "keepalive_ms=3600001", "header_ms=", "header_ms",
+                                  "nosuch=5"};
+    for (size_t i = 0; i < sizeof(bad_timeouts) / sizeof(bad_timeouts[0]); ++i) {
+        conn_timeouts t;
+        err.clear();
+        assert(!t.parse(bad_timeouts[i], &err) && err == bad_timeouts[i]);
+    }
+}
+
 int main() {
     std::cout << "HTTP Connection Class Test Program" << std::endl;
     std::cout << "----------------------------------------" << std::endl;
     
     test_http_parsing();
+    test_hpack_decoding();
+    test_range_parsing();
+    test_option_parsing();
     
     std::cout << "\nTest completed" << std::endl;
     return 0;
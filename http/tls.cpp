@@ -0,0 +1,249 @@
+#include "tls.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef USE_TLS
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+struct tls_session {
+    SSL *ssl;
+    int fd;
+    bool established;   // 握手已完成
+    bool ktls_send;     // 发送方向已交给内核加密
+};
+
+// ALPN按服务器的偏好选择，h2优先；协商出h2的客户端直接发送连接前言，由HTTP/1解析器识别后切换
+static const unsigned char ALPN_PROTOS[] = "\x02h2\x08http/1.1";
+
+static int alpn_select(SSL *, const unsigned char **out, unsigned char *outlen,
+                       const unsigned char *in, unsigned int inlen, void *) {
+    if (SSL_select_next_proto((unsigned char **)out, outlen, ALPN_PROTOS, sizeof(ALPN_PROTOS) - 1,
+                              in, inlen) != OPENSSL_NPN_NEGOTIATED)
+        return SSL_TLSEXT_ERR_NOACK;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+static void set_error(char *buf, size_t size, const char *what) {
+    unsigned long e = ERR_get_error();
+    if (e) {
+        char reason[160];
+        ERR_error_string_n(e, reason, sizeof(reason));
+        snprintf(buf, size, "%s: %s", what, reason);
+    } else {
+        snprintf(buf, size, "%s", what);
+    }
+    ERR_clear_error();
+}
+
+bool tls_context::init(const char *cert, const char *key, const char *ticket_key) {
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        set_error(m_error, sizeof(m_error), "SSL_CTX_new");
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    // kTLS由OpenSSL在握手完成后通过setsockopt(SOL_TLS)开启，内核只支持AES-GCM和ChaCha20-Poly1305，
+    // 这两类也是TLS 1.2/1.3下的默认首选
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE);
+    // 非阻塞写：允许部分写入，重试时iovec的地址可以不同（内容相同）
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                          SSL_MODE_RELEASE_BUFFERS);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, cert) != 1) {
+        set_error(m_error, sizeof(m_error), cert);
+        SSL_CTX_free(ctx);
+        return false;
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx, key, SSL_FILETYPE_PEM) != 1 || SSL_CTX_check_private_key(ctx) != 1) {
+        set_error(m_error, sizeof(m_error), key);
+        SSL_CTX_free(ctx);
+        return false;
+    }
+
+    // 会话恢复只用无状态的session ticket，服务端不保存会话
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_num_tickets(ctx, 1);
+    if (ticket_key && ticket_key[0]) {
+        unsigned char keys[TICKET_KEY_LEN];
+        FILE *fp = fopen(ticket_key, "rb");
+        size_t n = fp ? fread(keys, 1, sizeof(keys), fp) : 0;
+        if (fp)
+            fclose(fp);
+        if (n != sizeof(keys) || SSL_CTX_set_tlsext_ticket_keys(ctx, keys, sizeof(keys)) != 1) {
+            snprintf(m_error, sizeof(m_error), "%s: need %d bytes of key material", ticket_key, TICKET_KEY_LEN);
+            SSL_CTX_free(ctx);
+            return false;
+        }
+        memset(keys, 0, sizeof(keys));
+    }
+
+    SSL_CTX_set_alpn_select_cb(ctx, alpn_select, NULL);
+    m_ctx = ctx;
+    return true;
+}
+
+tls_session *tls_context::accept(int fd) {
+    SSL *ssl = SSL_new((SSL_CTX *)m_ctx);
+    if (!ssl)
+        return NULL;
+    if (SSL_set_fd(ssl, fd) != 1) {
+        SSL_free(ssl);
+        return NULL;
+    }
+    SSL_set_accept_state(ssl);
+    tls_session *s = new tls_session;
+    s->ssl = ssl;
+    s->fd = fd;
+    s->established = false;
+    s->ktls_send = false;
+    return s;
+}
+
+/**
+ * @brief 把SSL_get_error的结果转换为TLS_RESULT，错误队列只在本线程内有效，用完清空
+ */
+static TLS_RESULT tls_result(SSL *ssl, int ret) {
+    switch (SSL_get_error(ssl, ret)) {
+    case SSL_ERROR_WANT_READ:
+        return TLS_WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+        return TLS_WANT_WRITE;
+    default:
+        ERR_clear_error();
+        return TLS_ERROR;
+    }
+}
+
+TLS_RESULT tls_handshake(tls_session *s) {
+    if (s->established)
+        return TLS_OK;
+    int ret = SSL_do_handshake(s->ssl);
+    if (ret != 1)
+        return tls_result(s->ssl, ret);
+    s->established = true;
+#ifdef BIO_get_ktls_send
+    s->ktls_send = BIO_get_ktls_send(SSL_get_wbio(s->ssl));
+#endif
+    return TLS_OK;
+}
+
+bool tls_established(const tls_session *s) {
+    return s->established;
+}
+
+bool tls_ktls_send(const tls_session *s) {
+    return s->ktls_send;
+}
+
+ssize_t tls_recv(tls_session *s, char *buf, size_t len) {
+    size_t n = 0;
+    int ret = SSL_read_ex(s->ssl, buf, len, &n);
+    if (ret == 1)
+        return n;
+    int err = SSL_get_error(s->ssl, ret);
+    if (err == SSL_ERROR_ZERO_RETURN)
+        return 0;
+    if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+        errno = EAGAIN;
+        return -1;
+    }
+    ERR_clear_error();
+    errno = EIO;
+    return -1;
+}
+
+ssize_t tls_writev(tls_session *s, const struct iovec *iov, int count) {
+    // 内核负责加密时writev写入的数据会被封装成应用数据记录，映射区无需拷贝
+    if (s->ktls_send)
+        return writev(s->fd, iov, count);
+
+    ssize_t total = 0;
+    for (int i = 0; i < count; ++i) {
+        if (iov[i].iov_len == 0)
+            continue;
+        size_t n = 0;
+        int ret = SSL_write_ex(s->ssl, iov[i].iov_base, iov[i].iov_len, &n);
+        if (ret == 1) {
+            total += n;
+            if (n < iov[i].iov_len)
+                break;
+            continue;
+        }
+        if (tls_result(s->ssl, ret) == TLS_ERROR) {
+            if (total > 0)
+                return total;
+            errno = EIO;
+            return -1;
+        }
+        if (total > 0)
+            return total;
+        errno = EAGAIN;
+        return -1;
+    }
+    return total;
+}
+
+bool tls_pending(const tls_session *s) {
+    return SSL_pending(s->ssl) > 0;
+}
+
+void tls_free(tls_session *s) {
+    if (!s)
+        return;
+    SSL_free(s->ssl);
+    delete s;
+}
+
+#else
+
+// 未启用TLS编译时的空实现，tls_context::init()总是失败，不会产生TLS连接
+
+struct tls_session {
+    int fd;
+};
+
+bool tls_context::init(const char *, const char *, const char *) {
+    snprintf(m_error, sizeof(m_error), "built without TLS support, rebuild with `make TLS=1`");
+    return false;
+}
+
+tls_session *tls_context::accept(int) {
+    return NULL;
+}
+
+TLS_RESULT tls_handshake(tls_session *) {
+    return TLS_ERROR;
+}
+
+bool tls_established(const tls_session *) {
+    return false;
+}
+
+bool tls_ktls_send(const tls_session *) {
+    return false;
+}
+
+ssize_t tls_recv(tls_session *, char *, size_t) {
+    errno = EIO;
+    return -1;
+}
+
+ssize_t tls_writev(tls_session *, const struct iovec *, int) {
+    errno = EIO;
+    return -1;
+}
+
+bool tls_pending(const tls_session *) {
+    return false;
+}
+
+void tls_free(tls_session *s) {
+    delete s;
+}
+
+#endif
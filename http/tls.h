@@ -0,0 +1,120 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * @brief HTTPS支持
+ *
+ * 基于OpenSSL，需要用`make TLS=1`编译，否则tls_context::init()总是失败，HTTPS监听不会开启。
+ * 握手完成后由OpenSSL通过setsockopt(SOL_TLS)把会话密钥交给内核（kTLS），
+ * 之后响应直接对socket做writev，映射区的文件内容无需经过用户态加密即可发送；
+ * 内核或OpenSSL不支持kTLS时退回SSL_write。
+ * 会话恢复使用session ticket，指定票据密钥文件后多个进程、重启前后都能互相恢复会话
+ */
+
+// 单个TLS连接，内部持有SSL对象
+struct tls_session;
+
+// 非阻塞TLS操作的结果
+enum TLS_RESULT {
+    TLS_OK = 0,         // 完成
+    TLS_WANT_READ,      // 等待socket可读
+    TLS_WANT_WRITE,     // 等待socket可写
+    TLS_ERROR           // 出错，连接应当关闭
+};
+
+/**
+ * @brief 全局TLS配置（证书、私钥、票据密钥）
+ */
+class tls_context {
+public:
+    // 票据密钥文件的长度：16字节名称 + 32字节HMAC密钥 + 32字节AES密钥
+    static const int TICKET_KEY_LEN = 80;
+
+    /**
+     * @brief 获取TLS配置单例
+     */
+    static tls_context *get_instance() {
+        static tls_context instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 加载证书和私钥
+     * @param cert 证书链文件（PEM）
+     * @param key 私钥文件（PEM）
+     * @param ticket_key 票据密钥文件，为空时每个进程随机生成
+     * @return 是否成功
+     */
+    bool init(const char *cert, const char *key, const char *ticket_key);
+
+    /**
+     * @brief 是否已初始化
+     */
+    bool enabled() const { return m_ctx != NULL; }
+
+    /**
+     * @brief init()失败的原因
+     */
+    const char *error() const { return m_error; }
+
+    /**
+     * @brief 为新连接创建TLS会话，握手在之后的读写中逐步完成
+     * @param fd 已accept的socket
+     * @return 会话，失败返回NULL
+     */
+    tls_session *accept(int fd);
+
+private:
+    tls_context() : m_ctx(NULL) { m_error[0] = '\0'; }
+
+    void *m_ctx;            // SSL_CTX，头文件不依赖OpenSSL
+    char m_error[256];      // 初始化失败的原因
+};
+
+/**
+ * @brief 推进握手
+ * @return 握手完成时为TLS_OK
+ */
+TLS_RESULT tls_handshake(tls_session *s);
+
+/**
+ * @brief 握手是否已完成
+ */
+bool tls_established(const tls_session *s);
+
+/**
+ * @brief 发送方向是否已经由内核加密（kTLS）
+ */
+bool tls_ktls_send(const tls_session *s);
+
+/**
+ * @brief 读取解密后的数据
+ * @return 读到的字节数；0表示对端关闭；-1表示出错，errno为EAGAIN时表示暂无数据
+ */
+ssize_t tls_recv(tls_session *s, char *buf, size_t len);
+
+/**
+ * @brief 发送数据，语义与writev相同
+ *
+ * 启用kTLS发送时直接对socket做writev，否则依次调用SSL_write
+ * @return 写出的字节数，-1表示出错，errno为EAGAIN时表示socket已写满
+ */
+ssize_t tls_writev(tls_session *s, const struct iovec *iov, int count);
+
+/**
+ * @brief OpenSSL内部是否还有已解密、尚未读取的数据
+ *
+ * 这部分数据已经离开socket，epoll不会再通知，调用方需要主动读取
+ */
+bool tls_pending(const tls_session *s);
+
+/**
+ * @brief 释放会话，不关闭socket
+ */
+void tls_free(tls_session *s);
+
+#endif
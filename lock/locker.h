@@ -4,6 +4,7 @@
 #include <exception>
 #include <pthread.h>
 #include <semaphore.h>
+#include <time.h>
 
 /**
  * @brief 信号量类
@@ -48,6 +49,23 @@ public:
         return sem_wait(&m_sem) == 0;
     }
     
+    /**
+     * @brief 限时等待信号量
+     * @param ms 最多等待的毫秒数
+     * @return 是否等到，超时或被信号中断时返回false
+     */
+    bool timedwait(int ms) {
+        struct timespec t;
+        clock_gettime(CLOCK_REALTIME, &t);
+        t.tv_sec += ms / 1000;
+        t.tv_nsec += (long)(ms % 1000) * 1000000;
+        if (t.tv_nsec >= 1000000000) {
+            ++t.tv_sec;
+            t.tv_nsec -= 1000000000;
+        }
+        return sem_timedwait(&m_sem, &t) == 0;
+    }
+
     /**
      * @brief 增加信号量
      * 
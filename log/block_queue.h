@@ -170,6 +170,33 @@ public:
         return true;
     }
 
+    /**
+     * @brief 以赋值方式向队列中添加元素
+     * 
+     * 与push相同，但直接用item给队列槽位赋值，不需要先构造一个T；
+     * 对string这类元素，槽位会复用上一次分配的容量，稳定后不再申请内存
+     * @param item 可赋值给T的值，例如const char*
+     * @return 添加成功返回true，队列满则返回false
+     */
+    template <class U>
+    bool push_assign(const U &item) {
+        m_mutex.lock();
+        if (m_size >= m_max_size) {
+            m_cond.broadcast();
+            m_mutex.unlock();
+            return false;
+        }
+
+        m_back = (m_back + 1) % m_max_size;
+        m_array[m_back] = item;
+
+        m_size++;
+
+        m_cond.broadcast();
+        m_mutex.unlock();
+        return true;
+    }
+
     /**
      * @brief 从队列中取出元素
      * 
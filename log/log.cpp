@@ -85,8 +85,9 @@ void Log::write_log(int level, const char *format, ...)
     struct timeval now = {0, 0};
     gettimeofday(&now, NULL);
     time_t t = now.tv_sec;
-    struct tm *sys_tm = localtime(&t);
-    struct tm my_tm = *sys_tm;
+    //localtime_r线程安全，且不会每次重新检查时区配置（localtime会，代价是一次内存分配）
+    struct tm my_tm;
+    localtime_r(&t, &my_tm);
     char s[16] = {0};
     switch (level)
     {
@@ -138,7 +139,6 @@ void Log::write_log(int level, const char *format, ...)
     va_list valst;
     va_start(valst, format);
 
-    string log_str;
     m_mutex.lock();
 
     //写入的具体时间内容格式
@@ -147,23 +147,19 @@ void Log::write_log(int level, const char *format, ...)
                      my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec, now.tv_usec, s);
     
     int m = vsnprintf(m_buf + n, m_log_buf_size - n - 1, format, valst);
+    if (m > m_log_buf_size - n - 2)
+        m = m_log_buf_size - n - 2;
     m_buf[n + m] = '\n';
     m_buf[n + m + 1] = '\0';
-    log_str = m_buf;
 
-    m_mutex.unlock();
-
-    if (m_is_async && !m_log_queue->full())
+    //直接从m_buf入队或写文件，不再为每行日志构造临时string
+    if (!(m_is_async && m_log_queue->push_assign(m_buf)))
     {
-        m_log_queue->push(log_str);
-    }
-    else
-    {
-        m_mutex.lock();
-        fputs(log_str.c_str(), m_fp);
-        m_mutex.unlock();
+        fputs(m_buf, m_fp);
     }
 
+    m_mutex.unlock();
+
     va_end(valst);
 }
 
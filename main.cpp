@@ -11,28 +11,56 @@ int main(int argc, char *argv[]) {
     // 解析命令行参数
     config.parse_arg(argc, argv);
 
+    // 多进程模式：主进程在这里创建并监视工作进程，不会返回；工作进程各自继续完成下面的初始化。
+    // 由热升级启动时还会取走旧进程交来的监听socket
+    prefork::get_instance()->run(config.workers, config.PORT, config.tls_port);
+
     // 创建Web服务器对象
     WebServer server;
 
     // 初始化服务器
     // 参数包括：端口、数据库用户名/密码/数据库名、日志写入方式、优雅关闭连接选项
-    // 触发模式、数据库连接数、线程数、是否关闭日志、并发模型选择
+    // 触发模式、数据库连接数、线程数、是否关闭日志、并发模型选择、请求体大小上限
     server.init(config.PORT, user, passwd, databasename, config.LOGWrite,
                 config.OPT_LINGER, config.TRIGMode, config.sql_num, config.thread_num,
-                config.close_log, config.actor_model);
+                config.close_log, config.actor_model, config.max_body);
 
     // 初始化日志系统
     server.log_write();
 
+    // 配置HTTPS监听（-P为0时不开启）
+    server.tls(config.tls_port, config.tls_cert, config.tls_key, config.tls_ticket_key);
+
     // 初始化数据库连接池
     server.sql_pool();
 
+    // 线程绑核（-A），工作线程在创建时按它绑定
+    server.affinity(config.affinity);
+
+    // 线程池的伸缩范围和各类任务的调度（-E），默认固定为-t个线程
+    server.pool_size(config.sizing);
+
     // 初始化线程池
     server.thread_pool();
 
     // 设置触发模式（LT/ET）
     server.trig_mode();
 
+    // 选择I/O引擎（-e 1为io_uring，不可用时退回epoll）
+    server.io_engine(config.io_engine);
+
+    // socket调优参数（backlog、TCP_NODELAY等）
+    server.socket_tuning(config.sock_opts);
+
+    // 收到SIGTERM后最多等待多久让进行中的请求完成（-g）
+    server.drain(config.drain_timeout);
+
+    // 按客户端IP的并发连接数和新建连接速率上限（-L）
+    server.rate_limit(config.limits);
+
+    // 请求头、请求体、发送响应和长连接空闲各自的时限（-D）
+    server.timeouts(config.timeouts);
+
     // 开始监听连接请求
     server.eventListen();
 
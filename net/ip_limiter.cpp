@@ -0,0 +1,218 @@
+#include "ip_limiter.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/random.h>
+
+// 表项数量，约为连接上限的两倍；每项16字节
+static const uint32_t TABLE_SIZE = 1 << 17;
+// 插入和查找最多探测的表项数，超过时视为表满
+static const uint32_t MAX_PROBE = 64;
+// 已删除表项的键，255.255.255.255和0.0.0.0都不会是TCP连接的对端
+static const uint32_t TOMBSTONE = 0xffffffffu;
+
+ip_limit::ip_limit() : conns(0), rate(0), burst(0), rst(false) {}
+
+bool ip_limit::parse(const char *spec, std::string *err) {
+    std::string s(spec);
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        std::string item = s.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty())
+            continue;
+
+        size_t eq = item.find('=');
+        char *tail = NULL;
+        long value = eq == std::string::npos ? 0 : strtol(item.c_str() + eq + 1, &tail, 10);
+        if (eq == std::string::npos || tail == item.c_str() + eq + 1 || *tail != '\0' || value < 0 ||
+            value > 1000000) {
+            *err = item;
+            return false;
+        }
+        std::string key = item.substr(0, eq);
+        if (key == "conns")
+            conns = (int)value;
+        else if (key == "rate")
+            rate = (int)value;
+        else if (key == "burst")
+            burst = (int)value;
+        else if (key == "rst")
+            rst = value != 0;
+        else {
+            *err = item;
+            return false;
+        }
+    }
+    return true;
+}
+
+ip_limiter::ip_limiter()
+    : m_table(NULL), m_mask(0), m_seed(0), m_cap(0), m_fd_slot(NULL), m_max_fd(0) {}
+
+ip_limiter::~ip_limiter() {
+    delete[] m_table;
+    delete[] m_fd_slot;
+}
+
+// 低精度的单调时钟（vDSO读取，不进内核），毫秒，按32位回绕
+static uint32_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+void ip_limiter::init(const ip_limit &limit, int max_fd) {
+    m_limit = limit;
+    if (!m_limit.enabled())
+        return;
+    if (m_limit.burst <= 0)
+        m_limit.burst = m_limit.rate > 0 ? m_limit.rate : 1;
+    m_cap = (uint32_t)m_limit.burst * 1000;
+    m_table = new entry[TABLE_SIZE];
+    memset(m_table, 0, sizeof(entry) * TABLE_SIZE);
+    m_mask = TABLE_SIZE - 1;
+    if (getrandom(&m_seed, sizeof(m_seed), GRND_NONBLOCK) != sizeof(m_seed))
+        m_seed = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+    m_max_fd = max_fd;
+    m_fd_slot = new int[max_fd];
+    for (int i = 0; i < max_fd; ++i)
+        m_fd_slot[i] = -1;
+}
+
+// murmur3的最终混合，地址相近的客户端也能均匀散开
+static uint32_t mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return h;
+}
+
+int ip_limiter::find_or_insert(uint32_t ip, uint32_t now) {
+    for (;;) {
+        uint32_t home = mix(ip ^ m_seed) & m_mask;
+        int free_slot = -1;
+        uint32_t expect = 0;
+        for (uint32_t i = 0; i < MAX_PROBE; ++i) {
+            uint32_t idx = (home + i) & m_mask;
+            uint32_t key = __atomic_load_n(&m_table[idx].ip, __ATOMIC_ACQUIRE);
+            if (key == ip)
+                return (int)idx;
+            if (key == TOMBSTONE) {
+                if (free_slot < 0) {
+                    free_slot = (int)idx;
+                    expect = TOMBSTONE;
+                }
+                continue;
+            }
+            if (key == 0) {
+                // 探测链到此为止，ip不在表中
+                if (free_slot < 0) {
+                    free_slot = (int)idx;
+                    expect = 0;
+                }
+                break;
+            }
+        }
+        if (free_slot < 0)
+            return -1;
+
+        // 先初始化再发布键，其他线程看到键时计数和令牌桶已经就绪
+        entry &e = m_table[free_slot];
+        __atomic_store_n(&e.conns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&e.bucket, ((uint64_t)now << 32) | m_cap, __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(&e.ip, &expect, ip, false, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED))
+            return free_slot;
+        // 同一位置被并发插入，重新查找
+    }
+}
+
+bool ip_limiter::take_token(entry &e, uint32_t now) {
+    uint64_t old = __atomic_load_n(&e.bucket, __ATOMIC_RELAXED);
+    for (;;) {
+        uint32_t last = (uint32_t)(old >> 32);
+        uint64_t tokens = (uint32_t)old + (uint64_t)(uint32_t)(now - last) * m_limit.rate;
+        if (tokens > m_cap)
+            tokens = m_cap;
+        if (tokens < 1000)
+            return false;
+        uint64_t next = ((uint64_t)now << 32) | (tokens - 1000);
+        if (__atomic_compare_exchange_n(&e.bucket, &old, next, true, __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED))
+            return true;
+    }
+}
+
+bool ip_limiter::bucket_full(const entry &e, uint32_t now) const {
+    uint64_t b = __atomic_load_n(&e.bucket, __ATOMIC_RELAXED);
+    uint64_t tokens = (uint32_t)b + (uint64_t)(uint32_t)(now - (uint32_t)(b >> 32)) * m_limit.rate;
+    return m_limit.rate <= 0 || tokens >= m_cap;
+}
+
+ip_limiter::result ip_limiter::admit(int fd, uint32_t ip) {
+    if (!m_table || fd < 0 || fd >= m_max_fd)
+        return IP_ADMIT;
+    uint32_t now = now_ms();
+    int idx = find_or_insert(ip, now);
+    if (idx < 0)
+        return IP_ADMIT;
+    entry &e = m_table[idx];
+
+    // 先占连接数再取令牌：超过并发上限的连接不消耗令牌
+    int conns = __atomic_add_fetch(&e.conns, 1, __ATOMIC_ACQ_REL);
+    if (m_limit.conns > 0 && conns > m_limit.conns) {
+        __atomic_sub_fetch(&e.conns, 1, __ATOMIC_RELEASE);
+        return IP_CONNS;
+    }
+    if (m_limit.rate > 0 && !take_token(e, now)) {
+        __atomic_sub_fetch(&e.conns, 1, __ATOMIC_RELEASE);
+        return IP_RATE;
+    }
+    __atomic_store_n(&m_fd_slot[fd], idx, __ATOMIC_RELEASE);
+    return IP_ADMIT;
+}
+
+void ip_limiter::release(int fd) {
+    if (!m_table || fd < 0 || fd >= m_max_fd)
+        return;
+    int idx = __atomic_exchange_n(&m_fd_slot[fd], -1, __ATOMIC_ACQ_REL);
+    if (idx >= 0)
+        __atomic_sub_fetch(&m_table[idx].conns, 1, __ATOMIC_RELEASE);
+}
+
+void ip_limiter::sweep() {
+    if (!m_table)
+        return;
+    // 只有接入连接的线程（事件循环）插入和清理表项，工作线程只通过m_fd_slot减少连接数，
+    // 连接数为0的表项不会再被其他线程修改
+    uint32_t now = now_ms();
+    uint32_t empty = TABLE_SIZE;
+    for (uint32_t i = 0; i < TABLE_SIZE; ++i) {
+        entry &e = m_table[i];
+        uint32_t key = __atomic_load_n(&e.ip, __ATOMIC_RELAXED);
+        if (key == 0) {
+            empty = i;
+            continue;
+        }
+        if (key != TOMBSTONE && __atomic_load_n(&e.conns, __ATOMIC_ACQUIRE) == 0 && bucket_full(e, now))
+            __atomic_store_n(&e.ip, TOMBSTONE, __ATOMIC_RELEASE);
+    }
+    if (empty == TABLE_SIZE)
+        return;
+    // 后面紧跟空表项的删除标记不在任何探测链的中间，可以变回空表项；
+    // 从一个空表项开始倒着走一圈，连续的删除标记一次清完
+    for (uint32_t n = 1; n < TABLE_SIZE; ++n) {
+        uint32_t i = (empty - n) & m_mask;
+        uint32_t next = (i + 1) & m_mask;
+        if (m_table[i].ip == TOMBSTONE && m_table[next].ip == 0)
+            __atomic_store_n(&m_table[i].ip, 0, __ATOMIC_RELAXED);
+    }
+}
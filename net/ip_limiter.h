@@ -0,0 +1,106 @@
+#ifndef IP_LIMITER_H
+#define IP_LIMITER_H
+
+#include <stdint.h>
+#include <string>
+
+/**
+ * @brief 按客户端IP的接入限制参数
+ *
+ * 命令行用-L指定，格式为逗号分隔的key=value，例如`-L conns=64,rate=20,burst=40`；
+ * 全部为0时不启用（默认）
+ */
+struct ip_limit {
+    int conns;      // 单个IP同时保持的连接数上限，0表示不限制
+    int rate;       // 单个IP每秒新建连接数（令牌桶的补充速率），0表示不限制
+    int burst;      // 令牌桶容量，即允许的突发连接数，0表示与rate相同
+    bool rst;       // 拒绝时直接发送RST，默认回复429
+
+    ip_limit();
+
+    /**
+     * @brief 解析key=value[,key=value...]，未出现的参数保持原值
+     * @param spec 参数字符串
+     * @param err 失败时写入出错的部分
+     * @return 是否成功
+     */
+    bool parse(const char *spec, std::string *err);
+
+    bool enabled() const { return conns > 0 || rate > 0; }
+};
+
+/**
+ * @brief 按客户端IP的令牌桶和并发连接计数
+ *
+ * 固定大小的开放寻址表，每个IP一项，不加锁：键用CAS写入，令牌桶把上次补充的时刻和剩余令牌
+ * 打包在一个64位整数里用CAS更新，连接数用原子加减。连接占用的表项按fd记录，
+ * 关闭时（工作线程或定时器）不必查表；定时器每次tick时清理没有连接且令牌已经补满的表项。
+ * 表满时放行且不计数，而不是拒绝
+ */
+class ip_limiter {
+public:
+    enum result {
+        IP_ADMIT,       // 放行
+        IP_RATE,        // 新建连接过快
+        IP_CONNS        // 并发连接数已达上限
+    };
+
+    /**
+     * @brief 获取单例
+     */
+    static ip_limiter *get_instance() {
+        static ip_limiter instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 按参数分配表，未启用时不分配，之后admit()总是放行
+     * @param limit 限制参数
+     * @param max_fd 连接fd的上限
+     */
+    void init(const ip_limit &limit, int max_fd);
+
+    /**
+     * @brief 新连接接入时检查并占用配额，在分配连接状态之前调用
+     * @param fd 连接socket
+     * @param ip 客户端地址（网络字节序）
+     */
+    result admit(int fd, uint32_t ip);
+
+    /**
+     * @brief 连接关闭时归还配额，须在close(fd)之前调用；同一个fd重复调用无副作用
+     */
+    void release(int fd);
+
+    /**
+     * @brief 清理空闲表项，由定时器周期调用
+     */
+    void sweep();
+
+    bool rst() const { return m_limit.rst; }
+
+private:
+    struct entry {
+        uint32_t ip;        // 0表示空，TOMBSTONE表示已删除
+        int conns;          // 当前连接数
+        uint64_t bucket;    // 高32位为上次补充的时刻（毫秒），低32位为剩余令牌（千分之一个）
+    };
+
+    ip_limiter();
+    ~ip_limiter();
+
+    int find_or_insert(uint32_t ip, uint32_t now);
+    bool take_token(entry &e, uint32_t now);
+    bool bucket_full(const entry &e, uint32_t now) const;
+
+private:
+    ip_limit m_limit;
+    entry *m_table;         // 表项数组，未启用时为NULL
+    uint32_t m_mask;        // 表大小减一
+    uint32_t m_seed;        // 散列种子，避免客户端构造冲突的地址
+    uint32_t m_cap;         // 令牌桶容量（千分之一个）
+    int *m_fd_slot;         // 每个fd占用的表项，-1表示没有
+    int m_max_fd;
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include "socket_opts.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+socket_opts::socket_opts()
+    : backlog(1024), defer_accept(0), fastopen(0), nodelay(true), cork(true), sndbuf(0), rcvbuf(0),
+      busy_poll(0) {}
+
+bool socket_opts::parse(const char *spec, std::string *err) {
+    std::string s(spec);
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        std::string item = s.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty())
+            continue;
+
+        size_t eq = item.find('=');
+        char *tail = NULL;
+        long value = eq == std::string::npos ? 0 : strtol(item.c_str() + eq + 1, &tail, 10);
+        if (eq == std::string::npos || tail == item.c_str() + eq + 1 || *tail != '\0' || value < 0) {
+            *err = item;
+            return false;
+        }
+        std::string key = item.substr(0, eq);
+        if (key == "backlog")
+            backlog = (int)value;
+        else if (key == "defer_accept")
+            defer_accept = (int)value;
+        else if (key == "fastopen")
+            fastopen = (int)value;
+        else if (key == "nodelay")
+            nodelay = value != 0;
+        else if (key == "cork")
+            cork = value != 0;
+        else if (key == "sndbuf")
+            sndbuf = (int)value;
+        else if (key == "rcvbuf")
+            rcvbuf = (int)value;
+        else if (key == "busy_poll")
+            busy_poll = (int)value;
+        else {
+            *err = item;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool set_int(int fd, int level, int name, int value, const char *label, std::string *err) {
+    if (setsockopt(fd, level, name, &value, sizeof(value)) == 0)
+        return true;
+    if (!err->empty())
+        *err += ",";
+    *err += label;
+    return false;
+}
+
+bool socket_opts::apply_listen(int fd, std::string *err) const {
+    bool ok = true;
+    // 为0时保持内核默认：显式设置缓冲区大小会关闭该方向的自动调节
+    if (sndbuf > 0)
+        ok &= set_int(fd, SOL_SOCKET, SO_SNDBUF, sndbuf, "sndbuf", err);
+    if (rcvbuf > 0)
+        ok &= set_int(fd, SOL_SOCKET, SO_RCVBUF, rcvbuf, "rcvbuf", err);
+    if (busy_poll > 0)
+        ok &= set_int(fd, SOL_SOCKET, SO_BUSY_POLL, busy_poll, "busy_poll", err);
+    if (nodelay)
+        ok &= set_int(fd, IPPROTO_TCP, TCP_NODELAY, 1, "nodelay", err);
+    if (defer_accept > 0)
+        ok &= set_int(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, defer_accept, "defer_accept", err);
+    if (fastopen > 0)
+        ok &= set_int(fd, IPPROTO_TCP, TCP_FASTOPEN, fastopen, "fastopen", err);
+    return ok;
+}
+
+bool socket_opts::set_cork(int fd, bool on) {
+    int value = on ? 1 : 0;
+    return setsockopt(fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) == 0;
+}
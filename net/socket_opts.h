@@ -0,0 +1,48 @@
+#ifndef SOCKET_OPTS_H
+#define SOCKET_OPTS_H
+
+#include <string>
+
+/**
+ * @brief socket调优参数
+ *
+ * 缓冲区大小、TCP_NODELAY、SO_BUSY_POLL设置在监听socket上，accept得到的连接socket会继承，
+ * 不必每个连接再调用setsockopt；TCP_CORK由http_conn在流式响应期间开关。
+ * 命令行用-O指定，格式为逗号分隔的key=value，例如`-O backlog=4096,defer_accept=1,fastopen=256`
+ */
+struct socket_opts {
+    int backlog;        // listen的backlog，实际上限为net.core.somaxconn，默认1024
+    int defer_accept;   // TCP_DEFER_ACCEPT秒数：握手完成后等到首个数据包才通知accept，0表示不启用（默认）
+    int fastopen;       // TCP_FASTOPEN队列长度，0表示不启用（默认）；还需要net.ipv4.tcp_fastopen包含2
+    bool nodelay;       // TCP_NODELAY，默认开启
+    bool cork;          // 流式响应期间开启TCP_CORK，凑满报文段再发送，默认开启
+    int sndbuf;         // SO_SNDBUF字节数，0表示由内核自动调节（默认）
+    int rcvbuf;         // SO_RCVBUF字节数，0表示由内核自动调节（默认）
+    int busy_poll;      // SO_BUSY_POLL微秒数，0表示不启用（默认）；调大需要CAP_NET_ADMIN
+
+    socket_opts();
+
+    /**
+     * @brief 解析key=value[,key=value...]，未出现的参数保持原值
+     * @param spec 参数字符串
+     * @param err 失败时写入出错的部分
+     * @return 是否成功
+     */
+    bool parse(const char *spec, std::string *err);
+
+    /**
+     * @brief 设置监听socket，需在listen()之前调用（接收缓冲区决定握手时通告的窗口扩大因子）
+     * @param fd 监听socket
+     * @param err 追加设置失败的参数名
+     * @return 全部成功时返回true
+     */
+    bool apply_listen(int fd, std::string *err) const;
+
+    /**
+     * @brief 开关TCP_CORK
+     * @return 是否成功
+     */
+    static bool set_cork(int fd, bool on);
+};
+
+#endif
@@ -0,0 +1,274 @@
+#include "prefork.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/close_range.h>
+#include <string>
+
+// 工作进程启动后不到这么多秒就退出时，等待这么久再重启，避免启动即崩溃时反复fork
+static const int RESTART_BACKOFF = 1;
+
+prefork::prefork() : m_slots(&m_local), m_count(1), m_index(-1), m_old_pid(0) {
+    memset(&m_local, 0, sizeof(m_local));
+    m_bound[0] = m_bound[1] = -1;
+    sigemptyset(&m_signals);
+}
+
+// SO_REUSEPORT绑定但不listen：不进入内核的连接分配，只占住端口
+static int bind_reuseport(int port) {
+    int fd = socket(PF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    int flag = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void prefork::run(int workers, int port, int tls_port) {
+    // 由热升级启动：取走旧进程交来的监听socket和旧进程的pid，不再传给之后创建的进程
+    const char *fds = getenv("TINYWEBSERVER_FDS");
+    for (const char *p = fds; p && *p; ) {
+        char *end;
+        long fd = strtol(p, &end, 10);
+        if (end == p)
+            break;
+        m_inherited.push_back((int)fd);
+        p = *end == ',' ? end + 1 : end;
+    }
+    const char *old = getenv("TINYWEBSERVER_OLD_PID");
+    if (old)
+        m_old_pid = atoi(old);
+    unsetenv("TINYWEBSERVER_FDS");
+    unsetenv("TINYWEBSERVER_OLD_PID");
+    if (workers <= 0)
+        return;
+
+    m_bound[0] = bind_reuseport(port);
+    if (m_bound[0] < 0) {
+        fprintf(stderr, "bind port %d failed: %s\n", port, strerror(errno));
+        exit(1);
+    }
+    if (tls_port > 0) {
+        m_bound[1] = bind_reuseport(tls_port);
+        if (m_bound[1] < 0) {
+            fprintf(stderr, "bind port %d failed: %s\n", tls_port, strerror(errno));
+            exit(1);
+        }
+    }
+
+    // fork之前创建，所有工作进程映射同一块内存
+    void *mem = mmap(NULL, sizeof(worker_stats) * workers, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "mmap stats failed: %s\n", strerror(errno));
+        exit(1);
+    }
+    m_slots = (worker_stats *)mem;
+    m_count = workers;
+
+    // 屏蔽后由supervise同步等待，不会在检查标志和阻塞之间漏掉信号
+    sigaddset(&m_signals, SIGCHLD);
+    sigaddset(&m_signals, SIGTERM);
+    sigaddset(&m_signals, SIGINT);
+    sigaddset(&m_signals, SIGUSR2);
+    sigprocmask(SIG_BLOCK, &m_signals, NULL);
+
+    for (int i = 0; i < workers; ++i)
+        if (spawn(i) == 0)
+            return;
+    // 旧主进程由第一批工作进程在开始监听后通知，之后重启的工作进程不再通知
+    m_old_pid = 0;
+    supervise();
+}
+
+pid_t prefork::spawn(int index) {
+    pid_t master = getpid();
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "fork worker %d failed: %s\n", index, strerror(errno));
+        return -1;
+    }
+    if (pid > 0) {
+        m_slots[index].pid = pid;
+        m_slots[index].started = time(NULL);
+        return pid;
+    }
+
+    // 工作进程：解除屏蔽，信号处理由WebServer自己安装；主进程退出时收到SIGTERM
+    m_index = index;
+    sigprocmask(SIG_UNBLOCK, &m_signals, NULL);
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != master)
+        exit(0);
+    for (int i = 0; i < 2; ++i) {
+        if (m_bound[i] >= 0)
+            close(m_bound[i]);
+        m_bound[i] = -1;
+    }
+    return 0;
+}
+
+void prefork::supervise() {
+    int alive = 0;
+    for (int i = 0; i < m_count; ++i)
+        if (m_slots[i].pid > 0)
+            ++alive;
+    bool stopping = false;
+
+    while (alive > 0) {
+        int sig = sigwaitinfo(&m_signals, NULL);
+        if (sig < 0)
+            continue;
+        if (sig == SIGUSR2) {
+            // 新的主进程绑定自己的端口、创建工作进程，由它们通知这里退出
+            if (!stopping && reexec(std::vector<int>()) < 0)
+                fprintf(stderr, "upgrade failed: %s\n", strerror(errno));
+            continue;
+        }
+        if (sig != SIGCHLD) {
+            // 转发给工作进程，由它们各自处理完事件循环后退出
+            if (!stopping)
+                for (int i = 0; i < m_count; ++i)
+                    if (m_slots[i].pid > 0)
+                        kill(m_slots[i].pid, SIGTERM);
+            stopping = true;
+            continue;
+        }
+
+        // 多个子进程同时退出时SIGCHLD只会排队一个，一次收完
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            int index = -1;
+            for (int i = 0; i < m_count; ++i)
+                if (m_slots[i].pid == pid)
+                    index = i;
+            if (index < 0)
+                continue;
+
+            worker_stats &slot = m_slots[index];
+            slot.pid = 0;
+            __atomic_store_n(&slot.connections, 0, __ATOMIC_RELAXED);
+            // 线程池的瞬时状态随进程一起消失，累计值保留
+            __atomic_store_n(&slot.pool.threads, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&slot.pool.active, 0, __ATOMIC_RELAXED);
+            for (int c = 0; c < TASK_CLASSES; ++c)
+                __atomic_store_n(&slot.pool.queued[c], 0, __ATOMIC_RELAXED);
+            --alive;
+            if (stopping)
+                continue;
+
+            if (WIFSIGNALED(status))
+                fprintf(stderr, "worker %d (pid %d) killed by signal %d, restarting\n", index, pid,
+                        WTERMSIG(status));
+            else
+                fprintf(stderr, "worker %d (pid %d) exited with %d, restarting\n", index, pid,
+                        WEXITSTATUS(status));
+            if (time(NULL) - slot.started < RESTART_BACKOFF)
+                sleep(RESTART_BACKOFF);
+            ++slot.restarts;
+            pid_t child = spawn(index);
+            if (child == 0)
+                return;
+            if (child > 0)
+                ++alive;
+        }
+    }
+    exit(0);
+}
+
+pid_t prefork::reexec(const std::vector<int> &fds) {
+    // 参数和环境变量在fork之前准备好：多线程进程fork出的子进程在exec之前只能调用异步信号安全的函数
+    std::string cmdline;
+    FILE *fp = fopen("/proc/self/cmdline", "r");
+    if (!fp)
+        return -1;
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        cmdline.append(buf, n);
+    fclose(fp);
+    if (cmdline.empty())
+        return -1;
+    std::vector<char *> argv;
+    for (size_t pos = 0; pos < cmdline.size(); pos += strlen(&cmdline[pos]) + 1)
+        argv.push_back(&cmdline[pos]);
+    argv.push_back(NULL);
+
+    std::string fd_env = "TINYWEBSERVER_FDS=";
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (i > 0)
+            fd_env += ",";
+        fd_env += std::to_string(fds[i]);
+    }
+    std::string pid_env = "TINYWEBSERVER_OLD_PID=" + std::to_string(getpid());
+    std::vector<char *> envp;
+    for (char **e = environ; *e; ++e)
+        if (strncmp(*e, "TINYWEBSERVER_", 14) != 0)
+            envp.push_back(*e);
+    if (!fds.empty())
+        envp.push_back(&fd_env[0]);
+    envp.push_back(&pid_env[0]);
+    envp.push_back(NULL);
+
+    pid_t pid = fork();
+    if (pid != 0)
+        return pid;
+    // 新进程从干净的信号屏蔽字开始；连接、epoll、日志等fd都不继承，只留下标准输入输出和监听socket
+    sigset_t none;
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+    syscall(__NR_close_range, 3U, ~0U, CLOSE_RANGE_CLOEXEC);
+    for (size_t i = 0; i < fds.size(); ++i)
+        fcntl(fds[i], F_SETFD, 0);
+    // argv[0]按启动时的路径查找，替换过的可执行文件在这里生效
+    execvpe(argv[0], &argv[0], &envp[0]);
+    _exit(127);
+}
+
+int prefork::inherited(int port) {
+    for (size_t i = 0; i < m_inherited.size(); ++i) {
+        int fd = m_inherited[i];
+        struct sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        if (getsockname(fd, (struct sockaddr *)&addr, &len) == 0 && addr.sin_family == AF_INET &&
+            ntohs(addr.sin_port) == port) {
+            m_inherited.erase(m_inherited.begin() + i);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+            return fd;
+        }
+    }
+    return -1;
+}
+
+void prefork::upgraded() {
+    // 新配置不再使用的端口随旧进程一起关闭
+    for (size_t i = 0; i < m_inherited.size(); ++i)
+        close(m_inherited[i]);
+    m_inherited.clear();
+    if (m_old_pid > 0)
+        kill(m_old_pid, SIGTERM);
+    m_old_pid = 0;
+}
@@ -0,0 +1,125 @@
+#ifndef PREFORK_H
+#define PREFORK_H
+
+#include <signal.h>
+#include <sys/types.h>
+#include <vector>
+#include "../threadpool/pool_sizing.h"
+
+/**
+ * @brief 单个工作进程的计数器
+ *
+ * 每个工作进程独占一个槽位，按缓存行对齐，进程之间不共享锁也不争抢同一缓存行；
+ * 进程内的线程用原子操作更新。进程重启后计数器继续累加，连接数由主进程清零
+ */
+struct worker_stats {
+    pid_t pid;                      // 当前占用槽位的进程，0表示没有运行
+    int connections;                // 当前连接数
+    long long started;              // 进程启动时刻（unix秒）
+    unsigned long long restarts;    // 异常退出后被重启的次数
+    unsigned long long accepted;    // 累计接入的连接数
+    unsigned long long requests;    // 累计处理的请求数
+    unsigned long long limited_rate;   // 因单个IP新建连接过快被拒绝的连接数
+    unsigned long long limited_conns;  // 因单个IP并发连接数超限被拒绝的连接数
+    pool_stats pool;                // 线程池的运行状态
+} __attribute__((aligned(64)));
+
+/**
+ * @brief 多进程（prefork）模式
+ *
+ * 主进程只负责创建、重启工作进程和转发退出信号，不处理连接；
+ * 每个工作进程各自运行完整的WebServer（日志、数据库连接池、线程池、连接数组），
+ * 用自己的SO_REUSEPORT监听socket，由内核在进程间分配新连接。
+ * 计数器放在主进程fork之前创建的共享内存中，任一工作进程的/metrics都能汇总全部进程。
+ * 单进程模式下只有一个进程内的槽位，接口相同。
+ *
+ * 热升级：旧进程收到SIGUSR2后fork并exec新的可执行文件（参数与自己相同），
+ * 通过环境变量TINYWEBSERVER_FDS把监听socket交给新进程，TINYWEBSERVER_OLD_PID告诉它旧进程的pid；
+ * 新进程开始监听后向旧进程发送SIGTERM，旧进程停止接入并处理完进行中的请求后退出
+ */
+class prefork {
+public:
+    /**
+     * @brief 获取单例
+     */
+    static prefork *get_instance() {
+        static prefork instance;
+        return &instance;
+    }
+
+    /**
+     * @brief 读取热升级传来的环境变量；workers大于0时作为主进程运行：
+     *        先用SO_REUSEPORT绑定端口（占住端口并尽早发现端口冲突），
+     *        再创建workers个工作进程并一直监视，只有工作进程从这里返回；workers为0时直接返回
+     * @param workers 工作进程数量，0表示单进程
+     * @param port HTTP端口
+     * @param tls_port HTTPS端口，0表示不开启
+     */
+    void run(int workers, int port, int tls_port);
+
+    /**
+     * @brief 热升级：以相同参数启动新的可执行文件，fds中的socket保持打开交给它，其余fd全部不继承
+     * @param fds 交给新进程的监听socket
+     * @return 新进程的pid，失败返回-1
+     */
+    pid_t reexec(const std::vector<int> &fds);
+
+    /**
+     * @brief 取旧进程交来的、绑定在port上的监听socket
+     * @return socket，没有时返回-1
+     */
+    int inherited(int port);
+
+    /**
+     * @brief 新进程已经开始监听：通知旧进程优雅退出（只通知一次）
+     */
+    void upgraded();
+
+    /**
+     * @brief 是否处于多进程模式（监听socket需要设置SO_REUSEPORT）
+     */
+    bool active() const { return m_count > 1 || m_index >= 0; }
+
+    /**
+     * @brief 当前进程的工作进程编号，单进程模式为-1
+     */
+    int index() const { return m_index; }
+
+    /**
+     * @brief 当前进程的计数器
+     */
+    worker_stats *stats() { return m_slots + (m_index < 0 ? 0 : m_index); }
+
+    /**
+     * @brief 全部槽位，用于汇总
+     * @param count 写入槽位数量
+     */
+    const worker_stats *slots(int *count) const { *count = m_count; return m_slots; }
+
+private:
+    prefork();
+    ~prefork() {}
+
+    /**
+     * @brief 创建编号为index的工作进程，子进程中返回0
+     */
+    pid_t spawn(int index);
+
+    /**
+     * @brief 主进程的监视循环，用sigwaitinfo同步等待SIGCHLD和退出信号，工作进程全部退出后结束进程；
+     *        重启出的工作进程从这里返回
+     */
+    void supervise();
+
+private:
+    worker_stats m_local;      // 单进程模式下的槽位
+    worker_stats *m_slots;     // 槽位数组，多进程模式下位于共享内存
+    int m_count;               // 槽位数量
+    int m_index;               // 当前进程的编号，-1表示主进程或单进程
+    int m_bound[2];            // 主进程占住端口的socket，工作进程中关闭
+    sigset_t m_signals;        // 主进程屏蔽并同步等待的信号，工作进程中解除屏蔽
+    std::vector<int> m_inherited;  // 旧进程交来、尚未取走的监听socket
+    pid_t m_old_pid;           // 热升级时的旧进程，0表示不是由热升级启动或已经通知过
+};
+
+#endif
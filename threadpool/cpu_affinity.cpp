@@ -0,0 +1,167 @@
+#include "cpu_affinity.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+cpu_affinity::cpu_affinity() : loop_cpu(-1), rss(false) {}
+
+// 解析"3"或"1-7"，追加到cpus
+static bool parse_range(const std::string &item, std::vector<int> *cpus) {
+    char *tail = NULL;
+    long lo = strtol(item.c_str(), &tail, 10);
+    if (tail == item.c_str() || lo < 0)
+        return false;
+    long hi = lo;
+    if (*tail == '-') {
+        const char *p = tail + 1;
+        hi = strtol(p, &tail, 10);
+        if (tail == p || hi < lo)
+            return false;
+    }
+    if (*tail != '\0' || hi >= CPU_SETSIZE)
+        return false;
+    for (long c = lo; c <= hi; ++c)
+        cpus->push_back((int)c);
+    return true;
+}
+
+bool cpu_affinity::parse(const char *spec, std::string *err) {
+    std::string s(spec);
+    std::vector<int> *list = NULL;     // 正在解析的CPU列表，不含=的部分接在它后面
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        std::string item = s.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty())
+            continue;
+
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) {
+            if (!list || !parse_range(item, list)) {
+                *err = item;
+                return false;
+            }
+            continue;
+        }
+        std::string key = item.substr(0, eq);
+        std::string value = item.substr(eq + 1);
+        list = NULL;
+        bool ok;
+        if (key == "loop") {
+            std::vector<int> one;
+            ok = parse_range(value, &one) && one.size() == 1;
+            if (ok)
+                loop_cpu = one[0];
+        } else if (key == "workers") {
+            workers.clear();
+            ok = parse_range(value, &workers);
+            list = &workers;
+        } else if (key == "rss") {
+            ok = value == "0" || value == "1";
+            rss = value == "1";
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            *err = item;
+            return false;
+        }
+    }
+    std::sort(workers.begin(), workers.end());
+    workers.erase(std::unique(workers.begin(), workers.end()), workers.end());
+    return true;
+}
+
+static void to_set(const std::vector<int> &cpus, cpu_set_t *set) {
+    CPU_ZERO(set);
+    for (size_t i = 0; i < cpus.size(); ++i)
+        CPU_SET(cpus[i], set);
+}
+
+bool cpu_affinity::pin_self(const std::vector<int> &cpus) {
+    cpu_set_t set;
+    to_set(cpus, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+bool cpu_affinity::pin_attr(pthread_attr_t *attr, const std::vector<int> &cpus) {
+    cpu_set_t set;
+    to_set(cpus, &set);
+    return pthread_attr_setaffinity_np(attr, sizeof(set), &set) == 0;
+}
+
+int cpu_affinity::incoming_cpu(int fd) {
+    int cpu = -1;
+    socklen_t len = sizeof(cpu);
+    if (getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) != 0)
+        return -1;
+    return cpu;
+}
+
+int cpu_affinity::node_of_cpu(int cpu) {
+    // 每个CPU目录下有一个指向所属节点的nodeM链接
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (!dir)
+        return -1;
+    int node = -1;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' && ent->d_name[4] <= '9') {
+            node = atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+int cpu_affinity::node_count() {
+    static int count = -1;
+    if (count >= 0)
+        return count;
+    count = 1;
+    FILE *fp = fopen("/sys/devices/system/node/online", "r");
+    if (!fp)
+        return count;
+    char line[256];
+    if (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        std::vector<int> nodes;
+        char *save = NULL;
+        for (char *tok = strtok_r(line, ",", &save); tok; tok = strtok_r(NULL, ",", &save))
+            parse_range(tok, &nodes);
+        if (!nodes.empty())
+            count = (int)nodes.size();
+    }
+    fclose(fp);
+    return count;
+}
+
+bool cpu_affinity::place(void *addr, size_t len, int node) {
+    unsigned long mask[16];
+    if (node < 0 || node >= (int)(sizeof(mask) * 8 - 1))
+        return false;
+    // mbind只接受整页，跨页边界的头尾留给首次触碰决定
+    unsigned long page = (unsigned long)sysconf(_SC_PAGESIZE);
+    unsigned long begin = ((unsigned long)addr + page - 1) & ~(page - 1);
+    unsigned long end = ((unsigned long)addr + len) & ~(page - 1);
+    if (end <= begin)
+        return true;
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] |= 1UL << (node % (8 * sizeof(unsigned long)));
+    return syscall(__NR_mbind, begin, end - begin, MPOL_PREFERRED, mask, sizeof(mask) * 8,
+                   MPOL_MF_MOVE) == 0;
+}
@@ -0,0 +1,66 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 线程绑核与NUMA内存放置
+ *
+ * 命令行用-A指定，格式为逗号分隔的key=value，CPU列表沿用taskset的写法，
+ * 例如`-A loop=0,workers=1-7,rss=1`、`-A workers=0-3,8-11`
+ */
+struct cpu_affinity {
+    int loop_cpu;               // 事件循环线程绑定的CPU，-1表示不绑定（默认）
+    std::vector<int> workers;   // 工作线程使用的CPU集合，为空表示不绑定（默认）
+    bool rss;                   // 按SO_INCOMING_CPU把连接交给绑在同一个核上的工作线程，默认关闭
+
+    cpu_affinity();
+
+    /**
+     * @brief 解析key=value[,key=value...]，不含=的部分接在上一个CPU列表后面
+     * @param spec 参数字符串
+     * @param err 失败时写入出错的部分
+     * @return 是否成功
+     */
+    bool parse(const char *spec, std::string *err);
+
+    /**
+     * @brief 把当前线程绑定到给定的CPU集合
+     * @return 是否成功
+     */
+    static bool pin_self(const std::vector<int> &cpus);
+
+    /**
+     * @brief 在线程属性中设置CPU集合，线程从第一条指令起就运行在这些CPU上，栈也由它在本地节点首次触碰
+     * @return 是否成功
+     */
+    static bool pin_attr(pthread_attr_t *attr, const std::vector<int> &cpus);
+
+    /**
+     * @brief 读取连接最近一次收包时所在的CPU（网卡RSS队列对应的核）
+     * @return CPU编号，不支持时返回-1
+     */
+    static int incoming_cpu(int fd);
+
+    /**
+     * @brief CPU所属的NUMA节点，读取/sys/devices/system/cpu/cpuN/nodeM
+     * @return 节点编号，未知时返回-1
+     */
+    static int node_of_cpu(int cpu);
+
+    /**
+     * @brief 在线的NUMA节点数量
+     */
+    static int node_count();
+
+    /**
+     * @brief 让[addr, addr + len)内完整的页优先使用给定节点的内存，已分配到其他节点的页迁移过去
+     * @return 是否成功
+     */
+    static bool place(void *addr, size_t len, int node);
+};
+
+#endif
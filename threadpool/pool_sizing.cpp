@@ -0,0 +1,65 @@
+#include "pool_sizing.h"
+
+#include <stdlib.h>
+
+// 参数名中的类别名，与task_class的顺序一致
+static const char *const CLASS_NAMES[TASK_CLASSES] = {"fast", "db", "bg"};
+
+pool_sizing::pool_sizing() : min_threads(0), max_threads(0), wait_ms(5), idle_ms(30000) {
+    weight[TASK_FAST] = 4;
+    weight[TASK_DB] = 2;
+    weight[TASK_BACKGROUND] = 1;
+    reserve[TASK_FAST] = 1;
+    reserve[TASK_DB] = 0;
+    reserve[TASK_BACKGROUND] = 0;
+}
+
+bool pool_sizing::parse(const char *spec, std::string *err) {
+    std::string s(spec);
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        std::string item = s.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty())
+            continue;
+
+        size_t eq = item.find('=');
+        char *tail = NULL;
+        long value = eq == std::string::npos ? 0 : strtol(item.c_str() + eq + 1, &tail, 10);
+        std::string key = eq == std::string::npos ? item : item.substr(0, eq);
+        // <类别>_weight和<类别>_reserve
+        int *field = NULL;
+        for (int c = 0; c < TASK_CLASSES && !field; ++c) {
+            std::string name = CLASS_NAMES[c];
+            if (key == name + "_weight")
+                field = &weight[c];
+            else if (key == name + "_reserve")
+                field = &reserve[c];
+        }
+        // 线程数和保留数可以为0（线程数为0时沿用-t），时间和权重必须为正
+        bool count = key == "min" || key == "max" || (field && key.find("_reserve") != std::string::npos);
+        if (eq == std::string::npos || tail == item.c_str() + eq + 1 || *tail != '\0' || value < 0 ||
+            value > (field || count ? 4096 : 3600 * 1000) || (value == 0 && !count)) {
+            *err = item;
+            return false;
+        }
+        if (field)
+            *field = (int)value;
+        else if (key == "min")
+            min_threads = (int)value;
+        else if (key == "max")
+            max_threads = (int)value;
+        else if (key == "wait_ms")
+            wait_ms = (int)value;
+        else if (key == "idle_ms")
+            idle_ms = (int)value;
+        else {
+            *err = item;
+            return false;
+        }
+    }
+    return true;
+}
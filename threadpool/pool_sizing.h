@@ -0,0 +1,58 @@
+#ifndef POOL_SIZING_H
+#define POOL_SIZING_H
+
+#include <string>
+
+/**
+ * @brief 任务的优先级类别，每个请求队列中每类一个子队列
+ */
+enum task_class {
+    TASK_FAST = 0,      // 静态文件、缓存命中等不阻塞的请求
+    TASK_DB,            // 需要一次数据库往返的请求（登录、注册）
+    TASK_BACKGROUND,    // 可以延后的请求（/metrics等）
+    TASK_CLASSES
+};
+
+/**
+ * @brief 线程池的伸缩和调度参数
+ *
+ * 线程数在[min, max]之间变化：任务在队列中等待超过wait_ms且没有空闲线程时增加一个线程
+ * （每wait_ms最多增加一个），线程连续idle_ms没有取到任务时退出。
+ * 各类任务按权重轮流出队（平滑加权轮询），每类保留若干个线程：其他类的任务不会占用为它保留、
+ * 此刻空闲的线程，数据库请求扎堆时静态请求仍有线程可用；队列的线程数不超过保留数之和时不保留。
+ * 命令行用-E指定，例如`-E min=4,max=64,wait_ms=5`、`-E fast_reserve=2,db_weight=1`；
+ * min和max默认都等于-t，即固定大小
+ */
+struct pool_sizing {
+    int min_threads;    // 线程数下限，0表示与-t相同
+    int max_threads;    // 线程数上限，0表示与-t相同
+    int wait_ms;        // 排队时间的目标，默认5
+    int idle_ms;        // 线程空闲这么久后退出，默认30000
+    int weight[TASK_CLASSES];   // 出队权重，默认fast=4、db=2、bg=1
+    int reserve[TASK_CLASSES];  // 每个队列为各类保留的线程数，默认fast=1、db=0、bg=0
+
+    pool_sizing();
+
+    /**
+     * @brief 解析key=value[,key=value...]，未出现的参数保持原值
+     * @param spec 参数字符串
+     * @param err 失败时写入出错的部分
+     * @return 是否成功
+     */
+    bool parse(const char *spec, std::string *err);
+};
+
+/**
+ * @brief 线程池的运行状态，由线程池用原子操作更新，/metrics读取
+ */
+struct pool_stats {
+    int threads;                    // 当前线程数
+    int active;                     // 正在执行任务的线程数
+    int queued[TASK_CLASSES];       // 各类排队中的任务数
+    unsigned long long tasks[TASK_CLASSES];    // 各类累计取出的任务数
+    unsigned long long wait_us[TASK_CLASSES];  // 各类累计排队时间（微秒），除以tasks即平均排队时间
+    unsigned long long grown;       // 因排队过久增加线程的次数
+    unsigned long long shrunk;      // 因空闲退出的线程数
+};
+
+#endif
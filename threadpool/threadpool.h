@@ -3,9 +3,15 @@
 
 #include <list>
 #include <cstdio>
+#include <cstring>
 #include <exception>
+#include <vector>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include "../lock/locker.h"
+#include "cpu_affinity.h"
+#include "pool_sizing.h"
 #include "../CGImysql/sql_connection_pool.h"
   
 /**
@@ -13,6 +19,13 @@
  * 
  * 线程池用于管理工作线程，提高服务器并发处理能力
  * 实现了Reactor和Proactor两种并发模型
+ * 按CPU分流（cpu_affinity::rss）时每个CPU一个请求队列，工作线程绑在对应的核上只取自己队列的任务，
+ * 任务按request->m_cpu入队；否则所有线程共用一个队列。
+ * 线程数在sizing给出的范围内伸缩：入队和取任务时检查排队时间，超过目标且队列没有空闲线程时增加线程，
+ * 线程空闲超时后退出；每个队列至少保留一个线程。线程都是joinable的，退出的线程在槽位复用或析构时join。
+ * 每个队列按task_class分成几个子队列，线程按权重轮流从各子队列取任务，并为每类保留一定数量的线程：
+ * 某类任务只有在不占用其他类保留、且此刻空闲的线程时才能开始执行，暂时不能执行的任务留在队列里，
+ * 由下一个执行完任务的线程重新挑选
  * @tparam T 任务类型，通常是HTTP连接类
  */
 template <typename T>
@@ -22,13 +35,18 @@ public:
      * @brief 构造函数
      * @param actor_model 并发模型选择：0-Proactor模式，1-Reactor模式
      * @param connPool 数据库连接池指针
-     * @param thread_number 线程数量
-     * @param max_request 最大请求数量
+     * @param thread_number 初始线程数量，限制在sizing的范围内
+     * @param max_request 每个请求队列的最大请求数量
+     * @param affinity 工作线程绑核方式，NULL表示不绑定
+     * @param sizing 线程数的伸缩范围，NULL表示固定为thread_number
+     * @param stats 运行状态写到这里，NULL表示使用线程池自己的
      */
-    threadpool(int actor_model, connection_pool *connPool, int thread_number = 8, int max_request = 10000);
+    threadpool(int actor_model, connection_pool *connPool, int thread_number = 8, int max_request = 10000,
+               const cpu_affinity *affinity = NULL, const pool_sizing *sizing = NULL,
+               pool_stats *stats = NULL);
     
     /**
-     * @brief 析构函数
+     * @brief 析构函数：通知全部工作线程退出并等待，正在执行的任务先执行完，队列中剩余的任务丢弃
      */
     ~threadpool();
     
@@ -36,18 +54,79 @@ public:
      * @brief 向请求队列添加任务（reactor模式）
      * @param request 任务请求
      * @param state 状态（读/写）
+     * @param cls 任务类别（task_class）
      * @return 添加是否成功
      */
-    bool append(T *request, int state);
+    bool append(T *request, int state, int cls = TASK_FAST);
     
     /**
      * @brief 向请求队列添加任务（proactor模式）
      * @param request 任务请求
+     * @param cls 任务类别（task_class）
      * @return 添加是否成功
      */
-    bool append_p(T *request);
+    bool append_p(T *request, int cls = TASK_FAST);
+
+    /**
+     * @brief 请求队列数量，按CPU分流时等于绑定的核数，否则为1
+     */
+    int lanes() const { return m_lane_count; }
+
+    /**
+     * @brief 绑核失败、退回默认亲和性创建的线程数
+     */
+    int unpinned() const { return __atomic_load_n(&m_unpinned, __ATOMIC_RELAXED); }
+
+    /**
+     * @brief 当前线程数
+     */
+    int threads() const { return __atomic_load_n(&m_thread_number, __ATOMIC_RELAXED); }
+
+    /**
+     * @brief 运行状态
+     */
+    const pool_stats &stats() const { return *m_stats; }
 
 private:
+    /**
+     * @brief 排队中的任务
+     */
+    struct item {
+        T *request;
+        long long since;       // 入队时刻（纳秒）
+    };
+
+    /**
+     * @brief 请求队列，每个队列有自己的锁和信号量
+     */
+    struct lane {
+        std::list<item> queue[TASK_CLASSES]; // 各类任务的子队列
+        size_t size;           // 全部子队列的任务数
+        locker lock;           // 互斥锁，保护请求队列和下面的调度状态
+        sem stat;              // 信号量，表示是否有任务需要处理
+        int threads;           // 服务这个队列的线程数，在m_resize保护下修改
+        int active;            // 其中正在执行任务的线程数
+        int running[TASK_CLASSES];  // 各类正在执行的任务数
+        int credit[TASK_CLASSES];   // 平滑加权轮询的当前值
+        int deferred;          // 已经唤醒过线程、但因保留线程暂时不能执行的任务数
+    };
+
+    enum slot_state {
+        SLOT_FREE,             // 未使用
+        SLOT_RUNNING,          // 线程在运行
+        SLOT_EXITED            // 线程已因空闲退出，尚未join
+    };
+
+    /**
+     * @brief 工作线程的槽位和启动参数
+     */
+    struct slot {
+        threadpool *pool;
+        int lane;              // 线程服务的队列
+        pthread_t tid;
+        int state;             // slot_state
+    };
+
     /**
      * @brief 工作线程函数
      * @param arg 线程参数
@@ -57,144 +136,482 @@ private:
     
     /**
      * @brief 运行函数 - 线程池中的所有线程都调用这个函数
+     * @param s 线程的槽位
+     */
+    void run(slot *s);
+
+    /**
+     * @brief 执行一个任务
+     * @param cls 任务排队时的类别
+     */
+    void execute(T *request, int cls);
+
+    /**
+     * @brief 任务入队
      */
-    void run();
+    bool push(T *request, int cls);
+
+    /**
+     * @brief 在队列l中再开始一个cls类任务后，其他类保留且空闲的线程是否仍然够用，调用者持有l.lock
+     */
+    bool can_start(const lane &l, int cls) const;
+
+    /**
+     * @brief 在可以开始执行的非空子队列中按平滑加权轮询选出一类，调用者持有l.lock
+     * @return 类别，没有可执行的任务时返回-1
+     */
+    int pick(lane &l);
+
+    /**
+     * @brief 选择任务的队列：连接所在CPU有对应队列时用它，否则按连接散列
+     */
+    int lane_of(T *request) const;
+
+    /**
+     * @brief 为队列index创建一个线程，调用者持有m_resize
+     * @return 是否成功
+     */
+    bool spawn(int index);
+
+    /**
+     * @brief 队列index的cls类任务排队了wait纳秒：超过目标、没有能执行它的空闲线程且距上次增加已过目标时间时
+     *        增加一个线程
+     */
+    void grow(int index, int cls, long long wait);
+
+    /**
+     * @brief 线程空闲超时：线程数高于下限且队列还有其他线程时登记退出
+     * @return 线程是否应当退出
+     */
+    bool retire(slot *s);
+
+    /**
+     * @brief 单调时钟，纳秒
+     */
+    static long long now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    }
 
 private:
-    int m_thread_number;       // 线程池中的线程数
-    int m_max_requests;        // 请求队列中允许的最大请求数
-    pthread_t *m_threads;      // 线程池数组，大小为m_thread_number
-    std::list<T *> m_workqueue;// 请求队列
-    locker m_queuelocker;      // 互斥锁，保护请求队列
-    sem m_queuestat;           // 信号量，表示是否有任务需要处理
+    int m_thread_number;       // 当前线程数，在m_resize保护下修改
+    int m_min_threads;         // 线程数下限，不少于队列数
+    int m_max_threads;         // 线程数上限，也是槽位数
+    long long m_wait_target;   // 排队时间的目标（纳秒）
+    int m_idle_ms;             // 线程空闲多久后退出，线程数固定时为0
+    int m_weight[TASK_CLASSES];  // 各类的出队权重
+    int m_reserve[TASK_CLASSES]; // 各类保留的线程数
+    int m_reserve_total;       // 保留数之和，队列的线程数不超过它时不保留
+    long long m_grown_at;      // 上次增加线程的时刻（纳秒）
+    int m_max_requests;        // 每个请求队列中允许的最大请求数
+    lane *m_lanes;             // 请求队列数组
+    int m_lane_count;          // 请求队列数量
+    slot *m_slots;             // 工作线程的槽位，大小为m_max_threads
+    std::vector<int> m_cpus;   // 工作线程使用的CPU集合
+    std::vector<int> m_cpu_lane; // CPU编号到队列的映射，-1表示该CPU没有队列
+    int m_unpinned;            // 绑核失败的线程数
+    locker m_resize;           // 保护线程的增减
+    volatile bool m_stop;      // 析构时置位，工作线程醒来后退出
+    pool_stats m_local;        // 没有传入stats时使用
+    pool_stats *m_stats;       // 运行状态
     connection_pool *m_connPool; // 数据库连接池
     int m_actor_model;         // 模型切换（reactor/proactor）
 };
 
 template <typename T>
-threadpool<T>::threadpool(int actor_model, connection_pool *connPool, int thread_number, int max_requests)
-: m_actor_model(actor_model), m_thread_number(thread_number), m_max_requests(max_requests), 
-m_threads(NULL), m_connPool(connPool) {
+threadpool<T>::threadpool(int actor_model, connection_pool *connPool, int thread_number, int max_requests,
+                         const cpu_affinity *affinity, const pool_sizing *sizing, pool_stats *stats)
+: m_thread_number(0), m_grown_at(0), m_max_requests(max_requests), m_lanes(NULL), m_lane_count(1),
+m_slots(NULL), m_unpinned(0), m_stop(false), m_stats(stats), m_connPool(connPool),
+m_actor_model(actor_model) {
     if (thread_number <= 0 || max_requests <= 0) {
         throw std::exception(); 
-    }    
-    // 创建线程池数组
-    m_threads = new pthread_t[m_thread_number];
-    if (!m_threads)
-        throw std::exception();
+    }
+    m_min_threads = sizing && sizing->min_threads > 0 ? sizing->min_threads : thread_number;
+    m_max_threads = sizing && sizing->max_threads > 0 ? sizing->max_threads : thread_number;
+    if (m_max_threads < m_min_threads)
+        m_max_threads = m_min_threads;
+    if (thread_number < m_min_threads)
+        thread_number = m_min_threads;
+    if (thread_number > m_max_threads)
+        thread_number = m_max_threads;
+    pool_sizing defaults;
+    if (!sizing)
+        sizing = &defaults;
+    m_wait_target = sizing->wait_ms * 1000000LL;
+    m_idle_ms = m_max_threads > m_min_threads ? sizing->idle_ms : 0;
+    m_reserve_total = 0;
+    for (int c = 0; c < TASK_CLASSES; ++c) {
+        m_weight[c] = sizing->weight[c] > 0 ? sizing->weight[c] : 1;
+        m_reserve[c] = sizing->reserve[c];
+        m_reserve_total += m_reserve[c];
+    }
+    memset(&m_local, 0, sizeof(m_local));
+    if (!m_stats)
+        m_stats = &m_local;
 
-    // 创建thread_number个线程，并将它们设置为分离状态
+    bool by_cpu = false;
+    if (affinity) {
+        m_cpus = affinity->workers;
+        by_cpu = affinity->rss;
+    }
+    if (by_cpu && m_cpus.empty()) {
+        // 没有指定CPU集合时按进程当前可用的全部CPU分流
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+            for (int c = 0; c < CPU_SETSIZE; ++c)
+                if (CPU_ISSET(c, &set))
+                    m_cpus.push_back(c);
+    }
+    if (by_cpu && !m_cpus.empty()) {
+        // 线程比CPU少时只为前thread_number个CPU建队列，其余CPU上的连接按散列分配
+        m_lane_count = (int)m_cpus.size() < thread_number ? (int)m_cpus.size() : thread_number;
+        m_cpu_lane.assign(m_cpus.back() + 1, -1);
+        for (int i = 0; i < m_lane_count; ++i)
+            m_cpu_lane[m_cpus[i]] = i;
+    }
+    // 每个队列至少一个线程
+    if (m_min_threads < m_lane_count)
+        m_min_threads = m_lane_count;
+    m_lanes = new lane[m_lane_count];
+    for (int i = 0; i < m_lane_count; ++i) {
+        lane &l = m_lanes[i];
+        l.size = 0;
+        l.threads = l.active = l.deferred = 0;
+        for (int c = 0; c < TASK_CLASSES; ++c)
+            l.running[c] = l.credit[c] = 0;
+    }
+    m_slots = new slot[m_max_threads];
+    for (int i = 0; i < m_max_threads; ++i)
+        m_slots[i].state = SLOT_FREE;
+
+    // 创建thread_number个线程，按队列轮流分配，析构时逐个join
+    m_resize.lock();
     for (int i = 0; i < thread_number; ++i) {
-        // 创建线程，绑定worker函数
-        if (pthread_create(m_threads + i, NULL, worker, this) != 0) {
-            delete[] m_threads;
-            throw std::exception();
-        }
-        // 设置为分离状态，线程结束后自动回收资源
-        if (pthread_detach(m_threads[i])) {
-            delete[] m_threads;
+        if (!spawn(i % m_lane_count)) {
+            m_resize.unlock();
             throw std::exception();
         }
     }
+    m_resize.unlock();
 }
 
 template <typename T>
 threadpool<T>::~threadpool() {
-    delete[] m_threads;
+    // 置位后不再增减线程，每个队列的线程数不再变化
+    m_resize.lock();
+    m_stop = true;
+    m_resize.unlock();
+    // 每个线程都在自己队列的信号量上等待，按线程数逐个唤醒
+    for (int i = 0; i < m_lane_count; ++i)
+        for (int j = 0; j < m_lanes[i].threads; ++j)
+            m_lanes[i].stat.post();
+    for (int i = 0; i < m_max_threads; ++i)
+        if (m_slots[i].state != SLOT_FREE)
+            pthread_join(m_slots[i].tid, NULL);
+    __atomic_sub_fetch(&m_stats->threads, m_thread_number, __ATOMIC_RELAXED);
+    delete[] m_slots;
+    delete[] m_lanes;
 }
 
-// Reactor模式下的任务添加函数
 template <typename T>
-bool threadpool<T>::append(T *request, int state) {
-    m_queuelocker.lock();
-    // 如果工作队列已满，则拒绝添加
-    if (m_workqueue.size() >= m_max_requests) {
-        m_queuelocker.unlock();
+bool threadpool<T>::spawn(int index) {
+    slot *s = NULL;
+    for (int i = 0; i < m_max_threads && !s; ++i)
+        if (m_slots[i].state != SLOT_RUNNING)
+            s = m_slots + i;
+    if (!s)
         return false;
+    // 槽位上次的线程已经登记退出，join回收它的栈
+    if (s->state == SLOT_EXITED)
+        pthread_join(s->tid, NULL);
+    s->state = SLOT_FREE;
+    s->pool = this;
+    s->lane = index;
+
+    // 按CPU分流时线程绑在自己队列对应的核上，否则在整个CPU集合内调度
+    std::vector<int> pin;
+    if (m_lane_count > 1)
+        pin.push_back(m_cpus[index]);
+    else
+        pin = m_cpus;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    bool pinned = !pin.empty() && cpu_affinity::pin_attr(&attr, pin);
+    // 创建线程，绑定worker函数；CPU不在线等原因绑核失败时按默认亲和性重试
+    int ret = pthread_create(&s->tid, &attr, worker, s);
+    pthread_attr_destroy(&attr);
+    if (ret != 0 && pinned) {
+        __atomic_add_fetch(&m_unpinned, 1, __ATOMIC_RELAXED);
+        ret = pthread_create(&s->tid, NULL, worker, s);
     }
-    // 设置任务状态并添加到工作队列
-    request->m_state = state;
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    // 增加信号量，通知有任务要处理
-    m_queuestat.post();
+    if (ret != 0)
+        return false;
+    s->state = SLOT_RUNNING;
+    lane &l = m_lanes[index];
+    __atomic_add_fetch(&m_thread_number, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&m_stats->threads, 1, __ATOMIC_RELAXED);
+    // 多了一个线程，被推迟的任务可能已经可以执行，把记下的唤醒还给信号量
+    l.lock.lock();
+    __atomic_add_fetch(&l.threads, 1, __ATOMIC_RELAXED);
+    int deferred = l.deferred;
+    l.deferred = 0;
+    l.lock.unlock();
+    for (int i = 0; i < deferred; ++i)
+        l.stat.post();
     return true;
 }
 
-// Proactor模式下的任务添加函数
 template <typename T>
-bool threadpool<T>::append_p(T *request) {
-    m_queuelocker.lock();
-    if (m_workqueue.size() >= m_max_requests) {
-        m_queuelocker.unlock();
+void threadpool<T>::grow(int index, int cls, long long wait) {
+    if (wait <= m_wait_target || threads() >= m_max_threads)
+        return;
+    lane &l = m_lanes[index];
+    // 还有能执行它的线程空闲（已被唤醒、尚未取到任务）时等它处理；
+    // 不加锁读取调度状态，偶尔判断错只是早一点或晚一点增加线程
+    if (__atomic_load_n(&l.active, __ATOMIC_RELAXED) < __atomic_load_n(&l.threads, __ATOMIC_RELAXED) &&
+        can_start(l, cls))
+        return;
+    long long now = now_ns();
+    if (now - __atomic_load_n(&m_grown_at, __ATOMIC_RELAXED) < m_wait_target)
+        return;
+    m_resize.lock();
+    // 加锁后重新检查，并发的调用者只有一个增加线程
+    if (!m_stop && m_thread_number < m_max_threads && now - m_grown_at >= m_wait_target &&
+        spawn(index)) {
+        __atomic_store_n(&m_grown_at, now, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&m_stats->grown, 1, __ATOMIC_RELAXED);
+    }
+    m_resize.unlock();
+}
+
+template <typename T>
+bool threadpool<T>::retire(slot *s) {
+    lane &l = m_lanes[s->lane];
+    m_resize.lock();
+    // 至少留一个线程等待这个队列，超时和post之间到达的任务由它处理
+    bool quit = !m_stop && m_thread_number > m_min_threads && l.threads > 1;
+    if (quit) {
+        __atomic_sub_fetch(&l.threads, 1, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&m_thread_number, 1, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&m_stats->threads, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&m_stats->shrunk, 1, __ATOMIC_RELAXED);
+        s->state = SLOT_EXITED;
+    }
+    m_resize.unlock();
+    return quit;
+}
+
+template <typename T>
+int threadpool<T>::lane_of(T *request) const {
+    if (1 == m_lane_count)
+        return 0;
+    int cpu = request->m_cpu;
+    if (cpu >= 0 && cpu < (int)m_cpu_lane.size() && m_cpu_lane[cpu] >= 0)
+        return m_cpu_lane[cpu];
+    // 同一个连接总是落在同一个队列
+    return (int)(((size_t)request / sizeof(T)) % m_lane_count);
+}
+
+template <typename T>
+bool threadpool<T>::can_start(const lane &l, int cls) const {
+    int threads = l.threads;
+    if (threads <= m_reserve_total)
+        return true;
+    // 其他类还没用满的保留线程必须空着
+    int held = 0;
+    for (int c = 0; c < TASK_CLASSES; ++c)
+        if (c != cls && l.running[c] < m_reserve[c])
+            held += m_reserve[c] - l.running[c];
+    return l.active + 1 + held <= threads;
+}
+
+template <typename T>
+int threadpool<T>::pick(lane &l) {
+    // 平滑加权轮询：参与的类各加上自己的权重，选当前值最大的一类并减去参与者的权重之和；
+    // 空的子队列不参与，也不积累
+    int best = -1;
+    int total = 0;
+    for (int c = 0; c < TASK_CLASSES; ++c) {
+        if (l.queue[c].empty() || !can_start(l, c))
+            continue;
+        l.credit[c] += m_weight[c];
+        total += m_weight[c];
+        if (best < 0 || l.credit[c] > l.credit[best])
+            best = c;
+    }
+    if (best >= 0)
+        l.credit[best] -= total;
+    return best;
+}
+
+template <typename T>
+bool threadpool<T>::push(T *request, int cls) {
+    if (cls < 0 || cls >= TASK_CLASSES)
+        cls = TASK_FAST;
+    int index = lane_of(request);
+    lane &l = m_lanes[index];
+    item it = {request, now_ns()};
+    l.lock.lock();
+    // 如果工作队列已满，则拒绝添加
+    if (l.size >= (size_t)m_max_requests) {
+        l.lock.unlock();
         return false;
     }
-    m_workqueue.push_back(request);
-    m_queuelocker.unlock();
-    m_queuestat.post();
+    l.queue[cls].push_back(it);
+    ++l.size;
+    // 队首任务等待的时间；线程都阻塞在数据库等操作上时没有线程取任务，只能在入队时发现
+    long long wait = it.since - l.queue[cls].front().since;
+    l.lock.unlock();
+    __atomic_add_fetch(&m_stats->queued[cls], 1, __ATOMIC_RELAXED);
+    // 增加信号量，通知有任务要处理
+    l.stat.post();
+    if (m_idle_ms > 0)
+        grow(index, cls, wait);
     return true;
 }
 
+// Reactor模式下的任务添加函数
+template <typename T>
+bool threadpool<T>::append(T *request, int state, int cls) {
+    // 设置任务状态并添加到工作队列
+    request->m_state = state;
+    return push(request, cls);
+}
+
+// Proactor模式下的任务添加函数
+template <typename T>
+bool threadpool<T>::append_p(T *request, int cls) {
+    return push(request, cls);
+}
+
 // 线程工作函数（静态成员函数），将this指针作为参数传入
 template <typename T>
 void* threadpool<T>::worker(void* arg) {
-    threadpool *pool = (threadpool *) arg;
-    pool->run();
+    slot *s = (slot *) arg;
+    threadpool *pool = s->pool;
+    pool->run(s);
     return pool;
 }
 
-// 工作线程运行的函数，不断从工作队列中取出任务并执行
+// 执行一个任务：reactor模式下先完成读写，proactor模式下直接处理
 template <typename T>
-void threadpool<T>::run() {
-    while (true) {
-        // 等待信号量，有任务时才会继续执行
-        m_queuestat.wait();
-        m_queuelocker.lock();
-        if (m_workqueue.empty()) {
-            m_queuelocker.unlock();
-            continue;
-        }
-        
-        // 从请求队列中取出第一个任务
-        T *request = m_workqueue.front();
-        m_workqueue.pop_front();
-        m_queuelocker.unlock();
-        
-        if (!request) continue;
-        
-        // Reactor模式
-        if (1 == m_actor_model) {
-            // 读事件
-            if (0 == request->m_state) {
-                if (request->read_once()) {
-                    request->improv = 1;
-                    // 创建数据库连接
-                    connectionRAII mysqlcon(&request->mysql, m_connPool);
-                    // 处理请求
-                    request->process();
-                }
-                else {
-                    request->improv = 1;
-                    request->timer_flag = 1;
+void threadpool<T>::execute(T *request, int cls) {
+    // Reactor模式
+    if (1 == m_actor_model) {
+        // 读事件
+        if (0 == request->m_state) {
+            if (request->read_once()) {
+                // 事件循环入队时还没有读取，不知道类别；读到请求行后按实际类别重新排队，
+                // 数据库请求同样受权重和保留线程的约束。队列满时就地处理
+                int actual = request->classify();
+                if (actual != cls) {
+                    request->m_state = 2;
+                    if (push(request, actual)) {
+                        request->improv = 1;
+                        return;
+                    }
                 }
-            } 
-            // 写事件
+                request->improv = 1;
+                // 创建数据库连接
+                connectionRAII mysqlcon(&request->mysql, m_connPool);
+                // 处理请求
+                request->process();
+            }
             else {
-                if (request->write()) {
-                    request->improv = 1;
-                } else {
-                    request->improv = 1;
-                    request->timer_flag = 1;
-                }
+                request->improv = 1;
+                request->timer_flag = 1;
             }
         } 
-        // Proactor模式
-        else {
-            // 创建数据库连接
+        // 已经读取、按类别重新排队的请求
+        else if (2 == request->m_state) {
             connectionRAII mysqlcon(&request->mysql, m_connPool);
-            // 直接处理业务逻辑
             request->process();
         }
+        // 写事件
+        else {
+            if (request->write()) {
+                request->improv = 1;
+            } else {
+                request->improv = 1;
+                request->timer_flag = 1;
+            }
+        }
+    } 
+    // Proactor模式
+    else {
+        // 创建数据库连接
+        connectionRAII mysqlcon(&request->mysql, m_connPool);
+        // 直接处理业务逻辑
+        request->process();
+    }
+}
+
+// 工作线程运行的函数，不断从工作队列中取出任务并执行
+template <typename T>
+void threadpool<T>::run(slot *s) {
+    int index = s->lane;
+    lane &l = m_lanes[index];
+    // 上一个任务执行完时接手了一个被推迟的任务，不必再等信号量
+    bool resumed = false;
+    while (true) {
+        // 等待信号量，有任务时才会继续执行；可以伸缩时限时等待，空闲超时后按需退出
+        if (!resumed) {
+            bool woken = m_idle_ms > 0 ? l.stat.timedwait(m_idle_ms) : l.stat.wait();
+            if (m_stop)
+                break;
+            if (!woken) {
+                // 登记退出后s可能被新线程复用，之后不再访问
+                if (m_idle_ms > 0 && retire(s))
+                    break;
+                continue;
+            }
+        }
+        resumed = false;
+        if (m_stop)
+            break;
+        l.lock.lock();
+        int cls = pick(l);
+        if (cls < 0) {
+            // 剩下的任务都要等其他类的任务执行完，把这次唤醒记下来交给下一个执行完任务的线程
+            if (l.size > 0)
+                ++l.deferred;
+            l.lock.unlock();
+            continue;
+        }
+        
+        // 从选中的子队列中取出第一个任务
+        item it = l.queue[cls].front();
+        l.queue[cls].pop_front();
+        --l.size;
+        bool backlog = !l.queue[cls].empty();
+        ++l.running[cls];
+        __atomic_add_fetch(&l.active, 1, __ATOMIC_RELAXED);
+        l.lock.unlock();
+
+        T *request = it.request;
+        long long wait = now_ns() - it.since;
+        __atomic_sub_fetch(&m_stats->queued[cls], 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&m_stats->tasks[cls], 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&m_stats->wait_us[cls], (unsigned long long)wait / 1000, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&m_stats->active, 1, __ATOMIC_RELAXED);
+        // 取到的任务排队过久且后面还有同类任务说明队列积压，自己也算作忙碌线程；
+        // 队列里只有这一个任务时排队时间是唤醒线程的延迟，增加线程也不会缩短
+        if (m_idle_ms > 0 && backlog)
+            grow(index, cls, wait);
+        if (request)
+            execute(request, cls);
+        __atomic_sub_fetch(&m_stats->active, 1, __ATOMIC_RELAXED);
+        l.lock.lock();
+        --l.running[cls];
+        __atomic_sub_fetch(&l.active, 1, __ATOMIC_RELAXED);
+        // 执行完一个任务腾出了线程，接手一个被推迟的任务
+        if (l.deferred > 0) {
+            --l.deferred;
+            resumed = true;
+        }
+        l.lock.unlock();
     }
 }
 #endif
\ No newline at end of file
@@ -1,6 +1,8 @@
 #include "lst_timer.h"
 #include <cstring>
 #include "../http/http_conn.h"
+#include "../prefork/prefork.h"
+#include "../net/ip_limiter.h"
 
 sort_timer_lst::sort_timer_lst() {
     head = NULL;
@@ -67,6 +69,18 @@ void sort_timer_lst::adjust_timer(util_timer *timer) {
     if (!timer) {
         return;
     }
+    // 截止时间提前（连接进入了时限更短的阶段）：摘下后从头重新插入
+    if (timer->prev && timer->expire < timer->prev->expire) {
+        timer->prev->next = timer->next;
+        if (timer->next)
+            timer->next->prev = timer->prev;
+        else
+            tail = timer->prev;
+        timer->prev = NULL;
+        timer->next = NULL;
+        add_timer(timer);
+        return;
+    }
     util_timer *tmp = timer->next;
     if (!tmp || (timer->expire < tmp->expire)) {
         return;
@@ -113,18 +127,27 @@ void sort_timer_lst::del_timer(util_timer *timer) {
 
 void sort_timer_lst::tick() {
     if (!head) return;
-    time_t cur = time(NULL);
+    long long cur = timer_now_ms();
     util_timer *tmp = head;
     while (tmp) {
         if (cur < tmp->expire) {
             break;
         }
-        tmp->cb_func(tmp->user_data);
         head = tmp->next;
         if (head) {
             head->prev = NULL;
+        } else {
+            tail = NULL;
+        }
+        long long due = tmp->user_data && tmp->user_data->conn ? tmp->user_data->conn->deadline() : 0;
+        if (due > cur) {
+            tmp->expire = due;
+            tmp->next = NULL;
+            add_timer(tmp);
+        } else {
+            tmp->cb_func(tmp->user_data);
+            delete tmp;
         }
-        delete tmp;
         tmp = head;
     }
 }
@@ -133,6 +156,49 @@ void Utils::init(int timeslot) {
     m_TIMESLOT = timeslot;
 }
 
+conn_timeouts::conn_timeouts()
+    : header_ms(20000), body_ms(20000), min_rate(500), write_ms(15000), keepalive_ms(15000) {}
+
+bool conn_timeouts::parse(const char *spec, std::string *err) {
+    std::string s(spec);
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t end = s.find(',', pos);
+        if (end == std::string::npos)
+            end = s.size();
+        std::string item = s.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty())
+            continue;
+
+        size_t eq = item.find('=');
+        char *tail = NULL;
+        long value = eq == std::string::npos ? 0 : strtol(item.c_str() + eq + 1, &tail, 10);
+        std::string key = eq == std::string::npos ? item : item.substr(0, eq);
+        // 时限必须为正，最低速度可以为0
+        if (eq == std::string::npos || tail == item.c_str() + eq + 1 || *tail != '\0' || value < 0 ||
+            value > 3600 * 1000 || (value == 0 && key != "min_rate")) {
+            *err = item;
+            return false;
+        }
+        if (key == "header_ms")
+            header_ms = (int)value;
+        else if (key == "body_ms")
+            body_ms = (int)value;
+        else if (key == "min_rate")
+            min_rate = (int)value;
+        else if (key == "write_ms")
+            write_ms = (int)value;
+        else if (key == "keepalive_ms")
+            keepalive_ms = (int)value;
+        else {
+            *err = item;
+            return false;
+        }
+    }
+    return true;
+}
+
 int Utils::setnonblocking(int fd) {
     int old_option = fcntl(fd, F_GETFL);
     int new_option = old_option | O_NONBLOCK;
@@ -162,7 +228,32 @@ void Utils::sig_handler(int sig) {
 
 void Utils::timer_handler() {
     m_timer_lst.tick();
-    alarm(m_TIMESLOT);
+    long long now = timer_now_ms();
+    // 按IP的限流表项也随定时器老化，整表扫描，每个时间槽最多一次
+    if (now >= m_sweep_at) {
+        ip_limiter::get_instance()->sweep();
+        m_sweep_at = now + m_TIMESLOT * 1000LL;
+    }
+    m_alarm_at = 0;
+    util_timer *first = m_timer_lst.front();
+    arm(first ? first->expire : now + m_TIMESLOT * 1000LL);
+}
+
+void Utils::arm(long long at) {
+    long long now = timer_now_ms();
+    long long latest = now + m_TIMESLOT * 1000LL;
+    if (at > latest)
+        at = latest;
+    if (m_alarm_at > now && at >= m_alarm_at)
+        return;
+    // 一次性的毫秒级定时，到期后由timer_handler()按链表头重新安排
+    long long delay = at > now ? at - now : 1;
+    struct itimerval value;
+    memset(&value, 0, sizeof(value));
+    value.it_value.tv_sec = delay / 1000;
+    value.it_value.tv_usec = (delay % 1000) * 1000;
+    setitimer(ITIMER_REAL, &value, NULL);
+    m_alarm_at = now + delay;
 }
 
 void Utils::show_error(int connfd, const char *info) {
@@ -176,6 +267,8 @@ class Utils;
 void cb_func(client_data *user_data) {
     epoll_ctl(Utils::u_epollfd, EPOLL_CTL_DEL, user_data->sockfd, 0);
     assert(user_data);
+    ip_limiter::get_instance()->release(user_data->sockfd);
     close(user_data->sockfd);
     http_conn::m_user_count--;
+    __atomic_sub_fetch(&prefork::get_instance()->stats()->connections, 1, __ATOMIC_RELAXED);
 }
\ No newline at end of file
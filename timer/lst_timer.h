@@ -20,9 +20,46 @@
 #include <sys/uio.h>
 
 #include <sys/time.h>
+#include <time.h>
+#include <string>
 #include "../log/log.h"
 
 class util_timer;
+class http_conn;
+
+/**
+ * @brief 定时器使用的时钟：CLOCK_MONOTONIC的毫秒数，不受系统时间调整影响
+ */
+inline long long timer_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief 连接各阶段的时限
+ *
+ * 请求头从第一个字节起必须在header_ms内收完，不因陆续到达的数据延长；请求体在body_ms的宽限之外
+ * 按min_rate字节/秒计算，平均速度不低于它就不会超时；响应在write_ms内没有任何进展即超时；
+ * 长连接在两个请求之间最多空闲keepalive_ms。命令行用-D指定，例如`-D header_ms=5000,min_rate=1024`
+ */
+struct conn_timeouts {
+    int header_ms;      // 收完请求头的时限，默认20000
+    int body_ms;        // 请求体的宽限时间，默认20000
+    int min_rate;       // 请求体的最低平均速度（字节/秒），0表示只要求每body_ms内有数据到达，默认500
+    int write_ms;       // 响应在这么久内没有写出任何数据即超时，默认15000
+    int keepalive_ms;   // 长连接的空闲时限，默认15000
+
+    conn_timeouts();
+
+    /**
+     * @brief 解析key=value[,key=value...]，未出现的参数保持原值
+     * @param spec 参数字符串
+     * @param err 失败时写入出错的部分
+     * @return 是否成功
+     */
+    bool parse(const char *spec, std::string *err);
+};
 
 /**
  * @brief 客户端数据结构
@@ -33,6 +70,7 @@ struct client_data {
     sockaddr_in address;  // 客户端socket地址
     int sockfd;           // 客户端socket文件描述符
     util_timer *timer;    // 指向对应的定时器
+    http_conn *conn;      // 对应的连接，定时器到期时按它当前的截止时间决定是否关闭
 };
 
 /**
@@ -44,7 +82,7 @@ class util_timer {
 public:
     util_timer() : prev(NULL), next(NULL) {}
 public:
-    time_t expire;                      // 定时器到期时间
+    long long expire;                   // 定时器到期时刻（毫秒，timer_now_ms()）
     void (* cb_func)(client_data *);    // 回调函数，处理定时器到期事件
     client_data *user_data;             // 用户数据，指向对应的客户端数据
     util_timer *prev;                   // 前向指针，指向前一个定时器
@@ -75,7 +113,7 @@ public:
     void add_timer(util_timer *timer);
     
     /**
-     * @brief 调整定时器在链表中的位置
+     * @brief 修改到期时刻后调整定时器在链表中的位置，提前和推后都可以
      * @param timer 需要调整的定时器
      */
     void adjust_timer(util_timer *timer);
@@ -89,9 +127,16 @@ public:
     /**
      * @brief 定时器任务处理函数
      * 
-     * 处理链表上到期的定时器，执行回调函数
+     * 处理链表上到期的定时器，执行回调函数；对应连接的截止时间已经推后（工作线程推进了阶段）的
+     * 重新排入链表而不是关闭
      */
     void tick();
+
+    /**
+     * @brief 链表头，沿next指针可按到期时间遍历全部定时器
+     * @return 链表头指针，链表为空时为NULL
+     */
+    util_timer *front() const { return head; }
     
 private:
     /**
@@ -112,7 +157,7 @@ private:
  */
 class Utils {
 public:
-    Utils() {}
+    Utils() : m_alarm_at(0), m_sweep_at(0) {}
     ~Utils() {}
     
     /**
@@ -158,6 +203,12 @@ public:
      */
     void timer_handler();
 
+    /**
+     * @brief 安排下一次SIGALRM，早于已经安排的时刻时才重新设置
+     * @param at 触发时刻（毫秒，timer_now_ms()），最晚为一个时间槽之后
+     */
+    void arm(long long at);
+
     /**
      * @brief 显示错误信息
      * @param connfd 连接文件描述符
@@ -169,7 +220,9 @@ public:
     static int *u_pipefd;            // 管道文件描述符
     sort_timer_lst m_timer_lst;      // 定时器链表
     static int u_epollfd;            // epoll文件描述符
-    int m_TIMESLOT;                  // 时间槽
+    int m_TIMESLOT;                  // 时间槽，两次SIGALRM之间的最长间隔（秒）
+    long long m_alarm_at;            // 已安排的下一次SIGALRM的时刻（毫秒）
+    long long m_sweep_at;            // 下一次清理限流表项的时刻（毫秒）
 };
 
 /**
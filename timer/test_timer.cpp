@@ -26,9 +26,9 @@ void test_add_timer(sort_timer_lst& timer_lst) {
     util_timer* timer2 = new util_timer();
     util_timer* timer3 = new util_timer();
 
-    timer1->expire = time(NULL) + 5;
-    timer2->expire = time(NULL) + 10;
-    timer3->expire = time(NULL) + 15;
+    timer1->expire = timer_now_ms() + 5000;
+    timer2->expire = timer_now_ms() + 10000;
+    timer3->expire = timer_now_ms() + 15000;
 
     timer1->cb_func = timer_callback;
     timer2->cb_func = timer_callback;
@@ -50,24 +50,43 @@ void test_adjust_timer(sort_timer_lst& timer_lst) {
     client_data* client = create_client_data(4);
 
     util_timer* timer = new util_timer();
-    timer->expire = time(NULL) + 5;
+    timer->expire = timer_now_ms() + 5000;
     timer->cb_func = timer_callback;
     timer->user_data = client;
 
     timer_lst.add_timer(timer);
 
-    timer->expire = time(NULL) + 20;
+    timer->expire = timer_now_ms() + 20000;
     timer_lst.adjust_timer(timer);
 
     std::cout << "Adjust timer expiration time" << std::endl;
 }
 
+void test_adjust_timer_earlier(sort_timer_lst& timer_lst) {
+    std::cout << "\n=== Testing Adjust Timer Earlier ===" << std::endl;
+    client_data* client = create_client_data(7);
+
+    util_timer* timer = new util_timer();
+    timer->expire = timer_now_ms() + 30000;
+    timer->cb_func = timer_callback;
+    timer->user_data = client;
+
+    timer_lst.add_timer(timer);
+
+    // 连接进入时限更短的阶段，定时器应移到链表头
+    timer->expire = timer_now_ms() + 1000;
+    timer_lst.adjust_timer(timer);
+    assert(timer_lst.front() == timer);
+
+    std::cout << "Adjusted timer moved to the front" << std::endl;
+}
+
 void test_del_timer(sort_timer_lst& timer_lst) {
     std::cout << "\n=== Testing Delete Timer ===" << std::endl;
     client_data* client = create_client_data(5);
 
     util_timer* timer = new util_timer();
-    timer->expire = time(NULL) + 5;
+    timer->expire = timer_now_ms() + 5000;
     timer->cb_func = timer_callback;
     timer->user_data = client;
 
@@ -84,7 +103,7 @@ void test_timer_expiration(sort_timer_lst& timer_lst) {
     client_data* client = create_client_data(6);
 
     util_timer* timer = new util_timer();
-    timer->expire = time(NULL) + 3;
+    timer->expire = timer_now_ms() + 3000;
     timer->cb_func = timer_callback;
     timer->user_data = client;
 
@@ -101,6 +120,7 @@ int main() {
     sort_timer_lst timer_lst;
     test_add_timer(timer_lst);
     test_adjust_timer(timer_lst);
+    test_adjust_timer_earlier(timer_lst);
     test_del_timer(timer_lst);
     test_timer_expiration(timer_lst);
 
@@ -0,0 +1,191 @@
+#include "io_ring.h"
+
+#ifdef USE_IO_URING
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+io_ring::io_ring()
+    : m_fd(-1), m_sq_head(NULL), m_sq_tail(NULL), m_sq_mask(0), m_sq_entries(0), m_sq_array(NULL),
+      m_sqes(NULL), m_sqe_tail(0), m_cq_head(NULL), m_cq_tail(NULL), m_cq_mask(0), m_cqes(NULL),
+      m_ring_ptr(MAP_FAILED), m_ring_size(0), m_sqes_size(0), m_buf_base(NULL), m_buf_size(0),
+      m_buf_group(0) {}
+
+io_ring::~io_ring() {
+    release();
+}
+
+void io_ring::release() {
+    if (m_fd >= 0)
+        close(m_fd);
+    m_fd = -1;
+    if (m_ring_ptr != MAP_FAILED)
+        munmap(m_ring_ptr, m_ring_size);
+    m_ring_ptr = MAP_FAILED;
+    if (m_sqes)
+        munmap(m_sqes, m_sqes_size);
+    m_sqes = NULL;
+    delete[] m_buf_base;
+    m_buf_base = NULL;
+}
+
+bool io_ring::init(unsigned entries) {
+    // 依次尝试：单线程提交+延迟任务执行（6.1起），协作式任务执行（5.19起），最基本的设置
+    static const unsigned flag_sets[] = {
+        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_SUBMIT_ALL,
+        IORING_SETUP_COOP_TASKRUN | IORING_SETUP_SUBMIT_ALL,
+        0
+    };
+    struct io_uring_params p;
+    for (size_t i = 0; i < sizeof(flag_sets) / sizeof(flag_sets[0]); ++i) {
+        memset(&p, 0, sizeof(p));
+        p.flags = flag_sets[i] | IORING_SETUP_CQSIZE;
+        p.cq_entries = entries * 4;
+        m_fd = sys_io_uring_setup(entries, &p);
+        if (m_fd >= 0 || errno != EINVAL)
+            break;
+    }
+    if (m_fd < 0)
+        return false;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP)) {
+        release();
+        errno = ENOSYS;
+        return false;
+    }
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    m_ring_size = sq_size > cq_size ? sq_size : cq_size;
+    m_ring_ptr = mmap(NULL, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                      IORING_OFF_SQ_RING);
+    if (m_ring_ptr == MAP_FAILED) {
+        int saved = errno;
+        release();
+        errno = saved;
+        return false;
+    }
+    m_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        int saved = errno;
+        release();
+        errno = saved;
+        return false;
+    }
+    m_sqes = (struct io_uring_sqe *)sqes;
+
+    char *ring = (char *)m_ring_ptr;
+    m_sq_head = (unsigned *)(ring + p.sq_off.head);
+    m_sq_tail = (unsigned *)(ring + p.sq_off.tail);
+    m_sq_mask = *(unsigned *)(ring + p.sq_off.ring_mask);
+    m_sq_entries = p.sq_entries;
+    m_sq_array = (unsigned *)(ring + p.sq_off.array);
+    m_cq_head = (unsigned *)(ring + p.cq_off.head);
+    m_cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    m_cq_mask = *(unsigned *)(ring + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+
+    // SQ数组与SQE一一对应，之后只需移动队尾
+    for (unsigned i = 0; i < m_sq_entries; ++i)
+        m_sq_array[i] = i;
+    m_sqe_tail = *m_sq_tail;
+    return true;
+}
+
+bool io_ring::register_files(unsigned count) {
+    struct io_uring_rsrc_register reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.nr = count;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    return sys_io_uring_register(m_fd, IORING_REGISTER_FILES2, &reg, sizeof(reg)) == 0;
+}
+
+bool io_ring::setup_buffers(uint16_t group, unsigned count, unsigned size) {
+    m_buf_base = new char[(size_t)count * size];
+    m_buf_size = size;
+    m_buf_group = group;
+
+    // 一个PROVIDE_BUFFERS请求交出全部缓冲区，buffer id从0开始连续编号
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = count;
+    sqe->addr = (unsigned long)m_buf_base;
+    sqe->len = size;
+    sqe->off = 0;
+    sqe->buf_group = group;
+    sqe->user_data = 0;
+    if (submit_and_wait(1) < 0)
+        return false;
+    struct io_uring_cqe *cqe = peek_cqe();
+    int res = cqe ? cqe->res : -EIO;
+    if (cqe)
+        cqe_seen();
+    if (res < 0) {
+        errno = -res;
+        return false;
+    }
+    return true;
+}
+
+struct io_uring_sqe *io_ring::get_sqe() {
+    unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sqe_tail - head >= m_sq_entries) {
+        // 提交队列已满，先提交一批
+        submit_and_wait(0);
+        head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        if (m_sqe_tail - head >= m_sq_entries)
+            return NULL;
+    }
+    struct io_uring_sqe *sqe = &m_sqes[m_sqe_tail & m_sq_mask];
+    ++m_sqe_tail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int io_ring::submit_and_wait(unsigned wait_nr) {
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    // 延迟任务执行模式下，完成事件只在带GETEVENTS的io_uring_enter中产生，因此总是带上
+    return sys_io_uring_enter(m_fd, to_submit, wait_nr, IORING_ENTER_GETEVENTS);
+}
+
+struct io_uring_cqe *io_ring::peek_cqe() {
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+        return NULL;
+    return &m_cqes[head & m_cq_mask];
+}
+
+void io_ring::cqe_seen() {
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+void io_ring::recycle_buffer(uint16_t bid) {
+    struct io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = (unsigned long)buffer(bid);
+    sqe->len = m_buf_size;
+    sqe->off = bid;
+    sqe->buf_group = m_buf_group;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = 0;
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#ifdef USE_IO_URING
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/**
+ * @brief io_uring的最小封装
+ *
+ * 直接使用io_uring_setup/io_uring_enter/io_uring_register系统调用，不依赖liburing。
+ * 只在单个线程中使用（SINGLE_ISSUER），提交队列满时自动提交一次。
+ * 附带一组通过PROVIDE_BUFFERS交给内核的缓冲区，multishot recv从中取缓冲区，用完后归还。
+ * 没有使用6.0起的buffer ring：在部分内核上注册成功后recv仍然返回ENOBUFS
+ */
+class io_ring {
+public:
+    io_ring();
+    ~io_ring();
+
+    /**
+     * @brief 创建ring
+     * @param entries 提交队列长度，完成队列为它的4倍（multishot请求会产生大量完成事件）
+     * @return 失败时返回false，errno为失败原因
+     */
+    bool init(unsigned entries);
+
+    /**
+     * @brief 注册稀疏的固定文件表，之后可以用IORING_OP_FILES_UPDATE按下标填入
+     * @param count 表的大小
+     * @return 是否成功
+     */
+    bool register_files(unsigned count);
+
+    /**
+     * @brief 分配缓冲区并交给内核，需在提交其他请求之前调用
+     * @param group 缓冲区组ID，recv时通过buf_group指定
+     * @param count 缓冲区个数，不超过65536
+     * @param size 每个缓冲区的大小
+     * @return 是否成功
+     */
+    bool setup_buffers(uint16_t group, unsigned count, unsigned size);
+
+    /**
+     * @brief 取一个空闲的SQE，已清零
+     */
+    struct io_uring_sqe *get_sqe();
+
+    /**
+     * @brief 提交所有SQE，并等待至少wait_nr个完成事件
+     * @return 提交的SQE个数，-1表示出错（errno为EINTR时是被信号打断）
+     */
+    int submit_and_wait(unsigned wait_nr);
+
+    /**
+     * @brief 取下一个完成事件，没有时返回NULL；处理完后调用cqe_seen()
+     */
+    struct io_uring_cqe *peek_cqe();
+    void cqe_seen();
+
+    /**
+     * @brief 取buffer id对应的缓冲区
+     */
+    char *buffer(uint16_t bid) const { return m_buf_base + (size_t)bid * m_buf_size; }
+
+    /**
+     * @brief 把缓冲区还给内核，随下次提交一起生效；成功时不产生完成事件，失败时的user_data为0
+     */
+    void recycle_buffer(uint16_t bid);
+
+private:
+    void release();
+
+    int m_fd;                       // ring文件描述符
+    // 提交队列
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned m_sq_mask;
+    unsigned m_sq_entries;
+    unsigned *m_sq_array;
+    struct io_uring_sqe *m_sqes;
+    unsigned m_sqe_tail;            // 本地已填写、尚未发布的SQE位置
+    // 完成队列
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned m_cq_mask;
+    struct io_uring_cqe *m_cqes;
+    // 映射区
+    void *m_ring_ptr;
+    size_t m_ring_size;
+    size_t m_sqes_size;
+    // provided buffer
+    char *m_buf_base;
+    unsigned m_buf_size;
+    uint16_t m_buf_group;
+};
+
+#endif  // USE_IO_URING
+
+#endif
@@ -1,5 +1,103 @@
 #include "webserver.h"
 
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+#ifdef USE_COROUTINE
+#include "./coro/coro.h"
+
+// 定时器回调只能拿到client_data，通过它找回服务器
+static WebServer *coro_server = NULL;
+
+// 协程模式下的定时器回调：先销毁连接的协程，再按原方式关闭socket。
+// 数据库请求还在线程池中处理时不能关闭：fd会被新连接复用，而工作线程仍在读写同一个http_conn；
+// 只做标记，协程交回后由coro_done()关闭。定时器由调用方照常删除，连接上不再保留它
+static void coro_cb_func(client_data *user_data) {
+    if (!coro_server->coro_release(user_data->sockfd)) {
+        user_data->timer = NULL;
+        return;
+    }
+    cb_func(user_data);
+}
+#endif
+
+#ifdef USE_IO_URING
+#include <deque>
+#include <poll.h>
+#include <sys/resource.h>
+#include "./uring/io_ring.h"
+
+// 提交队列长度
+static const unsigned URING_ENTRIES = 4096;
+// provided buffer的组ID、个数和大小，大小与http_conn的读缓冲区一致
+static const uint16_t URING_BUF_GROUP = 0;
+static const unsigned URING_BUF_COUNT = 4096;
+static const unsigned URING_BUF_SIZE = http_conn::READ_BUFFER_SIZE;
+
+// user_data的高8位为请求类型，中间24位为代数，低32位为fd
+enum URING_OP {
+    UD_IGNORE = 0,  // 撤销、更新固定文件表等，失败时才产生完成事件，直接丢弃
+    UD_ACCEPT,
+    UD_RECV,
+    UD_SEND,
+    UD_POLL,
+    UD_SIGNAL,
+    UD_TIMEOUT
+};
+
+static inline unsigned long long uring_ud(int op, unsigned gen, int fd) {
+    return ((unsigned long long)op << 56) | ((unsigned long long)(gen & 0xffffff) << 32) | (unsigned)fd;
+}
+
+// 已收到、尚未交给http_conn的数据，位于provided buffer中
+struct uring_chunk {
+    uint16_t bid;
+    uint32_t off;
+    uint32_t len;
+};
+
+/**
+ * @brief io_uring模式下一个连接的状态
+ */
+struct uring_conn {
+    unsigned gen;           // 连接代数，fd复用后旧请求的完成事件据此丢弃
+    bool open;              // 连接是否有效
+    bool fixed;             // fd已填入固定文件表的同一下标
+    bool recv_armed;        // multishot recv进行中
+    bool sending;           // sendmsg进行中
+    bool poll_armed;        // POLL_ADD进行中
+    bool eof;               // 对端已关闭写方向，已收到的数据处理完后关闭
+    bool nobufs;            // 上次recv因缓冲区用完而结束
+    int poll_events;        // POLL_ADD等待的事件
+    int file;               // FILES_UPDATE的参数，提交前必须保持有效
+    struct msghdr msg;      // 进行中的sendmsg
+    std::deque<uring_chunk> input;  // 已收到、尚未交给http_conn的数据
+
+    uring_conn()
+        : gen(0), open(false), fixed(false), recv_armed(false), sending(false), poll_armed(false), eof(false),
+          nobufs(false), poll_events(0), file(-1) {
+        memset(&msg, 0, sizeof(msg));
+    }
+};
+
+// 定时器回调只能拿到client_data，通过它找回服务器
+static WebServer *uring_server = NULL;
+// 从固定文件表中移除时填入的值
+static int uring_no_file = -1;
+
+// io_uring模式下的定时器回调：先撤销该连接在ring中的请求，再按原方式关闭socket
+static void uring_cb_func(client_data *user_data) {
+    uring_server->uring_release(user_data->sockfd);
+    cb_func(user_data);
+}
+
+static inline void uring_set_fd(struct io_uring_sqe *sqe, int fd, bool fixed) {
+    sqe->fd = fd;
+    if (fixed)
+        sqe->flags |= IOSQE_FIXED_FILE;
+}
+#endif
+
 WebServer::WebServer() {
     users = new http_conn[MAX_FD];
 
@@ -11,20 +109,56 @@ WebServer::WebServer() {
     strcat(m_root, root);
 
     users_timer = new client_data[MAX_FD];
+
+    m_tls_port = 0;
+    m_tls_listenfd = -1;
+    m_accept_paused = false;
+    m_accept_resume_at = 0;
+    m_drain_timeout = 10;
+    m_draining = false;
+    m_drain_deadline = 0;
+    m_idle_check_at = 0;
+
+    m_io_engine = 0;
+    m_ring = NULL;
+    m_uconns = NULL;
+    m_fixed_files = 0;
+    m_accept_gen = 0;
+    m_pool = NULL;
+    m_coro_pool = NULL;
+    m_coro = NULL;
+    m_conn_node = NULL;
 }
 
 WebServer::~WebServer() {
+    // 先等工作线程退出，它们可能还在访问连接数组
+    delete m_pool;
+#ifdef USE_COROUTINE
+    delete m_coro_pool;
+    if (m_coro)
+        m_coro->destroy_all();
+    delete m_coro;
+#endif
     close(m_epollfd);
-    close(m_listenfd);
+    if (!m_draining) {
+        close(m_listenfd);
+        if (m_tls_listenfd >= 0)
+            close(m_tls_listenfd);
+    }
     close(m_pipefd[1]);
     close(m_pipefd[0]);
     delete[] users;
     delete[] users_timer;
-    delete m_pool;
+    delete[] m_conn_node;
+#ifdef USE_IO_URING
+    delete m_ring;
+    delete[] m_uconns;
+#endif
 }
 
 void WebServer::init(int port, string user, string passWord, string databaseName, int log_write,
-                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model) 
+                     int opt_linger, int trigmode, int sql_num, int thread_num, int close_log, int actor_model,
+                     long long max_body) 
 {
     m_port = port;
     m_user = user;
@@ -36,7 +170,60 @@ void WebServer::init(int port, string user, string passWord, string databaseName
     m_OPT_LINGER = opt_linger;
     m_TRIGMode = trigmode;
     m_close_log = close_log;
+#ifndef USE_COROUTINE
+    if (3 == actor_model) {
+        fprintf(stderr, "built without coroutine support, rebuild with `make CORO=1`; using -a 2\n");
+        actor_model = 2;
+    }
+#endif
     m_actormodel = actor_model;
+    http_conn::m_persist = (2 == actor_model || 3 == actor_model);
+    http_conn::m_max_body = max_body;
+
+    // 路由表在启动时一次性构建，之后只读
+    http_router::get_instance()->init(m_root);
+}
+
+void WebServer::tls(int port, string cert, string key, string ticket_key) {
+    m_tls_port = port;
+    if (port <= 0)
+        return;
+    tls_context *ctx = tls_context::get_instance();
+    if (!ctx->init(cert.c_str(), key.c_str(), ticket_key.c_str())) {
+        // 配置了HTTPS却无法提供时直接退出，避免悄悄只提供明文服务
+        LOG_ERROR("tls init failed: %s", ctx->error());
+        fprintf(stderr, "tls init failed: %s\n", ctx->error());
+        exit(1);
+    }
+}
+
+void WebServer::io_engine(int engine) {
+    m_io_engine = engine;
+}
+
+void WebServer::socket_tuning(const socket_opts &opts) {
+    m_sock_opts = opts;
+    http_conn::m_cork = opts.cork;
+}
+
+void WebServer::affinity(const cpu_affinity &affinity) {
+    m_affinity = affinity;
+}
+
+void WebServer::pool_size(const pool_sizing &sizing) {
+    m_sizing = sizing;
+}
+
+void WebServer::drain(int seconds) {
+    m_drain_timeout = seconds;
+}
+
+void WebServer::rate_limit(const ip_limit &limit) {
+    ip_limiter::get_instance()->init(limit, MAX_FD);
+}
+
+void WebServer::timeouts(const conn_timeouts &timeouts) {
+    http_conn::m_timeouts = timeouts;
 }
 
 void WebServer::trig_mode() {
@@ -53,14 +240,22 @@ void WebServer::trig_mode() {
         m_LISTENTrigmode = 1;
         m_CONNTrigmode = 1;
     }
+    // 单线程和协程模式下连接持久注册，只能用边沿触发
+    if (2 == m_actormodel || 3 == m_actormodel)
+        m_CONNTrigmode = 1;
 }
 
 void WebServer::log_write() {
     if (0 == m_close_log) {
+        // 多进程模式下每个工作进程写自己的日志文件，进程之间不共享文件缓冲
+        char name[32] = "./ServerLog";
+        if (prefork::get_instance()->index() >= 0)
+            snprintf(name, sizeof(name), "./ServerLog.%d", prefork::get_instance()->index());
         if (1 == m_log_write)
-            Log::get_instance()->init("./ServerLog", m_close_log, 2000, 800000, 800);
+            Log::get_instance()->init(name, m_close_log, 2000, 800000, 800);
         else
-            Log::get_instance()->init("./ServerLog", m_close_log, 2000, 800000, 0);
+            Log::get_instance()->init(name, m_close_log, 2000, 800000, 0);
+        LOG_INFO("http scanner: %s", http_scan_name());
     } 
 }
 
@@ -72,19 +267,51 @@ void WebServer::sql_pool() {
 }
 
 void WebServer::thread_pool() {
-    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num);
+    if (2 == m_actormodel)
+        return;     // 单线程模式不使用线程池
+#ifdef USE_COROUTINE
+    if (3 == m_actormodel) {
+        // 协程模式只把数据库请求交给线程池，线程池按proactor方式执行
+        m_coro = new coro_loop;
+        if (!m_coro->init(MAX_FD)) {
+            fprintf(stderr, "create eventfd failed: %s\n", strerror(errno));
+            exit(1);
+        }
+        coro_server = this;
+        m_coro_pool = new threadpool<coro_offload>(0, m_connPool, m_thread_num, 10000, &m_affinity, &m_sizing,
+                                                   &prefork::get_instance()->stats()->pool);
+        if (m_coro_pool->unpinned() > 0)
+            LOG_WARN("%d worker threads not pinned", m_coro_pool->unpinned());
+        return;
+    }
+#endif
+    m_pool = new threadpool<http_conn>(m_actormodel, m_connPool, m_thread_num, 10000, &m_affinity,
+                                       &m_sizing, &prefork::get_instance()->stats()->pool);
+    if (m_pool->unpinned() > 0)
+        LOG_WARN("%d worker threads not pinned", m_pool->unpinned());
+    if (m_pool->lanes() > 1 && cpu_affinity::node_count() > 1) {
+        m_conn_node = new signed char[MAX_FD];
+        memset(m_conn_node, -1, MAX_FD);
+    }
 }
 
-void WebServer::eventListen() {
-    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
-    assert(m_listenfd >= 0);
+int WebServer::listen_socket(int port) {
+    // 热升级启动时直接使用旧进程交来的socket，队列中的连接不会丢失；再次listen只更新backlog
+    int listenfd = prefork::get_instance()->inherited(port);
+    if (listenfd >= 0) {
+        listen(listenfd, m_sock_opts.backlog);
+        LOG_INFO("inherited listen socket %d for port %d", listenfd, port);
+        return listenfd;
+    }
+    listenfd = socket(PF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    assert(listenfd >= 0);
 
     if (0 == m_OPT_LINGER) {
         struct linger tmp = {0, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     } else if (1 == m_OPT_LINGER) {
         struct linger tmp = {1, 1};
-        setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+        setsockopt(listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
     }
 
     int ret = 0;
@@ -92,14 +319,34 @@ void WebServer::eventListen() {
     bzero(&address, sizeof(address));
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = htonl(INADDR_ANY);
-    address.sin_port = htons(m_port);
+    address.sin_port = htons(port);
 
     int flag = 1;
-    setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
-    ret = bind(m_listenfd, (struct sockaddr *)&address, sizeof(address));
+    setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    // 多进程模式下每个工作进程有自己的监听socket，由内核按四元组散列分配新连接
+    if (prefork::get_instance()->active())
+        setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &flag, sizeof(flag));
+    // 连接socket从监听socket继承这些选项
+    std::string failed;
+    if (!m_sock_opts.apply_listen(listenfd, &failed))
+        LOG_WARN("socket options not applied: %s", failed.c_str());
+    ret = bind(listenfd, (struct sockaddr *)&address, sizeof(address));
     assert(ret >= 0);
-    ret = listen(m_listenfd, 5);
+    ret = listen(listenfd, m_sock_opts.backlog);
     assert(ret >= 0);
+    return listenfd;
+}
+
+void WebServer::eventListen() {
+    // 在创建任何连接之前绑定，事件循环首次触碰的内存（epoll、连接对象）落在它所在的节点上；
+    // 线程池此时已经创建，工作线程不会继承这里的亲和性
+    if (m_affinity.loop_cpu >= 0 && !cpu_affinity::pin_self(std::vector<int>(1, m_affinity.loop_cpu)))
+        LOG_WARN("pin event loop to cpu %d failed", m_affinity.loop_cpu);
+
+    m_listenfd = listen_socket(m_port);
+    if (m_tls_port > 0)
+        m_tls_listenfd = listen_socket(m_tls_port);
+    int ret = 0;
 
     utils.init(TIMESLOT);
 
@@ -108,21 +355,29 @@ void WebServer::eventListen() {
     assert(m_epollfd != -1);
 
     utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
+    if (m_tls_listenfd >= 0)
+        utils.addfd(m_epollfd, m_tls_listenfd, false, m_LISTENTrigmode);
     http_conn::m_epollfd = m_epollfd;
 
     ret = socketpair(PF_UNIX, SOCK_STREAM, 0, m_pipefd);
     assert(ret != -1);
     utils.setnonblocking(m_pipefd[1]);
     utils.addfd(m_epollfd, m_pipefd[0], false, 0);
+    if (m_coro)
+        utils.addfd(m_epollfd, coro_eventfd(), false, 0);
 
     utils.addsig(SIGPIPE, SIG_IGN);
     utils.addsig(SIGALRM, utils.sig_handler, false);
     utils.addsig(SIGTERM, utils.sig_handler, false);
+    utils.addsig(SIGUSR2, utils.sig_handler, false);
 
-    alarm(TIMESLOT);
+    utils.arm(timer_now_ms() + TIMESLOT * 1000LL);
 
     Utils::u_pipefd = m_pipefd;
     Utils::u_epollfd = m_epollfd;
+
+    // 已经可以接入连接：由热升级启动时通知旧进程退出
+    prefork::get_instance()->upgraded();
 }
 
 void WebServer::timer(int connfd, struct sockaddr_in client_address) {
@@ -130,21 +385,21 @@ void WebServer::timer(int connfd, struct sockaddr_in client_address) {
 
     users_timer[connfd].address = client_address;
     users_timer[connfd].sockfd = connfd;
+    users_timer[connfd].conn = users + connfd;
     util_timer *timer = new util_timer;
     timer->user_data = &users_timer[connfd];
     timer->cb_func = cb_func;
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
+    timer->expire = users[connfd].deadline();
     users_timer[connfd].timer = timer;
     utils.m_timer_lst.add_timer(timer);
+    utils.arm(timer->expire);
 }
 
 void WebServer::adjust_timer(util_timer *timer) {
-    time_t cur = time(NULL);
-    timer->expire = cur + 3 * TIMESLOT;
+    // 截止时刻由连接按所处阶段（请求头、请求体、发送响应、长连接空闲）维护
+    timer->expire = timer->user_data->conn->deadline();
     utils.m_timer_lst.adjust_timer(timer);
-
-    LOG_INFO("%s", "adjust timer once");
+    utils.arm(timer->expire);
 }
 
 void WebServer::deal_timer(util_timer *timer, int sockfd) {
@@ -155,43 +410,146 @@ void WebServer::deal_timer(util_timer *timer, int sockfd) {
     LOG_INFO("close fd %d", users_timer[sockfd].sockfd);
 }
 
-bool WebServer::dealclientdata() {
-    struct sockaddr_in client_address;
-    socklen_t client_addrlength = sizeof(client_address);
-    if (0 == m_LISTENTrigmode) {
-        int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
+bool WebServer::start_tls(int connfd) {
+    if (!users[connfd].start_tls()) {
+        LOG_ERROR("%s", "create tls session failed");
+        deal_timer(users_timer[connfd].timer, connfd);
+        return false;
+    }
+    return true;
+}
+
+static long long monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+bool WebServer::dealclientdata(int listenfd) {
+    // LT和ET模式都一直accept到EAGAIN，每次最多ACCEPT_BATCH个；
+    // accept4直接得到非阻塞、close-on-exec的socket，省去两次fcntl
+    for (int i = 0; i < ACCEPT_BATCH; ++i) {
+        if (http_conn::m_user_count >= MAX_FD - ACCEPT_RESERVE) {
+            // 连接留在内核的全连接队列里，负载回落后再处理，而不是accept之后立刻关闭
+            pause_accept();
+            return false;
+        }
+        struct sockaddr_in client_address;
+        socklen_t client_addrlength = sizeof(client_address);
+        int connfd = accept4(listenfd, (struct sockaddr *)&client_address, &client_addrlength,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
         if (connfd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
             LOG_ERROR("%s:errno is:%d", "accept error", errno);
+            // fd或内存耗尽时监听socket一直可读，LT模式下会空转，同样先暂停
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                pause_accept();
             return false;
         }
-        if (http_conn::m_user_count >= MAX_FD) {
+        if (connfd >= MAX_FD) {
             utils.show_error(connfd, "Internal server busy");
             LOG_ERROR("%s", "Internal server busy");
-            return false;
+            continue;
         }
-        timer(connfd, client_address);
-    } else {
-        while (1) {
-            int connfd = accept(m_listenfd, (struct sockaddr *)&client_address, &client_addrlength);
-            if (connfd < 0) {
-                LOG_ERROR("%s:errno is:%d", "accept error", errno);
-                break;
-            }
-            if (http_conn::m_user_count >= MAX_FD) {
-                utils.show_error(connfd, "Internal server busy");
-                LOG_ERROR("%s", "Internal server busy");
-                break;
-            }
-            timer(connfd, client_address);
+        if (!admit(connfd, client_address, listenfd))
+            continue;
+        // 按CPU分流时记下连接收包所在的核，由绑在该核上的工作线程处理
+        int cpu = -1;
+        if (m_pool && m_pool->lanes() > 1) {
+            cpu = cpu_affinity::incoming_cpu(connfd);
+            place_conn(connfd, cpu);
         }
-        return false;
+        timer(connfd, client_address);
+        users[connfd].m_cpu = cpu;
+        if (listenfd == m_tls_listenfd && !start_tls(connfd))
+            continue;
+        if (3 == m_actormodel)
+            coro_open(connfd);
+    }
+
+    // 配额用完但队列里可能还有连接：ET模式不会再通知，用EPOLL_CTL_MOD让内核重新检查就绪状态
+    if (1 == m_LISTENTrigmode) {
+        epoll_event event;
+        event.data.fd = listenfd;
+        event.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
+        epoll_ctl(m_epollfd, EPOLL_CTL_MOD, listenfd, &event);
     }
     return true;
 }
 
-bool WebServer::dealwithsignal(bool &timeout, bool &stop_server) {
+bool WebServer::admit(int connfd, const sockaddr_in &addr, int listenfd) {
+    ip_limiter::result r = ip_limiter::get_instance()->admit(connfd, addr.sin_addr.s_addr);
+    if (r == ip_limiter::IP_ADMIT)
+        return true;
+    worker_stats *stats = prefork::get_instance()->stats();
+    __atomic_add_fetch(r == ip_limiter::IP_RATE ? &stats->limited_rate : &stats->limited_conns, 1,
+                       __ATOMIC_RELAXED);
+    // 预先构造好的响应，不分配连接状态也不进入事件循环；HTTPS连接还没有握手，只能RST
+    static const char TOO_MANY[] = "HTTP/1.1 429 Too Many Requests\r\n"
+                                   "Content-Length: 0\r\n"
+                                   "Retry-After: 1\r\n"
+                                   "Connection: close\r\n\r\n";
+    if (ip_limiter::get_instance()->rst() || listenfd == m_tls_listenfd) {
+        struct linger tmp = {1, 0};
+        setsockopt(connfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
+    } else {
+        // 先读走已经到达的请求：关闭时接收队列不为空，内核会发送RST而不是FIN，客户端可能读不到响应
+        char discard[1024];
+        recv(connfd, discard, sizeof(discard), MSG_DONTWAIT);
+        send(connfd, TOO_MANY, sizeof(TOO_MANY) - 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+    }
+    close(connfd);
+    return false;
+}
+
+void WebServer::place_conn(int connfd, int cpu) {
+    if (!m_conn_node || cpu < 0)
+        return;
+    int node = cpu_affinity::node_of_cpu(cpu);
+    // 同一个fd上一个连接已经放在这个节点时不必再调用mbind
+    if (node < 0 || node == m_conn_node[connfd])
+        return;
+    if (cpu_affinity::place(users + connfd, sizeof(http_conn), node))
+        m_conn_node[connfd] = (signed char)node;
+}
+
+void WebServer::pause_accept() {
+    if (m_accept_paused)
+        return;
+    if (m_ring) {
+        uring_cancel_accept();
+    } else {
+        epoll_ctl(m_epollfd, EPOLL_CTL_DEL, m_listenfd, 0);
+        if (m_tls_listenfd >= 0)
+            epoll_ctl(m_epollfd, EPOLL_CTL_DEL, m_tls_listenfd, 0);
+    }
+    m_accept_paused = true;
+    m_accept_resume_at = monotonic_ms() + ACCEPT_PAUSE_MS;
+    LOG_WARN("pause accept, %d connections", http_conn::m_user_count);
+}
+
+void WebServer::resume_accept() {
+    if (!m_accept_paused || m_draining || http_conn::m_user_count >= MAX_FD - 2 * ACCEPT_RESERVE ||
+        monotonic_ms() < m_accept_resume_at)
+        return;
+    m_accept_paused = false;
+    if (m_ring) {
+        uring_accept(m_listenfd);
+        if (m_tls_listenfd >= 0)
+            uring_accept(m_tls_listenfd);
+    } else {
+        utils.addfd(m_epollfd, m_listenfd, false, m_LISTENTrigmode);
+        if (m_tls_listenfd >= 0)
+            utils.addfd(m_epollfd, m_tls_listenfd, false, m_LISTENTrigmode);
+    }
+    LOG_INFO("resume accept, %d connections", http_conn::m_user_count);
+}
+
+bool WebServer::dealwithsignal(bool &timeout) {
     int ret = 0;
-    int sig;
     char signals[1024];
     ret = recv(m_pipefd[0], signals, sizeof(signals), 0);
     if (ret == -1) return false;
@@ -206,7 +564,12 @@ bool WebServer::dealwithsignal(bool &timeout, bool &stop_server) {
             }
             case SIGTERM:
             {
-                stop_server = true;
+                start_drain();
+                break;
+            }
+            case SIGUSR2:
+            {
+                upgrade();
                 break;
             }
             }
@@ -219,10 +582,7 @@ void WebServer::dealwithread(int sockfd) {
     util_timer *timer = users_timer[sockfd].timer;
     // reactor
     if (1 == m_actormodel) {
-        if (timer) {
-            adjust_timer(timer);
-        }
-
+        // 还没有读取，先按快速请求排队；工作线程读到请求行后按实际类别重新排队
         m_pool->append(users + sockfd, 0);
 
         while (true) {
@@ -230,17 +590,23 @@ void WebServer::dealwithread(int sockfd) {
                 if (1 == users[sockfd].timer_flag) {    // 检查是否需要处理定时器
                     deal_timer(timer, sockfd);          // 处理定时器
                     users[sockfd].timer_flag = 0;       // 清除定时器标志
+                    timer = NULL;
                 }
                 users[sockfd].improv = 0;                // 清除处理完成标志
                 break;
             }
         }
+        // 读取和解析已经完成，按连接现在所处的阶段调整定时器
+        if (timer) {
+            adjust_timer(timer);
+        }
     } else {
         //proactor
         if (users[sockfd].read_once()) {
             LOG_INFO("deal with the client(%s)", inet_ntoa(users[sockfd].get_address()->sin_addr));
 
-            m_pool->append_p(users + sockfd);
+            // 按请求行分类排队，数据库请求扎堆时不挡住静态请求
+            m_pool->append_p(users + sockfd, users[sockfd].classify());
 
             if (timer) {
                 adjust_timer(timer);
@@ -254,10 +620,6 @@ void WebServer::dealwithread(int sockfd) {
 void WebServer::dealwithwrite(int sockfd) {
     util_timer *timer = users_timer[sockfd].timer;
     if (1 == m_actormodel) {
-        if (timer) {
-            adjust_timer(timer);
-        }
-
         m_pool->append(users + sockfd, 1);
 
         while (true) {
@@ -265,29 +627,130 @@ void WebServer::dealwithwrite(int sockfd) {
                 if (1 == users[sockfd].timer_flag) {
                     deal_timer(timer, sockfd);
                     users[sockfd].timer_flag = 0;
+                    timer = NULL;
                 }
                 users[sockfd].improv = 0;
                 break;
             }
         }
+        if (timer) {
+            adjust_timer(timer);
+        }
+        // 缓冲区里还有流水线请求，连接未重新注册EPOLLIN，直接按读事件派发
+        if (users[sockfd].pending_request()) {
+            dealwithread(sockfd);
+        }
     } else {
         if (users[sockfd].write()) {
             LOG_INFO("send data to the client(%S)", inet_ntoa(users[sockfd].get_address()->sin_addr));
             if (timer) {
                 adjust_timer(timer);
             }
+            if (users[sockfd].pending_request()) {
+                m_pool->append_p(users + sockfd, users[sockfd].classify());
+            }
         } else {
             deal_timer(timer, sockfd);
         }
     }
 }
 
+void WebServer::dealwithevent(int sockfd, uint32_t events) {
+    http_conn &conn = users[sockfd];
+    // 边沿只通知一次，记下来直到真正读到EAGAIN或写出数据
+    conn.ready |= events & (EPOLLIN | EPOLLOUT);
+    if (3 == m_actormodel)
+        coro_wake(sockfd);
+    else
+        inline_drive(sockfd);
+    // 连接关闭时inline_close()已经清空了定时器
+    if (users_timer[sockfd].timer)
+        adjust_timer(users_timer[sockfd].timer);
+}
+
+void WebServer::inline_drive(int sockfd) {
+    http_conn &conn = users[sockfd];
+    while (true) {
+        if (conn.blocked) {
+            // 响应没发完时不处理后面的请求，保证响应按顺序发出
+            if (!(conn.ready & EPOLLOUT))
+                return;
+            conn.ready &= ~EPOLLOUT;
+            if (!inline_write(sockfd))
+                return;
+            continue;
+        }
+        if (conn.pending_request()) {
+            if (!inline_process(sockfd))
+                return;
+            continue;
+        }
+        if (!(conn.ready & EPOLLIN))
+            return;
+        if (!conn.read_once()) {
+            inline_close(sockfd);
+            return;
+        }
+        // 读缓冲区先满了的话socket里还有数据，不会再有新的边沿，处理完腾出空间后接着读
+        if (conn.drained())
+            conn.ready &= ~EPOLLIN;
+        if (!inline_process(sockfd))
+            return;
+    }
+}
+
+bool WebServer::inline_process(int sockfd) {
+    {
+        connectionRAII mysqlcon(&users[sockfd].mysql, m_connPool);
+        users[sockfd].process();
+    }
+    if (users[sockfd].closed()) {
+        inline_close(sockfd);
+        return false;
+    }
+    if (EPOLLOUT == users[sockfd].take_interest())
+        return inline_write(sockfd);
+    return true;
+}
+
+bool WebServer::inline_write(int sockfd) {
+    http_conn &conn = users[sockfd];
+    if (!conn.write()) {
+        inline_close(sockfd);
+        return false;
+    }
+    // 只有socket写满（或TLS握手需要写）时write()才会要求等待EPOLLOUT
+    conn.blocked = (EPOLLOUT == conn.take_interest());
+    return true;
+}
+
+void WebServer::inline_close(int sockfd) {
+    util_timer *timer = users_timer[sockfd].timer;
+    if (users[sockfd].released()) {
+        // close_conn()已经关闭了socket并减少了连接计数，只需删除定时器
+        utils.m_timer_lst.del_timer(timer);
+        LOG_INFO("close fd %d", sockfd);
+    } else {
+        deal_timer(timer, sockfd);
+    }
+    users_timer[sockfd].timer = NULL;
+}
+
 void WebServer::eventLoop() {
+    if (1 == m_io_engine && 3 == m_actormodel) {
+        LOG_WARN("%s", "coroutine mode runs on epoll, -e 1 ignored");
+    } else if (1 == m_io_engine && uring_init()) {
+        uring_loop();
+        return;
+    }
+
     bool timeout = false;
     bool stop_server = false;
 
     while (!stop_server) {
-        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, -1);
+        // 暂停监听期间定时醒来检查能否恢复
+        int number = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER,
+                                m_accept_paused || m_draining ? ACCEPT_PAUSE_MS : -1);
         if (number < 0 && errno != EINTR) {
             LOG_ERROR("%s", "epoll failure");
             break;
@@ -296,21 +759,29 @@ void WebServer::eventLoop() {
         for (int i = 0; i < number; ++i) {
             int sockfd = events[i].data.fd;
 
-            if (sockfd == m_listenfd) {
-                bool flag = dealclientdata();
+            if (sockfd == m_listenfd || sockfd == m_tls_listenfd) {
+                bool flag = dealclientdata(sockfd);
                 if (flag == false) {
                     continue;
                 }
             } else if (events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                // 协程模式下等待协程交回后再关闭的连接已经没有定时器
                 util_timer *timer = users_timer[sockfd].timer;
-                deal_timer(timer, sockfd);
+                if (timer)
+                    deal_timer(timer, sockfd);
             } else if ((sockfd == m_pipefd[0]) && (events[i].events & EPOLLIN)) {
-                bool flag = dealwithsignal(timeout, stop_server);
-                if (false == false)
-                    LOG_ERROR("%s", "dealclientdata failure");
+                bool flag = dealwithsignal(timeout);
+                if (false == flag)
+                    LOG_ERROR("%s", "dealwithsignal failure");
+            } else if (m_coro && sockfd == coro_eventfd()) {
+                coro_done();
+            } else if (2 == m_actormodel || 3 == m_actormodel) {
+                dealwithevent(sockfd, events[i].events);
             } else if (events[i].events & EPOLLIN) {
+                users[sockfd].fired();
                 dealwithread(sockfd);
             } else if (events[i].events & EPOLLOUT) {
+                users[sockfd].fired();
                 dealwithwrite(sockfd);
             }
         }
@@ -319,5 +790,624 @@ void WebServer::eventLoop() {
             LOG_INFO("%s", "timer tick");
             timeout = false;
         }
+        resume_accept();
+        if (m_draining && drain_done())
+            stop_server = true;
+    }
+}
+
+void WebServer::start_drain() {
+    if (m_draining)
+        return;
+    pause_accept();
+    m_draining = true;
+    http_conn::m_draining = true;
+    m_drain_deadline = monotonic_ms() + m_drain_timeout * 1000LL;
+    // 关闭监听socket：新连接立即被拒绝，而不是在队列里等到进程退出时被重置；
+    // 热升级时新进程持有同一个socket，队列中的连接由它接入
+    close(m_listenfd);
+    if (m_tls_listenfd >= 0)
+        close(m_tls_listenfd);
+    LOG_INFO("draining %d connections, timeout %ds", http_conn::m_user_count, m_drain_timeout);
+    close_idle();
+}
+
+void WebServer::close_idle() {
+    long long now = monotonic_ms();
+    if (now < m_idle_check_at)
+        return;
+    m_idle_check_at = now + ACCEPT_PAUSE_MS;
+    for (util_timer *t = utils.m_timer_lst.front(); t; t = t->next) {
+        int fd = t->user_data->sockfd;
+        int unread = 0;
+        // 只关闭读方向：事件循环随即收到EPOLLRDHUP（io_uring收到0字节），按正常路径关闭连接
+        if (users[fd].idle() && ioctl(fd, FIONREAD, &unread) == 0 && unread == 0)
+            shutdown(fd, SHUT_RD);
+    }
+}
+
+bool WebServer::drain_done() {
+    close_idle();
+    if (http_conn::m_user_count <= 0)
+        return true;
+    if (monotonic_ms() < m_drain_deadline)
+        return false;
+    LOG_WARN("drain timeout, closing %d connections", http_conn::m_user_count);
+    return true;
+}
+
+void WebServer::upgrade() {
+    if (m_draining)
+        return;
+    if (prefork::get_instance()->index() >= 0) {
+        LOG_WARN("%s", "SIGUSR2 ignored: send it to the master process");
+        return;
     }
-}
\ No newline at end of file
+    // 回收之前启动失败的新进程
+    while (waitpid(-1, NULL, WNOHANG) > 0) {}
+    std::vector<int> fds(1, m_listenfd);
+    if (m_tls_listenfd >= 0)
+        fds.push_back(m_tls_listenfd);
+    pid_t pid = prefork::get_instance()->reexec(fds);
+    if (pid < 0) {
+        LOG_ERROR("upgrade failed: %s", strerror(errno));
+    } else {
+        LOG_INFO("upgrade: started pid %d", pid);
+    }
+}
+#ifdef USE_IO_URING
+
+bool WebServer::uring_init() {
+    io_ring *ring = new io_ring;
+    if (!ring->init(URING_ENTRIES) || !ring->setup_buffers(URING_BUF_GROUP, URING_BUF_COUNT, URING_BUF_SIZE)) {
+        LOG_WARN("io_uring unavailable: %s, using epoll", strerror(errno));
+        fprintf(stderr, "io_uring unavailable: %s, using epoll\n", strerror(errno));
+        delete ring;
+        return false;
+    }
+    // 固定文件表直接用fd作下标，大小受RLIMIT_NOFILE限制；注册失败时照常使用普通fd
+    unsigned files = MAX_FD;
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < files)
+        files = rl.rlim_cur;
+    m_fixed_files = ring->register_files(files) ? files : 0;
+
+    m_ring = ring;
+    m_uconns = new uring_conn[MAX_FD];
+    uring_server = this;
+    http_conn::m_uring = true;
+    LOG_INFO("io engine: io_uring, fixed files %u", m_fixed_files);
+    return true;
+}
+
+void WebServer::uring_loop() {
+    bool timeout = false;
+    bool stop_server = false;
+    bool pause_timer = false;   // 暂停监听期间的定时唤醒是否已提交
+    struct __kernel_timespec pause_ts;
+    pause_ts.tv_sec = 0;
+    pause_ts.tv_nsec = ACCEPT_PAUSE_MS * 1000000LL;
+
+    uring_accept(m_listenfd);
+    if (m_tls_listenfd >= 0)
+        uring_accept(m_tls_listenfd);
+    // 信号经由管道通知，用multishot poll等待
+    struct io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = m_pipefd[0];
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = uring_ud(UD_SIGNAL, 0, m_pipefd[0]);
+
+    while (!stop_server) {
+        if ((m_accept_paused || m_draining) && !pause_timer) {
+            sqe = m_ring->get_sqe();
+            sqe->opcode = IORING_OP_TIMEOUT;
+            sqe->addr = (unsigned long)&pause_ts;
+            sqe->len = 1;
+            sqe->user_data = uring_ud(UD_TIMEOUT, 0, 0);
+            pause_timer = true;
+        }
+        // 一次系统调用既提交上一轮产生的全部请求，也收取新的完成事件
+        if (m_ring->submit_and_wait(1) < 0 && errno != EINTR) {
+            LOG_ERROR("%s", "io_uring_enter failure");
+            break;
+        }
+
+        struct io_uring_cqe *cqe;
+        while ((cqe = m_ring->peek_cqe()) != NULL) {
+            unsigned long long data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            m_ring->cqe_seen();
+
+            int op = (int)(data >> 56);
+            unsigned gen = (unsigned)(data >> 32) & 0xffffff;
+            int fd = (int)(unsigned)data;
+            switch (op) {
+            case UD_ACCEPT:
+                uring_on_accept(fd, gen, res, flags);
+                break;
+            case UD_RECV:
+                uring_on_recv(fd, gen, res, flags);
+                break;
+            case UD_SEND:
+                uring_on_send(fd, gen, res);
+                break;
+            case UD_POLL:
+                uring_on_poll(fd, gen, res);
+                break;
+            case UD_SIGNAL:
+                dealwithsignal(timeout);
+                if (!(flags & IORING_CQE_F_MORE)) {
+                    sqe = m_ring->get_sqe();
+                    sqe->opcode = IORING_OP_POLL_ADD;
+                    sqe->fd = m_pipefd[0];
+                    sqe->poll32_events = POLLIN;
+                    sqe->len = IORING_POLL_ADD_MULTI;
+                    sqe->user_data = data;
+                }
+                break;
+            case UD_TIMEOUT:
+                pause_timer = false;
+                break;
+            default:
+                break;
+            }
+        }
+
+        if (timeout) {
+            utils.timer_handler();
+            LOG_INFO("%s", "timer tick");
+            timeout = false;
+        }
+        resume_accept();
+        if (m_draining && drain_done())
+            stop_server = true;
+    }
+}
+
+void WebServer::uring_accept(int listenfd) {
+    struct io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listenfd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = uring_ud(UD_ACCEPT, m_accept_gen, listenfd);
+}
+
+void WebServer::uring_cancel_accept() {
+    uring_cancel(uring_ud(UD_ACCEPT, m_accept_gen, m_listenfd));
+    if (m_tls_listenfd >= 0)
+        uring_cancel(uring_ud(UD_ACCEPT, m_accept_gen, m_tls_listenfd));
+    // 被撤销的请求结束时不再重新提交
+    m_accept_gen = (m_accept_gen + 1) & 0xffffff;
+}
+
+void WebServer::uring_on_accept(int listenfd, unsigned gen, int res, unsigned flags) {
+    if (res >= 0) {
+        int connfd = res;
+        if (connfd >= MAX_FD) {
+            utils.show_error(connfd, "Internal server busy");
+            LOG_ERROR("%s", "Internal server busy");
+        } else {
+            // multishot accept不返回对端地址，每个连接查询一次
+            struct sockaddr_in client_address;
+            socklen_t client_addrlength = sizeof(client_address);
+            memset(&client_address, 0, sizeof(client_address));
+            getpeername(connfd, (struct sockaddr *)&client_address, &client_addrlength);
+            if (admit(connfd, client_address, listenfd)) {
+                timer(connfd, client_address);
+                users_timer[connfd].timer->cb_func = uring_cb_func;
+                if (listenfd != m_tls_listenfd || start_tls(connfd))
+                    uring_open(connfd);
+            }
+        }
+        if (http_conn::m_user_count >= MAX_FD - ACCEPT_RESERVE)
+            pause_accept();
+    } else if (res != -ECANCELED) {
+        LOG_ERROR("%s:errno is:%d", "accept error", -res);
+        if (res == -EMFILE || res == -ENFILE || res == -ENOBUFS || res == -ENOMEM)
+            pause_accept();
+        if (res == -EINVAL)
+            return;     // 内核不支持multishot accept
+    }
+    // multishot accept因出错结束时重新提交；暂停监听时由resume_accept()提交
+    if (!(flags & IORING_CQE_F_MORE) && gen == m_accept_gen && !m_accept_paused)
+        uring_accept(listenfd);
+}
+
+void WebServer::uring_open(int connfd) {
+    uring_conn &uc = m_uconns[connfd];
+    uc.gen = (uc.gen + 1) & 0xffffff;
+    uc.open = true;
+    uc.recv_armed = false;
+    uc.sending = false;
+    uc.poll_armed = false;
+    uc.eof = false;
+    uc.nobufs = false;
+    uc.fixed = (unsigned)connfd < m_fixed_files;
+    if (uc.fixed) {
+        // 把fd填入固定文件表的同一下标，之后的请求不再逐次查找、引用fd；
+        // 明文连接与随后提交的首个recv链接，保证先于它执行
+        uc.file = connfd;
+        struct io_uring_sqe *sqe = m_ring->get_sqe();
+        sqe->opcode = IORING_OP_FILES_UPDATE;
+        sqe->fd = -1;
+        sqe->addr = (unsigned long)&uc.file;
+        sqe->len = 1;
+        sqe->off = connfd;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        if (!users[connfd].is_tls())
+            sqe->flags |= IOSQE_IO_LINK;
+        sqe->user_data = uring_ud(UD_IGNORE, uc.gen, connfd);
+    }
+    uring_drive(connfd);
+}
+
+void WebServer::uring_recv(int fd) {
+    uring_conn &uc = m_uconns[fd];
+    struct io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_RECV;
+    uring_set_fd(sqe, fd, uc.fixed);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = uring_ud(UD_RECV, uc.gen, fd);
+    uc.recv_armed = true;
+}
+
+void WebServer::uring_poll(int fd, int events) {
+    uring_conn &uc = m_uconns[fd];
+    struct io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    uring_set_fd(sqe, fd, uc.fixed);
+    sqe->poll32_events = events;
+    sqe->user_data = uring_ud(UD_POLL, uc.gen, fd);
+    uc.poll_armed = true;
+    uc.poll_events = events;
+}
+
+void WebServer::uring_cancel(unsigned long long user_data) {
+    struct io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = uring_ud(UD_IGNORE, 0, 0);
+}
+
+void WebServer::uring_on_recv(int fd, unsigned gen, int res, unsigned flags) {
+    uring_conn &uc = m_uconns[fd];
+    if (!uc.open || gen != uc.gen) {
+        // 连接已关闭，归还缓冲区即可
+        if (flags & IORING_CQE_F_BUFFER)
+            m_ring->recycle_buffer(flags >> IORING_CQE_BUFFER_SHIFT);
+        return;
+    }
+    if (!(flags & IORING_CQE_F_MORE))
+        uc.recv_armed = false;
+    if (res > 0) {
+        uring_chunk chunk = {(uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT), 0, (uint32_t)res};
+        uc.input.push_back(chunk);
+    } else if (0 == res) {
+        uc.eof = true;
+    } else if (-ENOBUFS == res) {
+        // 缓冲区用完时multishot recv结束，已收到的数据处理完后改为等待可读、直接读入
+        uc.nobufs = true;
+    } else {
+        uring_close(fd);
+        return;
+    }
+    uring_drive(fd);
+    if (users_timer[fd].timer)
+        adjust_timer(users_timer[fd].timer);
+}
+
+void WebServer::uring_on_send(int fd, unsigned gen, int res) {
+    uring_conn &uc = m_uconns[fd];
+    if (!uc.open || gen != uc.gen)
+        return;
+    uc.sending = false;
+    if (res < 0) {
+        uring_close(fd);
+        return;
+    }
+    users[fd].sent(res);
+    if (uring_send(fd))
+        uring_drive(fd);
+    if (users_timer[fd].timer)
+        adjust_timer(users_timer[fd].timer);
+}
+
+void WebServer::uring_on_poll(int fd, unsigned gen, int res) {
+    uring_conn &uc = m_uconns[fd];
+    if (!uc.open || gen != uc.gen)
+        return;
+    uc.poll_armed = false;
+    if (res < 0) {
+        uring_close(fd);
+        return;
+    }
+    if (uc.poll_events & POLLOUT) {
+        if (uring_write(fd))
+            uring_drive(fd);
+    } else if (!users[fd].read_once()) {
+        uring_close(fd);
+    } else if (uring_process(fd)) {
+        uring_drive(fd);
+    }
+    // 连接关闭时uring_close()已经清空了定时器
+    if (users_timer[fd].timer)
+        adjust_timer(users_timer[fd].timer);
+}
+
+void WebServer::uring_drive(int fd) {
+    uring_conn &uc = m_uconns[fd];
+    http_conn &conn = users[fd];
+    // 发送响应或等待可写期间不处理后面的请求，保证响应按顺序发出
+    while (uc.open && !uc.sending && !uc.poll_armed) {
+        if (conn.pending_request()) {
+            if (!uring_process(fd))
+                return;
+            continue;
+        }
+        if (conn.is_tls()) {
+            // HTTPS连接的数据由OpenSSL自己从socket读取，只等待可读
+            uring_poll(fd, POLLIN);
+            return;
+        }
+        if (uc.input.empty()) {
+            if (uc.eof) {
+                uring_close(fd);
+            } else if (uc.nobufs) {
+                // 缓冲区被其他连接占满，立即重新提交recv只会再次得到ENOBUFS
+                uc.nobufs = false;
+                uring_poll(fd, POLLIN);
+            } else if (!uc.recv_armed) {
+                uring_recv(fd);
+            }
+            return;
+        }
+        uring_chunk &chunk = uc.input.front();
+        long n = conn.feed(m_ring->buffer(chunk.bid) + chunk.off, chunk.len);
+        if (n < 0) {
+            // 请求放不进读缓冲区，与read_once()的处理一致
+            uring_close(fd);
+            return;
+        }
+        chunk.off += n;
+        chunk.len -= n;
+        if (0 == chunk.len) {
+            m_ring->recycle_buffer(chunk.bid);
+            uc.input.pop_front();
+        }
+        if (!uring_process(fd))
+            return;
+    }
+}
+
+bool WebServer::uring_process(int fd) {
+    {
+        connectionRAII mysqlcon(&users[fd].mysql, m_connPool);
+        users[fd].process();
+    }
+    if (users[fd].closed()) {
+        uring_close(fd);
+        return false;
+    }
+    if (EPOLLOUT == users[fd].take_interest())
+        return uring_write(fd);
+    return true;
+}
+
+bool WebServer::uring_write(int fd) {
+    http_conn &conn = users[fd];
+    if (!conn.is_tls() && !conn.is_h2())
+        return uring_send(fd);
+    // HTTPS需要OpenSSL加密，HTTP/2由会话组帧，都沿用同步的write()，socket写满时等待可写
+    if (!conn.write()) {
+        uring_close(fd);
+        return false;
+    }
+    if (EPOLLOUT == conn.take_interest())
+        uring_poll(fd, POLLOUT);
+    return true;
+}
+
+bool WebServer::uring_send(int fd) {
+    uring_conn &uc = m_uconns[fd];
+    struct iovec *iov;
+    int count;
+    http_conn::SEND_RESULT r = users[fd].next_send(&iov, &count);
+    if (http_conn::SEND_DONE == r)
+        return true;
+    if (http_conn::SEND_CLOSE == r) {
+        uring_close(fd);
+        return false;
+    }
+    // iovec指向连接的写缓冲区和文件映射区，完成前保持不变
+    uc.msg.msg_iov = iov;
+    uc.msg.msg_iovlen = count;
+    struct io_uring_sqe *sqe = m_ring->get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    uring_set_fd(sqe, fd, uc.fixed);
+    sqe->addr = (unsigned long)&uc.msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = uring_ud(UD_SEND, uc.gen, fd);
+    uc.sending = true;
+    return true;
+}
+
+void WebServer::uring_close(int fd) {
+    if (!m_uconns[fd].open)
+        return;
+    util_timer *timer = users_timer[fd].timer;
+    if (users[fd].released()) {
+        // close_conn()已经关闭了socket并减少了连接计数，只需撤销请求和定时器
+        uring_release(fd);
+        utils.m_timer_lst.del_timer(timer);
+    } else {
+        deal_timer(timer, fd);
+    }
+    users_timer[fd].timer = NULL;
+}
+
+void WebServer::uring_release(int fd) {
+    uring_conn &uc = m_uconns[fd];
+    if (!uc.open)
+        return;
+    uc.open = false;
+    if (uc.recv_armed)
+        uring_cancel(uring_ud(UD_RECV, uc.gen, fd));
+    if (uc.sending)
+        uring_cancel(uring_ud(UD_SEND, uc.gen, fd));
+    if (uc.poll_armed)
+        uring_cancel(uring_ud(UD_POLL, uc.gen, fd));
+    uc.recv_armed = false;
+    uc.sending = false;
+    uc.poll_armed = false;
+    if (uc.fixed) {
+        // 固定文件表也持有socket的引用，不移除的话close()后连接不会真正关闭
+        struct io_uring_sqe *sqe = m_ring->get_sqe();
+        sqe->opcode = IORING_OP_FILES_UPDATE;
+        sqe->fd = -1;
+        sqe->addr = (unsigned long)&uring_no_file;
+        sqe->len = 1;
+        sqe->off = fd;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = uring_ud(UD_IGNORE, uc.gen, fd);
+    }
+    for (size_t i = 0; i < uc.input.size(); ++i)
+        m_ring->recycle_buffer(uc.input[i].bid);
+    uc.input.clear();
+}
+
+#else
+
+// 未启用io_uring编译时的空实现，uring_init()总是失败，使用epoll
+
+bool WebServer::uring_init() {
+    LOG_WARN("%s", "built without io_uring support, rebuild with `make URING=1`; using epoll");
+    fprintf(stderr, "built without io_uring support, rebuild with `make URING=1`; using epoll\n");
+    return false;
+}
+
+void WebServer::uring_loop() {}
+
+void WebServer::uring_accept(int) {}
+
+void WebServer::uring_cancel_accept() {}
+
+void WebServer::uring_release(int) {}
+
+#endif
+
+#ifdef USE_COROUTINE
+
+int WebServer::coro_eventfd() {
+    return m_coro->eventfd();
+}
+
+conn_task WebServer::coro_serve(int sockfd) {
+    http_conn &conn = users[sockfd];
+    coro_conn &state = m_coro->conn(sockfd);
+    while (true) {
+        // 读取：缓冲区里没有流水线请求时等到socket可读
+        if (!conn.pending_request()) {
+            co_await io_wait{&state, &conn.ready, EPOLLIN};
+            if (!conn.read_once())
+                break;
+            // 读缓冲区先满了的话socket里还有数据，不会再有新的边沿，处理完腾出空间后接着读
+            if (conn.drained())
+                conn.ready &= ~EPOLLIN;
+        }
+
+        // 处理：数据库请求交给线程池，挂起期间事件循环继续处理其他连接；其余请求直接处理
+        int cls = conn.classify();
+        if (TASK_DB == cls) {
+            co_await coro_offload(m_coro, m_coro_pool, m_connPool, &conn, sockfd, cls);
+        } else {
+            connectionRAII mysqlcon(&conn.mysql, m_connPool);
+            conn.process();
+        }
+        if (conn.closed())
+            break;
+
+        // 发送：socket写满时等到可写，响应发完才处理下一个请求，保证响应按顺序发出
+        if (EPOLLOUT == conn.take_interest()) {
+            bool ok = conn.write();
+            while (ok && EPOLLOUT == conn.take_interest()) {
+                co_await io_wait{&state, &conn.ready, EPOLLOUT};
+                conn.ready &= ~EPOLLOUT;
+                ok = conn.write();
+            }
+            if (!ok)
+                break;
+        }
+    }
+    // 协程即将结束，帧随之释放：先从连接上摘下，关闭时不再销毁它
+    state.handle = nullptr;
+    inline_close(sockfd);
+}
+
+void WebServer::coro_open(int connfd) {
+    users_timer[connfd].timer->cb_func = coro_cb_func;
+    coro_serve(connfd);
+}
+
+void WebServer::coro_wake(int sockfd) {
+    coro_conn &state = m_coro->conn(sockfd);
+    if (state.handle && !state.offloaded && (users[sockfd].ready & state.waiting))
+        state.handle.resume();
+}
+
+void WebServer::coro_done() {
+    std::vector<coro_loop::done> list;
+    m_coro->take(&list);
+    for (size_t i = 0; i < list.size(); ++i) {
+        coro_loop::done &d = list[i];
+        coro_conn &state = m_coro->conn(d.fd);
+        // 不属于当前连接的协程直接销毁；连接的关闭都推迟到协程交回之后，正常情况下不会发生
+        if (!state.offloaded || state.handle != d.handle || state.gen != d.gen) {
+            d.handle.destroy();
+            continue;
+        }
+        state.offloaded = false;
+        if (state.closing) {
+            // 处理期间定时器已经到期并删除：工作线程已经放开连接，协程不再恢复，现在关闭socket
+            m_coro->release(d.fd);
+            cb_func(&users_timer[d.fd]);
+            LOG_INFO("close fd %d", d.fd);
+            continue;
+        }
+        d.handle.resume();
+        if (users_timer[d.fd].timer)
+            adjust_timer(users_timer[d.fd].timer);
+    }
+}
+
+bool WebServer::coro_release(int sockfd) {
+    return m_coro->release(sockfd);
+}
+
+#else
+
+// 未启用协程编译时的空实现，-a 3在init()中已经退回单线程模式
+
+int WebServer::coro_eventfd() {
+    return -1;
+}
+
+void WebServer::coro_open(int) {}
+
+void WebServer::coro_wake(int) {}
+
+void WebServer::coro_done() {}
+
+bool WebServer::coro_release(int) {
+    return true;
+}
+
+#endif
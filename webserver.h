@@ -11,8 +11,22 @@
 #include <stdlib.h>
 #include <cassert>
 #include <sys/epoll.h>
+#include <time.h>
 #include "./threadpool/threadpool.h"
 #include "./http/http_conn.h"
+#include "./http/http_scan.h"
+#include "./http/http_router.h"
+#include "./net/socket_opts.h"
+#include "./net/ip_limiter.h"
+#include "./threadpool/cpu_affinity.h"
+#include "./threadpool/pool_sizing.h"
+#include "./prefork/prefork.h"
+
+class io_ring;
+struct uring_conn;
+class coro_loop;
+struct coro_offload;
+struct conn_task;
 
 // 最大文件描述符数量
 const int MAX_FD = 65536;
@@ -20,6 +34,12 @@ const int MAX_FD = 65536;
 const int MAX_EVENT_NUMBER = 10000;
 // 定时器时间槽
 const int TIMESLOT = 5;
+// 每次监听事件最多accept的连接数，连接风暴时事件循环不会被accept独占
+const int ACCEPT_BATCH = 64;
+// 连接数达到MAX_FD - ACCEPT_RESERVE时暂停监听，降到MAX_FD - 2 * ACCEPT_RESERVE以下再恢复
+const int ACCEPT_RESERVE = 256;
+// 暂停监听后至少等待的毫秒数，fd耗尽（EMFILE）时也靠它退避
+const int ACCEPT_PAUSE_MS = 100;
 
 /**
  * @brief WebServer类 - 整个服务器的核心类
@@ -43,18 +63,71 @@ public:
      * @param sql_num 数据库连接池数量
      * @param thread_num 线程池中的线程数量
      * @param close_log 是否关闭日志
-     * @param actor_model reactor/proactor模式选择
+     * @param actor_model 并发模型选择（0:proactor，1:reactor，2:单线程）
+     * @param max_body 请求体大小上限（字节）
      */
     void init(int port, string user, string passWord, string dataBaseName,
               int log_write, int opt_linger, int trigmode, int sql_num,
-              int thread_num, int close_log, int actor_model);
+              int thread_num, int close_log, int actor_model, long long max_body);
     
+    /**
+     * @brief 配置HTTPS监听，需在eventListen()之前调用
+     * @param port HTTPS端口，0表示不开启
+     * @param cert 证书链文件
+     * @param key 私钥文件
+     * @param ticket_key 会话票据密钥文件，为空时每个进程随机生成
+     */
+    void tls(int port, string cert, string key, string ticket_key);
+
+    /**
+     * @brief 选择I/O引擎，需在eventLoop()之前调用
+     * @param engine 0:epoll，1:io_uring（编译或内核不支持时退回epoll）
+     */
+    void io_engine(int engine);
+
+    /**
+     * @brief 设置socket调优参数，需在eventListen()之前调用
+     * @param opts 调优参数
+     */
+    void socket_tuning(const socket_opts &opts);
+
+    /**
+     * @brief 设置线程绑核方式，需在thread_pool()之前调用
+     * @param affinity 事件循环和工作线程使用的CPU
+     */
+    void affinity(const cpu_affinity &affinity);
+
+    /**
+     * @brief 设置线程池的伸缩范围，需在thread_pool()之前调用
+     * @param sizing 线程数上下限、排队时间目标、空闲退出时间，以及各类任务的权重和保留线程数
+     */
+    void pool_size(const pool_sizing &sizing);
+
+    /**
+     * @brief 设置优雅退出的最长等待时间
+     * @param seconds 收到SIGTERM后等待进行中请求完成的秒数，超时后直接退出
+     */
+    void drain(int seconds);
+
+    /**
+     * @brief 设置按客户端IP的接入限制，需在eventListen()之前调用
+     * @param limit 并发连接数和新建连接速率的上限
+     */
+    void rate_limit(const ip_limit &limit);
+
+    /**
+     * @brief 设置连接各阶段的时限（请求头、请求体、发送响应、长连接空闲）
+     * @param timeouts 时限参数
+     */
+    void timeouts(const conn_timeouts &timeouts);
+
     // 各个模块的初始化函数
     void thread_pool();    // 初始化线程池
     void sql_pool();       // 初始化数据库连接池
     void log_write();      // 初始化日志系统
     void trig_mode();      // 设置触发模式
     void eventListen();    // 开始监听
+    int listen_socket(int port);  // 创建并绑定监听socket
     void eventLoop();      // 事件循环处理
     
     // 定时器相关函数
@@ -63,17 +136,63 @@ public:
     void deal_timer(util_timer *timer, int sockfd);            // 处理定时器事件
     
     // 客户端连接处理函数
-    bool dealclientdata();  // 处理客户端连接
-    bool dealwithsignal(bool& timeout, bool& stop_server);  // 处理信号
+    bool dealclientdata(int listenfd);  // 处理客户端连接
+    void pause_accept();                // 过载时把监听socket移出epoll
+    void resume_accept();               // 负载回落后重新监听
+    bool start_tls(int connfd);         // 新连接切换为HTTPS，失败时关闭并返回false
+    void place_conn(int connfd, int cpu);  // 把连接对象的内存放到处理它的CPU所在的NUMA节点
+    bool dealwithsignal(bool& timeout);  // 处理信号
+
+    // 优雅退出与热升级
+    void start_drain();                 // 收到SIGTERM：停止接入新连接，关闭空闲长连接，等进行中的请求完成
+    void close_idle();                  // 关闭空闲的长连接，由事件循环按正常路径收尾
+    bool drain_done();                  // 连接已全部关闭或超过等待时间
+    void upgrade();                     // 收到SIGUSR2：启动新的可执行文件并把监听socket交给它
+    bool admit(int connfd, const sockaddr_in &addr, int listenfd);  // 按客户端IP检查接入限制，超限时回复429或RST并关闭
+
+    // io_uring引擎
+    bool uring_init();                  // 创建ring，失败时返回false
+    void uring_loop();                  // io_uring事件循环
+    void uring_accept(int listenfd);    // 提交multishot accept
+    void uring_cancel_accept();         // 撤销multishot accept（暂停监听）
+    void uring_on_accept(int listenfd, unsigned gen, int res, unsigned flags);  // accept完成
+    void uring_on_recv(int fd, unsigned gen, int res, unsigned flags);  // recv完成
+    void uring_on_send(int fd, unsigned gen, int res);  // sendmsg完成
+    void uring_on_poll(int fd, unsigned gen, int res);  // POLL_ADD完成
+    void uring_open(int connfd);        // 新连接：填入固定文件表并开始接收
+    void uring_recv(int fd);            // 提交multishot recv
+    void uring_poll(int fd, int events);  // 提交一次性POLL_ADD（HTTPS连接、同步发送写满时）
+    void uring_cancel(unsigned long long user_data);  // 撤销一个进行中的请求
+    void uring_drive(int fd);           // 把已收到的数据交给http_conn，直到需要等待
+    bool uring_process(int fd);         // 调用process()并按登记的兴趣继续，连接关闭时返回false
+    bool uring_write(int fd);           // 开始发送响应
+    bool uring_send(int fd);            // 提交下一批sendmsg
+    void uring_close(int fd);           // 关闭连接
+    void uring_release(int fd);         // 撤销连接在ring中的请求，由定时器回调在关闭前调用
     void dealwithread(int sockfd);   // 处理读事件
     void dealwithwrite(int sockfd);  // 处理写事件
 
+    // 单线程模式：连接持久注册为边沿触发，主线程完成读取、处理和发送
+    void dealwithevent(int sockfd, uint32_t events);  // 处理连接上的事件
+    void inline_drive(int sockfd);      // 读取、处理、发送，直到需要等待下一个事件
+    bool inline_process(int sockfd);    // 调用process()并发送响应，连接关闭时返回false
+    bool inline_write(int sockfd);      // 发送响应，socket写满时标记blocked，连接关闭时返回false
+    void inline_close(int sockfd);      // 关闭连接
+
+    // 协程模式：每个连接一个协程，按读取、处理、发送的顺序写成一个循环，等待时挂起
+    conn_task coro_serve(int sockfd);   // 连接的处理协程
+    void coro_open(int connfd);         // 新连接：启动协程
+    void coro_wake(int sockfd);         // 连接上有事件：恢复等待该事件的协程
+    void coro_done();                   // 恢复线程池处理完交回的协程
+    bool coro_release(int sockfd);      // 销毁连接的协程，由定时器回调在关闭前调用；协程在线程池中时返回false，推迟关闭
+    int coro_eventfd();                 // 线程池交回协程时可读的eventfd
+
 public:
     int m_port;           // 服务器端口
     char *m_root;         // 网站根目录
     int m_log_write;      // 日志写入方式
     int m_close_log;      // 是否关闭日志
-    int m_actormodel;     // 模型选择（reactor/proactor）
+    int m_actormodel;     // 模型选择（0:proactor，1:reactor，2:单线程，3:协程）
 
     int m_pipefd[2];      // 管道文件描述符
     int m_epollfd;        // epoll文件描述符
@@ -89,10 +208,30 @@ public:
     // 线程池相关
     threadpool<http_conn> *m_pool;  // 线程池
     int m_thread_num;               // 线程数量
+    threadpool<coro_offload> *m_coro_pool;  // 协程模式下处理数据库请求的线程池
+    coro_loop *m_coro;              // 协程模式的调度器，其他模式为NULL
 
     epoll_event events[MAX_EVENT_NUMBER];  // epoll事件数组
 
+    socket_opts m_sock_opts;  // socket调优参数
+    cpu_affinity m_affinity;  // 线程绑核方式
+    pool_sizing m_sizing;     // 线程池的伸缩和调度参数
+    signed char *m_conn_node; // 每个连接对象的内存当前所在的NUMA节点，-1表示未放置；单节点机器上为NULL
     int m_listenfd;         // 监听的文件描述符
+    int m_tls_port;         // HTTPS端口，0表示不开启
+    int m_tls_listenfd;     // HTTPS监听的文件描述符，-1表示未开启
+    bool m_accept_paused;   // 监听socket是否已移出epoll
+    long long m_accept_resume_at;  // 最早恢复监听的时刻（毫秒，CLOCK_MONOTONIC）
+    int m_drain_timeout;    // 优雅退出的最长等待时间（秒）
+    bool m_draining;        // 是否正在优雅退出，此时监听socket已关闭
+    long long m_drain_deadline;  // 优雅退出的截止时刻（毫秒，CLOCK_MONOTONIC）
+    long long m_idle_check_at;   // 下一次检查空闲长连接的时刻（毫秒，CLOCK_MONOTONIC）
+
+    int m_io_engine;        // I/O引擎，0:epoll，1:io_uring
+    io_ring *m_ring;        // io_uring，NULL表示使用epoll
+    uring_conn *m_uconns;   // io_uring模式下每个连接的状态，按fd索引
+    unsigned m_fixed_files; // 固定文件表大小，0表示未注册
+    unsigned m_accept_gen;  // accept请求的代数，暂停后旧请求的完成事件据此丢弃
     int m_OPT_LINGER;       // 是否优雅关闭连接
     int m_TRIGMode;         // 触发组合模式
     int m_LISTENTrigmode;   // 监听的触发模式